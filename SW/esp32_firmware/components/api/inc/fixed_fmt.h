@@ -0,0 +1,50 @@
+#ifndef __FIXED_FMT_H__
+#define __FIXED_FMT_H__
+
+#include <stdint.h>
+
+/*
+ * Fixed point to text without printf. fmt_fixed<W, F>(dst, v) writes
+ * v / 10^F the way "%-W.Ff" would print it: left aligned and padded with
+ * spaces to exactly W chars (clipped if longer). No terminator is added,
+ * the return value points past the last char written.
+ */
+template <unsigned W, unsigned F> char *fmt_fixed(char *dst, int32_t value)
+{
+	static_assert(W > F, "field too narrow");
+
+	char tmp[12];
+	unsigned n = 0;
+	uint32_t v = value < 0 ? -(uint32_t)value : value;
+
+	/* digits in reverse, at least one integer digit */
+	for (unsigned i = 0; i < F; i++) {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	}
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	unsigned i = 0;
+
+	if (value < 0)
+		dst[i++] = '-';
+
+	while (n && i < W) {
+		if (n == F) {
+			dst[i++] = '.';
+			if (i == W)
+				break;
+		}
+		dst[i++] = tmp[--n];
+	}
+
+	while (i < W)
+		dst[i++] = ' ';
+
+	return dst + W;
+}
+
+#endif /* __FIXED_FMT_H__ */
@@ -4,7 +4,16 @@
 #include <free_rtos_h.h>
 #include <esp32_i2c.h>
 #include <stdint.h>
+#include <stdarg.h>
 #include <string>
+#include <atomic>
+#include "spsc_ring.h"
+#include "fixed_fmt.h"
+
+#define LCD_MAX_MESSAGE_SIZE		36
+#define LCD_RING_SIZE			8
+#define LCD_ROWS			2
+#define LCD_COLS			16
 
 enum row_e {
 	FIRST_ROW,
@@ -17,6 +26,28 @@ enum align {
 	RIGHT,
 };
 
+struct lcd_msg {
+	uint8_t cmd;
+	uint8_t row, col;
+	char text[LCD_MAX_MESSAGE_SIZE];
+};
+
+struct lcd_stats {
+	uint32_t frames;	/* flushes that sent anything */
+	uint32_t bytes;		/* command + data bytes sent in total */
+	uint32_t last_frame;	/* bytes sent by the last flush */
+};
+
+/*
+ * Messages are formatted straight into a preallocated ring and drawn by the
+ * lcd task, nothing touches the heap. All print/clear calls are expected to
+ * come from one task. print() waits for a free slot, try_print() drops the
+ * message instead and returns false.
+ *
+ * The lcd task applies the messages to a shadow frame buffer and once per
+ * frame sends only the cells that differ from what is on the glass, so a
+ * clear() followed by a reprint of the same text costs nothing.
+ */
 class lcd {
 public:
 	lcd();
@@ -36,13 +67,82 @@ public:
 		print(row, col, format.c_str());
 	}
 
+	bool try_print(enum row_e row, enum align a, const char *format, ...);
+	bool try_print(enum row_e row, uint8_t col, const char *format, ...);
+
+	/*
+	 * @label followed by @value / 10^F left aligned in W chars, rendered
+	 * directly into the message slot without printf.
+	 */
+	template <unsigned W, unsigned F>
+	void print_fixed(enum row_e row, uint8_t col,
+			 const char *label, int32_t value) {
+		put_fixed<W, F>(row, col, label, value, true);
+	}
+
+	template <unsigned W, unsigned F>
+	bool try_print_fixed(enum row_e row, uint8_t col,
+			     const char *label, int32_t value) {
+		return put_fixed<W, F>(row, col, label, value, false);
+	}
+
 	void clear();
 	void clear(enum row_e row);
+
+	/* Wait until everything printed so far is on the glass */
+	void sync();
+
+	/* Messages lost by try_print() on a full ring */
+	uint32_t get_dropped() {
+		return dropped;
+	}
+
+	lcd_stats get_stats() {
+		return stats;
+	}
 private:
 	static void handler(void *arg);
+	void apply(const lcd_msg *msg);
+	void flush();
+
+	lcd_msg *claim(bool wait);
+	void send();
+	bool vprint(enum row_e row, uint8_t col, bool wait,
+		    const char *format, va_list args);
+	bool vprint(enum row_e row, enum align a, bool wait,
+		    const char *format, va_list args);
+
+	template <unsigned W, unsigned F>
+	bool put_fixed(enum row_e row, uint8_t col,
+		       const char *label, int32_t value, bool wait) {
+		static_assert(W < LCD_MAX_MESSAGE_SIZE / 2, "field too wide");
+
+		lcd_msg *msg = claim(wait);
+		if (!msg)
+			return false;
+
+		char *p = msg->text;
+		while (*label && p != msg->text + LCD_COLS - W)
+			*p++ = *label++;
+		p = fmt_fixed<W, F>(p, value);
+		*p = 0;
+
+		msg->row = (uint8_t)row;
+		msg->col = col < LCD_COLS ? col : 0;
+		msg->cmd = 0;
+
+		send();
+		return true;
+	}
 
-	QueueHandle_t queue;
+	spsc_ring<lcd_msg, LCD_RING_SIZE> ring;
+	uint32_t dropped = 0;
+	char fb[LCD_ROWS][LCD_COLS];		/* what we want to see */
+	char shown[LCD_ROWS][LCD_COLS];		/* what is on the glass */
+	lcd_stats stats = { };
 	TaskHandle_t handle = NULL;
+	uint32_t sent = 0;			/* messages published */
+	std::atomic<uint32_t> drawn = 0;	/* and flushed by the task */
 };
 
 #endif /* __LCD_H__ */
@@ -4,19 +4,14 @@
 #include <log.h>
 #include <esp_timer.h>
 #include "hardware.h"
+#include "boot_time.h"
 #include "lcd.h"
 
 #define LCD_I2C_ADDR			0x27
 #define LCD_TASK_SIZE			0x1000
-#define LCD_QUEUE_SIZE			4
-#define MAX_MESSAGE_SIZE		36
-#define LCD_ROW_LENGHT			16
-
-typedef struct {
-	uint8_t cmd;
-	uint8_t row, col;
-	char text[MAX_MESSAGE_SIZE];
-} *msg_t;
+#define LCD_ROW_LENGHT			LCD_COLS
+#define LCD_FRAME_MS			20
+#define LCD_CMD_CLEAR			0x01
 
 static i2c<> i2c_bus;
 
@@ -47,60 +42,65 @@ static struct hd44780_lcd hd44780 = {
 
 lcd::lcd()
 {
+	memset(fb, ' ', sizeof(fb));
+	memset(shown, ' ', sizeof(shown));
 	i2c_bus.init(LCD_I2C_SDA, LCD_I2C_SCL);
-	queue = xQueueCreate(LCD_QUEUE_SIZE, sizeof(msg_t));
-	xTaskCreate(lcd::handler, "lcd", LCD_TASK_SIZE, this, 1, &handle);
+	xTaskCreatePinnedToCore(lcd::handler, "lcd", LCD_TASK_SIZE, this,
+		LCD_TASK_PRIO, &handle, UI_CORE);
 }
 
 lcd::~lcd()
 {
 	vTaskDelete(handle);
-	vQueueDelete(queue);
 }
 
-static msg_t prepare(char *dest, const char *format, va_list arg)
+lcd_msg *lcd::claim(bool wait)
 {
-	msg_t msg = (msg_t)malloc(sizeof(*msg));
+	lcd_msg *msg;
 
-	vsnprintf(msg->text, MAX_MESSAGE_SIZE, format, arg);
+	while (!(msg = ring.claim())) {
+		if (!wait) {
+			dropped++;
+			return nullptr;
+		}
+		vTaskDelay(1);
+	}
 
 	return msg;
 }
 
-void lcd::print(const char *format, ...)
+void lcd::send()
 {
-	va_list args;
-	va_start(args, format);
-	msg_t msg = prepare(msg->text, format, args);
-	va_end(args);
-
-	msg->row = 0;
-	msg->col = 0;
-	msg->cmd = 0;
-
-	xQueueSend(queue, &msg, portMAX_DELAY);
+	ring.publish();
+	sent++;
+	xTaskNotifyGive(handle);
 }
 
-void lcd::print(enum row_e row, uint8_t col, const char *format, ...)
+bool lcd::vprint(enum row_e row, uint8_t col, bool wait,
+		 const char *format, va_list args)
 {
-	va_list args;
-	va_start(args, format);
-	msg_t msg = prepare(msg->text, format, args);
-	va_end(args);
+	lcd_msg *msg = claim(wait);
+	if (!msg)
+		return false;
+
+	vsnprintf(msg->text, LCD_MAX_MESSAGE_SIZE, format, args);
 
 	msg->row = (uint8_t)row;
 	msg->col = col < LCD_ROW_LENGHT ? col : 0;
 	msg->cmd = 0;
 
-	xQueueSend(queue, &msg, portMAX_DELAY);
+	send();
+	return true;
 }
 
-void lcd::print(enum row_e row, enum align a, const char *format, ...)
+bool lcd::vprint(enum row_e row, enum align a, bool wait,
+		 const char *format, va_list args)
 {
-	va_list args;
-	va_start(args, format);
-	msg_t msg = prepare(msg->text, format, args);
-	va_end(args);
+	lcd_msg *msg = claim(wait);
+	if (!msg)
+		return false;
+
+	vsnprintf(msg->text, LCD_MAX_MESSAGE_SIZE, format, args);
 
 	uint8_t col = 0;
 
@@ -119,54 +119,178 @@ void lcd::print(enum row_e row, enum align a, const char *format, ...)
 	msg->col = col < LCD_ROW_LENGHT ? col : LCD_ROW_LENGHT - col;
 	msg->cmd = 0;
 
-	xQueueSend(queue, &msg, portMAX_DELAY);
+	send();
+	return true;
+}
+
+void lcd::print(const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vprint(FIRST_ROW, (uint8_t)0, true, format, args);
+	va_end(args);
+}
+
+void lcd::print(enum row_e row, uint8_t col, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vprint(row, col, true, format, args);
+	va_end(args);
+}
+
+void lcd::print(enum row_e row, enum align a, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vprint(row, a, true, format, args);
+	va_end(args);
+}
+
+bool lcd::try_print(enum row_e row, uint8_t col, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	bool ret = vprint(row, col, false, format, args);
+	va_end(args);
+
+	return ret;
+}
+
+bool lcd::try_print(enum row_e row, enum align a, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	bool ret = vprint(row, a, false, format, args);
+	va_end(args);
+
+	return ret;
 }
 
 void lcd::clear()
 {
-	msg_t msg = (msg_t)malloc(sizeof(*msg));
+	lcd_msg *msg = claim(true);
 
 	msg->text[0] = 0;
 	msg->row = 0;
 	msg->col = 0;
-	msg->cmd = 1;
+	msg->cmd = LCD_CMD_CLEAR;
 
-	xQueueSend(queue, &msg, portMAX_DELAY);
+	send();
 }
 
 void lcd::clear(enum row_e row)
 {
-	msg_t msg = (msg_t)malloc(sizeof(*msg));
+	lcd_msg *msg = claim(true);
 
 	memset(msg->text, ' ', LCD_ROW_LENGHT);
 	msg->text[LCD_ROW_LENGHT] = 0;
-	msg->row = 0;
+	msg->row = (uint8_t)row;
 	msg->col = 0;
 	msg->cmd = 0;
 
-	xQueueSend(queue, &msg, portMAX_DELAY);
+	send();
+}
+
+void lcd::sync()
+{
+	while ((int32_t)(drawn - sent) < 0)
+		vTaskDelay(1);
+}
+
+void lcd::apply(const lcd_msg *msg)
+{
+	if (msg->cmd == LCD_CMD_CLEAR) {
+		memset(fb, ' ', sizeof(fb));
+	} else if (msg->cmd) {
+		/* unknown state after a raw command, redraw everything */
+		hd44780_send_cmd(msg->cmd);
+		memset(shown, 0, sizeof(shown));
+	}
+
+	if (msg->row >= LCD_ROWS)
+		return;
+
+	char *dst = fb[msg->row];
+	for (uint8_t i = msg->col; i < LCD_COLS && msg->text[i - msg->col]; i++)
+		dst[i] = msg->text[i - msg->col];
+
+	if (msg->text[0])
+		DEBUG("%s", msg->text);
+}
+
+void lcd::flush()
+{
+	uint32_t bytes = 0;
+
+	for (uint8_t row = 0; row != LCD_ROWS; row++) {
+		uint8_t col = 0;
+
+		while (col < LCD_COLS) {
+			if (fb[row][col] == shown[row][col]) {
+				col++;
+				continue;
+			}
+
+			/*
+			 * Extend the run over single clean cells, rewriting
+			 * one char costs the same as a cursor move.
+			 */
+			uint8_t last = col;
+			for (uint8_t i = col + 1; i < LCD_COLS; i++) {
+				if (fb[row][i] != shown[row][i])
+					last = i;
+				else if (i - last > 1)
+					break;
+			}
+
+			char run[LCD_COLS + 1];
+			uint8_t len = last - col + 1;
+			memcpy(run, &fb[row][col], len);
+			run[len] = 0;
+
+			hd44780_set_pos(row, col);
+			hd44780_print(run);
+			memcpy(&shown[row][col], run, len);
+			bytes += 1 + len;
+
+			col = last + 1;
+		}
+	}
+
+	if (bytes) {
+		stats.frames++;
+		stats.bytes += bytes;
+		stats.last_frame = bytes;
+	}
 }
 
 void lcd::handler(void *arg)
 {
 	lcd *l = (lcd *)arg;
+	int stage = boot_begin("display");
 
+	/* the first messages wait in the ring meanwhile */
 	hd44780_pcf8574_con_init(&hd44780);
 	hd44780_init(&hd44780);
+	boot_end(stage);
 
 	while (1) {
-		msg_t msg;
+		lcd_msg *msg;
+		uint32_t n = 0;
+
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-		xQueueReceive(l->queue, &msg, portMAX_DELAY);
+		/* let the rest of the frame arrive */
+		vTaskDelay(pdMS_TO_TICKS(LCD_FRAME_MS));
 
-		if (msg->cmd)
-			hd44780_send_cmd(msg->cmd);
-		hd44780_set_pos(msg->row, msg->col);
-		if (msg->text[0]) {
-			hd44780_print(msg->text);
-			DEBUG("%s", msg->text);
+		while ((msg = l->ring.peek())) {
+			l->apply(msg);
+			l->ring.pop();
+			n++;
 		}
 
-		free(msg);
+		l->flush();
+		l->drawn += n;
 	}
 }
@@ -0,0 +1,74 @@
+#ifndef __ABS_POS_H__
+#define __ABS_POS_H__
+
+#include <stdint.h>
+#include "esp_attr.h"
+#include "hardware.h"
+
+/*
+ * Machine-wide carriage position in motor steps, counted at the DIR pin
+ * (high is +1), so it does not depend on which menu moved the carriage.
+ * 64 bit, it never wraps. It survives thread_cut sessions, resets and
+ * power cycles.
+ *
+ * The journal is in RTC memory, which a software reset, panic or OTA
+ * reboot leaves alone: the motion interrupt updates it on every step with
+ * two plain stores, the position and its complement. A reader on the other
+ * core retries until the two agree, and at boot the same check tells a
+ * kept journal from power-on garbage.
+ *
+ * A low priority task on UI_CORE commits it to the ABS_POS_PARTITION NVS
+ * partition, once it has not changed for ABS_POS_COMMIT_MS and the motion
+ * core saw no spindle edges for ABS_POS_QUIET_MS: a flash write holds off
+ * the interrupts of both cores, so it is only done when there is nothing
+ * to follow. NVS appends every commit as a new entry and spreads them over
+ * the partition pages, which levels the wear.
+ *
+ * At boot a valid RTC journal wins; after a power cut the last commit is
+ * restored, i.e. the position where the carriage last came to rest.
+ */
+struct abs_pos_journal {
+	uint32_t magic;
+	volatile int64_t pos;
+	volatile int64_t check;		/* ~pos, written after it */
+	volatile int32_t dir;		/* last motor step, 0 unknown */
+};
+
+extern abs_pos_journal abs_pos_rtc;
+
+/* Restore the position and start the commit task, before motion_init() */
+void abs_pos_init();
+
+/* Position in motor steps and in 0.01 mm */
+int64_t abs_pos_get();
+int64_t abs_pos_get_10um();
+
+/* Only while no motion is running, e.g. to zero it from a menu */
+void abs_pos_set(int64_t pos);
+
+/*
+ * Side the lead screw slack was last taken up on: DIR level of the last
+ * motor step, +1 high, -1 low, 0 unknown (after a power cut).
+ */
+int32_t abs_pos_get_dir();
+
+/* From the motion core: true while nothing moves, so commits are safe */
+void abs_pos_quiet(bool quiet);
+
+/* Count one step, from the motion interrupt */
+static inline void IRAM_ATTR abs_pos_step(int32_t step)
+{
+	int64_t pos = abs_pos_rtc.pos + step;
+
+	abs_pos_rtc.pos = pos;
+	abs_pos_rtc.check = ~pos;
+	abs_pos_rtc.dir = step;
+}
+
+/* A motor step that only takes up backlash, the carriage stays */
+static inline void IRAM_ATTR abs_pos_take_up(int32_t step)
+{
+	abs_pos_rtc.dir = step;
+}
+
+#endif /* __ABS_POS_H__ */
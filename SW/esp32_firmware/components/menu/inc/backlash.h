@@ -0,0 +1,84 @@
+#ifndef __BACKLASH_H__
+#define __BACKLASH_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <free_rtos_h.h>
+#include "driver/gptimer.h"
+
+/* @step is +-1, @take_up if it only takes up the slack */
+typedef void (*backlash_step_cb_t)(void *arg, int32_t step, bool take_up);
+
+/*
+ * Backlash take-up while following. After a reversal the motor turns
+ * @slack steps before the lead screw pushes the carriage again, so these
+ * are made on top of the carriage steps.
+ *
+ * defer() sees every carriage step. On a reversal it starts a GP timer,
+ * which makes the take-up steps at @hz, and keeps the carriage steps that
+ * come in meanwhile; once the slack is taken up the timer makes the kept
+ * ones at @catch_hz and then hands the output back. A reversal during
+ * take-up only takes up what was given back, so the motor stays within the
+ * slack of the carriage and ends on the right side of it.
+ *
+ * Both run on the motion core. The timer interrupt may preempt defer(),
+ * so the state they share is under a spinlock, taken only while busy.
+ * With no slack there is nothing to do and no timer is allocated.
+ */
+class backlash_comp
+{
+public:
+	static const uint32_t TIMER_HZ = 1000000;
+
+	backlash_comp(uint32_t slack, uint32_t hz, uint32_t catch_hz,
+		      backlash_step_cb_t cb, void *arg);
+	~backlash_comp();
+
+	/* Carriage step @step, true if kept: the caller must not make it */
+	bool defer(int32_t step);
+
+	/* Slack taken up on the @dir side (+-1, 0 unknown), from a task */
+	void reset(int32_t dir);
+
+	bool is_busy() {
+		return busy.load(std::memory_order_relaxed);
+	}
+
+	/* Side the slack is taken up on, once busy() is over */
+	int32_t get_dir() {
+		return dir;
+	}
+
+	uint32_t get_reversals() {
+		return reversals;
+	}
+
+	/* Axis number its timer interrupts are traced under, see trace.h */
+	void set_id(uint8_t id) {
+		this->id = id;
+	}
+
+private:
+	uint32_t slack;
+	uint32_t take_up_ticks;
+	uint32_t catch_ticks;
+	backlash_step_cb_t cb;
+	void *arg;
+	gptimer_handle_t timer = nullptr;
+	portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+	std::atomic<bool> busy { false };
+	int32_t dir = 0;
+	int32_t due = 0;		/* take-up steps to make, signed */
+	int32_t owed = 0;		/* carriage steps kept, same sign as dir */
+	bool catching = false;
+	uint32_t reversals = 0;
+	uint8_t id = 0;
+
+	void arm(uint32_t ticks);
+	static bool on_alarm(gptimer_handle_t timer,
+			     const gptimer_alarm_event_data_t *edata,
+			     void *user_ctx);
+};
+
+#endif /* __BACKLASH_H__ */
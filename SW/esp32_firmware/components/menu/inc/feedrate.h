@@ -5,31 +5,79 @@
 #include <vector>
 #include "motor_ctrl.h"
 #include "menu.h"
+#include "motion.h"
+#include "kinematics.h"
 
 class FeedRateType {
 public:
 	const char *title;
-	float step;
+	kin_gear gear;		/* exact, from kinematics.h */
 };
 
 static const std::vector<FeedRateType> thread_list {
-	{ .title = "M2x0.4",	.step = 0.4 },
-	{ .title = "M3x0.5",	.step = 0.5 },
-	{ .title = "M4x0.7",	.step = 0.7 },
-	{ .title = "M5x0.8",	.step = 0.8 },
-	{ .title = "M6x1.0",	.step = 1.0 },
-	{ .title = "M8x1.25",	.step = 1.25 },
-	{ .title = "M10x1.5",	.step = 1.5 },
-	{ .title = "M12x1.75",	.step = 1.75 },
-	{ .title = "M14x2.0",	.step = 2.0 },
-	{ .title = "M16x2.0",	.step = 2.0 }
+	{ .title = "M2x0.4",	.gear = kin_metric(400) },
+	{ .title = "M3x0.5",	.gear = kin_metric(500) },
+	{ .title = "M4x0.7",	.gear = kin_metric(700) },
+	{ .title = "M5x0.8",	.gear = kin_metric(800) },
+	{ .title = "M6x1.0",	.gear = kin_metric(1000) },
+	{ .title = "M8x1.25",	.gear = kin_metric(1250) },
+	{ .title = "M10x1.5",	.gear = kin_metric(1500) },
+	{ .title = "M12x1.75",	.gear = kin_metric(1750) },
+	{ .title = "M14x2.0",	.gear = kin_metric(2000) },
+	{ .title = "M16x2.0",	.gear = kin_metric(2000) }
+};
+
+static const std::vector<FeedRateType> tpi_list {
+	{ .title = "40 TPI",	.gear = kin_tpi(40) },
+	{ .title = "32 TPI",	.gear = kin_tpi(32) },
+	{ .title = "28 TPI",	.gear = kin_tpi(28) },
+	{ .title = "24 TPI",	.gear = kin_tpi(24) },
+	{ .title = "20 TPI",	.gear = kin_tpi(20) },
+	{ .title = "19 TPI",	.gear = kin_tpi(19) },
+	{ .title = "18 TPI",	.gear = kin_tpi(18) },
+	{ .title = "16 TPI",	.gear = kin_tpi(16) },
+	{ .title = "14 TPI",	.gear = kin_tpi(14) },
+	{ .title = "13 TPI",	.gear = kin_tpi(13) },
+	{ .title = "12 TPI",	.gear = kin_tpi(12) },
+	{ .title = "11.5 TPI",	.gear = kin_tpi(23, 2) },
+	{ .title = "11 TPI",	.gear = kin_tpi(11) },
+	{ .title = "10 TPI",	.gear = kin_tpi(10) },
+	{ .title = "9 TPI",	.gear = kin_tpi(9) },
+	{ .title = "8 TPI",	.gear = kin_tpi(8) },
+	{ .title = "7 TPI",	.gear = kin_tpi(7) },
+	{ .title = "6 TPI",	.gear = kin_tpi(6) },
+	{ .title = "5 TPI",	.gear = kin_tpi(5) },
+	{ .title = "4.5 TPI",	.gear = kin_tpi(9, 2) },
+	{ .title = "4 TPI",	.gear = kin_tpi(4) }
+};
+
+static const std::vector<FeedRateType> module_list {
+	{ .title = "MOD 0.5",	.gear = kin_module(500) },
+	{ .title = "MOD 0.75",	.gear = kin_module(750) },
+	{ .title = "MOD 1.0",	.gear = kin_module(1000) },
+	{ .title = "MOD 1.25",	.gear = kin_module(1250) },
+	{ .title = "MOD 1.5",	.gear = kin_module(1500) },
+	{ .title = "MOD 2.0",	.gear = kin_module(2000) },
+	{ .title = "MOD 2.5",	.gear = kin_module(2500) },
+	{ .title = "MOD 3.0",	.gear = kin_module(3000) }
+};
+
+/* Lead = starts x pitch, the tool moves one pitch along for each start */
+static const std::vector<FeedRateType> multistart_list {
+	{ .title = "P1.0 x2",	.gear = kin_metric(1000, 2) },
+	{ .title = "P1.0 x3",	.gear = kin_metric(1000, 3) },
+	{ .title = "P1.5 x2",	.gear = kin_metric(1500, 2) },
+	{ .title = "P1.5 x3",	.gear = kin_metric(1500, 3) },
+	{ .title = "P2.0 x2",	.gear = kin_metric(2000, 2) },
+	{ .title = "P2.0 x3",	.gear = kin_metric(2000, 3) },
+	{ .title = "P2.0 x4",	.gear = kin_metric(2000, 4) }
 };
 
 static const std::vector<FeedRateType> feedrate_list {
-	{ .title = "0.05 mm/r",	.step = 0.05 },
-	{ .title = "0.10 mm/r",	.step = 0.10 },
-	{ .title = "0.25 mm/r",	.step = 0.25  },
-	{ .title = "0.50 mm/r",	.step = 0.50  }
+	{ .title = "0.05 mm/r",	.gear = kin_metric(50) },
+	{ .title = "0.10 mm/r",	.gear = kin_metric(100) },
+	{ .title = "0.25 mm/r",	.gear = kin_metric(250) },
+	{ .title = "0.50 mm/r",	.gear = kin_metric(500) }
 };
 
 class FeedRateMenu : public MenuItem
@@ -39,6 +87,8 @@ class FeedRateMenu : public MenuItem
 	dir direction;
 	int limit;
 	bool autoreturn;
+	bool index_sync;
+	bool cycle;
 public:
 	FeedRateMenu() { }
 
@@ -46,13 +96,17 @@ public:
 		   enum dir dir,
 		   Child<FeedRateType> step_list,
 		   int support_limit = 0,
-		   bool enable_autoreturn = false) {
+		   bool enable_autoreturn = false,
+		   bool enable_index_sync = false,
+		   bool enable_cycle = false) {
 		title_str = title;
 		direction = dir;
 		list = step_list;
 		current = list.get_first();
 		limit = support_limit;
 		autoreturn = enable_autoreturn;
+		index_sync = enable_index_sync;
+		cycle = enable_cycle;
 	}
 
 	void next() {
@@ -65,8 +119,13 @@ public:
 
 	MenuItem *enter(lcd& lcd, Buttons& btns) {
 		auto item = list.get_current();
-		thread_cut(lcd, btns, item.title, item.step, direction,
-			limit, autoreturn);
+		if (cycle)
+			thread_cycle(lcd, btns, item.title, item.gear.num,
+				item.gear.den, direction, limit);
+		else
+			thread_cut(lcd, btns, item.title, item.gear.num,
+				item.gear.den, direction, limit, autoreturn,
+				index_sync);
 		return MenuItem::back();
 	}
 
@@ -78,7 +137,99 @@ public:
 		auto item = list.get_current();
 		lcd.clear();
 		lcd.print(FIRST_ROW,  CENTER, "%s", title_str.c_str());
-		lcd.print(SECOND_ROW, CENTER, "%s", item.title);
+		lcd.print(SECOND_ROW, LEFT, "%s", item.title);
+		/* highest safe spindle speed for this pitch */
+		lcd.print(SECOND_ROW, RIGHT, "<%ld",
+			motion_max_rpm(item.gear.num, item.gear.den));
+	}
+};
+
+/* Z feed per revolution for the tapers and cones */
+#define TAPER_FEED_UM		100
+
+class TaperType {
+public:
+	const char *title;
+	kin_gear_xz gear;	/* Z and X, exact */
+};
+
+/* Diameter ratio, the Morse ones from DIN 228 */
+static const std::vector<TaperType> taper_list {
+	{ .title = "MT1",	.gear = kin_taper(TAPER_FEED_UM,
+					kin_taper_ratio(20047)) },
+	{ .title = "MT2",	.gear = kin_taper(TAPER_FEED_UM,
+					kin_taper_ratio(20020)) },
+	{ .title = "MT3",	.gear = kin_taper(TAPER_FEED_UM,
+					kin_taper_ratio(19922)) },
+	{ .title = "MT4",	.gear = kin_taper(TAPER_FEED_UM,
+					kin_taper_ratio(19254)) },
+	{ .title = "1:10",	.gear = kin_taper(TAPER_FEED_UM,
+					kin_taper_ratio(10000)) },
+	{ .title = "1:20",	.gear = kin_taper(TAPER_FEED_UM,
+					kin_taper_ratio(20000)) },
+	{ .title = "1:50",	.gear = kin_taper(TAPER_FEED_UM,
+					kin_taper_ratio(50000)) }
+};
+
+/* Half angle, to the spindle axis, like the compound slide scale */
+static const std::vector<TaperType> cone_list {
+	{ .title = "15 DEG",	.gear = kin_taper(TAPER_FEED_UM,
+					rational(2) - KIN_SQRT3) },
+	{ .title = "30 DEG",	.gear = kin_taper(TAPER_FEED_UM,
+					rational(1) / KIN_SQRT3) },
+	{ .title = "45 DEG",	.gear = kin_taper(TAPER_FEED_UM,
+					rational(1)) },
+	{ .title = "60 DEG",	.gear = kin_taper(TAPER_FEED_UM,
+					KIN_SQRT3) }
+};
+
+class TaperMenu : public MenuItem
+{
+	Child<TaperType> list;
+	dir direction;
+	bool x_in;
+	int limit;
+public:
+	TaperMenu() { }
+
+	TaperMenu(std::string title,
+		  enum dir dir,
+		  bool grows_in,
+		  Child<TaperType> taper_list,
+		  int support_limit = 300) {
+		title_str = title;
+		direction = dir;
+		x_in = grows_in;
+		list = taper_list;
+		limit = support_limit;
+	}
+
+	void next() {
+		list.next();
+	}
+
+	void prev() {
+		list.prev();
+	}
+
+	MenuItem *enter(lcd& lcd, Buttons& btns) {
+		auto item = list.get_current();
+		taper_cut(lcd, btns, item.title, item.gear.z.num,
+			item.gear.z.den, item.gear.x.num, item.gear.x.den,
+			direction, x_in, limit);
+		return MenuItem::back();
+	}
+
+	void update_lcd(lcd& lcd) {
+		auto item = list.get_current();
+		int32_t z = motion_max_rpm(item.gear.z.num, item.gear.z.den);
+		int32_t x = motion_max_rpm(item.gear.x.num, item.gear.x.den);
+
+		lcd.clear();
+		lcd.print(FIRST_ROW,  CENTER, "%s", title_str.c_str());
+		lcd.print(SECOND_ROW, LEFT, "%s", item.title);
+		/* the faster axis sets it */
+		lcd.print(SECOND_ROW, RIGHT, "<%ld", z < x ? z : x);
 	}
 };
 
@@ -0,0 +1,71 @@
+#ifndef __FW_UPDATE_H__
+#define __FW_UPDATE_H__
+
+#include <stdint.h>
+
+/*
+ * Firmware update from FW_UPDATE_SERVER_IP over TCP, compressed and
+ * resumable, see SW/tools/ota for the server.
+ *
+ * The server cuts the image into FW_BLOCK_SIZE blocks, one flash sector
+ * each, and compresses every block on its own (hs_decode.h), so any block
+ * decodes without the ones before it. The device asks for the image from
+ * the first block it does not have; each one is decoded into a sector
+ * buffer, checked against its CRC, erased and written straight into the
+ * update partition, read back and compared. The count of verified blocks
+ * goes to NVS every FW_UPDATE_SAVE_BLOCKS, so a dropped connection, or a
+ * power cut, goes on from there. Two sector buffers are all the RAM it
+ * takes, whatever the image size.
+ *
+ * Once every block is in, esp_ota_set_boot_partition() checks the image
+ * and the device restarts into it.
+ *
+ * Wire format, little endian: the device sends fw_request, the server
+ * answers with fw_image_hdr and then, from @start on, fw_block_hdr and
+ * @comp_len bytes for every block. @comp_len == @raw_len is a block sent
+ * as is, compression did not make it smaller.
+ */
+#define FW_MAGIC_REQUEST	0x51525746 /* "FWRQ" */
+#define FW_MAGIC_IMAGE		0x4d495746 /* "FWIM" */
+#define FW_PROTO_VERSION	1
+#define FW_BLOCK_SIZE		4096
+#define FW_VERSION_LEN		32
+
+struct fw_request {
+	uint32_t magic;
+	uint16_t proto;
+	uint16_t reserved;
+	uint32_t image_id;	/* of the blocks the device has, 0 none */
+	uint32_t from;		/* first block it wants */
+};
+
+struct fw_image_hdr {
+	uint32_t magic;
+	uint16_t proto;
+	uint8_t window_bits;
+	uint8_t lookahead_bits;
+	uint32_t image_id;	/* CRC-32 of the whole image */
+	uint32_t size;		/* image bytes */
+	uint32_t block_size;
+	uint32_t start;		/* @from, or 0 for another image */
+	char version[FW_VERSION_LEN];
+};
+
+struct fw_block_hdr {
+	uint32_t index;
+	uint16_t raw_len;
+	uint16_t comp_len;
+	uint32_t crc;		/* CRC-32 of the raw block */
+};
+
+static_assert(sizeof(fw_request) == 16, "fw_request is the wire format");
+static_assert(sizeof(fw_image_hdr) == 56, "fw_image_hdr is the wire format");
+static_assert(sizeof(fw_block_hdr) == 12, "fw_block_hdr is the wire format");
+
+/* Start the update task, unless one runs; it restarts the device when done */
+void fw_update_start(const char *ip, uint16_t port);
+
+/* "IDLE", "12/334", "UP TO DATE" or what failed, for the menu */
+const char *fw_update_status();
+
+#endif /* __FW_UPDATE_H__ */
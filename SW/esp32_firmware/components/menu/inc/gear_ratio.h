@@ -0,0 +1,78 @@
+#ifndef __GEAR_RATIO_H__
+#define __GEAR_RATIO_H__
+
+#include <stdint.h>
+#include <assert.h>
+
+/*
+ * Electronic gear (Bresenham / DDA style).
+ *
+ * Emits exactly num motor steps per den encoder edges. The remainder is kept
+ * in the accumulator, so the position never drifts regardless of how long the
+ * spindle runs. Each call costs one multiply-add, two compares and at most
+ * one add/subtract.
+ *
+ * After N edges in total the number of issued steps is floor(N * num / den),
+ * whatever the batching and the reversals were.
+ */
+class gear_ratio
+{
+public:
+	gear_ratio() { }
+
+	gear_ratio(uint32_t num, uint32_t den) {
+		set(num, den);
+	}
+
+	void set(uint32_t num, uint32_t den) {
+		/* one step per edge at most, the ISR can't do more */
+		assert(den && num <= den);
+
+		uint32_t a = num, b = den;
+		while (b) {
+			uint32_t t = a % b;
+			a = b;
+			b = t;
+		}
+
+		this->num = num / a;
+		this->den = den / a;
+		acc = 0;
+	}
+
+	void reset() {
+		acc = 0;
+	}
+
+	/*
+	 * Spindle moved by @edges (signed), returns the step to issue: -1, 0
+	 * or 1. |edges| must not exceed max_batch().
+	 */
+	int32_t advance(int32_t edges) {
+		acc += num * edges;
+		if (acc >= den) {
+			acc -= den;
+			return 1;
+		}
+		if (acc < 0) {
+			acc += den;
+			return -1;
+		}
+		return 0;
+	}
+
+	/* Largest edge batch that can't produce more than one step */
+	uint32_t max_batch() const {
+		return num ? den / num : den;
+	}
+
+	uint32_t get_num() const { return num; }
+	uint32_t get_den() const { return den; }
+
+private:
+	int32_t num = 0;
+	int32_t den = 1;
+	int32_t acc = 0;
+};
+
+#endif /* __GEAR_RATIO_H__ */
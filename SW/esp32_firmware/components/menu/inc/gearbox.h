@@ -0,0 +1,56 @@
+#ifndef __GEARBOX_H__
+#define __GEARBOX_H__
+
+#include <stdint.h>
+#include "spindle.h"
+#include "stepper_ctrl.h"
+
+/*
+ * Electronic gearbox: up to MAX_AXES stepper_ctrl axes follow one spindle,
+ * each at its own exact ratio, with its own limits and step output, e.g.
+ * the carriage and the cross-slide turning a taper.
+ *
+ * The spindle is started with the smallest batch of all the axes, so none
+ * of them can owe more than one step per event. Every event then visits
+ * each axis once, in the order they were added: the interrupt grows by one
+ * gear and at most one step per axis, whatever the ratios.
+ *
+ * Braking into a limit is done for the group: every axis tells what share
+ * of the spindle motion it can follow (limit_ramp.h), and they all get the
+ * smallest one, through a DDA on the edges. The axes slow down together,
+ * so the ratio between them, the taper, holds to the end, and one axis on
+ * its limit stops all of them.
+ *
+ * The index pulse goes to every axis, armed ones engage on the same one.
+ */
+class gearbox
+{
+public:
+	static const uint32_t MAX_AXES = 2;
+
+	gearbox(spindle_source& spindle) : spindle(spindle) { }
+	~gearbox();
+
+	/* Before start(), in order; the gearbox does not own them */
+	void add(stepper_ctrl *axis);
+	void start();
+	void stop();
+
+	uint32_t get_batch() const {
+		return batch;
+	}
+
+private:
+	spindle_source& spindle;
+	stepper_ctrl *axes[MAX_AXES] = { };
+	uint32_t n = 0;
+	uint32_t batch = 0;
+	int32_t count = 0;		/* mirrors the delivered count */
+	int32_t acc = 0;		/* braking DDA, Q16 edges */
+	bool started = false;
+
+	static void on_edges(void *arg, int32_t edges);
+	static void on_index(void *arg, int32_t count);
+};
+
+#endif /* __GEARBOX_H__ */
@@ -0,0 +1,26 @@
+#ifndef __INFEED_H__
+#define __INFEED_H__
+
+#include <stdint.h>
+#include "hardware.h"
+
+/* One pass of the threading cycle, from the touch-off point */
+struct infeed_pass {
+	int32_t depth_um;	/* X, radial, into the work */
+	int32_t shift_um;	/* Z, in the cutting direction */
+};
+
+/* Largest plan infeed_plan() makes */
+#define INFEED_MAX_PASSES	(CYCLE_MAX_PASSES + CYCLE_SPRING_PASSES)
+
+/*
+ * Compound infeed for a 60 degree external thread of @pitch_um: ISO 68
+ * depth 0.6134 x P, cut in 2 + 3 x P[mm] passes of about the same chip
+ * area (depth grows with the square root of the pass, the first one at
+ * 0.3 of a share so the tip is not overloaded), then CYCLE_SPRING_PASSES
+ * more at full depth. Z moves with the infeed at CYCLE_FLANK_DEG10, so
+ * only the leading flank cuts. Returns the number of passes in @pass.
+ */
+uint32_t infeed_plan(uint32_t pitch_um, infeed_pass *pass, uint32_t size);
+
+#endif /* __INFEED_H__ */
@@ -0,0 +1,101 @@
+#ifndef __LIMIT_RAMP_H__
+#define __LIMIT_RAMP_H__
+
+#include <stdint.h>
+#include <assert.h>
+#include "spindle_est.h"
+
+/*
+ * Deceleration into the support limit. Following the spindle, the carriage
+ * runs at the spindle speed x num / den steps/s; at the limit it has to be
+ * stopped, and cutting the steps off at full rate asks the motor for an
+ * infinite deceleration, which it answers by stalling or overshooting.
+ *
+ * Stopping from v steps/s at @dec steps/s^2 takes v^2 / (2 x dec) steps.
+ * Once that reaches what is left to the limit, the gear is ramped down:
+ * the axis takes only k = sqrt(2 x dec x left) / v of the spindle motion,
+ * see gearbox.h. The carriage then runs on the braking curve and arrives
+ * on the limit itself; its last step is from sqrt(2 x dec) steps/s. It
+ * stays slaved to the spindle meanwhile, and stops when the spindle does.
+ *
+ * Nothing is computed farther than the stopping distance from the ceiling
+ * rate, so following costs one compare. k follows the spindle estimate and
+ * the limit as they are at every event, the limit can move under it. Runs
+ * in the motion interrupt, set() from the motion task.
+ */
+class limit_ramp
+{
+public:
+	static const int Q = spindle_est::Q;
+	static const int32_t ONE = 1 << Q;
+
+	limit_ramp() { }
+
+	/* @max_hz steps/s ceiling, @dec steps/s^2, 0 to stop dead */
+	void set(uint32_t num, uint32_t den, uint32_t max_hz, uint32_t dec) {
+		/* 2 x dec x left must fit the square root */
+		assert((uint64_t)max_hz * max_hz + 2ull * dec <= UINT32_MAX);
+
+		this->dec = dec;
+		ratio = ((uint64_t)num << Q) / den;
+		zone = dec ? (uint64_t)max_hz * max_hz / (2 * dec) + 1 : 0;
+	}
+
+	/* Steps from the limit the ramp starts at, at the ceiling rate */
+	uint32_t get_zone() const {
+		return zone;
+	}
+
+	/* Whether scale() can be below ONE, @left > 0 steps from the limit */
+	bool near(int32_t left) const {
+		return (uint32_t)left <= zone;
+	}
+
+	/* Steps to stop from @hz steps/s */
+	uint32_t stop_steps(uint32_t hz) const {
+		return dec ? (uint64_t)hz * hz / (2 * dec) : 0;
+	}
+
+	/*
+	 * Share of the spindle motion, Q16, the axis can follow with @left
+	 * > 0 steps to the limit it goes to, the spindle at @vel edges/s Q16.
+	 */
+	int32_t scale(int32_t left, int64_t vel) const {
+		if (!near(left))
+			return ONE;
+
+		/* steps/s Q16 */
+		int64_t hz = (vel < 0 ? -vel : vel) * ratio >> Q;
+		uint32_t allow = isqrt(2 * dec * (uint32_t)left);
+
+		if (hz >> Q <= allow)
+			return ONE;
+
+		return ((int64_t)allow << (2 * Q)) / hz;
+	}
+
+private:
+	uint32_t dec = 0;
+	uint32_t zone = 0;		/* steps */
+	int64_t ratio = 0;		/* num / den, Q16 */
+
+	static uint32_t isqrt(uint32_t x) {
+		uint32_t r = 0;
+		uint32_t bit = 1u << 30;
+
+		while (bit > x)
+			bit >>= 2;
+		while (bit) {
+			if (x >= r + bit) {
+				x -= r + bit;
+				r = (r >> 1) + bit;
+			} else {
+				r >>= 1;
+			}
+			bit >>= 2;
+		}
+		return r;
+	}
+};
+
+#endif /* __LIMIT_RAMP_H__ */
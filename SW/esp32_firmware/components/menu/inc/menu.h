@@ -7,7 +7,15 @@
 #include "lcd.h"
 #include "esp_buttons.h"
 
-void menu_start(const char *version);
+/*
+ * Display and buttons, showing @version while the rest of the init goes
+ * on; then the menu, once everything else is up. Does not return.
+ */
+void menu_init(const char *version);
+void menu_start();
+
+/* The display menu_init() brought up, for what runs instead of the menu */
+lcd& menu_lcd();
 
 template <typename T> class Child
 {
@@ -19,7 +27,7 @@ public:
 	Child(std::vector<T> child_list) : list(child_list) {}
 
 	T next() {
-		n = n == list.capacity() - 1 ? 0 : n + 1;
+		n = n == (int)list.capacity() - 1 ? 0 : n + 1;
 		return list[n];
 	}
 
@@ -87,15 +95,18 @@ class MenuExe : public MenuItem
 	std::function<void()> _handler;
 	bool done = false;
 	bool _run_once;
+	std::string _message;
 public:
 	MenuExe() { }
 
 	MenuExe(std::string title,
 		std::function<void()> handler,
-		bool run_once = true) {
+		bool run_once = true,
+		std::string message = "UPDATE STARTED") {
 			title_str = title;
 			_handler = handler;
 			_run_once = run_once;
+			_message = message;
 		}
 
 	void next() { }
@@ -113,7 +124,33 @@ public:
 		_handler();
 
 		lcd.clear();
-		lcd.print(FIRST_ROW,  CENTER, "UPDATE STARTED");
+		lcd.print(FIRST_ROW,  CENTER, "%s", _message.c_str());
+	}
+};
+
+class MenuInfo : public MenuItem
+{
+	std::function<std::string(lcd& lcd)> _value;
+public:
+	MenuInfo() { }
+
+	MenuInfo(std::string title,
+		 std::function<std::string(lcd& lcd)> value) {
+			title_str = title;
+			_value = value;
+		}
+
+	void next() { }
+	void prev() { }
+
+	MenuItem *enter(lcd& lcd, Buttons& btns) {
+		return MenuItem::back();
+	}
+
+	void update_lcd(lcd& lcd) {
+		lcd.clear();
+		lcd.print(FIRST_ROW,  CENTER, "%s", title_str.c_str());
+		lcd.print(SECOND_ROW, CENTER, "%s", _value(lcd).c_str());
 	}
 };
 
@@ -0,0 +1,120 @@
+#ifndef __MOTION_H__
+#define __MOTION_H__
+
+#include <stdint.h>
+#include <free_rtos_h.h>
+#include "planner.h"
+
+/*
+ * Motion service. The spindle source, the gearbox and, for every axis, the
+ * step output and stepper_ctrl are created and destroyed by a task pinned
+ * to MOTION_CORE, so the PCNT, RMT and timer interrupts are allocated
+ * there, away from the LCD, WiFi and OTA on UI_CORE.
+ *
+ * The UI only talks to it through a lock-free command mailbox: every call
+ * below posts one command and waits until the motion task has done it.
+ * The status getters read words written by the motion core and never
+ * block. All calls must come from a single UI task.
+ */
+enum motion_src {
+	MOTION_SRC_ENCODER,	/* lathe spindle encoder */
+	MOTION_SRC_SIM,		/* spindle_sim at @rpm, step driver disabled */
+};
+
+/* Gearbox axes, all following the spindle encoder, see gearbox.h */
+enum motion_axis {
+	MOTION_AXIS_Z,		/* carriage, on the lead screw */
+	MOTION_AXIS_X,		/* cross-slide, X+ away from the work */
+	MOTION_AXES,
+};
+
+/* @num / @den steps per encoder edge, 0 / 1 holds the axis */
+struct motion_gear {
+	uint32_t num;
+	uint32_t den;
+	bool dir_invert;
+};
+
+/* Notification bits sent to the motion_notify() task */
+#define MOTION_EV_LIMIT		(1 << 0)	/* support limit reached */
+#define MOTION_EV_FAULT		(1 << 1)	/* planner fault latched */
+
+void motion_init();
+
+/* Follow the spindle at @num / @den steps per encoder edge, Z only */
+void motion_start(enum motion_src src, uint32_t num, uint32_t den,
+		  bool dir_invert, int32_t rpm = 0);
+
+/* The first @axes axes, each at its @gear, in motion_axis order */
+void motion_start_axes(enum motion_src src, const motion_gear *gear,
+		       uint32_t axes, int32_t rpm = 0);
+void motion_stop();
+void motion_enable();
+void motion_disable();
+void motion_reset();
+
+/*
+ * Stop following and zero the position (unless @keep), without power
+ * cycling the drivers. Following resumes on the index pulse matching the
+ * first pass, on every following axis at once.
+ */
+void motion_arm(bool keep = false);
+bool motion_is_armed();
+
+/*
+ * S-curve rapid back to the start of the pass, then follow or arm. Of two
+ * axes, the one that takes the tool away from the work moves first.
+ */
+void motion_return(bool arm);
+
+/* S-curve rapid of one @axis to @um from its zero, following held */
+void motion_rapid(enum motion_axis axis, int32_t um);
+
+/*
+ * The motion interrupt sets MOTION_EV_* bits in @task's notification value
+ * (eSetBits) as things happen, nullptr for none. Kept across motion_start().
+ */
+void motion_notify(TaskHandle_t task);
+
+/* Movement limit in 0.1 mm, 0 for none; check is for any axis */
+void motion_set_limit(int32_t lim10,
+		      enum motion_axis axis = MOTION_AXIS_Z);
+bool motion_check_limit();
+
+/*
+ * Step rate planner: highest safe spindle RPM for the running gears, or for
+ * any @num / @den, and the latched fault. ENTER in the UI clears it.
+ */
+int32_t motion_get_max_rpm();
+int32_t motion_max_rpm(uint32_t num, uint32_t den);
+enum plan_fault motion_get_fault();
+void motion_clear_fault();
+
+/* Axis position in 0.01 mm */
+int32_t motion_get_position_10um(enum motion_axis axis = MOTION_AXIS_Z);
+
+/* Spindle speed in 0.1 RPM and acceleration in RPM/s, signed */
+int32_t motion_get_rpm10();
+int32_t motion_get_rpm_s();
+
+/* Spindle angle in 1/2^32 revolution, interpolated between edges */
+uint32_t motion_get_angle();
+
+/*
+ * Everything at once, for a sampling task other than the UI one: unlike
+ * the getters above it is safe against a motion_stop() meanwhile.
+ */
+struct motion_status {
+	bool running;
+	bool armed;
+	enum plan_fault fault;
+	int32_t rpm10;
+	int32_t rpm_s;
+	int32_t steps[MOTION_AXES];	/* position in motor steps */
+	int32_t pos_10um[MOTION_AXES];
+	bool at_limit[MOTION_AXES];
+};
+
+void motion_get_status(motion_status *st);
+
+#endif /* __MOTION_H__ */
@@ -0,0 +1,62 @@
+#ifndef __MOTION_STATS_H__
+#define __MOTION_STATS_H__
+
+#include <stdint.h>
+#include "hardware.h"
+
+/*
+ * Motion interrupt timing in CPU cycles, binned in log2 histograms:
+ *  isr  - motion callback entry to exit
+ *  step - motion callback entry to the step pulse being issued
+ * and in microseconds:
+ *  rtn  - support limit reached to the autoreturn starting
+ * plus the running total of isr cycles, for the load over any interval.
+ * Everything below compiles to nothing with MOTION_STATS set to 0.
+ */
+enum mstat_hist {
+	MSTAT_HIST_ISR,
+	MSTAT_HIST_STEP,
+	MSTAT_HIST_RETURN,
+};
+
+#if MOTION_STATS
+#include "histogram.h"
+#include "esp_cpu.h"
+
+struct motion_stats_t {
+	log2_histogram isr;
+	log2_histogram step;
+	log2_histogram rtn;
+	std::atomic<uint32_t> busy;	/* isr cycles, wraps */
+	uint32_t t0;		/* entry of the running callback */
+};
+
+extern motion_stats_t motion_stats;
+
+#define MSTAT_ENTRY()	(motion_stats.t0 = esp_cpu_get_cycle_count())
+#define MSTAT_STEP()	motion_stats.step.add(esp_cpu_get_cycle_count() - \
+					      motion_stats.t0)
+#define MSTAT_EXIT()	do { \
+		uint32_t dt = esp_cpu_get_cycle_count() - motion_stats.t0; \
+		motion_stats.isr.add(dt); \
+		motion_stats.busy.fetch_add(dt, std::memory_order_relaxed); \
+	} while (0)
+#define MSTAT_RETURN(us)	motion_stats.rtn.add(us)
+#else
+#define MSTAT_ENTRY()
+#define MSTAT_STEP()
+#define MSTAT_EXIT()
+#define MSTAT_RETURN(us)
+#endif
+
+/* Print the histograms to the console */
+void motion_stats_dump();
+void motion_stats_clear();
+
+/* Short "99%:N M:N" summary for the diagnostics page */
+const char *motion_stats_summary(enum mstat_hist hist);
+
+/* Motion callback cycles so far, 0 without MOTION_STATS */
+uint32_t motion_stats_busy();
+
+#endif /* __MOTION_STATS_H__ */
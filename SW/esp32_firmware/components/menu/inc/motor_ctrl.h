@@ -10,9 +10,40 @@ enum dir { CW, CCW };
 void thread_cut(lcd& lcd,		/* LCD driver */
 		Buttons& btns,		/* Buttons driver */
 		const char *name,	/* Title */
-		float step_mm,		/* Support steps per rotation */
+		uint32_t num,		/* Support steps per */
+		uint32_t den,		/* encoder edges */
 		enum dir dir,		/* Support movement direction */
 		int32_t limit10,	/* Support movement limit x10 mm */
-		bool sup_return);	/* Automatic support return */
+		bool sup_return,	/* Automatic support return */
+		bool index_sync = false); /* Passes start on the index */
+
+/*
+ * Taper or cone: Z at @z_num / @z_den and the cross-slide at @x_num /
+ * @x_den of the same edges, outwards or, with @x_in, into the work. Stops
+ * both at the Z limit and returns them to the start.
+ */
+void taper_cut(lcd& lcd,		/* LCD driver */
+	       Buttons& btns,		/* Buttons driver */
+	       const char *name,	/* Title */
+	       uint32_t z_num,		/* Z steps per */
+	       uint32_t z_den,		/* encoder edges */
+	       uint32_t x_num,		/* X steps per */
+	       uint32_t x_den,		/* encoder edges */
+	       enum dir dir,		/* Z movement direction */
+	       bool x_in,		/* X moves into the work */
+	       int32_t limit10);	/* Z movement limit x10 mm */
+
+/*
+ * Threading cycle with compound infeed, see infeed.h: the cross-slide
+ * feeds in before every pass, retracts at the Z limit, and the passes
+ * start on the index. The tool is touched off on the thread start first.
+ */
+void thread_cycle(lcd& lcd,		/* LCD driver */
+		  Buttons& btns,	/* Buttons driver */
+		  const char *name,	/* Title */
+		  uint32_t num,		/* Support steps per */
+		  uint32_t den,		/* encoder edges */
+		  enum dir dir,		/* Support movement direction */
+		  int32_t limit10);	/* Thread length x10 mm */
 
 #endif /* __MOTOR_CTRL_H__ */
@@ -0,0 +1,84 @@
+#ifndef __PLANNER_H__
+#define __PLANNER_H__
+
+#include <stdint.h>
+#include <atomic>
+#include "hardware.h"
+#include "spindle_est.h"
+
+enum plan_fault {
+	PLAN_OK,
+	PLAN_OVERSPEED,		/* step rate over the ceiling */
+	PLAN_OVERACCEL,		/* step rate changing too fast */
+};
+
+/*
+ * Step rate ceiling. The stepper follows the spindle at num / den steps
+ * per edge, so its step rate and acceleration scale with the spindle's.
+ * Given the machine limits the planner knows the highest safe spindle RPM
+ * for a gear, and checks the spindle estimate against it: the fault is
+ * latched when the speed predicted PLAN_LOOKAHEAD_US ahead goes over
+ * PLAN_MARGIN_PCT of the ceiling, i.e. before steps can be dropped.
+ *
+ * check() is called from the motion interrupt, the rest from tasks.
+ */
+class step_planner
+{
+public:
+	static const int Q = spindle_est::Q;
+	static const int64_t US = spindle_est::US;
+
+	step_planner() { }
+
+	step_planner(uint32_t num, uint32_t den, uint32_t max_hz,
+		     uint32_t max_acc) {
+		set(num, den, max_hz, max_acc);
+	}
+
+	/* @max_hz steps/s, @max_acc steps/s^2 */
+	void set(uint32_t num, uint32_t den, uint32_t max_hz,
+		 uint32_t max_acc) {
+		max_vel = ((int64_t)max_hz * PLAN_MARGIN_PCT / 100 * den << Q) /
+			num;
+		max_dv = ((int64_t)max_acc * den << Q) / num;
+		clear();
+	}
+
+	/* Highest safe spindle speed, RPM */
+	int32_t max_rpm() const {
+		return max_vel * 60 * ENC_PULSES_PER_REV_DEN /
+			((int64_t)ENC_PULSES_PER_REV_NUM << Q);
+	}
+
+	/* Spindle @vel edges/s Q16 and @acc edges/s^2 Q16, true if faulted */
+	bool check(int64_t vel, int64_t acc) {
+		if (fault.load(std::memory_order_relaxed) != PLAN_OK)
+			return true;
+
+		int64_t ahead = vel + acc * PLAN_LOOKAHEAD_US / US;
+
+		if (ahead > max_vel || ahead < -max_vel)
+			fault.store(PLAN_OVERSPEED, std::memory_order_relaxed);
+		else if (acc > max_dv || acc < -max_dv)
+			fault.store(PLAN_OVERACCEL, std::memory_order_relaxed);
+		else
+			return false;
+
+		return true;
+	}
+
+	enum plan_fault get_fault() const {
+		return fault.load(std::memory_order_relaxed);
+	}
+
+	void clear() {
+		fault.store(PLAN_OK, std::memory_order_relaxed);
+	}
+
+private:
+	int64_t max_vel = 0;	/* edges/s Q16 */
+	int64_t max_dv = 0;	/* edges/s^2 Q16 */
+	std::atomic<enum plan_fault> fault { PLAN_OK };
+};
+
+#endif /* __PLANNER_H__ */
@@ -0,0 +1,52 @@
+#ifndef __QUADRATURE_H__
+#define __QUADRATURE_H__
+
+#include <stdint.h>
+
+/*
+ * Full 4x quadrature decoder driven by a state table indexed by the
+ * previous and the current AB state (A in bit 1, B in bit 0). Forward is
+ * A leading B: 00 -> 10 -> 11 -> 01 -> 00.
+ *
+ * A transition where both channels changed means an edge was missed. It is
+ * counted as illegal and taken as two edges in the last known direction,
+ * which is what a missed edge at speed almost always is.
+ */
+class quad_decoder
+{
+public:
+	static const int8_t ILLEGAL = 2;
+
+	/* Re-sync to the current pin state without producing a delta */
+	void reset(uint8_t ab) {
+		state = ab & 3;
+	}
+
+	/* New AB state, returns the signed number of edges */
+	int32_t update(uint8_t ab) {
+		int8_t d = table[state << 2 | ab];
+		state = ab;
+
+		if (d == ILLEGAL) {
+			illegal++;
+			return 2 * dir;
+		}
+		if (d)
+			dir = d;
+		return d;
+	}
+
+	uint32_t get_illegal() const {
+		return illegal;
+	}
+
+private:
+	/* in DRAM, read from the encoder interrupt (spindle.cpp) */
+	static const int8_t table[16];
+
+	uint8_t state = 0;
+	int8_t dir = 1;
+	uint32_t illegal = 0;
+};
+
+#endif /* __QUADRATURE_H__ */
@@ -0,0 +1,72 @@
+#ifndef __RAPID_H__
+#define __RAPID_H__
+
+#include <stdint.h>
+#include <free_rtos_h.h>
+#include "driver/gptimer.h"
+#include "step_out.h"
+
+/*
+ * Jerk-limited (S-curve) rapid moves on the step output the motion code
+ * already owns, so nothing is re-initialized between following and a
+ * return.
+ *
+ * The acceleration ramp from rest to max_hz is integrated once, in the
+ * constructor, into a table of step intervals in timer ticks. A move of n
+ * steps plays the table forwards, cruises, and plays it backwards; a move
+ * too short to reach full speed turns around half way. The GP timer
+ * interrupt only looks up the next interval and issues the step.
+ */
+class rapid_engine
+{
+public:
+	static const uint32_t TIMER_HZ = 10000000;
+	static const uint32_t MAX_SEGS = 4;
+	static const uint32_t MAX_RAMP = 2048;
+
+	/* @max_hz steps/s, @max_acc steps/s^2, @max_jerk steps/s^3 */
+	rapid_engine(step_output& out, bool dir_invert, uint32_t max_hz,
+		     uint32_t max_acc, uint32_t max_jerk);
+	~rapid_engine();
+
+	/* Queue a move of @steps, signed like stepper_ctrl positions */
+	bool add(int32_t steps);
+
+	/* Run the queued moves, returns when done with the steps made */
+	int32_t run();
+
+	/* Planned duration of a move of @steps */
+	uint32_t duration_us(uint32_t steps);
+
+	uint32_t get_ramp_len() {
+		return ramp_len;
+	}
+
+private:
+	struct segment {
+		uint32_t n;
+		int32_t dir;
+	};
+
+	step_output& out;
+	bool dir_invert;
+	uint32_t *ramp = nullptr;	/* ticks between steps from rest */
+	uint32_t ramp_len = 0;
+	gptimer_handle_t timer = nullptr;
+	SemaphoreHandle_t done = nullptr;
+
+	segment segs[MAX_SEGS];
+	uint32_t nsegs = 0;
+	uint32_t cur = 0;		/* running segment */
+	uint32_t k = 0;			/* next step in it */
+	int32_t moved = 0;
+
+	void build(uint32_t max_hz, uint32_t max_acc, uint32_t max_jerk);
+	uint32_t interval(const segment& s, uint32_t k);
+	void arm_next(uint32_t ticks);
+	static bool on_alarm(gptimer_handle_t timer,
+			     const gptimer_alarm_event_data_t *edata,
+			     void *user_ctx);
+};
+
+#endif /* __RAPID_H__ */
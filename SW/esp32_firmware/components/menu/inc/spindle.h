@@ -0,0 +1,261 @@
+#ifndef __SPINDLE_H__
+#define __SPINDLE_H__
+
+#include <stdint.h>
+#include "driver/gpio.h"
+#include "driver/pulse_cnt.h"
+#include "driver/gptimer.h"
+#include "quadrature.h"
+#include "spindle_est.h"
+#include "trace.h"
+#include "esp_timer.h"
+
+/*
+ * Called with the signed number of spindle encoder edges seen since the
+ * previous call. Runs in interrupt context.
+ */
+typedef void (*spindle_cb_t)(void *arg, int32_t edges);
+
+/* Called with the spindle count at the index (Z) pulse */
+typedef void (*spindle_index_cb_t)(void *arg, int32_t count);
+
+/*
+ * Spindle position source. Delivers encoder edges to the motion code in
+ * batches of at most @batch edges, so that the consumer can choose how
+ * often it wants to be woken up.
+ */
+class spindle_source
+{
+public:
+	virtual ~spindle_source() { }
+
+	virtual void start(uint32_t batch, spindle_cb_t cb, void *arg) = 0;
+	virtual void stop() = 0;
+
+	/* Absolute spindle position in encoder edges */
+	virtual int32_t get_count() {
+		return count;
+	}
+
+	/* Number of callbacks issued, i.e. interrupts taken */
+	uint32_t get_events() {
+		return events;
+	}
+
+	/* Decoding errors (missed edges), if the source can see them */
+	virtual uint32_t get_errors() {
+		return 0;
+	}
+
+	/* Speed and phase, see spindle_est.h */
+	const spindle_est& get_est() {
+		return est;
+	}
+
+	/* Set before start(), the source may have no index at all */
+	void set_index(spindle_index_cb_t cb, void *arg) {
+		index_cb = cb;
+		index_arg = arg;
+	}
+
+	uint32_t get_index_events() {
+		return index_events;
+	}
+
+protected:
+	spindle_cb_t cb = nullptr;
+	void *cb_arg = nullptr;
+	int32_t count = 0;
+	uint32_t events = 0;
+	spindle_est est;
+	spindle_index_cb_t index_cb = nullptr;
+	void *index_arg = nullptr;
+	uint32_t index_events = 0;
+
+	void bind(uint32_t batch, spindle_cb_t cb, void *arg) {
+		this->cb = cb;
+		cb_arg = arg;
+
+		int64_t t = esp_timer_get_time();
+		est.reset(count, t, batch);
+		trace_cmd(0, TRACE_CMD_BIND, t);
+	}
+
+	/* the estimator runs after the step, off the latency path */
+	void deliver(int32_t edges) {
+		count += edges;
+		events++;
+		cb(cb_arg, edges);
+
+		int64_t t = esp_timer_get_time();
+		est.update(count, t);
+		trace(TRACE_EDGES, 0, edges, t);
+	}
+
+	void deliver_index(int32_t at) {
+		trace(TRACE_INDEX, 0, 0, at);
+		index_events++;
+		if (index_cb)
+			index_cb(index_arg, at);
+	}
+
+	/* Z on a rising edge GPIO interrupt, GPIO_NUM_NC for none */
+	void index_start(gpio_num_t z);
+	void index_stop(gpio_num_t z);
+	static void index_isr(void *arg);
+};
+
+/*
+ * Software quadrature decoder, one GPIO interrupt per edge on either
+ * channel. Both channels are sampled with a single port read and decoded
+ * by quad_decoder. The batch is ignored, every edge is delivered.
+ */
+class spindle_isr : public spindle_source
+{
+public:
+	spindle_isr(gpio_num_t a, gpio_num_t b, gpio_num_t z = GPIO_NUM_NC) :
+		pin_a(a), pin_b(b), pin_z(z) { }
+	~spindle_isr() { stop(); }
+
+	void start(uint32_t batch, spindle_cb_t cb, void *arg);
+	void stop();
+
+	uint32_t get_errors() {
+		return quad.get_illegal();
+	}
+
+private:
+	gpio_num_t pin_a, pin_b, pin_z;
+	bool started = false;
+	quad_decoder quad;
+
+	uint8_t read_ab();
+	static void isr(void *params);
+};
+
+/*
+ * Hardware quadrature decoder on the PCNT peripheral. Edges are counted
+ * in hardware with glitch filtering, the CPU only gets an interrupt when
+ * the counter reaches +/- batch.
+ */
+class spindle_pcnt : public spindle_source
+{
+public:
+	spindle_pcnt(gpio_num_t a, gpio_num_t b, uint32_t glitch_ns,
+		     gpio_num_t z = GPIO_NUM_NC) :
+		pin_a(a), pin_b(b), pin_z(z), glitch_ns(glitch_ns) { }
+	~spindle_pcnt() { stop(); }
+
+	void start(uint32_t batch, spindle_cb_t cb, void *arg);
+	void stop();
+	int32_t get_count();
+
+private:
+	gpio_num_t pin_a, pin_b, pin_z;
+	uint32_t glitch_ns;
+	pcnt_unit_handle_t unit = nullptr;
+	pcnt_channel_handle_t chan_a = nullptr;
+	pcnt_channel_handle_t chan_b = nullptr;
+
+	static bool on_reach(pcnt_unit_handle_t unit,
+			     const pcnt_watch_event_data_t *edata,
+			     void *user_ctx);
+};
+
+/* Speed ramp from rpm_from to rpm_to over duration_ms */
+struct sim_segment {
+	uint32_t duration_ms;
+	int32_t rpm_from;
+	int32_t rpm_to;
+};
+
+/*
+ * Simulated spindle for bench tests without the lathe. Edges are generated
+ * from a periodic GP timer interrupt (on the core that calls start()), at a
+ * fixed speed or following a profile of
+ * ramps (negative RPM runs backwards). Optional jitter moves up to
+ * @jitter edges between ticks without changing the long-term position.
+ * The index pulse comes every EXT_ENC_Z_EDGES, like the real encoder.
+ */
+class spindle_sim : public spindle_source
+{
+public:
+	spindle_sim(uint32_t period_us = 1000) : period_us(period_us) { }
+	~spindle_sim() { stop(); }
+
+	void start(uint32_t batch, spindle_cb_t cb, void *arg);
+	void stop();
+
+	/* Spindle speed in RPM, negative to run backwards */
+	void set_rpm(int32_t rpm) {
+		profile = nullptr;
+		this->rpm = rpm;
+	}
+
+	int32_t get_rpm() {
+		return rpm;
+	}
+
+	/* Run @n segments, then hold the last speed (or start over) */
+	void set_profile(const sim_segment *seg, uint32_t n, bool loop = false);
+	bool profile_done() {
+		return !profile;
+	}
+
+	void set_jitter(uint32_t edges) {
+		jitter = edges;
+	}
+
+	/* Inject edges directly, bypassing the timer */
+	void feed(int32_t edges);
+
+	/* Advance the simulation by one timer period */
+	void tick();
+
+private:
+	uint32_t period_us;
+	uint32_t batch = 1;
+	volatile int32_t rpm = 0;
+	int64_t acc = 0;
+	gptimer_handle_t timer = nullptr;
+
+	const sim_segment *volatile profile = nullptr;
+	uint32_t profile_len = 0;
+	uint32_t seg = 0;
+	uint32_t seg_us = 0;
+	bool loop = false;
+
+	uint32_t jitter = 0;
+	int32_t last_jitter = 0;
+	int32_t turn = 0;
+
+	void check_index();
+
+	static bool on_alarm(gptimer_handle_t timer,
+			     const gptimer_alarm_event_data_t *edata,
+			     void *user_ctx);
+};
+
+/*
+ * Plays a motion trace (trace.h) back: edge batches and index pulses as
+ * they were recorded, the time stamps come from the caller's clock.
+ */
+class spindle_replay : public spindle_source
+{
+public:
+	void start(uint32_t batch, spindle_cb_t cb, void *arg) {
+		bind(batch, cb, arg);
+	}
+
+	void stop() { }
+
+	void edges(int32_t edges) {
+		deliver(edges);
+	}
+
+	void index(int32_t at) {
+		deliver_index(at);
+	}
+};
+
+#endif /* __SPINDLE_H__ */
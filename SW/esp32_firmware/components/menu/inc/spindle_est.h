@@ -0,0 +1,188 @@
+#ifndef __SPINDLE_EST_H__
+#define __SPINDLE_EST_H__
+
+#include <stdint.h>
+#include <atomic>
+#include "hardware.h"
+
+/*
+ * Spindle speed and phase estimator (alpha-beta-gamma tracker).
+ *
+ * Fed from the encoder interrupt with every edge batch and its time stamp.
+ * The count at a batch event is exact at that instant, so the tracker sees
+ * both the edge counts and the edge period without a dedicated timer. It
+ * runs in fixed point (no FPU in interrupts) and at most once per
+ * MIN_DT_US; events in between only accumulate the count.
+ *
+ * Readers poll from any task or core: the state is published under a
+ * sequence counter and read back consistently without locking. Between
+ * events the reported speed is bounded by what the encoder could have
+ * missed, so it falls to 0 when the spindle stops. The interpolated phase
+ * is exact at events and within a batch of edges in between.
+ *
+ * From a reset the speed is within 1% after 60 tracker updates, i.e.
+ * 30 ms at speed or 60 batches when slow. After 100 updates, from 10 to
+ * 2000 RPM and batches of 1 to 20 edges: the speed is within 0.05%
+ * steady and 0.1% on ramps up to 3400 RPM/s, the acceleration within
+ * 300 RPM/s and the interpolated phase within an edge. The host test
+ * test_spindle_est.cpp holds it to these.
+ *
+ * Units: edges in Q16, time in us.
+ */
+struct spindle_est_state {
+	int64_t t_us;		/* last tracker update */
+	int64_t pos;		/* edges Q16, at t_us */
+	int64_t vel;		/* edges/s Q16 */
+	int64_t acc;		/* edges/s^2 Q16 */
+	int64_t t_edge;		/* last batch event */
+	int32_t count;		/* edges, at t_edge */
+};
+
+class spindle_est
+{
+public:
+	static const int Q = 16;
+	static const int64_t US = 1000000;
+	static const int64_t MIN_DT_US = 500;	/* tracker update rate cap */
+	static const int64_t MAX_DT_US = 100000;	/* restart after a gap */
+	static const int A = 1;			/* alpha = 1/2 */
+	static const int B = 3;			/* beta = 1/8 */
+	static const int G = 6;			/* gamma = 1/64 */
+
+	void reset(int32_t count, int64_t t_us, uint32_t batch) {
+		begin();
+		s = { t_us, (int64_t)count << Q, 0, 0, t_us, count };
+		this->batch = batch ? batch : 1;
+		end();
+	}
+
+	/* @count reached at @t_us, from the edge interrupt */
+	void update(int32_t count, int64_t t_us) {
+		begin();
+		s.count = count;
+		s.t_edge = t_us;
+
+		int64_t dt = t_us - s.t_us;
+		int64_t meas = (int64_t)count << Q;
+
+		/* slow, restarting or reversing: plain average over the gap */
+		if (dt >= MAX_DT_US || (dt >= MIN_DT_US &&
+					((meas - s.pos) ^ s.vel) < 0)) {
+			s.vel = (meas - s.pos) * US / dt;
+			s.acc = 0;
+			s.pos = meas;
+			s.t_us = t_us;
+		} else if (dt >= MIN_DT_US) {
+			track(meas, dt);
+			s.t_us = t_us;
+		}
+		end();
+	}
+
+	/* Consistent copy of the state */
+	spindle_est_state get() const {
+		spindle_est_state st;
+		uint32_t seq0, seq1;
+
+		do {
+			seq0 = seq.load(std::memory_order_acquire);
+			st = s;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			seq1 = seq.load(std::memory_order_relaxed);
+		} while ((seq0 & 1) || seq0 != seq1);
+
+		return st;
+	}
+
+	/* Edges/s Q16 at @now_us, bounded by the time since the last event */
+	int64_t get_vel(int64_t now_us) const {
+		return bound(get(), now_us);
+	}
+
+	/* Speed in 0.1 RPM, signed */
+	int32_t get_rpm10(int64_t now_us) const {
+		return get_vel(now_us) * 600 * ENC_PULSES_PER_REV_DEN /
+			((int64_t)ENC_PULSES_PER_REV_NUM << Q);
+	}
+
+	/* Acceleration in RPM/s */
+	int32_t get_rpm_s() const {
+		return get().acc * 60 * ENC_PULSES_PER_REV_DEN /
+			((int64_t)ENC_PULSES_PER_REV_NUM << Q);
+	}
+
+	/* Sub-edge spindle position in edges Q16, interpolated to @now_us */
+	int64_t get_phase(int64_t now_us) const {
+		spindle_est_state st = get();
+		int64_t base = (int64_t)st.count << Q;
+		int64_t d = bound(st, now_us) * (now_us - st.t_edge) / US;
+		int64_t lim = (int64_t)batch << Q;
+
+		/* never past the next event, it would have been reported */
+		if (d > lim)
+			d = lim;
+		else if (d < -lim)
+			d = -lim;
+
+		return base + d;
+	}
+
+	/* Spindle angle in 1/2^32 revolution, interpolated to @now_us */
+	uint32_t get_angle(int64_t now_us) const {
+		const int64_t rev = (int64_t)ENC_PULSES_PER_REV_NUM << Q;
+		int64_t m = get_phase(now_us) * ENC_PULSES_PER_REV_DEN % rev;
+
+		if (m < 0)
+			m += rev;
+
+		return (m << 16) / ENC_PULSES_PER_REV_NUM;
+	}
+
+private:
+	spindle_est_state s = { };
+	uint32_t batch = 1;
+	std::atomic<uint32_t> seq { 0 };
+
+	void begin() {
+		seq.store(seq.load(std::memory_order_relaxed) + 1,
+			  std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	void end() {
+		seq.store(seq.load(std::memory_order_relaxed) + 1,
+			  std::memory_order_release);
+	}
+
+	void track(int64_t meas, int64_t dt) {
+		/* predict, the divisions are ordered to stay in 64 bits */
+		int64_t dv = s.acc * dt / US;
+		int64_t pos = s.pos + s.vel * dt / US + dv * dt / (2 * US);
+		int64_t vel = s.vel + dv;
+		int64_t r = meas - pos;
+		int64_t rv = r * US / dt;
+
+		s.pos = pos + (r >> A);
+		s.vel = vel + (rv >> B);
+		s.acc = s.acc + ((rv * 2 * US / dt) >> G);
+	}
+
+	/*
+	 * The spindle moved less than a batch since the last event. Two are
+	 * allowed, so time stamp jitter doesn't clip a steady speed.
+	 */
+	int64_t bound(const spindle_est_state& st, int64_t now_us) const {
+		int64_t gap = now_us - st.t_edge;
+		if (gap <= 0)
+			return st.vel;
+
+		int64_t max = ((int64_t)batch << (Q + 1)) * US / gap;
+		if (st.vel > max)
+			return max;
+		if (st.vel < -max)
+			return -max;
+		return st.vel;
+	}
+};
+
+#endif /* __SPINDLE_EST_H__ */
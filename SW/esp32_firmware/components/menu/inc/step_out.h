@@ -0,0 +1,198 @@
+#ifndef __STEP_OUT_H__
+#define __STEP_OUT_H__
+
+#include <stdint.h>
+#include "hardware.h"
+#include "driver/gpio.h"
+
+class delayed_action;
+class spindle_source;
+
+/*
+ * Step/dir output stage. pulse() and set_dir() are called from the motion
+ * interrupt and must return quickly with constant cost.
+ */
+class step_output
+{
+public:
+	virtual ~step_output() { }
+
+	/* Emit one step pulse */
+	virtual void pulse() = 0;
+
+	/* A step that only takes up backlash, the carriage stays */
+	virtual void take_up() {
+		pulse();
+	}
+
+	/* Change DIR level, respecting the driver hold time */
+	virtual void set_dir(bool level) = 0;
+
+	/* Driver enable (ENA) */
+	virtual void set_enable(bool on) = 0;
+
+	/* Highest step rate the backend can produce [steps/s] */
+	virtual uint32_t max_rate() = 0;
+
+	/* Take the pins back after another driver has used them */
+	virtual void reclaim() { }
+
+	/* Pulses that waited for the one before to finish */
+	virtual uint32_t get_late() { return 0; }
+};
+
+/*
+ * Raises CLK in software and drops it from an esp_timer callback after
+ * MOTOR_CLK_PULSE_US. One timer dispatch per step, main axis pins only.
+ */
+class step_out_timer : public step_output
+{
+public:
+	static const uint32_t MAX_RATE = 1000000 / (2 * MOTOR_CLK_PULSE_US);
+
+	step_out_timer();
+	~step_out_timer();
+
+	void pulse();
+	void set_dir(bool level);
+	void set_enable(bool on);
+	uint32_t max_rate() { return MAX_RATE; }
+
+private:
+	const gpio_num_t clk = STP_CLK_PIN;
+	const gpio_num_t dir = STP_DIR_PIN;
+	const gpio_num_t ena = STP_ENA_PIN;
+	delayed_action *pull_down_clk;
+
+	static void pull_down_clk_handler(void *args);
+};
+
+/*
+ * Pulse shape is preloaded into an RMT channel, so a step is just a
+ * transmitter restart: DIR setup delay, exact width pulse and minimum low
+ * time are all timed by hardware.
+ */
+class step_out_rmt : public step_output
+{
+public:
+	static const uint32_t MAX_RATE = 1000000 /
+		(STP_DIR_SETUP_US + STP_PULSE_US + STP_DIR_HOLD_US);
+
+	step_out_rmt(gpio_num_t clk = STP_CLK_PIN,
+		     gpio_num_t dir = STP_DIR_PIN,
+		     gpio_num_t ena = STP_ENA_PIN,
+		     int channel = STP_RMT_CHANNEL);
+	~step_out_rmt();
+
+	void pulse();
+	void set_dir(bool level);
+	void set_enable(bool on);
+	uint32_t max_rate() { return MAX_RATE; }
+	void reclaim();
+	uint32_t get_late() { return late; }
+
+private:
+	gpio_num_t clk, dir, ena;
+	int channel;
+	uint32_t last_pulse = 0;
+	uint32_t busy_cycles;
+	uint32_t late = 0;
+};
+
+struct step_record {
+	int64_t time_us;
+	int32_t spindle;	/* spindle edge count when the step was made */
+	int32_t position;	/* position after the step */
+};
+
+/*
+ * Simulated driver, keeps the motor position and records every step with
+ * a timestamp into a caller provided buffer. Recording stops when the
+ * buffer is full, the position keeps counting.
+ */
+class step_out_sim : public step_output
+{
+public:
+	static const uint32_t MAX_RATE = 1000000;
+
+	step_out_sim(step_record *log = nullptr, uint32_t log_size = 0,
+		     spindle_source *spindle = nullptr) :
+		log(log), log_size(log_size), spindle(spindle) { }
+
+	void pulse();
+	void set_dir(bool level) { dir = level; }
+	void set_enable(bool on) { enabled = on; }
+	uint32_t max_rate() { return MAX_RATE; }
+
+	int32_t get_position() { return position; }
+	uint32_t get_steps() { return steps; }
+	uint32_t get_recorded() { return n; }
+	bool is_enabled() { return enabled; }
+
+private:
+	step_record *log;
+	uint32_t log_size;
+	spindle_source *spindle;
+	uint32_t n = 0;
+	uint32_t steps = 0;
+	int32_t position = 0;
+	bool dir = false;
+	bool enabled = false;
+};
+
+/*
+ * Passes everything on to @out, which it owns, and counts the steps made
+ * with the driver enabled into the machine position, see abs_pos.h.
+ */
+class step_out_tracked : public step_output
+{
+public:
+	step_out_tracked(step_output *out) : out(out) { }
+	~step_out_tracked() { delete out; }
+
+	void pulse();
+	void take_up();
+	void set_dir(bool level);
+	void set_enable(bool on);
+	uint32_t max_rate() { return out->max_rate(); }
+	void reclaim() { out->reclaim(); }
+	uint32_t get_late() { return out->get_late(); }
+
+private:
+	step_output *out;
+	int32_t step = 1;		/* DIR high is +1 */
+	bool enabled = false;
+};
+
+/*
+ * Passes steps and DIR on to @out, which it owns, and keeps the driver
+ * off whatever the axis asks for: the simulated spindle runs the whole
+ * step path, returns and resets included, and nothing moves.
+ */
+class step_out_dry : public step_output
+{
+public:
+	step_out_dry(step_output *out) : out(out) {
+		out->set_enable(false);
+	}
+	~step_out_dry() { delete out; }
+
+	void pulse() { out->pulse(); }
+	void take_up() { out->take_up(); }
+	void set_dir(bool level) { out->set_dir(level); }
+	void set_enable(bool on) { }
+	uint32_t max_rate() { return out->max_rate(); }
+	void reclaim() { out->reclaim(); }
+	uint32_t get_late() { return out->get_late(); }
+
+private:
+	step_output *out;
+};
+
+#if STP_PULSE_BACKEND == STP_PULSE_BACKEND_RMT
+typedef step_out_rmt step_out_default;
+#else
+typedef step_out_timer step_out_default;
+#endif
+
+#endif /* __STEP_OUT_H__ */
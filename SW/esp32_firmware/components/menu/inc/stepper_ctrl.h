@@ -0,0 +1,215 @@
+#ifndef __STEPPER_CTRL_H__
+#define __STEPPER_CTRL_H__
+
+#include <stdint.h>
+#include <atomic>
+#include "hardware.h"
+#include "gear_ratio.h"
+#include "spindle.h"
+#include "step_out.h"
+#include "planner.h"
+#include "rapid.h"
+#include "backlash.h"
+#include "limit_ramp.h"
+#include "trace.h"
+
+/* Axis mechanics, what differs between the carriage and the cross-slide */
+struct axis_config {
+	const char *name;
+	uint32_t steps_mm_num;		/* motor steps per mm */
+	uint32_t steps_mm_den;
+	uint32_t backlash_um;
+	uint32_t overshoot_um;		/* rapid moves end past and come back */
+};
+
+static const axis_config axis_z_config = {
+	"Z", MOTOR_STEPS_PER_MM_NUM, MOTOR_STEPS_PER_MM_DEN,
+	STP_BACKLASH_UM, RTN_OVERSHOOT_UM,
+};
+
+static const axis_config axis_x_config = {
+	"X", CROSS_STEPS_PER_MM_NUM, CROSS_STEPS_PER_MM_DEN,
+	CROSS_BACKLASH_UM, CROSS_OVERSHOOT_UM,
+};
+
+/*
+ * One axis following the spindle: every edge batch the gearbox (gearbox.h)
+ * hands over goes through the gear ratio and becomes at most one step on
+ * the step output. Only the step output touches the hardware, so the same
+ * code runs against the real lathe or against spindle_sim + step_out_sim.
+ * A ratio of 0 holds the axis, it then only makes rapid moves.
+ *
+ * Runs on MOTION_CORE, see motion.h. The position and the limit flag are
+ * the only state read from the other core; reaching the limit and a
+ * planner fault are also sent to the listener task as MOTION_EV_* bits.
+ *
+ * Near the limit the axis asks the gearbox to slow the spindle motion it
+ * passes on, so that it brakes at STP_LIMIT_DEC_HZ_S and stops on the
+ * limit, see limit_ramp.h.
+ *
+ * For multi-pass threading, arm() stops following and zeroes the position;
+ * following starts again on an index pulse at the same spindle angle as
+ * the first pass, so every pass lands in the same groove. Index pulses
+ * repeat at one spindle angle every EXT_ENC_Z_SYNC_EDGES.
+ *
+ * The planner watches the spindle speed against the step rate ceiling of
+ * the output and the motor; a fault is latched (and the spindle stop
+ * output asserted) until clear_fault(), following carries on.
+ *
+ * rapid_to() drives the same output from the S-curve engine, following
+ * held, e.g. back to where the pass started.
+ *
+ * On a reversal the lead screw slack is taken up first, see backlash.h;
+ * the position counts carriage steps only.
+ *
+ * The calls from the motion task and the steps are recorded in the motion
+ * trace, under the id, see trace.h; internal calls are not, so a replay
+ * makes the same calls in the same order.
+ */
+class stepper_ctrl
+{
+public:
+	stepper_ctrl(step_output& out,
+		     const axis_config& axis,
+		     uint32_t num,
+		     uint32_t den,
+		     bool dir_invert);
+	~stepper_ctrl();
+
+	const char *get_name() {
+		return axis.name;
+	}
+
+	/* Number in the gearbox, records its config in the trace */
+	void set_id(uint8_t id);
+
+	/* Support position in motor steps */
+	int32_t get_position() {
+		return position;
+	}
+
+	/* Support position in 0.01 mm */
+	int32_t get_position_10um() {
+		return (int64_t)position * axis.steps_mm_den * 100 /
+			axis.steps_mm_num;
+	}
+
+	/* Task to notify of MOTION_EV_* from the interrupt, or nullptr */
+	void set_listener(TaskHandle_t task) {
+		listener = task;
+	}
+
+	/* Slack taken up on the DIR @level side, +1 high, -1 low, 0 unknown */
+	void set_slack(int32_t level);
+
+	void clear_abs_position();
+	void enable() {
+		trace_cmd(id, TRACE_CMD_ENABLE, true);
+		set_enable(true);
+	}
+
+	void disable() {
+		trace_cmd(id, TRACE_CMD_ENABLE, false);
+		set_enable(false);
+	}
+
+	/* Support movement limit in 0.1 mm */
+	void set_limit(int32_t lim10);
+	bool check_limit();
+
+	/* On the limit now; unlike check_limit() it leaves the flag alone */
+	bool at_limit() {
+		return max && (position >= max || position <= -max);
+	}
+	void reset();
+
+	/* Stop following, wait for the index; zero the position unless @keep */
+	void arm(bool keep = false);
+	bool is_armed() {
+		return sync != SYNC_FOLLOW;
+	}
+
+	/* Highest safe spindle RPM, 0 if the axis does not follow */
+	int32_t get_max_rpm() {
+		return follows() ? planner.max_rpm() : 0;
+	}
+
+	enum plan_fault get_fault() {
+		return planner.get_fault();
+	}
+
+	void clear_fault();
+
+	uint32_t get_reversals() {
+		return backlash.get_reversals();
+	}
+
+	/* Rapid to @um from the zero, then hold until arm() or resume() */
+	void rapid_to(int32_t um);
+
+	/* Zero the position and follow again, after rapid_to() */
+	void resume();
+
+	/* Positive steps drive DIR low if set */
+	bool get_dir_invert() const {
+		return dir_invert;
+	}
+
+	/* False for a held axis */
+	bool follows() const {
+		return gear.get_num();
+	}
+
+	/* From the gearbox, in the motion interrupt */
+	uint32_t max_batch() const {
+		return gear.max_batch();
+	}
+	int32_t allow(int32_t edges, const spindle_est& est);
+	void follow(int32_t edges, int32_t count);
+	void plan(const spindle_est_state& st);
+	void index(int32_t count);
+
+private:
+	enum {
+		SYNC_FOLLOW,		/* every edge goes to the gear */
+		SYNC_HOLD,		/* edges and index ignored */
+		SYNC_ARMED,		/* waiting for the index */
+		SYNC_ENGAGE,		/* index seen at engage_at */
+	};
+
+	step_output& out;
+	const axis_config& axis;
+	bool is_enabled = true;
+	gear_ratio gear;
+	step_planner planner;
+	limit_ramp ramp;
+	rapid_engine rapid;
+	int32_t max = 0;
+	std::atomic<bool> limit_reached { false };
+	int64_t limit_us = 0;		/* when it was, for MSTAT_RETURN */
+	TaskHandle_t listener = nullptr;
+	int32_t position = 0;		/* motor steps */
+	uint8_t id = 0;			/* in the gearbox and the trace */
+	bool dir_invert = false;
+	int32_t last_step = 0;
+	std::atomic<int> sync { SYNC_FOLLOW };
+	std::atomic<int32_t> engage_at { 0 };
+	bool has_ref = false;		/* index of the first pass */
+	int32_t ref = 0;
+	backlash_comp backlash;		/* last, its timer calls back in */
+
+	static uint32_t limit_hz(step_output& out);
+	int32_t um_to_steps(int32_t um);
+	void set_enable(bool on);
+	int32_t step_dir(int32_t level);
+	void wait_backlash();
+	void move(int32_t steps);
+	void hit_limit();
+	static void notify(stepper_ctrl *s, uint32_t bits);
+	static void set_dir(stepper_ctrl *s, int32_t step);
+	static void motor_step(stepper_ctrl *s, int32_t step);
+	static void carriage_step(stepper_ctrl *s, int32_t step);
+	static void on_take_up(void *arg, int32_t step, bool take_up);
+};
+
+#endif /* __STEPPER_CTRL_H__ */
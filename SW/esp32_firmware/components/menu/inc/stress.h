@@ -0,0 +1,15 @@
+#ifndef __STRESS_H__
+#define __STRESS_H__
+
+#include "lcd.h"
+
+/*
+ * Step latency under load. Runs a dry-run simulated spindle on the motion
+ * core twice: once with the UI core idle, once with the LCD ring and the
+ * WiFi TX path saturated. Both histograms are dumped to the console, the
+ * returned "99%" summary pair is for the diagnostics page. WiFi must be
+ * started by the caller, without it only the LCD is loaded.
+ */
+const char *stress_test(lcd& lcd);
+
+#endif /* __STRESS_H__ */
@@ -0,0 +1,80 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <stdint.h>
+
+/*
+ * Telemetry over UDP: spindle speed, axis positions and step rates, limit
+ * state and the motion interrupt load, sampled by a low priority task on
+ * UI_CORE at a set rate. Samples go into a preallocated frame and every
+ * TELEM_FRAME_SAMPLES of them out as one datagram; the motion core and the
+ * cutting loop do nothing for it. The send never waits: a datagram the
+ * stack has no room for is counted lost, the next frame goes on.
+ *
+ * Frames are fixed size, little endian: telem_frame_hdr, then
+ * TELEM_FRAME_SAMPLES samples of which the first @n are valid. SW/tools/
+ * telemetry has a receiver.
+ */
+#define TELEM_MAGIC		0x4d4c4554 /* "TELM" */
+#define TELEM_VERSION		1
+#define TELEM_AXES		2 /* Z, X */
+
+/* telem_sample @flags */
+#define TELEM_F_RUNNING		(1 << 0)	/* motion started */
+#define TELEM_F_ARMED		(1 << 1)	/* waiting for the index */
+#define TELEM_F_FAULT		(1 << 2)	/* planner fault latched */
+#define TELEM_F_LIMIT_Z		(1 << 3)	/* on its limit */
+#define TELEM_F_LIMIT_X		(1 << 4)
+
+struct telem_sample {
+	uint32_t t_ms;			/* since boot */
+	int32_t rpm10;			/* spindle, 0.1 RPM, signed */
+	int32_t rpm_s;			/* spindle acceleration, RPM/s */
+	int32_t pos_10um[TELEM_AXES];	/* from the start of the pass */
+	int32_t step_hz[TELEM_AXES];	/* since the previous sample */
+	uint16_t isr_load;		/* motion callback, 0.01% of a core */
+	uint8_t flags;
+	uint8_t reserved;
+};
+
+static_assert(sizeof(telem_sample) == 32, "telem_sample is the wire format");
+
+struct telem_frame_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint8_t n;		/* valid samples */
+	uint8_t rate_hz;
+	uint32_t seq;		/* frames since telemetry_start() */
+	uint32_t lost;		/* frames the stack did not take */
+};
+
+#define TELEM_FRAME_SIZE(samples) \
+	(sizeof(telem_frame_hdr) + (samples) * sizeof(telem_sample))
+
+/* Sampling task, once */
+void telemetry_init();
+
+/*
+ * Stream to @ip:@port at @rate_hz samples/s, up to the tick rate, until
+ * telemetry_stop(). The network stack must be up.
+ */
+void telemetry_start(const char *ip, uint16_t port, uint32_t rate_hz);
+void telemetry_stop();
+
+/* 0 when stopped */
+uint32_t telemetry_get_rate();
+
+/* Frames sent and lost since started, and task cycles per sample */
+uint32_t telemetry_get_sent();
+uint32_t telemetry_get_lost();
+uint32_t telemetry_get_cycles();
+
+/*
+ * Loopback check, takes a few seconds: streams a simulated cut to a UDP
+ * listener on 127.0.0.1 standing in for the server, counts the frames
+ * that do not arrive and the CPU the sampling task took. Details go to
+ * the console, the summary is for the diagnostics page.
+ */
+const char *telemetry_test();
+
+#endif /* __TELEMETRY_H__ */
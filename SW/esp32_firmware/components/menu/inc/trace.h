@@ -0,0 +1,139 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "hardware.h"
+
+/*
+ * Motion trace: what the spindle encoder and the step outputs did, for
+ * when a thread comes out wrong. The motion interrupts write one 8 byte
+ * record per event into a preallocated ring in DRAM, a low priority task
+ * drains it to TRACE_UART in CRC checked frames. The interrupts never wait:
+ * a full ring drops the record and counts it, the frames carry the count.
+ *
+ * The records are the inputs of the motion code (edge batches with the
+ * time stamp the estimator saw, index pulses, backlash timer interrupts,
+ * the motion task calls) and what it made of them (steps, take-up steps,
+ * limits). SW/tools/trace feeds the inputs through the same gearbox and
+ * stepper_ctrl on the host and checks the outputs come out the same.
+ *
+ * All records come from MOTION_CORE: the interrupts are all level 1 there
+ * and do not nest, so they write without a lock; the motion task masks
+ * them with trace_cmd(). Off, a trace point costs one load. MOTION_TRACE
+ * 0, the default, compiles them all out; set it to 1 in hardware.h for a
+ * diagnostic build.
+ */
+enum trace_type {
+	TRACE_EDGES,	/* @arg edges delivered, @val time stamp, us */
+	TRACE_INDEX,	/* @val spindle count at the pulse */
+	TRACE_STEP,	/* @axis carriage step @arg, @val position after */
+	TRACE_TAKE_UP,	/* @axis slack step @arg, @val position */
+	TRACE_TICK,	/* @axis backlash timer interrupt */
+	TRACE_LIMIT,	/* @axis stopped on its limit, @val position */
+	TRACE_CMD,	/* @axis motion task call @arg, @val its argument */
+	TRACE_TYPES,
+};
+
+/* TRACE_CMD @arg */
+enum trace_cmd {
+	TRACE_CMD_NUM,		/* axis config: gear numerator */
+	TRACE_CMD_DEN,		/* gear denominator */
+	TRACE_CMD_RATE,		/* step output max_rate() */
+	TRACE_CMD_AXIS,		/* name | dir_invert << 8, config complete */
+	TRACE_CMD_BIND,		/* spindle started, @val time stamp */
+	TRACE_CMD_SLACK,	/* set_slack(@val) */
+	TRACE_CMD_ENABLE,	/* enable() / disable(), @val on */
+	TRACE_CMD_LIMIT,	/* set_limit(@val) */
+	TRACE_CMD_RESET,	/* reset() */
+	TRACE_CMD_ARM,		/* arm(@val) */
+	TRACE_CMD_RESUME,	/* resume() */
+	TRACE_CMD_RAPID,	/* rapid_to(@val) */
+	TRACE_CMD_CLEAR_FAULT,	/* clear_fault() */
+};
+
+struct trace_rec {
+	uint8_t type;
+	uint8_t axis;
+	int16_t arg;
+	uint32_t val;
+};
+
+static_assert(sizeof(trace_rec) == 8, "trace_rec is the wire format");
+
+/*
+ * UART frame, little endian: TRACE_SYNC0, TRACE_SYNC1, trace_frame_hdr,
+ * @n records and a CRC-16/CCITT of the header and the records. @seq counts
+ * frames, @dropped records lost since tracing started.
+ */
+#define TRACE_SYNC0		0xa5
+#define TRACE_SYNC1		0x5a
+
+struct trace_frame_hdr {
+	uint8_t seq;
+	uint8_t n;
+	uint16_t version;
+	uint32_t dropped;
+};
+
+#define TRACE_VERSION		1
+
+static inline uint16_t trace_crc16(uint16_t crc, const void *buf, size_t len)
+{
+	const uint8_t *p = static_cast<const uint8_t *>(buf);
+
+	while (len--) {
+		crc ^= (uint16_t)*p++ << 8;
+		for (int i = 0; i != 8; i++)
+			crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+#if MOTION_TRACE
+#include "spsc_ring.h"
+
+typedef spsc_ring<trace_rec, TRACE_RING_SIZE> trace_ring_t;
+
+extern trace_ring_t trace_ring;
+extern std::atomic<bool> trace_on;
+extern std::atomic<uint32_t> trace_dropped;
+
+/* From the motion interrupts */
+static inline void trace(uint8_t type, uint8_t axis, int32_t arg,
+			 uint32_t val)
+{
+	if (!trace_on.load(std::memory_order_relaxed))
+		return;
+
+	trace_rec *r = trace_ring.claim();
+	if (!r) {
+		trace_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	*r = { type, axis, (int16_t)arg, val };
+	trace_ring.publish();
+}
+
+/* From the motion task */
+void trace_cmd(uint8_t axis, enum trace_cmd cmd, uint32_t val = 0);
+#else
+static inline void trace(uint8_t type, uint8_t axis, int32_t arg,
+			 uint32_t val) { }
+static inline void trace_cmd(uint8_t axis, enum trace_cmd cmd,
+			     uint32_t val = 0) { }
+#endif
+
+/* UART and the drain task, once */
+void trace_init();
+
+/* Start or stop recording, a capture replays from the next motion start */
+void trace_enable(bool on);
+bool trace_is_enabled();
+
+/* Records sent and dropped since enabled */
+uint32_t trace_get_sent();
+uint32_t trace_get_dropped();
+
+#endif /* __TRACE_H__ */
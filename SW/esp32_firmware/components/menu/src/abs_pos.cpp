@@ -0,0 +1,183 @@
+#include "abs_pos.h"
+#include "hardware.h"
+#include "log.h"
+#include <free_rtos_h.h>
+#include <atomic>
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "esp_system.h"
+#include "esp_rom_crc.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define ABS_POS_MAGIC			0x41425331 /* "ABS1" */
+#define ABS_POS_TASK_SIZE		0x1000
+#define ABS_POS_NAMESPACE		"abs_pos"
+#define ABS_POS_KEY			"pos"
+
+/* What goes to flash, crc over the rest */
+struct abs_pos_rec {
+	int64_t pos;
+	uint32_t seq;
+	uint32_t crc;
+};
+
+RTC_NOINIT_ATTR abs_pos_journal abs_pos_rtc;
+
+static nvs_handle_t nvs;
+static abs_pos_rec saved;
+static std::atomic<bool> motion_quiet { true };
+
+static uint32_t abs_pos_crc(const abs_pos_rec *rec)
+{
+	return esp_rom_crc32_le(0, (const uint8_t *)rec,
+		offsetof(abs_pos_rec, crc));
+}
+
+static bool abs_pos_open()
+{
+	esp_err_t err = nvs_flash_init_partition(ABS_POS_PARTITION);
+
+	/*
+	 * Never written, or by another NVS version: start over, as
+	 * nvs_flash_init() does. Already initialised (WiFi) is ESP_OK.
+	 */
+	if (err == ESP_ERR_NVS_NO_FREE_PAGES ||
+	    err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+		ERROR("Erasing the %s partition", ABS_POS_PARTITION);
+		ESP_ERROR_CHECK(nvs_flash_erase_partition(ABS_POS_PARTITION));
+		err = nvs_flash_init_partition(ABS_POS_PARTITION);
+	}
+	if (err == ESP_OK)
+		err = nvs_open_from_partition(ABS_POS_PARTITION,
+			ABS_POS_NAMESPACE, NVS_READWRITE, &nvs);
+	if (err != ESP_OK) {
+		ERROR("Position storage unavailable: %s", esp_err_to_name(err));
+		return false;
+	}
+
+	return true;
+}
+
+static bool abs_pos_load(abs_pos_rec *rec)
+{
+	size_t len = sizeof(*rec);
+
+	if (nvs_get_blob(nvs, ABS_POS_KEY, rec, &len) != ESP_OK)
+		return false;
+
+	return len == sizeof(*rec) && rec->crc == abs_pos_crc(rec);
+}
+
+static void abs_pos_commit(int64_t pos)
+{
+	abs_pos_rec rec = { pos, saved.seq + 1, 0 };
+	esp_err_t err;
+
+	rec.crc = abs_pos_crc(&rec);
+	err = nvs_set_blob(nvs, ABS_POS_KEY, &rec, sizeof(rec));
+	if (err == ESP_OK)
+		err = nvs_commit(nvs);
+	if (err != ESP_OK) {
+		ERROR("Position commit failed: %s", esp_err_to_name(err));
+		return;
+	}
+
+	saved = rec;
+	DEBUG("Position %" PRId64 " committed (#%" PRIu32 ")", pos, rec.seq);
+}
+
+static bool abs_pos_rtc_valid()
+{
+	esp_reset_reason_t why = esp_reset_reason();
+
+	/* RTC memory did not survive these, whatever it says */
+	if (why == ESP_RST_POWERON || why == ESP_RST_BROWNOUT)
+		return false;
+
+	return abs_pos_rtc.magic == ABS_POS_MAGIC &&
+		abs_pos_rtc.pos == ~abs_pos_rtc.check;
+}
+
+/* Batches all the steps since the last commit into one flash write */
+static void abs_pos_task(void *arg)
+{
+	int64_t last = abs_pos_get();
+
+	while (1) {
+		delay_ms(ABS_POS_COMMIT_MS);
+
+		int64_t pos = abs_pos_get();
+		if (pos == last && pos != saved.pos && motion_quiet)
+			abs_pos_commit(pos);
+		last = pos;
+	}
+}
+
+void abs_pos_init()
+{
+	bool have_flash = abs_pos_open();
+	bool loaded = have_flash && abs_pos_load(&saved);
+
+	if (abs_pos_rtc_valid()) {
+		INFO("Position %" PRId64 " restored from RTC",
+			abs_pos_rtc.pos);
+	} else if (loaded) {
+		abs_pos_set(saved.pos);
+		abs_pos_rtc.dir = 0;
+		INFO("Position %" PRId64 " restored from flash (#%" PRIu32
+			")", saved.pos, saved.seq);
+	} else {
+		abs_pos_set(0);
+		abs_pos_rtc.dir = 0;
+		INFO("No saved position, starting at 0");
+	}
+
+	/* commit the first one even if it is 0 */
+	if (!loaded)
+		saved.pos = ~abs_pos_get();
+
+	if (have_flash)
+		xTaskCreatePinnedToCore(abs_pos_task, "abs_pos",
+			ABS_POS_TASK_SIZE, NULL, ABS_POS_TASK_PRIO, NULL,
+			UI_CORE);
+}
+
+int64_t abs_pos_get()
+{
+	int64_t pos, check;
+
+	/* torn by a step on the other core */
+	do {
+		pos = abs_pos_rtc.pos;
+		check = abs_pos_rtc.check;
+	} while (pos != ~check);
+
+	return pos;
+}
+
+int64_t abs_pos_get_10um()
+{
+	return abs_pos_get() * MOTOR_STEPS_PER_MM_DEN * 100 /
+		MOTOR_STEPS_PER_MM_NUM;
+}
+
+void abs_pos_set(int64_t pos)
+{
+	abs_pos_rtc.pos = pos;
+	abs_pos_rtc.check = ~pos;
+	abs_pos_rtc.magic = ABS_POS_MAGIC;
+}
+
+int32_t abs_pos_get_dir()
+{
+	int32_t dir = abs_pos_rtc.dir;
+
+	return dir > 0 ? 1 : dir < 0 ? -1 : 0;
+}
+
+void abs_pos_quiet(bool quiet)
+{
+	motion_quiet = quiet;
+}
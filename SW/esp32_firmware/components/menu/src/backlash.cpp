@@ -0,0 +1,142 @@
+#include "backlash.h"
+#include "trace.h"
+#include "log.h"
+#include <inttypes.h>
+
+#include "esp_attr.h"
+
+backlash_comp::backlash_comp(uint32_t slack,
+			     uint32_t hz,
+			     uint32_t catch_hz,
+			     backlash_step_cb_t cb,
+			     void *arg) :
+	slack(slack),
+	take_up_ticks(TIMER_HZ / hz),
+	catch_ticks(TIMER_HZ / catch_hz),
+	cb(cb),
+	arg(arg)
+{
+	/* defer() never starts it, keep the GP timer for another axis */
+	if (!slack)
+		return;
+
+	gptimer_config_t config = {
+		.clk_src = GPTIMER_CLK_SRC_DEFAULT,
+		.direction = GPTIMER_COUNT_UP,
+		.resolution_hz = TIMER_HZ,
+	};
+	ESP_ERROR_CHECK(gptimer_new_timer(&config, &timer));
+
+	gptimer_event_callbacks_t cbs = {
+		.on_alarm = backlash_comp::on_alarm,
+	};
+	ESP_ERROR_CHECK(gptimer_register_event_callbacks(timer, &cbs, this));
+	ESP_ERROR_CHECK(gptimer_enable(timer));
+
+	INFO("Backlash %" PRIu32 " steps, taken up at %" PRIu32 " steps/s",
+		slack, hz);
+}
+
+backlash_comp::~backlash_comp()
+{
+	if (!timer)
+		return;
+
+	/* may still be catching up */
+	gptimer_stop(timer);
+	gptimer_disable(timer);
+	gptimer_del_timer(timer);
+}
+
+void backlash_comp::reset(int32_t dir)
+{
+	portENTER_CRITICAL(&lock);
+	this->dir = dir;
+	due = 0;
+	owed = 0;
+	portEXIT_CRITICAL(&lock);
+}
+
+void IRAM_ATTR backlash_comp::arm(uint32_t ticks)
+{
+	gptimer_alarm_config_t alarm = {
+		.alarm_count = ticks,
+		.reload_count = 0,
+		.flags = { .auto_reload_on_alarm = true },
+	};
+	gptimer_set_alarm_action(timer, &alarm);
+}
+
+bool IRAM_ATTR backlash_comp::defer(int32_t step)
+{
+	/* timer stopped, nothing shared */
+	if (!busy.load(std::memory_order_relaxed)) {
+		if (step == dir || dir == 0 || slack == 0) {
+			dir = step;
+			return false;
+		}
+
+		dir = step;
+		due = step * (int32_t)slack;
+		owed = step;
+		catching = false;
+		reversals++;
+		busy.store(true, std::memory_order_relaxed);
+
+		gptimer_set_raw_count(timer, 0);
+		arm(take_up_ticks);
+		gptimer_start(timer);
+		return true;
+	}
+
+	portENTER_CRITICAL_ISR(&lock);
+	bool kept = busy.load(std::memory_order_relaxed);
+	if (kept) {
+		/* kept steps are on the dir side, an opposite one cancels */
+		if (owed == 0 && step != dir) {
+			due += step * (int32_t)slack;
+			dir = step;
+			reversals++;
+			if (catching) {
+				catching = false;
+				arm(take_up_ticks);
+			}
+		}
+		owed += step;
+	}
+	portEXIT_CRITICAL_ISR(&lock);
+
+	/* the timer handed the output back meanwhile */
+	return kept ? true : defer(step);
+}
+
+bool IRAM_ATTR backlash_comp::on_alarm(gptimer_handle_t timer,
+				       const gptimer_alarm_event_data_t *edata,
+				       void *user_ctx)
+{
+	backlash_comp *b = static_cast<backlash_comp *>(user_ctx);
+
+	trace(TRACE_TICK, b->id, 0, 0);
+	portENTER_CRITICAL_ISR(&b->lock);
+	if (b->due) {
+		int32_t step = b->due > 0 ? 1 : -1;
+
+		b->due -= step;
+		b->cb(b->arg, step, true);
+	} else if (b->owed) {
+		int32_t step = b->owed > 0 ? 1 : -1;
+
+		if (!b->catching) {
+			b->catching = true;
+			b->arm(b->catch_ticks);
+		}
+		b->owed -= step;
+		b->cb(b->arg, step, false);
+	} else {
+		gptimer_stop(timer);
+		b->busy.store(false, std::memory_order_relaxed);
+	}
+	portEXIT_CRITICAL_ISR(&b->lock);
+
+	return false;
+}
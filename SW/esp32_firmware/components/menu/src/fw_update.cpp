@@ -0,0 +1,374 @@
+#include "fw_update.h"
+#include "hs_decode.h"
+#include "hardware.h"
+#include "lcd.h"
+#include "log.h"
+#include <free_rtos_h.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <atomic>
+#include "lwip/sockets.h"
+
+#include "esp_heap_caps.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#define FW_UPDATE_TASK_SIZE		0x1000
+#define FW_UPDATE_NAMESPACE		"fw_update"
+#define FW_UPDATE_KEY			"progress"
+#define FW_UPDATE_FLASH_MAX		(16 << 20) /* the most an ESP32 takes */
+
+static_assert(FW_UPDATE_FLASH_MAX / FW_BLOCK_SIZE <= UINT16_MAX,
+	      "block counts are shown as 16 bits");
+
+/* What is in the update partition, crc over the rest */
+struct fw_progress {
+	uint32_t image_id;
+	uint32_t address;	/* of the partition */
+	uint32_t blocks;	/* verified */
+	uint32_t crc;
+};
+
+/* Transfer figures, for the log */
+struct fw_stats {
+	int64_t t0;
+	uint32_t image;		/* bytes */
+	uint32_t wire;		/* bytes received, this boot */
+	uint32_t connects;
+	uint32_t heap_start;	/* free */
+	uint32_t heap_low;	/* low water mark since boot, before it */
+};
+
+static std::atomic<bool> running;
+static char status[LCD_COLS + 1] = "IDLE";
+
+/* Only the update task touches these */
+static uint8_t comp[FW_BLOCK_SIZE];
+static uint8_t raw[FW_BLOCK_SIZE];
+static fw_progress progress;
+static fw_stats stats;
+static nvs_handle_t nvs;
+
+static uint32_t fw_progress_crc(const fw_progress *p)
+{
+	return esp_rom_crc32_le(0, (const uint8_t *)p,
+		offsetof(fw_progress, crc));
+}
+
+/* Same partition as abs_pos.h, already initialised */
+static void fw_progress_load(const esp_partition_t *part)
+{
+	fw_progress p;
+	size_t len = sizeof(p);
+
+	progress = { 0, part->address, 0, 0 };
+	if (nvs_open_from_partition(ABS_POS_PARTITION, FW_UPDATE_NAMESPACE,
+				    NVS_READWRITE, &nvs) != ESP_OK) {
+		nvs = 0;
+		return;
+	}
+	if (nvs_get_blob(nvs, FW_UPDATE_KEY, &p, &len) == ESP_OK &&
+	    len == sizeof(p) && p.crc == fw_progress_crc(&p) &&
+	    p.address == part->address)
+		progress = p;
+}
+
+static void fw_progress_save()
+{
+	if (!nvs)
+		return;
+
+	progress.crc = fw_progress_crc(&progress);
+	esp_err_t err = nvs_set_blob(nvs, FW_UPDATE_KEY, &progress,
+		sizeof(progress));
+	if (err == ESP_OK)
+		err = nvs_commit(nvs);
+	if (err != ESP_OK)
+		ERROR("FW update: progress not saved");
+}
+
+/* All of @len, or false on a timeout or a closed connection */
+static bool fw_recv(int sock, void *buf, size_t len)
+{
+	uint8_t *p = static_cast<uint8_t *>(buf);
+
+	while (len) {
+		int n = recv(sock, p, len, 0);
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+		stats.wire += n;
+	}
+	return true;
+}
+
+static int fw_connect(const char *ip, uint16_t port)
+{
+	struct sockaddr_in addr = { };
+	struct timeval tv = { FW_UPDATE_TIMEOUT_MS / 1000,
+			      FW_UPDATE_TIMEOUT_MS % 1000 * 1000 };
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = inet_addr(ip);
+
+	int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sock < 0)
+		return -1;
+
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(sock);
+		return -1;
+	}
+	stats.connects++;
+	return sock;
+}
+
+/* Decode, check, write and read back one block */
+static bool fw_block(const esp_partition_t *part, const fw_image_hdr& img,
+		     const fw_block_hdr& blk)
+{
+	const uint8_t *data = comp;
+	uint32_t offset = blk.index * FW_BLOCK_SIZE;
+
+	if (blk.comp_len != blk.raw_len) {
+		int32_t n = hs_decode(comp, blk.comp_len, raw, blk.raw_len,
+			img.window_bits, img.lookahead_bits);
+		if (n != blk.raw_len) {
+			ERROR("FW update: block %" PRIu32 " does not decode",
+				blk.index);
+			return false;
+		}
+		data = raw;
+	}
+	if (esp_rom_crc32_le(0, data, blk.raw_len) != blk.crc) {
+		ERROR("FW update: block %" PRIu32 " CRC error", blk.index);
+		return false;
+	}
+
+	if (esp_partition_erase_range(part, offset, FW_BLOCK_SIZE) != ESP_OK ||
+	    esp_partition_write(part, offset, data, blk.raw_len) != ESP_OK) {
+		ERROR("FW update: block %" PRIu32 " write failed",
+			blk.index);
+		return false;
+	}
+
+	/* the other buffer is free now */
+	uint8_t *back = data == raw ? comp : raw;
+	if (esp_partition_read(part, offset, back, blk.raw_len) != ESP_OK ||
+	    memcmp(back, data, blk.raw_len)) {
+		ERROR("FW update: block %" PRIu32 " does not read back",
+			blk.index);
+		return false;
+	}
+	return true;
+}
+
+enum fw_result {
+	FW_RETRY,	/* connection lost, go on from the last block */
+	FW_DONE,
+	FW_FAILED,
+};
+
+/* One connection: as many blocks as it brings */
+static enum fw_result fw_session(int sock, const esp_partition_t *part,
+				 const char *running_version)
+{
+	fw_request req = {
+		.magic = FW_MAGIC_REQUEST,
+		.proto = FW_PROTO_VERSION,
+		.image_id = progress.image_id,
+		.from = progress.blocks,
+	};
+	fw_image_hdr img;
+
+	if (send(sock, &req, sizeof(req), 0) != sizeof(req) ||
+	    !fw_recv(sock, &img, sizeof(img)))
+		return FW_RETRY;
+
+	img.version[FW_VERSION_LEN - 1] = '\0';
+	uint32_t blocks = (img.size + FW_BLOCK_SIZE - 1) / FW_BLOCK_SIZE;
+
+	stats.image = img.size;
+
+	if (img.magic != FW_MAGIC_IMAGE || img.proto != FW_PROTO_VERSION ||
+	    img.block_size != FW_BLOCK_SIZE || !img.size ||
+	    img.size > part->size || img.window_bits > 15 ||
+	    img.lookahead_bits > 15) {
+		snprintf(status, sizeof(status), "BAD IMAGE");
+		return FW_FAILED;
+	}
+	if (!strcmp(img.version, running_version)) {
+		snprintf(status, sizeof(status), "UP TO DATE");
+		return FW_FAILED;
+	}
+
+	/* another image than the blocks we have: from the start */
+	if (img.image_id != progress.image_id) {
+		progress.image_id = img.image_id;
+		progress.blocks = 0;
+	}
+	if (img.start != progress.blocks) {
+		ERROR("FW update: server starts at %" PRIu32 ", not %" PRIu32,
+			img.start,
+			progress.blocks);
+		return FW_FAILED;
+	}
+	if (progress.blocks)
+		INFO("FW update: %s, resuming at block %" PRIu32 " of %" PRIu32,
+			img.version, progress.blocks, blocks);
+	else
+		INFO("FW update: %s, %" PRIu32 " bytes", img.version,
+			img.size);
+
+	while (progress.blocks < blocks) {
+		fw_block_hdr blk;
+		uint32_t want = img.size - progress.blocks * FW_BLOCK_SIZE;
+
+		if (want > FW_BLOCK_SIZE)
+			want = FW_BLOCK_SIZE;
+		if (!fw_recv(sock, &blk, sizeof(blk)))
+			return FW_RETRY;
+		if (blk.index != progress.blocks || blk.raw_len != want ||
+		    blk.comp_len > blk.raw_len) {
+			ERROR("FW update: unexpected block %" PRIu32,
+				blk.index);
+			return FW_RETRY;
+		}
+		if (!fw_recv(sock, comp, blk.comp_len))
+			return FW_RETRY;
+
+		/* a bad block may be the wire, ask again */
+		if (!fw_block(part, img, blk))
+			return FW_RETRY;
+
+		progress.blocks++;
+		if (progress.blocks % FW_UPDATE_SAVE_BLOCKS == 0)
+			fw_progress_save();
+		/* at most part->size in blocks, see FW_UPDATE_FLASH_MAX */
+		snprintf(status, sizeof(status), "%u/%u",
+			(uint16_t)progress.blocks, (uint16_t)blocks);
+	}
+	return FW_DONE;
+}
+
+struct fw_target {
+	char ip[16];
+	uint16_t port;
+};
+
+static void fw_update_task(void *arg)
+{
+	const fw_target *target = static_cast<fw_target *>(arg);
+	const esp_app_desc_t *app = esp_app_get_description();
+	const esp_partition_t *part = esp_ota_get_next_update_partition(NULL);
+	enum fw_result res = FW_RETRY;
+
+	stats = { .t0 = esp_timer_get_time() };
+	stats.heap_start = esp_get_free_heap_size();
+	stats.heap_low = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+
+	if (!part) {
+		snprintf(status, sizeof(status), "NO PARTITION");
+		res = FW_FAILED;
+	} else {
+		fw_progress_load(part);
+		INFO("FW update into %s at 0x%" PRIx32 ", %" PRIu32
+			" blocks kept", part->label,
+			part->address, progress.blocks);
+	}
+
+	for (uint32_t tries = 0; res == FW_RETRY; tries++) {
+		if (tries == FW_UPDATE_RETRIES) {
+			snprintf(status, sizeof(status), "NO SERVER");
+			break;
+		}
+		if (tries)
+			delay_ms(FW_UPDATE_RETRY_MS);
+
+		int sock = fw_connect(target->ip, target->port);
+		if (sock < 0)
+			continue;
+
+		uint32_t had = progress.blocks;
+		res = fw_session(sock, part, app->version);
+		close(sock);
+
+		/* the blocks so far are kept, whatever comes next */
+		fw_progress_save();
+		/* a connection that brought something starts the count over */
+		if (progress.blocks != had)
+			tries = 0;
+	}
+
+	int64_t ms = (esp_timer_get_time() - stats.t0) / 1000;
+	INFO("FW update: %" PRIu32 " byte image, %" PRIu32 " bytes received "
+		"in %" PRId64 " ms, %" PRIu32 " connections", stats.image,
+		stats.wire, ms, stats.connects);
+	/*
+	 * The allocator's low water mark catches the peak inside lwip and
+	 * esp_ota_write() too. If it did not move, the update never went
+	 * below what the boot already had.
+	 */
+	uint32_t low = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+	if (low < stats.heap_low)
+		INFO("FW update: heap %" PRIu32 " free, %" PRIu32 " more used "
+			"at the peak, %zu bytes of static buffers",
+			stats.heap_start,
+			stats.heap_start - low, sizeof(comp) + sizeof(raw));
+	else
+		INFO("FW update: heap %" PRIu32 " free, peak below the boot "
+			"one (%" PRIu32 " free), %zu bytes of static buffers",
+			stats.heap_start, stats.heap_low,
+			sizeof(comp) + sizeof(raw));
+
+	if (res == FW_DONE) {
+		esp_err_t err = esp_ota_set_boot_partition(part);
+
+		progress = { 0, part->address, 0, 0 };
+		fw_progress_save();
+		if (err == ESP_OK) {
+			snprintf(status, sizeof(status), "RESTARTING");
+			INFO("FW update done, restarting");
+			delay_ms(1000);
+			esp_restart();
+		}
+		ERROR("FW update: image rejected: %s", esp_err_to_name(err));
+		snprintf(status, sizeof(status), "BAD IMAGE");
+	}
+
+	if (nvs)
+		nvs_close(nvs);
+	nvs = 0;
+	running = false;
+	vTaskDelete(NULL);
+}
+
+void fw_update_start(const char *ip, uint16_t port)
+{
+	static fw_target target;
+
+	if (running.exchange(true))
+		return;
+
+	snprintf(target.ip, sizeof(target.ip), "%s", ip);
+	target.port = port;
+	snprintf(status, sizeof(status), "CONNECTING");
+	xTaskCreatePinnedToCore(fw_update_task, "fw_update",
+		FW_UPDATE_TASK_SIZE, &target, FW_UPDATE_TASK_PRIO, NULL,
+		UI_CORE);
+}
+
+const char *fw_update_status()
+{
+	return status;
+}
@@ -0,0 +1,98 @@
+#include "gearbox.h"
+#include "motion_stats.h"
+#include "log.h"
+#include <assert.h>
+#include <inttypes.h>
+
+#include "esp_attr.h"
+
+gearbox::~gearbox()
+{
+	stop();
+}
+
+void gearbox::add(stepper_ctrl *axis)
+{
+	assert(!started && n < MAX_AXES);
+
+	axis->set_id(n);
+	axes[n++] = axis;
+}
+
+void gearbox::start()
+{
+	assert(n);
+
+	/* wake up at most once per step of the fastest axis */
+	batch = 0;
+	for (uint32_t i = 0; i < n; i++)
+		if (axes[i]->follows() &&
+		    (!batch || axes[i]->max_batch() < batch))
+			batch = axes[i]->max_batch();
+	/* nothing follows, the index is all that matters */
+	if (!batch)
+		batch = EXT_ENC_Z_EDGES;
+
+	count = spindle.get_count();
+	acc = 0;
+	started = true;
+	spindle.set_index(gearbox::on_index, this);
+	spindle.start(batch, gearbox::on_edges, this);
+	INFO("Gearbox: %" PRIu32 " axes, batch %" PRIu32 " edges", n, batch);
+}
+
+void gearbox::stop()
+{
+	if (!started)
+		return;
+
+	spindle.stop();
+	started = false;
+	INFO("Spindle events: %" PRIu32 ", errors: %" PRIu32,
+		spindle.get_events(), spindle.get_errors());
+}
+
+void IRAM_ATTR gearbox::on_edges(void *arg, int32_t edges)
+{
+	gearbox *g = static_cast<gearbox *>(arg);
+	const uint32_t n = g->n;
+
+	g->count += edges;
+
+	MSTAT_ENTRY();
+
+	const spindle_est& est = g->spindle.get_est();
+	int32_t k = limit_ramp::ONE;
+
+	for (uint32_t i = 0; i < n; i++) {
+		int32_t a = g->axes[i]->allow(edges, est);
+		if (a < k)
+			k = a;
+	}
+
+	/* the share all of them can follow, never more edges than came */
+	if (k < limit_ramp::ONE) {
+		g->acc += edges * k;
+		edges = g->acc >> limit_ramp::Q;
+		g->acc -= edges << limit_ramp::Q;
+	} else {
+		g->acc = 0;
+	}
+
+	for (uint32_t i = 0; i < n; i++)
+		g->axes[i]->follow(edges, g->count);
+
+	MSTAT_EXIT();
+
+	spindle_est_state st = est.get();
+	for (uint32_t i = 0; i < n; i++)
+		g->axes[i]->plan(st);
+}
+
+void IRAM_ATTR gearbox::on_index(void *arg, int32_t count)
+{
+	gearbox *g = static_cast<gearbox *>(arg);
+
+	for (uint32_t i = 0; i < g->n; i++)
+		g->axes[i]->index(count);
+}
@@ -0,0 +1,31 @@
+#include "infeed.h"
+#include <math.h>
+
+/* ISO 68-1 external thread depth h3 / P */
+#define INFEED_DEPTH_P		0.61343f
+#define INFEED_FIRST_SHARE	0.3f
+#define INFEED_MIN_PASSES	3
+
+uint32_t infeed_plan(uint32_t pitch_um, infeed_pass *pass, uint32_t size)
+{
+	float h = INFEED_DEPTH_P * pitch_um;
+	float flank = tanf(CYCLE_FLANK_DEG10 * (float)M_PI / 1800);
+	uint32_t n = 2 + (3 * pitch_um + 999) / 1000;
+	uint32_t i = 0;
+
+	if (n < INFEED_MIN_PASSES)
+		n = INFEED_MIN_PASSES;
+	if (n > CYCLE_MAX_PASSES)
+		n = CYCLE_MAX_PASSES;
+
+	for (; i < n + CYCLE_SPRING_PASSES && i < size; i++) {
+		float share = i == 0 ? INFEED_FIRST_SHARE :
+			      i < n ? i : n - 1;
+		float depth = h * sqrtf(share / (n - 1));
+
+		pass[i].depth_um = lroundf(depth);
+		pass[i].shift_um = lroundf(depth * flank);
+	}
+
+	return i;
+}
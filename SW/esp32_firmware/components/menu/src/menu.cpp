@@ -3,8 +3,15 @@
 #include "hardware.h"
 #include "feedrate.h"
 #include "motor_ctrl.h"
+#include "step_out.h"
+#include "motion_stats.h"
+#include "stress.h"
+#include "abs_pos.h"
+#include "trace.h"
+#include "telemetry.h"
+#include "fw_update.h"
+#include "boot_time.h"
 #include <wifi.h>
-#include <ota.h>
 #include <log.h>
 #include "esp_ota_ops.h"
 #include "cpp_menu.h"
@@ -17,33 +24,31 @@ static void gpio_ota_workaround(void)
 	gpio_set_level(GPIO_NUM_2, 0);
 }
 
-static ota_t ota = {
-	.server_ip = "192.168.0.108",
-	.server_port = 5005,
-	.serial_number = 1,
-	.check_interval_ms = 0,
-	.message_size = 0,
-	.uniq_magic_word = 0,
-	.version = 0, /* set later */
-	.gpio_ota_workaround = gpio_ota_workaround,
-	.gpio_ota_cancel_workaround = 0,
-};
-
 wifi_credentials_t wifi_aps[] = {
 	{ "Tower",	"555666777",	WIFI_AP_AUTH_WPA2_PSK },
 	{ "Tower3",	"555666777",	WIFI_AP_AUTH_WPA2_PSK },
 	{ "Tower24GHz",	"555666777",	WIFI_AP_AUTH_WPA2_PSK },
 };
 
+/* Started once, on the first page that needs it */
+static void wifi_up()
+{
+	static bool started;
+
+	if (!started)
+		wifi_start(wifi_aps, 3);
+	started = true;
+}
+
 static int start_fw_update()
 {
 	const esp_app_desc_t *app_desc = esp_app_get_description();
-	ota.version = app_desc->version;
 
-	wifi_start(wifi_aps, 3);
-	ota_start(&ota);
+	gpio_ota_workaround();
+	wifi_up();
+	fw_update_start(FW_UPDATE_SERVER_IP, FW_UPDATE_PORT);
 
-	INFO("Firmware version: %s", ota.version);
+	INFO("Firmware version: %s", app_desc->version);
 
 	//LCD->clear();
 	//LCD->print(FIRST_ROW, CENTER, "START FW UPDATE");
@@ -56,6 +61,26 @@ typedef std::vector<MenuItem *> menu_t;
 
 static FeedRateMenu thread_r("RIGHT", CW, thread_list);
 static FeedRateMenu thread_l("LEFT", CCW, thread_list);
+static FeedRateMenu multipass_r("MULTIPASS RIGHT", CW, thread_list, 300, true, true);
+static FeedRateMenu multipass_l("MULTIPASS LEFT", CCW, thread_list, 300, true, true);
+static FeedRateMenu cycle_r("CYCLE RIGHT", CW, thread_list, 300, true, true, true);
+static FeedRateMenu cycle_l("CYCLE LEFT", CCW, thread_list, 300, true, true, true);
+static FeedRateMenu tpi_r("RIGHT", CW, tpi_list);
+static FeedRateMenu tpi_l("LEFT", CCW, tpi_list);
+static FeedRateMenu tpi_multipass_r("MULTIPASS RIGHT", CW, tpi_list, 300, true, true);
+static FeedRateMenu tpi_multipass_l("MULTIPASS LEFT", CCW, tpi_list, 300, true, true);
+static FeedRateMenu tpi_cycle_r("CYCLE RIGHT", CW, tpi_list, 300, true, true, true);
+static FeedRateMenu tpi_cycle_l("CYCLE LEFT", CCW, tpi_list, 300, true, true, true);
+static FeedRateMenu module_r("RIGHT", CW, module_list);
+static FeedRateMenu module_l("LEFT", CCW, module_list);
+static FeedRateMenu module_multipass_r("MULTIPASS RIGHT", CW, module_list, 300, true, true);
+static FeedRateMenu module_multipass_l("MULTIPASS LEFT", CCW, module_list, 300, true, true);
+static FeedRateMenu multistart_r("MULTIPASS RIGHT", CW, multistart_list, 300, true, true);
+static FeedRateMenu multistart_l("MULTIPASS LEFT", CCW, multistart_list, 300, true, true);
+static TaperMenu taper_out("TAPER OUT", CCW, false, taper_list);
+static TaperMenu taper_in("TAPER IN", CW, true, taper_list);
+static TaperMenu cone_out("CONE OUT", CCW, false, cone_list);
+static TaperMenu cone_in("CONE IN", CW, true, cone_list);
 static FeedRateMenu feed_r("RIGHT", CCW, feedrate_list);
 static FeedRateMenu feed_l("LEFT", CW, feedrate_list);
 static FeedRateMenu limiter_feed_r("LIMITED RIGHT", CCW, feedrate_list, 300);
@@ -66,6 +91,41 @@ static FeedRateMenu autoreturn_feed_l("AUTORETURN LEFT", CW, feedrate_list, 300,
 static MenuItem metric_thread("METRIC THREAD", menu_t {
 	&thread_r,
 	&thread_l,
+	&multipass_r,
+	&multipass_l,
+	&cycle_r,
+	&cycle_l,
+});
+
+static MenuItem inch_thread("INCH THREAD", menu_t {
+	&tpi_r,
+	&tpi_l,
+	&tpi_multipass_r,
+	&tpi_multipass_l,
+	&tpi_cycle_r,
+	&tpi_cycle_l,
+});
+
+static MenuItem module_thread("MODULE THREAD", menu_t {
+	&module_r,
+	&module_l,
+	&module_multipass_r,
+	&module_multipass_l,
+});
+
+static MenuItem multistart_thread("MULTI-START", menu_t {
+	&multistart_r,
+	&multistart_l,
+});
+
+static MenuItem taper("TAPER", menu_t {
+	&taper_out,
+	&taper_in,
+});
+
+static MenuItem cone("CONE", menu_t {
+	&cone_out,
+	&cone_in,
 });
 
 static MenuItem manual_feed("MANUAL FEED", menu_t {
@@ -80,37 +140,203 @@ static MenuItem limited_feed("LIMITED FEED", menu_t {
 	&autoreturn_feed_r,
 });
 
-static MenuExe fw_update("RUN FW UPDATE", start_fw_update);
+static MenuInfo carriage_pos("CARRIAGE POS", [] (lcd& lcd) {
+	int64_t um10 = abs_pos_get_10um();
+	int64_t a = um10 < 0 ? -um10 : um10;
+	char buf[LCD_COLS + 1];
+
+	snprintf(buf, sizeof(buf), "%s%lld.%02lld mm", um10 < 0 ? "-" : "",
+		a / 100, a % 100);
+	return std::string(buf);
+});
+
+static MenuExe carriage_zero("ZERO CARRIAGE", [] () {
+	abs_pos_set(0);
+}, false, "ZEROED");
+
+static MenuItem carriage("CARRIAGE", menu_t {
+	&carriage_pos,
+	&carriage_zero,
+});
+
+static MenuInfo max_step_rate("MAX STEP RATE", [] (lcd& lcd) {
+	return std::to_string(step_out_default::MAX_RATE) + " Hz";
+});
+
+static MenuInfo lcd_bytes("LCD BYTES/FRAME", [] (lcd& lcd) {
+	lcd_stats st = lcd.get_stats();
+	uint32_t avg = st.frames ? st.bytes / st.frames : 0;
+	return "LAST " + std::to_string(st.last_frame) +
+		" AVG " + std::to_string(avg);
+});
+
+/* Viewing the page also dumps the full histograms to the console */
+static MenuInfo isr_time("ISR CYCLES", [] (lcd& lcd) {
+	motion_stats_dump();
+	return std::string(motion_stats_summary(MSTAT_HIST_ISR));
+});
+
+static MenuInfo step_latency("STEP LATENCY", [] (lcd& lcd) {
+	return std::string(motion_stats_summary(MSTAT_HIST_STEP));
+});
+
+/* Autoreturn, in us */
+static MenuInfo return_latency("RETURN LATENCY", [] (lcd& lcd) {
+	return std::string(motion_stats_summary(MSTAT_HIST_RETURN));
+});
+
+/* Takes 10 s, idle and loaded figures are on the console */
+static MenuInfo stress("STRESS TEST", [] (lcd& lcd) {
+	wifi_up();
+	return std::string(stress_test(lcd));
+});
+
+static MenuExe isr_stats_clear("CLEAR ISR STATS", motion_stats_clear,
+	false, "CLEARED");
+
+/* Records sent to TRACE_UART and lost, see trace.h */
+static MenuInfo trace_stats("MOTION TRACE", [] (lcd& lcd) {
+	return std::string(trace_is_enabled() ? "ON" : "OFF") +
+		" S:" + std::to_string(trace_get_sent()) +
+		" D:" + std::to_string(trace_get_dropped());
+});
+
+static MenuExe trace_toggle("TOGGLE TRACE", [] () {
+	trace_enable(!trace_is_enabled());
+}, false, "TOGGLED");
+
+/* Streamed to TELEM_SERVER_IP, see telemetry.h */
+static MenuInfo telem_stats("TELEMETRY", [] (lcd& lcd) {
+	uint32_t hz = telemetry_get_rate();
+
+	if (!hz)
+		return std::string("OFF");
+	return std::to_string(hz) + "HZ S:" +
+		std::to_string(telemetry_get_sent()) +
+		" L:" + std::to_string(telemetry_get_lost());
+});
+
+/* Off, then every rate in turn */
+static MenuExe telem_rate("TELEMETRY RATE", [] () {
+	static const uint32_t rates[] = {
+		TELEM_RATE_HZ / 5, TELEM_RATE_HZ, TELEM_RATE_HZ * 2, 0,
+	};
+	uint32_t hz = telemetry_get_rate();
+	uint32_t i = 0;
+
+	while (i < sizeof(rates) / sizeof(rates[0]) - 1 && rates[i] <= hz)
+		i++;
+	if (rates[i]) {
+		wifi_up();
+		telemetry_start(TELEM_SERVER_IP, TELEM_PORT, rates[i]);
+	} else {
+		telemetry_stop();
+	}
+}, false, "CHANGED");
+
+/* Takes 5 s, frames lost and CPU taken, details on the console */
+static MenuInfo telem_test("TELEMETRY TEST", [] (lcd& lcd) {
+	wifi_up();
+	return std::string(telemetry_test());
+});
+
+/* From power on to the menu, the stages go to the console */
+static MenuInfo boot_time("BOOT TIME", [] (lcd& lcd) {
+	boot_dump();
+	return "READY " + std::to_string(boot_get_ready_ms()) + " MS";
+});
+
+static MenuItem diagnostics("DIAGNOSTICS", menu_t {
+	&boot_time,
+	&max_step_rate,
+	&lcd_bytes,
+	&isr_time,
+	&step_latency,
+	&return_latency,
+	&stress,
+	&isr_stats_clear,
+	&trace_stats,
+	&trace_toggle,
+	&telem_stats,
+	&telem_rate,
+	&telem_test,
+});
+
+static MenuExe fw_update_run("RUN FW UPDATE", start_fw_update);
+
+/* Blocks written, see fw_update.h; an update goes on from there */
+static MenuInfo fw_update_state("UPDATE STATUS", [] (lcd& lcd) {
+	return std::string(fw_update_status());
+});
+
+static MenuItem fw_update("FW UPDATE", menu_t {
+	&fw_update_run,
+	&fw_update_state,
+});
+
 static MenuItem top("E-GEAR LATHE", menu_t {
 	&metric_thread,
+	&inch_thread,
+	&module_thread,
+	&multistart_thread,
+	&taper,
+	&cone,
 	&manual_feed,
 	&limited_feed,
+	&carriage,
+	&diagnostics,
 	&fw_update,
 });
 
-void menu_start(const char *version)
+static lcd *screen;
+static Buttons *btns;
+static int64_t splash_us;
+
+void menu_init(const char *version)
 {
-	lcd lcd;
-	lcd.clear();
-	lcd.print(FIRST_ROW, CENTER, "VERSION");
-	lcd.print(SECOND_ROW, CENTER, "%s", version);
-	delay_s(3);
-	lcd.clear();
+	/* the controller comes up in the lcd task, the version then shows */
+	screen = new lcd;
+	screen->clear();
+	screen->print(FIRST_ROW, CENTER, "VERSION");
+	screen->print(SECOND_ROW, CENTER, "%s", version);
+	splash_us = esp_timer_get_time();
 
-	Buttons btns;
-	btns.add(ENC_BTN);
-	btns.add(BTN1);
-	btns.add(BTN2);
+	int stage = boot_begin("buttons");
+	btns = new Buttons;
+	btns->add(ENC_BTN);
+	btns->add(BTN1);
+	btns->add(BTN2);
+	boot_end(stage);
+}
+
+lcd& menu_lcd()
+{
+	return *screen;
+}
 
+void menu_start()
+{
+	lcd& lcd = *screen;
 	MenuItem *current = &top;
 
+	/* what is left of the splash, a button cuts it short */
+	int64_t shown = (esp_timer_get_time() - splash_us) / 1000;
+	if (shown < BOOT_SPLASH_MS)
+		btns->wait(BOOT_SPLASH_MS - shown);
+	lcd.clear();
+
+	/* the splash is off the glass, the menu shows from here */
+	lcd.sync();
+	boot_ready();
+	boot_dump();
+
 	while (1) {
 		current->update_lcd(lcd);
 
-		switch (btns.wait())
+		switch (btns->wait())
 		{
 		case BUTTON_ENTER:
-			current = current->enter(lcd, btns);
+			current = current->enter(lcd, *btns);
 			break;
 		case BUTTON_NEXT:
 			current->next();
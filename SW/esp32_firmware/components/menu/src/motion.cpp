@@ -0,0 +1,464 @@
+#include "motion.h"
+#include "stepper_ctrl.h"
+#include "gearbox.h"
+#include "abs_pos.h"
+#include "spsc_ring.h"
+#include "hardware.h"
+#include "log.h"
+#include <free_rtos_h.h>
+#include <assert.h>
+#include <atomic>
+
+#define MOTION_TASK_SIZE		0x1000
+#define MOTION_MAILBOX_SIZE		4
+
+enum motion_op {
+	MOTION_OP_START,
+	MOTION_OP_STOP,
+	MOTION_OP_ENABLE,
+	MOTION_OP_DISABLE,
+	MOTION_OP_RESET,
+	MOTION_OP_ARM,
+	MOTION_OP_SET_LIMIT,
+	MOTION_OP_CLEAR_FAULT,
+	MOTION_OP_RETURN,
+	MOTION_OP_RAPID,
+	MOTION_OP_NOTIFY,
+};
+
+struct motion_cmd {
+	enum motion_op op;
+	enum motion_src src;
+	motion_gear gear[MOTION_AXES];
+	uint32_t axes;
+	enum motion_axis axis;
+	int32_t arg;
+	TaskHandle_t task;
+};
+
+static spsc_ring<motion_cmd, MOTION_MAILBOX_SIZE> mailbox;
+static TaskHandle_t task;
+static SemaphoreHandle_t done;
+
+/* Owned by the motion task, read only by the getters */
+static spindle_source *spindle;
+static gearbox *box;
+static step_output *out[MOTION_AXES];
+static stepper_ctrl *ctrl[MOTION_AXES];
+static TaskHandle_t listener;
+
+/* Callers in motion_get_status(), and whether there is anything to read */
+static std::atomic<uint32_t> readers;
+static std::atomic<bool> live;
+
+static const axis_config *const axis_configs[MOTION_AXES] = {
+	&axis_z_config,
+	&axis_x_config,
+};
+
+static void motion_destroy()
+{
+	/* a sampler that saw it live is done with it before it goes */
+	live = false;
+	while (readers)
+		vTaskDelay(1);
+
+	/* stops the spindle first, nothing calls into the axes after */
+	delete box;
+	box = nullptr;
+	for (uint32_t i = 0; i < MOTION_AXES; i++) {
+		if (out[i] && out[i]->get_late())
+			ERROR("Axis %lu: %lu steps waited for the pulse before",
+				i, out[i]->get_late());
+		delete ctrl[i];
+		delete out[i];
+		ctrl[i] = nullptr;
+		out[i] = nullptr;
+	}
+	delete spindle;
+	spindle = nullptr;
+}
+
+/*
+ * Z on the default backend, the cross-slide on its own RMT channel. A dry
+ * run keeps the driver off even for returns: the whole step path runs,
+ * the driver ignores it.
+ */
+static step_output *motion_output(uint32_t axis, enum motion_src src)
+{
+	step_output *o;
+
+	if (axis == MOTION_AXIS_X)
+		o = new step_out_rmt(CROSS_CLK_PIN, CROSS_DIR_PIN,
+			CROSS_ENA_PIN, CROSS_RMT_CHANNEL);
+	else
+		o = new step_out_default;
+
+	if (src == MOTION_SRC_SIM)
+		return new step_out_dry(o);
+	/* only real moves count into the machine position */
+	if (axis == MOTION_AXIS_Z)
+		o = new step_out_tracked(o);
+	return o;
+}
+
+static void motion_create(const motion_cmd *cmd)
+{
+	motion_destroy();
+
+	if (cmd->src == MOTION_SRC_SIM) {
+		spindle_sim *sim = new spindle_sim;
+		sim->set_rpm(cmd->arg);
+		spindle = sim;
+	} else {
+#if EXT_ENC_PCNT
+		spindle = new spindle_pcnt(EXT_ENC_A, EXT_ENC_B,
+			EXT_ENC_GLITCH_NS, EXT_ENC_Z);
+#else
+		spindle = new spindle_isr(EXT_ENC_A, EXT_ENC_B, EXT_ENC_Z);
+#endif
+	}
+
+	box = new gearbox(*spindle);
+	for (uint32_t i = 0; i < cmd->axes; i++) {
+		const motion_gear& g = cmd->gear[i];
+
+		out[i] = motion_output(i, cmd->src);
+		ctrl[i] = new stepper_ctrl(*out[i], *axis_configs[i], g.num,
+			g.den, g.dir_invert);
+		ctrl[i]->set_listener(listener);
+		box->add(ctrl[i]);
+	}
+	/* the slack is where the last session left it */
+	ctrl[MOTION_AXIS_Z]->set_slack(abs_pos_get_dir());
+	box->start();
+	live = true;
+
+	INFO("Motion started on core %d", xPortGetCoreID());
+}
+
+/*
+ * X+ is away from the work: an X below its start goes back out first, one
+ * above it once Z is back, so the tool does not cross the part on the way.
+ * Nothing follows again before all of them are back.
+ */
+static void motion_return_axes(bool arm)
+{
+	stepper_ctrl *x = ctrl[MOTION_AXIS_X];
+	int32_t x_out = 0;
+
+	/* session steps are X+ unless the gear turned the direction round */
+	if (x && x->follows())
+		x_out = x->get_dir_invert() == CROSS_DIR_INVERT ?
+			x->get_position() : -x->get_position();
+
+	bool x_first = x_out < 0;
+
+	if (x_first)
+		x->rapid_to(0);
+	for (uint32_t i = 0; i < MOTION_AXES; i++)
+		if (ctrl[i] && ctrl[i]->follows() && !(x_first && ctrl[i] == x))
+			ctrl[i]->rapid_to(0);
+
+	for (uint32_t i = 0; i < MOTION_AXES; i++) {
+		if (!ctrl[i] || !ctrl[i]->follows())
+			continue;
+		if (arm)
+			ctrl[i]->arm();
+		else
+			ctrl[i]->resume();
+	}
+}
+
+static void motion_exec(const motion_cmd *cmd)
+{
+	if (cmd->op == MOTION_OP_START) {
+		motion_create(cmd);
+		return;
+	}
+	if (cmd->op == MOTION_OP_STOP) {
+		motion_destroy();
+		return;
+	}
+	if (cmd->op == MOTION_OP_NOTIFY) {
+		listener = cmd->task;
+		for (uint32_t i = 0; i < MOTION_AXES; i++)
+			if (ctrl[i])
+				ctrl[i]->set_listener(listener);
+		return;
+	}
+	if (!box)
+		return;
+
+	switch (cmd->op) {
+	case MOTION_OP_RETURN:
+		motion_return_axes(cmd->arg);
+		return;
+	case MOTION_OP_SET_LIMIT:
+		if (ctrl[cmd->axis])
+			ctrl[cmd->axis]->set_limit(cmd->arg);
+		return;
+	case MOTION_OP_RAPID:
+		if (ctrl[cmd->axis])
+			ctrl[cmd->axis]->rapid_to(cmd->arg);
+		return;
+	default:
+		break;
+	}
+
+	for (uint32_t i = 0; i < MOTION_AXES; i++) {
+		stepper_ctrl *c = ctrl[i];
+
+		if (!c)
+			continue;
+
+		switch (cmd->op) {
+		case MOTION_OP_ENABLE:
+			c->enable();
+			break;
+		case MOTION_OP_DISABLE:
+			c->disable();
+			break;
+		case MOTION_OP_RESET:
+			/* take the pins back if something else drove them */
+			out[i]->reclaim();
+			c->reset();
+			break;
+		case MOTION_OP_ARM:
+			/* a held axis keeps its place */
+			out[i]->reclaim();
+			if (c->follows())
+				c->arm(cmd->arg);
+			break;
+		case MOTION_OP_CLEAR_FAULT:
+			c->clear_fault();
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* No spindle, or no edges for ABS_POS_QUIET_MS */
+static bool motion_quiet()
+{
+	if (!spindle)
+		return true;
+
+	spindle_est_state st = spindle->get_est().get();
+
+	return esp_timer_get_time() - st.t_edge > ABS_POS_QUIET_MS * 1000LL;
+}
+
+static void motion_task(void *arg)
+{
+	motion_cmd *cmd;
+
+	/*
+	 * The GPIO ISR service runs on the core that installs it. Do it
+	 * first, so the encoder and index interrupts are on this core (the
+	 * front panel ones come along, they are light).
+	 */
+	gpio_install_isr_service(0);
+	xSemaphoreGive(done);
+
+	while (1) {
+		/* wakes up now and then to tell abs_pos when flash is safe */
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ABS_POS_COMMIT_MS));
+		while ((cmd = mailbox.peek())) {
+			abs_pos_quiet(false);
+			motion_exec(cmd);
+			mailbox.pop();
+			xSemaphoreGive(done);
+		}
+		abs_pos_quiet(motion_quiet());
+	}
+}
+
+static void motion_post(const motion_cmd& cmd)
+{
+	assert(task);
+
+	while (!mailbox.push(cmd))
+		vTaskDelay(1);
+	xTaskNotifyGive(task);
+	xSemaphoreTake(done, portMAX_DELAY);
+}
+
+void motion_init()
+{
+	done = xSemaphoreCreateBinary();
+	xTaskCreatePinnedToCore(motion_task, "motion", MOTION_TASK_SIZE,
+		NULL, MOTION_TASK_PRIO, &task, MOTION_CORE);
+	xSemaphoreTake(done, portMAX_DELAY);
+}
+
+void motion_start(enum motion_src src, uint32_t num, uint32_t den,
+		  bool dir_invert, int32_t rpm)
+{
+	motion_gear gear = { num, den, dir_invert };
+
+	motion_start_axes(src, &gear, 1, rpm);
+}
+
+void motion_start_axes(enum motion_src src, const motion_gear *gear,
+		       uint32_t axes, int32_t rpm)
+{
+	motion_cmd cmd = { .op = MOTION_OP_START, .src = src, .axes = axes,
+			   .arg = rpm };
+
+	assert(axes && axes <= MOTION_AXES);
+	for (uint32_t i = 0; i < axes; i++)
+		cmd.gear[i] = gear[i];
+	motion_post(cmd);
+}
+
+void motion_stop()
+{
+	motion_post({ .op = MOTION_OP_STOP });
+}
+
+void motion_enable()
+{
+	motion_post({ .op = MOTION_OP_ENABLE });
+}
+
+void motion_disable()
+{
+	motion_post({ .op = MOTION_OP_DISABLE });
+}
+
+void motion_reset()
+{
+	motion_post({ .op = MOTION_OP_RESET });
+}
+
+void motion_arm(bool keep)
+{
+	motion_post({ .op = MOTION_OP_ARM, .arg = keep });
+}
+
+bool motion_is_armed()
+{
+	stepper_ctrl *c = ctrl[MOTION_AXIS_Z];
+
+	return c ? c->is_armed() : false;
+}
+
+void motion_return(bool arm)
+{
+	motion_post({ .op = MOTION_OP_RETURN, .arg = arm });
+}
+
+void motion_rapid(enum motion_axis axis, int32_t um)
+{
+	motion_post({ .op = MOTION_OP_RAPID, .axis = axis, .arg = um });
+}
+
+void motion_notify(TaskHandle_t task)
+{
+	motion_post({ .op = MOTION_OP_NOTIFY, .task = task });
+}
+
+void motion_set_limit(int32_t lim10, enum motion_axis axis)
+{
+	motion_post({ .op = MOTION_OP_SET_LIMIT, .axis = axis, .arg = lim10 });
+}
+
+/* The slowest of the following axes */
+int32_t motion_get_max_rpm()
+{
+	int32_t rpm = 0;
+
+	for (uint32_t i = 0; i < MOTION_AXES; i++) {
+		stepper_ctrl *c = ctrl[i];
+
+		if (c && c->follows() && (!rpm || c->get_max_rpm() < rpm))
+			rpm = c->get_max_rpm();
+	}
+	return rpm;
+}
+
+int32_t motion_max_rpm(uint32_t num, uint32_t den)
+{
+	uint32_t max_hz = step_out_default::MAX_RATE;
+
+	if (max_hz > STP_MAX_STEP_HZ)
+		max_hz = STP_MAX_STEP_HZ;
+
+	return step_planner(num, den, max_hz, STP_MAX_ACC_HZ_S).max_rpm();
+}
+
+enum plan_fault motion_get_fault()
+{
+	for (uint32_t i = 0; i < MOTION_AXES; i++)
+		if (ctrl[i] && ctrl[i]->get_fault() != PLAN_OK)
+			return ctrl[i]->get_fault();
+	return PLAN_OK;
+}
+
+void motion_clear_fault()
+{
+	motion_post({ .op = MOTION_OP_CLEAR_FAULT });
+}
+
+/* Clears the flag of every axis */
+bool motion_check_limit()
+{
+	bool ret = false;
+
+	for (uint32_t i = 0; i < MOTION_AXES; i++)
+		if (ctrl[i] && ctrl[i]->check_limit())
+			ret = true;
+	return ret;
+}
+
+int32_t motion_get_position_10um(enum motion_axis axis)
+{
+	stepper_ctrl *c = ctrl[axis];
+
+	return c ? c->get_position_10um() : 0;
+}
+
+int32_t motion_get_rpm10()
+{
+	if (!spindle)
+		return 0;
+	return spindle->get_est().get_rpm10(esp_timer_get_time());
+}
+
+int32_t motion_get_rpm_s()
+{
+	return spindle ? spindle->get_est().get_rpm_s() : 0;
+}
+
+uint32_t motion_get_angle()
+{
+	if (!spindle)
+		return 0;
+	return spindle->get_est().get_angle(esp_timer_get_time());
+}
+
+void motion_get_status(motion_status *st)
+{
+	*st = { };
+
+	readers++;
+	if (live) {
+		st->running = true;
+		st->armed = motion_is_armed();
+		st->fault = motion_get_fault();
+		st->rpm10 = motion_get_rpm10();
+		st->rpm_s = motion_get_rpm_s();
+		for (uint32_t i = 0; i < MOTION_AXES; i++) {
+			stepper_ctrl *c = ctrl[i];
+
+			if (!c)
+				continue;
+			st->steps[i] = c->get_position();
+			st->pos_10um[i] = c->get_position_10um();
+			st->at_limit[i] = c->at_limit();
+		}
+	}
+	readers--;
+}
@@ -0,0 +1,70 @@
+#include "motion_stats.h"
+#include "log.h"
+#include <stdio.h>
+
+#if MOTION_STATS
+#include "esp_attr.h"
+
+DRAM_ATTR motion_stats_t motion_stats;
+
+static void dump(const char *name, const log2_histogram& h,
+		 const char *unit = "cycles")
+{
+	INFO("%s: %lu samples, 50%%: %lu, 99%%: %lu, max: %lu [%s]",
+		name, h.count(), h.percentile(50), h.percentile(99),
+		h.get_max(), unit);
+
+	for (unsigned i = 0; i != log2_histogram::BINS; i++) {
+		if (h.get_bin(i))
+			INFO("  %10lu..: %lu", i ? 1ul << i : 0ul, h.get_bin(i));
+	}
+}
+
+void motion_stats_dump()
+{
+	dump("motion isr", motion_stats.isr);
+	dump("step latency", motion_stats.step);
+	dump("limit to return", motion_stats.rtn, "us");
+}
+
+void motion_stats_clear()
+{
+	motion_stats.isr.clear();
+	motion_stats.step.clear();
+	motion_stats.rtn.clear();
+}
+
+const char *motion_stats_summary(enum mstat_hist hist)
+{
+	static char buf[24];
+	const log2_histogram& h = hist == MSTAT_HIST_STEP ? motion_stats.step :
+		hist == MSTAT_HIST_RETURN ? motion_stats.rtn : motion_stats.isr;
+
+	snprintf(buf, sizeof(buf), "99%%:%lu M:%lu",
+		h.percentile(99), h.get_max());
+
+	return buf;
+}
+
+uint32_t motion_stats_busy()
+{
+	return motion_stats.busy.load(std::memory_order_relaxed);
+}
+#else
+void motion_stats_dump()
+{
+	INFO("motion stats disabled (MOTION_STATS = 0)");
+}
+
+void motion_stats_clear() { }
+
+const char *motion_stats_summary(enum mstat_hist hist)
+{
+	return "DISABLED";
+}
+
+uint32_t motion_stats_busy()
+{
+	return 0;
+}
+#endif
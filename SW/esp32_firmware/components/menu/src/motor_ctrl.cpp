@@ -4,274 +4,367 @@
 #include <free_rtos_h.h>
 #include <errno.h>
 #include <string.h>
-#include <esp32_timer.h>
-#include <step_motor.h>
 #include <esp_encoder.h>
-
-/* ESP32 drivers */
-#include "driver/gpio.h"
+#include "motion.h"
+#include "infeed.h"
 #include "esp_timer.h"
-#include "hal/gpio_ll.h"
 
-#include <atomic>
+/* "L:" + 5 chars, right aligned */
+#define LIMIT_COL		(LCD_COLS - 7)
+
+/* Cutting loop events, next to the MOTION_EV_* bits */
+#define CUT_EV_RETURN		(1 << 8)
+#define CUT_EV_ENTER		(1 << 9)
+#define CUT_EV_REFRESH		(1 << 10)
 
-/* Hardware timer clock divider */
-#define TIMER_DIVIDER		(16)
-/* convert counter value to seconds */
-#define TIMER_SCALE		(TIMER_BASE_CLK / (TIMER_DIVIDER * 1000000UL))
-#define GPIO_SET(pin, state)	gpio_ll_set_level(&GPIO, pin, state)
-#define GPIO_GET(pin)		gpio_ll_get_level(&GPIO, pin)
+#define CUT_REFRESH_MS		200
+#define CUT_BTN_TASK_SIZE	0x800
+#define CUT_BTN_TASK_PRIO	2
+#define CUT_TASK_PRIO		3 /* over the LCD task, or it waits a tick */
 
-class stepper_ctrl
+/* Fault tag for the right end of the second row, nullptr if none */
+static const char *fault_tag()
 {
-public:
-	stepper_ctrl(uint32_t ratio,
-		     bool dir_invert,
-		     int32_t limit = 0) :
-		ratio(ratio),
-		dir_invert(dir_invert) {
-		ESP_ERROR_CHECK(gpio_reset_pin(EXT_ENC_A));
-		ESP_ERROR_CHECK(gpio_reset_pin(EXT_ENC_B));
-		ESP_ERROR_CHECK(gpio_reset_pin(STP_CLK_PIN));
-		ESP_ERROR_CHECK(gpio_reset_pin(STP_DIR_PIN));
-		ESP_ERROR_CHECK(gpio_reset_pin(STP_ENA_PIN));
-	
-		ESP_ERROR_CHECK(gpio_set_direction(EXT_ENC_A, GPIO_MODE_INPUT));
-		ESP_ERROR_CHECK(gpio_set_direction(EXT_ENC_B, GPIO_MODE_INPUT));
-
-		ESP_ERROR_CHECK(gpio_set_direction(STP_CLK_PIN, GPIO_MODE_OUTPUT));
-		ESP_ERROR_CHECK(gpio_set_direction(STP_DIR_PIN, GPIO_MODE_OUTPUT));
-		ESP_ERROR_CHECK(gpio_set_direction(STP_ENA_PIN, GPIO_MODE_OUTPUT));
-
-		ESP_ERROR_CHECK(gpio_set_intr_type(EXT_ENC_A, GPIO_INTR_ANYEDGE));
-		ESP_ERROR_CHECK(gpio_set_intr_type(EXT_ENC_B, GPIO_INTR_ANYEDGE));
-
-		gpio_install_isr_service(0);
-		ESP_ERROR_CHECK(gpio_isr_handler_add(
-			EXT_ENC_A, stepper_ctrl::isr_a, this));
-		ESP_ERROR_CHECK(gpio_isr_handler_add(
-			EXT_ENC_B, stepper_ctrl::isr_b, this));
-
-		ESP_ERROR_CHECK(gpio_set_level(STP_DIR_PIN, 0));
-		enable();
-
-		fan_start();
-
-		pull_down_clk = new delayed_action(MOTOR_CLK_PULSE_US,
-			pull_down_clk_handler);
+	switch (motion_get_fault()) {
+	case PLAN_OVERSPEED:
+		return "OVSP";
+	case PLAN_OVERACCEL:
+		return "OVAC";
+	default:
+		return nullptr;
 	}
+}
 
-	~stepper_ctrl() {
-		gpio_isr_handler_remove(EXT_ENC_A);
-		gpio_isr_handler_remove(EXT_ENC_B);
-		gpio_reset_pin(EXT_ENC_A);
-		gpio_reset_pin(EXT_ENC_B);
-		disable();
+/*
+ * What the cutting loop runs: the axes it starts, what it does when the
+ * limit is reached and on ENTER, and the tag it shows. The default is the
+ * single axis thread_cut(), with its optional return and index sync.
+ */
+class cut_job
+{
+public:
+	bool sup_return = false;
+	bool index_sync = false;
 
-		fan_stop();
-		delete(pull_down_clk);
-	}
+	virtual ~cut_job() { }
+	virtual void start() = 0;
 
-	float get_abs_position() {
-		return (float)position * ENC_PULSES_TO_SUPPORT_MM /
-			(float)ratio / MOTOR_PULSES_TO_SUPPORT_MM;
+	/* The support is waiting on the limit */
+	virtual void limit() {
+		if (sup_return && motion_check_limit())
+			motion_return(index_sync);
 	}
 
-	void clear_abs_position() {
-		position = 0;
-		cnt = 0;
-		check_limit();
+	virtual void enter() {
+		motion_clear_fault();
+		if (index_sync)
+			motion_arm();
+		else
+			motion_reset();
 	}
 
-	void enable() {
-		GPIO_SET(STP_ENA_PIN, STP_ENA_POL);
-		is_enabled = true;
-		INFO("Stepper enabled");
-	}
+	/* Right end of the second row, faults first */
+	virtual const char *tag() {
+		const char *fault = fault_tag();
 
-	void disable() {
-		GPIO_SET(STP_ENA_PIN, !STP_ENA_POL);
-		is_enabled = false;
-		INFO("Stepper disabled");
-	}
+		if (fault)
+			return fault;
 
-	void set_limit(float lim) {
-		limit_reached = false;
-		max = lim  / ENC_PULSES_TO_SUPPORT_MM *
-			(float)ratio * MOTOR_PULSES_TO_SUPPORT_MM;
+		/* WAIT until the pass engages on the index */
+		if (index_sync)
+			return motion_is_armed() ? "WAIT" : "SYNC";
+
+		return sup_return ? "+RTN" : "    ";
 	}
 
-	bool check_limit() {
-		bool ret = limit_reached;
-		if (ret)
-			INFO("LIMIT REACHED! (pos = %ld, lim: %ld)",
-				position, max);
-		limit_reached = false;
-		return ret;
+	/* Before the motion stops */
+	virtual void finish() { }
+};
+
+class thread_job : public cut_job
+{
+	uint32_t num;
+	uint32_t den;
+	enum dir dir;
+public:
+	thread_job(uint32_t num, uint32_t den, enum dir dir) :
+		num(num), den(den), dir(dir) { }
+
+	void start() {
+		motion_start(MOTION_SRC_ENCODER, num, den, dir);
+		if (index_sync)
+			motion_arm();
 	}
+};
 
-	void reset() {
-		clear_abs_position();
-		disable();
-		delay_ms(STP_DELAY_MS);
-		enable();
+/* Z and X on one gearbox, the Z limit stops both */
+class taper_job : public cut_job
+{
+	motion_gear gear[MOTION_AXES];
+public:
+	taper_job(uint32_t z_num, uint32_t z_den, uint32_t x_num,
+		  uint32_t x_den, enum dir dir, bool x_in) {
+		gear[MOTION_AXIS_Z] = { z_num, z_den, dir };
+		gear[MOTION_AXIS_X] = { x_num, x_den,
+					(bool)(CROSS_DIR_INVERT ^ x_in) };
 	}
 
-private:
-	bool is_enabled = true;
-	uint32_t ratio;
-	uint32_t cnt = 0;
-	int32_t max = 0;
-	bool limit_reached = false;
-	int32_t position = 0;
-	bool dir_invert = false;
-	enum prev_p { ENC_P_A, ENC_P_B } prev_p = ENC_P_A;
-	enum dir { FRONT, REVERS } direction;
-	delayed_action *pull_down_clk;
-
-	static void pull_down_clk_handler(void *args)
-	{
-		GPIO_SET(STP_CLK_PIN, !STP_CLK_POL);
+	void start() {
+		motion_start_axes(MOTION_SRC_ENCODER, gear, MOTION_AXES);
 	}
+};
 
-	static void motor_step(stepper_ctrl *s)
-	{
-		s->cnt++;
-
-		if (s->direction == dir::REVERS) {
-			s->position++;
-			if (s->max && s->position > s->max) {
-				s->limit_reached = true;
-				return;
-			}
-		} else {
-			s->position--;
-			if (s->max && s->position < -s->max) {
-				s->limit_reached = true;
-				return;
-			}
-		}
+/*
+ * Z follows, X is held and only makes the infeed moves between the
+ * passes; every pass engages on the index. X positions are from the
+ * touch-off, X- into the work.
+ */
+class cycle_job : public cut_job
+{
+	motion_gear gear[MOTION_AXES];
+	infeed_pass pass[INFEED_MAX_PASSES];
+	uint32_t passes;
+	uint32_t next = 0;
+	bool done = false;
+
+	void feed_in() {
+		const infeed_pass& p = pass[next++];
+
+		INFO("Pass %lu/%lu: depth %ld um, shift %ld um", next, passes,
+			p.depth_um, p.shift_um);
+		motion_rapid(MOTION_AXIS_Z, p.shift_um);
+		motion_rapid(MOTION_AXIS_X, -p.depth_um);
+		motion_arm(true);
+	}
+public:
+	cycle_job(uint32_t num, uint32_t den, enum dir dir) {
+		gear[MOTION_AXIS_Z] = { num, den, dir };
+		gear[MOTION_AXIS_X] = { 0, 1, CROSS_DIR_INVERT };
+		passes = infeed_plan((uint64_t)num * ENC_PULSES_TO_SUPPORT_UM /
+			den, pass, INFEED_MAX_PASSES);
+		index_sync = true;
+	}
 
-		if (s->cnt == s->ratio) {
-			s->cnt = 0;
-			GPIO_SET(STP_CLK_PIN, STP_CLK_POL);
-			delayed_action *d = s->pull_down_clk;
-			d->run();
-		}
+	void start() {
+		motion_start_axes(MOTION_SRC_ENCODER, gear, MOTION_AXES);
+		feed_in();
 	}
 
-	static void isr_a(void *params)
-	{
-		stepper_ctrl *s = static_cast<stepper_ctrl *>(params);
-		if (s->prev_p == ENC_P_A)
+	/* Out of the groove first, then back along Z */
+	void limit() {
+		if (!motion_check_limit() || done)
 			return;
-		s->prev_p = ENC_P_A;
 
-		if (s->is_enabled == false)
+		motion_rapid(MOTION_AXIS_X, CYCLE_CLEAR_UM);
+		if (next < passes) {
+			feed_in();
 			return;
-
-		if (GPIO_GET(EXT_ENC_A)) {
-			if (GPIO_GET(EXT_ENC_B)) {
-				GPIO_SET(STP_DIR_PIN, s->dir_invert);
-				s->direction = dir::FRONT;
-			} else {
-				GPIO_SET(STP_DIR_PIN, !s->dir_invert);
-				s->direction = dir::REVERS;
-			}
 		}
+		motion_rapid(MOTION_AXIS_Z, 0);
+		done = true;
+		INFO("Cycle done, %lu passes", passes);
+	}
 
-		motor_step(s);
+	/* Passes are not restarted by hand, ENTER only clears a fault */
+	void enter() {
+		motion_clear_fault();
 	}
 
-	static void isr_b(void *params)
-	{
-		stepper_ctrl *s = static_cast<stepper_ctrl *>(params);
-		if (s->prev_p == ENC_P_B)
-			return;
-		s->prev_p = ENC_P_B;
+	const char *tag() {
+		static char buf[5];
+		const char *fault = fault_tag();
 
-		if (s->is_enabled == false)
-			return;
+		if (fault)
+			return fault;
+		if (done)
+			return "DONE";
+		if (motion_is_armed())
+			return "WAIT";
 
-		motor_step(s);
+		snprintf(buf, sizeof(buf), "P%02lu", next);
+		return buf;
+	}
+
+	/* Left early: do not leave the tool in the groove */
+	void finish() {
+		if (!done)
+			motion_rapid(MOTION_AXIS_X, CYCLE_CLEAR_UM);
 	}
 };
 
-void thread_cut(lcd& lcd,		/* LCD driver */
-		Buttons& btns,		/* Buttons driver */
-		const char *name,	/* Title */
-		float step_mm,		/* Support steps per rotation */
-		enum dir dir,		/* Support movement direction */
-		int32_t limit10,	/* Support movement limit x10 mm */
-		bool sup_return)	/* Automatic support return */
+/* Buttons forwarded to the cutting loop, ends with RETURN */
+struct cut_buttons {
+	Buttons *btns;
+	TaskHandle_t owner;
+};
+
+static void buttons_task(void *arg)
+{
+	cut_buttons *b = static_cast<cut_buttons *>(arg);
+	int press;
+
+	do {
+		press = b->btns->wait();
+		if (press == BUTTON_ENTER)
+			xTaskNotify(b->owner, CUT_EV_ENTER, eSetBits);
+	} while (press != BUTTON_RETURN);
+
+	xTaskNotify(b->owner, CUT_EV_RETURN, eSetBits);
+	vTaskDelete(NULL);
+}
+
+static void refresh_cb(void *arg)
+{
+	xTaskNotify((TaskHandle_t)arg, CUT_EV_REFRESH, eSetBits);
+}
+
+/*
+ * Everything the loop reacts to comes as a bit in this task's notification
+ * value: MOTION_EV_* straight from the motion interrupt, buttons from
+ * buttons_task and CUT_EV_REFRESH from a periodic timer, which also paces
+ * the LCD and the front encoder. A limit is handled as soon as it is
+ * reached, not on the next display refresh.
+ */
+static void cut_loop(lcd& lcd,
+		     Buttons& btns,
+		     cut_job& job,
+		     enum dir dir,
+		     int32_t limit10)
 {
-	uint32_t step = (uint32_t)((float)ENC_PULSES_TO_SUPPORT_MM / step_mm);
+	TaskHandle_t self = xTaskGetCurrentTaskHandle();
+	UBaseType_t prio = uxTaskPriorityGet(NULL);
 	int32_t step_dir = dir == CW ? 1 : -1;
-	float limit = (float)(limit10 * step_dir) / 10;
-	freq_meter meter(EXT_ENC_Z, false);
-	stepper_ctrl stepper_thread_cut(step, dir);
+	int32_t lim10 = limit10 * step_dir;
+
+	vTaskPrioritySet(NULL, CUT_TASK_PRIO);
+
+	/* drop bits left from the last session */
+	xTaskNotifyWait(0, UINT32_MAX, NULL, 0);
+	motion_notify(self);
+	job.start();
+	fan_start();
 	Encoder<int32_t> *enc = nullptr;
 	int32_t enc_prev = 0;
+	char tag_shown[5] = "";
 
 	lcd.clear();
 	if (limit10) {
-		lcd.print(FIRST_ROW, RIGHT, "L:%-5.1f", limit);
-		stepper_thread_cut.set_limit(limit);
-		INFO("Setting limit: %.2f [mm]", limit);
+		lcd.print_fixed<5, 1>(FIRST_ROW, LIMIT_COL, "L:", lim10);
+		/* the sign is for the display, the limit is along the gear */
+		motion_set_limit(limit10);
+		INFO("Setting limit: %ld [0.1 mm]", lim10);
 		enc = new Encoder<int32_t>(ENC_A, ENC_B, Encoder<int32_t>::NONE);
 		enc->set_value(limit10);
 		enc->invert();
 		enc_prev = limit10;
 	}
-	if (sup_return)
-		lcd.print(SECOND_ROW, RIGHT, "+RTN");
-	
-	while (1) {
-		float freq =
-			SPEED_RATIO_CALC(meter.get_frequency<float>());
-		float abs_pos = stepper_thread_cut.get_abs_position();
-
-		lcd.print(FIRST_ROW,  LEFT, "FRQ:%-4.0f", freq);
-		lcd.print(SECOND_ROW, LEFT, "POS:%-6.2f", abs_pos);
-
-		int press = btns.wait(200);
-		if (press == BUTTON_RETURN)
-			break;
-		else if (press == BUTTON_ENTER)
-			stepper_thread_cut.reset();
-
-		/* Semiautomatic support return */
-		if (sup_return && stepper_thread_cut.check_limit()) {
-			int32_t step_to_run = (limit + STP_BACKLASH_MM) * \
-				step_mm  * \
-				MOTOR_PULSES_TO_SUPPORT_MM * step_dir / 10;
-			int32_t backlash = STP_BACKLASH_MM * step_mm * \
-				MOTOR_PULSES_TO_SUPPORT_MM * step_dir / 10;
-			stepper_thread_cut.disable();
-			INFO("steps: %ld, backlash: %ld", step_to_run, backlash);
-			Step_motor m(STP_ENA_PIN,
-				     STP_CLK_PIN,
-				     STP_DIR_PIN,
-				     STP_ACC, 50,
-				     nullptr,
-				     STP_CLK_INVERT,
-				     STP_ENA_INVERT);
-			m.init(true);
-			m.add_segment(step_to_run, STP_SPEED);
-			m.add_segment(-backlash, STP_SPEED);
-			m.run();
-			m.wait();
-			stepper_thread_cut.reset();
-		}
+	INFO("Max spindle speed: %ld RPM", motion_get_max_rpm());
+
+	cut_buttons buttons = { &btns, self };
+	xTaskCreatePinnedToCore(buttons_task, "cut_btns", CUT_BTN_TASK_SIZE,
+		&buttons, CUT_BTN_TASK_PRIO, NULL, UI_CORE);
+
+	esp_timer_handle_t refresh;
+	esp_timer_create_args_t refresh_args = {
+		.callback = refresh_cb,
+		.arg = self,
+		.dispatch_method = ESP_TIMER_TASK,
+		.name = "cut_refresh",
+		.skip_unhandled_events = true,
+	};
+	ESP_ERROR_CHECK(esp_timer_create(&refresh_args, &refresh));
+	ESP_ERROR_CHECK(esp_timer_start_periodic(refresh,
+		CUT_REFRESH_MS * 1000));
+
+	uint32_t ev = CUT_EV_REFRESH;
+	while (!(ev & CUT_EV_RETURN)) {
+		/* first: the support is waiting */
+		if (ev & MOTION_EV_LIMIT)
+			job.limit();
+
+		if (ev & CUT_EV_ENTER)
+			job.enter();
 
 		/* Update support limit using rotary encoder */
 		if (enc && enc->get_value() != enc_prev) {
+			/* the knob turns the magnitude, shown signed as above */
 			enc_prev = enc->get_value();
-			limit = (float)enc_prev / 10;
-			lcd.print(FIRST_ROW, RIGHT, "L:%-5.1f", limit);
-			stepper_thread_cut.set_limit(limit);
+			lim10 = enc_prev * step_dir;
+			lcd.print_fixed<5, 1>(FIRST_ROW, LIMIT_COL, "L:", lim10);
+			motion_set_limit(enc_prev);
+			INFO("Setting limit: %ld [0.1 mm]", lim10);
 		}
+
+		int32_t rpm = motion_get_rpm10() / 10;
+		int32_t pos = motion_get_position_10um();
+
+		/* live values, skip a refresh rather than stall the loop */
+		lcd.try_print_fixed<4, 0>(FIRST_ROW,  0, "FRQ:", rpm);
+		lcd.try_print_fixed<6, 2>(SECOND_ROW, 0, "POS:", pos);
+
+		const char *tag = job.tag();
+		if (strcmp(tag, tag_shown)) {
+			lcd.print(SECOND_ROW, RIGHT, "%s", tag);
+			snprintf(tag_shown, sizeof(tag_shown), "%s", tag);
+		}
+
+		xTaskNotifyWait(0, UINT32_MAX, &ev, portMAX_DELAY);
 	}
 
+	job.finish();
+	esp_timer_stop(refresh);
+	esp_timer_delete(refresh);
 	delete(enc);
+	motion_notify(nullptr);
+	motion_stop();
+	fan_stop();
+	vTaskPrioritySet(NULL, prio);
+}
+
+void thread_cut(lcd& lcd,		/* LCD driver */
+		Buttons& btns,		/* Buttons driver */
+		const char *name,	/* Title */
+		uint32_t num,		/* Support steps per */
+		uint32_t den,		/* encoder edges */
+		enum dir dir,		/* Support movement direction */
+		int32_t limit10,	/* Support movement limit x10 mm */
+		bool sup_return,	/* Automatic support return */
+		bool index_sync)	/* Passes start on the index */
+{
+	thread_job job(num, den, dir);
+
+	job.sup_return = sup_return;
+	job.index_sync = index_sync;
+	cut_loop(lcd, btns, job, dir, limit10);
+}
+
+void taper_cut(lcd& lcd,		/* LCD driver */
+	       Buttons& btns,		/* Buttons driver */
+	       const char *name,	/* Title */
+	       uint32_t z_num,		/* Z steps per */
+	       uint32_t z_den,		/* encoder edges */
+	       uint32_t x_num,		/* X steps per */
+	       uint32_t x_den,		/* encoder edges */
+	       enum dir dir,		/* Z movement direction */
+	       bool x_in,		/* X moves into the work */
+	       int32_t limit10)		/* Z movement limit x10 mm */
+{
+	taper_job job(z_num, z_den, x_num, x_den, dir, x_in);
+
+	/* back along the taper: the tool leaves the work first */
+	job.sup_return = true;
+	cut_loop(lcd, btns, job, dir, limit10);
+}
+
+void thread_cycle(lcd& lcd,		/* LCD driver */
+		  Buttons& btns,	/* Buttons driver */
+		  const char *name,	/* Title */
+		  uint32_t num,		/* Support steps per */
+		  uint32_t den,		/* encoder edges */
+		  enum dir dir,		/* Support movement direction */
+		  int32_t limit10)	/* Thread length x10 mm */
+{
+	cycle_job job(num, den, dir);
+
+	cut_loop(lcd, btns, job, dir, limit10);
 }
@@ -0,0 +1,186 @@
+#include "rapid.h"
+#include "hardware.h"
+#include "log.h"
+#include <math.h>
+#include <inttypes.h>
+
+#include "esp_attr.h"
+
+/* ramp integration step, the crossings are interpolated within it */
+#define RAPID_DT_S		1e-5f
+
+rapid_engine::rapid_engine(step_output& out,
+			   bool dir_invert,
+			   uint32_t max_hz,
+			   uint32_t max_acc,
+			   uint32_t max_jerk) :
+	out(out),
+	dir_invert(dir_invert)
+{
+	build(max_hz, max_acc, max_jerk);
+
+	gptimer_config_t config = {
+		.clk_src = GPTIMER_CLK_SRC_DEFAULT,
+		.direction = GPTIMER_COUNT_UP,
+		.resolution_hz = TIMER_HZ,
+	};
+	ESP_ERROR_CHECK(gptimer_new_timer(&config, &timer));
+
+	gptimer_event_callbacks_t cbs = {
+		.on_alarm = rapid_engine::on_alarm,
+	};
+	ESP_ERROR_CHECK(gptimer_register_event_callbacks(timer, &cbs, this));
+	ESP_ERROR_CHECK(gptimer_enable(timer));
+
+	done = xSemaphoreCreateBinary();
+}
+
+rapid_engine::~rapid_engine()
+{
+	gptimer_disable(timer);
+	gptimer_del_timer(timer);
+	vSemaphoreDelete(done);
+	delete[] ramp;
+}
+
+/*
+ * S-curve from rest to max_hz: jerk up to the peak acceleration, hold it,
+ * jerk down to zero acceleration at full speed. Integrated in float here,
+ * in task context, the interrupt only reads the result.
+ */
+void rapid_engine::build(uint32_t max_hz, uint32_t max_acc, uint32_t max_jerk)
+{
+	float j = max_jerk;
+	float a_peak = fminf(max_acc, sqrtf((float)max_hz * j));
+	float t_j = a_peak / j;
+	float t_a = fmaxf(0, ((float)max_hz - a_peak * t_j) / a_peak);
+	float v = 0, s = 0, last = 0;
+
+	ramp = new uint32_t[MAX_RAMP];
+
+	for (uint32_t i = 1; ramp_len < MAX_RAMP; i++) {
+		float t = i * RAPID_DT_S;
+		float a;
+
+		if (t < t_j)
+			a = j * t;
+		else if (t < t_j + t_a)
+			a = a_peak;
+		else if (t < 2 * t_j + t_a)
+			a = a_peak - j * (t - t_j - t_a);
+		else
+			break;
+
+		v += a * RAPID_DT_S;
+		s += v * RAPID_DT_S;
+
+		if (s >= ramp_len + 1) {
+			float at = t - (s - (ramp_len + 1)) / v;
+			ramp[ramp_len++] = (at - last) * TIMER_HZ;
+			last = at;
+		}
+	}
+
+	/* cruise at exactly max_hz */
+	if (ramp_len < MAX_RAMP)
+		ramp[ramp_len++] = TIMER_HZ / max_hz;
+
+	INFO("Rapid ramp: %" PRIu32 " steps, %" PRIu32 " us to %" PRIu32
+		" steps/s", ramp_len, (uint32_t)(last * 1000000), max_hz);
+}
+
+/* Ticks before step @k of @s: ramp up, cruise, ramp down */
+uint32_t IRAM_ATTR rapid_engine::interval(const segment& s, uint32_t k)
+{
+	uint32_t up = s.n / 2 < ramp_len - 1 ? s.n / 2 : ramp_len - 1;
+
+	if (k < up)
+		return ramp[k];
+	if (s.n - 1 - k < up)
+		return ramp[s.n - 1 - k];
+	return ramp[up];
+}
+
+bool rapid_engine::add(int32_t steps)
+{
+	if (!steps)
+		return true;
+	if (nsegs == MAX_SEGS)
+		return false;
+
+	segs[nsegs].n = steps > 0 ? steps : -steps;
+	segs[nsegs].dir = steps > 0 ? 1 : -1;
+	nsegs++;
+
+	return true;
+}
+
+int32_t rapid_engine::run()
+{
+	if (!nsegs)
+		return 0;
+
+	cur = 0;
+	k = 0;
+	moved = 0;
+	xSemaphoreTake(done, 0);
+
+	ESP_ERROR_CHECK(gptimer_set_raw_count(timer, 0));
+	arm_next(interval(segs[0], 0));
+	ESP_ERROR_CHECK(gptimer_start(timer));
+
+	xSemaphoreTake(done, portMAX_DELAY);
+	nsegs = 0;
+
+	return moved;
+}
+
+uint32_t rapid_engine::duration_us(uint32_t steps)
+{
+	segment s = { steps, 1 };
+	uint64_t ticks = 0;
+
+	for (uint32_t i = 0; i != steps; i++)
+		ticks += interval(s, i);
+
+	return ticks * 1000000 / TIMER_HZ;
+}
+
+void IRAM_ATTR rapid_engine::arm_next(uint32_t ticks)
+{
+	/* the counter restarts at each alarm, latency doesn't add up */
+	gptimer_alarm_config_t alarm = {
+		.alarm_count = ticks,
+		.reload_count = 0,
+		.flags = { .auto_reload_on_alarm = true },
+	};
+	gptimer_set_alarm_action(timer, &alarm);
+}
+
+bool IRAM_ATTR rapid_engine::on_alarm(gptimer_handle_t timer,
+				      const gptimer_alarm_event_data_t *edata,
+				      void *user_ctx)
+{
+	rapid_engine *r = static_cast<rapid_engine *>(user_ctx);
+	const segment& s = r->segs[r->cur];
+
+	if (r->k == 0)
+		r->out.set_dir(s.dir > 0 ? !r->dir_invert : r->dir_invert);
+	r->out.pulse();
+	r->moved += s.dir;
+
+	if (++r->k == s.n) {
+		r->k = 0;
+		if (++r->cur == r->nsegs) {
+			BaseType_t woken = pdFALSE;
+
+			gptimer_stop(timer);
+			xSemaphoreGiveFromISR(r->done, &woken);
+			return woken == pdTRUE;
+		}
+	}
+
+	r->arm_next(r->interval(r->segs[r->cur], r->k));
+
+	return false;
+}
@@ -0,0 +1,334 @@
+#include "spindle.h"
+#include "hardware.h"
+#include "log.h"
+#include <assert.h>
+#include <inttypes.h>
+
+/* ESP32 drivers */
+#include "esp_attr.h"
+#include "esp_random.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+/* Simulated edges per period: rpm x ENC_PULSES_PER_REV x period / 60s */
+#define SIM_EDGES_DIV		((int64_t)ENC_PULSES_PER_REV_DEN * 60000000)
+
+DRAM_ATTR const int8_t quad_decoder::table[16] = {
+	/* prev 00 */  0, -1, +1, ILLEGAL,
+	/* prev 01 */ +1,  0, ILLEGAL, -1,
+	/* prev 10 */ -1, ILLEGAL,  0, +1,
+	/* prev 11 */ ILLEGAL, +1, -1,  0,
+};
+
+void spindle_source::index_start(gpio_num_t z)
+{
+	if (z == GPIO_NUM_NC)
+		return;
+
+	ESP_ERROR_CHECK(gpio_reset_pin(z));
+	ESP_ERROR_CHECK(gpio_set_direction(z, GPIO_MODE_INPUT));
+	ESP_ERROR_CHECK(gpio_set_intr_type(z, GPIO_INTR_POSEDGE));
+	gpio_install_isr_service(0);
+	ESP_ERROR_CHECK(gpio_isr_handler_add(z, spindle_source::index_isr,
+		this));
+}
+
+void spindle_source::index_stop(gpio_num_t z)
+{
+	if (z == GPIO_NUM_NC)
+		return;
+
+	gpio_isr_handler_remove(z);
+	gpio_reset_pin(z);
+}
+
+/* The live count includes edges not delivered yet */
+void IRAM_ATTR spindle_source::index_isr(void *arg)
+{
+	spindle_source *s = static_cast<spindle_source *>(arg);
+
+	s->deliver_index(s->get_count());
+}
+
+void spindle_isr::start(uint32_t batch, spindle_cb_t cb, void *arg)
+{
+	/* every edge is delivered */
+	bind(1, cb, arg);
+
+	ESP_ERROR_CHECK(gpio_reset_pin(pin_a));
+	ESP_ERROR_CHECK(gpio_reset_pin(pin_b));
+	ESP_ERROR_CHECK(gpio_set_direction(pin_a, GPIO_MODE_INPUT));
+	ESP_ERROR_CHECK(gpio_set_direction(pin_b, GPIO_MODE_INPUT));
+	ESP_ERROR_CHECK(gpio_set_intr_type(pin_a, GPIO_INTR_ANYEDGE));
+	ESP_ERROR_CHECK(gpio_set_intr_type(pin_b, GPIO_INTR_ANYEDGE));
+
+	/* single port read needs both pins in GPIO_IN_REG */
+	assert(pin_a < 32 && pin_b < 32);
+	quad.reset(read_ab());
+
+	gpio_install_isr_service(0);
+	ESP_ERROR_CHECK(gpio_isr_handler_add(pin_a, spindle_isr::isr, this));
+	ESP_ERROR_CHECK(gpio_isr_handler_add(pin_b, spindle_isr::isr, this));
+	index_start(pin_z);
+	started = true;
+}
+
+void spindle_isr::stop()
+{
+	if (!started)
+		return;
+
+	index_stop(pin_z);
+	gpio_isr_handler_remove(pin_a);
+	gpio_isr_handler_remove(pin_b);
+	gpio_reset_pin(pin_a);
+	gpio_reset_pin(pin_b);
+	started = false;
+}
+
+uint8_t IRAM_ATTR spindle_isr::read_ab()
+{
+	uint32_t in = REG_READ(GPIO_IN_REG);
+
+	return ((in >> pin_a) & 1) << 1 | ((in >> pin_b) & 1);
+}
+
+void IRAM_ATTR spindle_isr::isr(void *params)
+{
+	spindle_isr *s = static_cast<spindle_isr *>(params);
+	int32_t edges = s->quad.update(s->read_ab());
+
+	/* a missed edge comes as 2, keep one edge per callback */
+	if (edges > 1 || edges < -1) {
+		edges /= 2;
+		s->deliver(edges);
+	}
+	if (edges)
+		s->deliver(edges);
+}
+
+void spindle_pcnt::start(uint32_t batch, spindle_cb_t cb, void *arg)
+{
+	if (batch > INT16_MAX)
+		batch = INT16_MAX;
+
+	bind(batch, cb, arg);
+
+	/* counter wraps to zero at +/- batch, firing the watch point */
+	pcnt_unit_config_t unit_config = {
+		.low_limit = -(int)batch,
+		.high_limit = (int)batch,
+	};
+	ESP_ERROR_CHECK(pcnt_new_unit(&unit_config, &unit));
+
+	pcnt_glitch_filter_config_t filter_config = {
+		.max_glitch_ns = glitch_ns,
+	};
+	ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(unit, &filter_config));
+
+	/* 4x decoding, same sign convention as spindle_isr */
+	pcnt_chan_config_t chan_a_config = {
+		.edge_gpio_num = pin_a,
+		.level_gpio_num = pin_b,
+	};
+	ESP_ERROR_CHECK(pcnt_new_channel(unit, &chan_a_config, &chan_a));
+	ESP_ERROR_CHECK(pcnt_channel_set_edge_action(chan_a,
+		PCNT_CHANNEL_EDGE_ACTION_INCREASE,
+		PCNT_CHANNEL_EDGE_ACTION_DECREASE));
+	ESP_ERROR_CHECK(pcnt_channel_set_level_action(chan_a,
+		PCNT_CHANNEL_LEVEL_ACTION_INVERSE,
+		PCNT_CHANNEL_LEVEL_ACTION_KEEP));
+
+	pcnt_chan_config_t chan_b_config = {
+		.edge_gpio_num = pin_b,
+		.level_gpio_num = pin_a,
+	};
+	ESP_ERROR_CHECK(pcnt_new_channel(unit, &chan_b_config, &chan_b));
+	ESP_ERROR_CHECK(pcnt_channel_set_edge_action(chan_b,
+		PCNT_CHANNEL_EDGE_ACTION_DECREASE,
+		PCNT_CHANNEL_EDGE_ACTION_INCREASE));
+	ESP_ERROR_CHECK(pcnt_channel_set_level_action(chan_b,
+		PCNT_CHANNEL_LEVEL_ACTION_INVERSE,
+		PCNT_CHANNEL_LEVEL_ACTION_KEEP));
+
+	ESP_ERROR_CHECK(pcnt_unit_add_watch_point(unit, batch));
+	ESP_ERROR_CHECK(pcnt_unit_add_watch_point(unit, -(int)batch));
+
+	pcnt_event_callbacks_t cbs = {
+		.on_reach = spindle_pcnt::on_reach,
+	};
+	ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(unit, &cbs, this));
+
+	ESP_ERROR_CHECK(pcnt_unit_enable(unit));
+	ESP_ERROR_CHECK(pcnt_unit_clear_count(unit));
+	ESP_ERROR_CHECK(pcnt_unit_start(unit));
+	index_start(pin_z);
+
+	INFO("PCNT spindle source, %" PRIu32 " edges per event", batch);
+}
+
+void spindle_pcnt::stop()
+{
+	if (!unit)
+		return;
+
+	index_stop(pin_z);
+	pcnt_unit_stop(unit);
+	pcnt_unit_disable(unit);
+	pcnt_del_channel(chan_a);
+	pcnt_del_channel(chan_b);
+	pcnt_del_unit(unit);
+	unit = nullptr;
+}
+
+int32_t IRAM_ATTR spindle_pcnt::get_count()
+{
+	int value = 0;
+
+	if (unit)
+		pcnt_unit_get_count(unit, &value);
+
+	return count + value;
+}
+
+bool IRAM_ATTR spindle_pcnt::on_reach(pcnt_unit_handle_t unit,
+				      const pcnt_watch_event_data_t *edata,
+				      void *user_ctx)
+{
+	spindle_pcnt *s = static_cast<spindle_pcnt *>(user_ctx);
+
+	s->deliver(edata->watch_point_value);
+
+	return false;
+}
+
+void spindle_sim::start(uint32_t batch, spindle_cb_t cb, void *arg)
+{
+	bind(batch, cb, arg);
+	this->batch = batch ? batch : 1;
+
+	gptimer_config_t config = {
+		.clk_src = GPTIMER_CLK_SRC_DEFAULT,
+		.direction = GPTIMER_COUNT_UP,
+		.resolution_hz = 1000000,
+	};
+	ESP_ERROR_CHECK(gptimer_new_timer(&config, &timer));
+
+	gptimer_event_callbacks_t cbs = {
+		.on_alarm = spindle_sim::on_alarm,
+	};
+	ESP_ERROR_CHECK(gptimer_register_event_callbacks(timer, &cbs, this));
+	ESP_ERROR_CHECK(gptimer_enable(timer));
+
+	gptimer_alarm_config_t alarm = {
+		.alarm_count = period_us,
+		.reload_count = 0,
+		.flags = { .auto_reload_on_alarm = true },
+	};
+	ESP_ERROR_CHECK(gptimer_set_alarm_action(timer, &alarm));
+	ESP_ERROR_CHECK(gptimer_start(timer));
+}
+
+void spindle_sim::stop()
+{
+	if (!timer)
+		return;
+
+	gptimer_stop(timer);
+	gptimer_disable(timer);
+	gptimer_del_timer(timer);
+	timer = nullptr;
+}
+
+void IRAM_ATTR spindle_sim::feed(int32_t edges)
+{
+	int32_t b = (int32_t)batch;
+
+	while (edges > b) {
+		deliver(b);
+		check_index();
+		edges -= b;
+	}
+	while (edges < -b) {
+		deliver(-b);
+		check_index();
+		edges += b;
+	}
+	if (edges) {
+		deliver(edges);
+		check_index();
+	}
+}
+
+/* Index at every multiple of EXT_ENC_Z_EDGES, in either direction */
+void IRAM_ATTR spindle_sim::check_index()
+{
+	int32_t t = count >= 0 ? count / EXT_ENC_Z_EDGES :
+		-((EXT_ENC_Z_EDGES - 1 - count) / EXT_ENC_Z_EDGES);
+
+	if (t == turn)
+		return;
+
+	/* the pulse is where the boundary was crossed */
+	deliver_index((t > turn ? t : turn) * EXT_ENC_Z_EDGES);
+	turn = t;
+}
+
+void spindle_sim::set_profile(const sim_segment *seg, uint32_t n, bool loop)
+{
+	profile = nullptr;
+	profile_len = n;
+	this->seg = 0;
+	seg_us = 0;
+	this->loop = loop;
+	rpm = n ? seg[0].rpm_from : rpm;
+	profile = n ? seg : nullptr;
+}
+
+void IRAM_ATTR spindle_sim::tick()
+{
+	const sim_segment *p = profile;
+
+	if (p) {
+		const sim_segment *cur = &p[seg];
+		uint32_t dur_us = cur->duration_ms * 1000;
+
+		rpm = cur->rpm_from + (int64_t)(cur->rpm_to - cur->rpm_from) *
+			seg_us / (dur_us ? dur_us : 1);
+
+		seg_us += period_us;
+		if (seg_us >= dur_us) {
+			seg_us = 0;
+			if (++seg == profile_len) {
+				seg = 0;
+				rpm = cur->rpm_to;
+				if (!loop)
+					profile = nullptr;
+			}
+		}
+	}
+
+	acc += (int64_t)rpm * ENC_PULSES_PER_REV_NUM * period_us;
+	int32_t edges = acc / SIM_EDGES_DIV;
+	acc -= edges * SIM_EDGES_DIV;
+
+	/* shift edges between ticks, the sum stays the same */
+	if (jitter) {
+		int32_t j = esp_random() % (2 * jitter + 1) - jitter;
+		edges += j - last_jitter;
+		last_jitter = j;
+	}
+
+	feed(edges);
+}
+
+bool IRAM_ATTR spindle_sim::on_alarm(gptimer_handle_t timer,
+				     const gptimer_alarm_event_data_t *edata,
+				     void *user_ctx)
+{
+	spindle_sim *s = static_cast<spindle_sim *>(user_ctx);
+
+	s->tick();
+
+	return false;
+}
@@ -0,0 +1,194 @@
+#include "step_out.h"
+#include "spindle.h"
+#include "abs_pos.h"
+#include "log.h"
+#include <esp32_timer.h>
+
+/*
+ * ESP32 drivers. The legacy RMT driver on purpose, its deprecation warning
+ * is off in sdkconfig: a step restarts the preloaded pulse from the motion
+ * interrupt with rmt_ll_*, and the IDF 5.0 rmt_tx.h has no such restart,
+ * its rmt_transmit() waits on a queue and cannot run in an interrupt.
+ */
+#include "driver/rmt.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "hal/gpio_ll.h"
+#include "hal/rmt_ll.h"
+
+#define GPIO_SET(pin, state)	gpio_ll_set_level(&GPIO, pin, state)
+
+/* 80 MHz APB / 80 = 1us per RMT tick */
+#define RMT_CLK_DIV		80
+
+static void enable_pin_init(gpio_num_t ena)
+{
+	ESP_ERROR_CHECK(gpio_reset_pin(ena));
+	ESP_ERROR_CHECK(gpio_set_direction(ena, GPIO_MODE_OUTPUT));
+	ESP_ERROR_CHECK(gpio_set_level(ena, !STP_ENA_POL));
+}
+
+step_out_timer::step_out_timer()
+{
+	ESP_ERROR_CHECK(gpio_reset_pin(clk));
+	ESP_ERROR_CHECK(gpio_reset_pin(dir));
+	ESP_ERROR_CHECK(gpio_set_direction(clk, GPIO_MODE_OUTPUT));
+	ESP_ERROR_CHECK(gpio_set_direction(dir, GPIO_MODE_OUTPUT));
+	ESP_ERROR_CHECK(gpio_set_level(dir, 0));
+	enable_pin_init(ena);
+
+	pull_down_clk = new delayed_action(MOTOR_CLK_PULSE_US,
+		pull_down_clk_handler);
+}
+
+step_out_timer::~step_out_timer()
+{
+	delete(pull_down_clk);
+}
+
+void IRAM_ATTR step_out_timer::pulse()
+{
+	GPIO_SET(clk, STP_CLK_POL);
+	pull_down_clk->run();
+}
+
+void IRAM_ATTR step_out_timer::set_dir(bool level)
+{
+	GPIO_SET(dir, level);
+}
+
+void step_out_timer::set_enable(bool on)
+{
+	GPIO_SET(ena, on ? STP_ENA_POL : !STP_ENA_POL);
+}
+
+void step_out_timer::pull_down_clk_handler(void *args)
+{
+	GPIO_SET(STP_CLK_PIN, !STP_CLK_POL);
+}
+
+step_out_rmt::step_out_rmt(gpio_num_t clk,
+			   gpio_num_t dir,
+			   gpio_num_t ena,
+			   int channel) :
+	clk(clk), dir(dir), ena(ena), channel(channel)
+{
+	rmt_channel_t ch = (rmt_channel_t)channel;
+
+	ESP_ERROR_CHECK(gpio_reset_pin(dir));
+	ESP_ERROR_CHECK(gpio_set_direction(dir, GPIO_MODE_OUTPUT));
+	ESP_ERROR_CHECK(gpio_set_level(dir, 0));
+	enable_pin_init(ena);
+
+	rmt_config_t config = RMT_DEFAULT_CONFIG_TX(clk, ch);
+	config.clk_div = RMT_CLK_DIV;
+	config.tx_config.idle_output_en = true;
+	config.tx_config.idle_level = STP_CLK_POL ?
+		RMT_IDLE_LEVEL_LOW : RMT_IDLE_LEVEL_HIGH;
+	ESP_ERROR_CHECK(rmt_config(&config));
+	ESP_ERROR_CHECK(rmt_driver_install(ch, 0, 0));
+
+	/* DIR setup, pulse, then minimum low time before the next one */
+	rmt_item32_t items[2] = { };
+	items[0].level0 = !STP_CLK_POL;
+	items[0].duration0 = STP_DIR_SETUP_US;
+	items[0].level1 = STP_CLK_POL;
+	items[0].duration1 = STP_PULSE_US;
+	items[1].level0 = !STP_CLK_POL;
+	items[1].duration0 = STP_DIR_HOLD_US;
+	items[1].level1 = !STP_CLK_POL;
+	items[1].duration1 = 0; /* end marker */
+	ESP_ERROR_CHECK(rmt_fill_tx_items(ch, items, 2, 0));
+
+	busy_cycles = esp_rom_get_cpu_ticks_per_us() *
+		(STP_DIR_SETUP_US + STP_PULSE_US + STP_DIR_HOLD_US);
+
+	INFO("RMT step output, max %lu steps/s", MAX_RATE);
+}
+
+step_out_rmt::~step_out_rmt()
+{
+	rmt_driver_uninstall((rmt_channel_t)channel);
+	gpio_reset_pin(clk);
+}
+
+void step_out_rmt::reclaim()
+{
+	ESP_ERROR_CHECK(rmt_set_gpio((rmt_channel_t)channel, RMT_MODE_TX,
+		clk, false));
+	ESP_ERROR_CHECK(gpio_set_direction(dir, GPIO_MODE_OUTPUT));
+}
+
+void IRAM_ATTR step_out_rmt::pulse()
+{
+	/*
+	 * A restart would cut the pulse in flight short: the driver would
+	 * see one step where abs_pos counts two. Within max_rate() this never
+	 * waits, the count says how often the gear asked for more.
+	 */
+	if (esp_cpu_get_cycle_count() - last_pulse < busy_cycles) {
+		late++;
+		while (esp_cpu_get_cycle_count() - last_pulse < busy_cycles)
+			;
+	}
+
+	last_pulse = esp_cpu_get_cycle_count();
+	rmt_ll_tx_reset_pointer(&RMT, channel);
+	rmt_ll_tx_start(&RMT, channel);
+}
+
+void IRAM_ATTR step_out_rmt::set_dir(bool level)
+{
+	/* let the pulse in flight finish and honour the hold time */
+	while (esp_cpu_get_cycle_count() - last_pulse < busy_cycles)
+		;
+
+	GPIO_SET(dir, level);
+}
+
+void step_out_rmt::set_enable(bool on)
+{
+	GPIO_SET(ena, on ? STP_ENA_POL : !STP_ENA_POL);
+}
+
+void IRAM_ATTR step_out_sim::pulse()
+{
+	position += dir ? 1 : -1;
+	steps++;
+
+	if (n == log_size)
+		return;
+
+	step_record *r = &log[n++];
+	r->time_us = esp_timer_get_time();
+	r->spindle = spindle ? spindle->get_count() : 0;
+	r->position = position;
+}
+
+void IRAM_ATTR step_out_tracked::pulse()
+{
+	out->pulse();
+	if (enabled)
+		abs_pos_step(step);
+}
+
+void IRAM_ATTR step_out_tracked::take_up()
+{
+	out->pulse();
+	if (enabled)
+		abs_pos_take_up(step);
+}
+
+void IRAM_ATTR step_out_tracked::set_dir(bool level)
+{
+	out->set_dir(level);
+	step = level ? 1 : -1;
+}
+
+void step_out_tracked::set_enable(bool on)
+{
+	out->set_enable(on);
+	enabled = on;
+}
@@ -0,0 +1,360 @@
+#include "stepper_ctrl.h"
+#include "motion_stats.h"
+#include "motion.h"
+#include "hardware.h"
+#include "log.h"
+#include <free_rtos_h.h>
+#include <inttypes.h>
+
+#include "esp_attr.h"
+
+stepper_ctrl::stepper_ctrl(step_output& out,
+			   const axis_config& axis,
+			   uint32_t num,
+			   uint32_t den,
+			   bool dir_invert) :
+	out(out),
+	axis(axis),
+	gear(num, den),
+	rapid(out, dir_invert, limit_hz(out), STP_MAX_ACC_HZ_S,
+	      STP_MAX_JERK_HZ_S2),
+	dir_invert(dir_invert),
+	backlash((uint64_t)axis.backlash_um * axis.steps_mm_num /
+		 (axis.steps_mm_den * 1000), STP_BACKLASH_HZ,
+		 limit_hz(out), stepper_ctrl::on_take_up, this)
+{
+	uint32_t max_hz = limit_hz(out);
+
+	/* a held axis has no rate to plan for */
+	if (num) {
+		planner.set(num, den, max_hz, STP_MAX_ACC_HZ_S);
+		ramp.set(num, den, max_hz, STP_LIMIT_DEC_HZ_S);
+		INFO("%s: max spindle speed %" PRId32 " RPM "
+			"(%" PRIu32 " steps/s)", axis.name, planner.max_rpm(),
+			max_hz);
+		INFO("%s: limit ramp from %" PRIu32 " steps out", axis.name,
+			ramp.get_zone());
+	}
+
+	set_enable(true);
+}
+
+/* Whichever is slower, the output or the motor */
+uint32_t stepper_ctrl::limit_hz(step_output& out)
+{
+	uint32_t max_hz = out.max_rate();
+
+	return max_hz < STP_MAX_STEP_HZ ? max_hz : STP_MAX_STEP_HZ;
+}
+
+int32_t stepper_ctrl::um_to_steps(int32_t um)
+{
+	return (int64_t)um * axis.steps_mm_num / (axis.steps_mm_den * 1000);
+}
+
+/* DIR @level (+1 high, -1 low, 0 unknown) as a step of this session */
+int32_t stepper_ctrl::step_dir(int32_t level)
+{
+	if (!level)
+		return 0;
+
+	return (level > 0) != dir_invert ? 1 : -1;
+}
+
+stepper_ctrl::~stepper_ctrl()
+{
+	INFO("%s: reversals: %" PRIu32, axis.name,
+		backlash.get_reversals());
+	set_enable(false);
+}
+
+void stepper_ctrl::set_id(uint8_t id)
+{
+	this->id = id;
+	backlash.set_id(id);
+
+	/* all a replay needs to build the same axis */
+	trace_cmd(id, TRACE_CMD_NUM, gear.get_num());
+	trace_cmd(id, TRACE_CMD_DEN, gear.get_den());
+	trace_cmd(id, TRACE_CMD_RATE, out.max_rate());
+	trace_cmd(id, TRACE_CMD_AXIS, axis.name[0] | dir_invert << 8);
+}
+
+void stepper_ctrl::set_slack(int32_t level)
+{
+	trace_cmd(id, TRACE_CMD_SLACK, level);
+	backlash.reset(step_dir(level));
+}
+
+void stepper_ctrl::clear_abs_position()
+{
+	position = 0;
+	gear.reset();
+	check_limit();
+}
+
+void stepper_ctrl::set_enable(bool on)
+{
+	out.set_enable(on);
+	is_enabled = on;
+	INFO("Stepper %s %s", axis.name, on ? "enabled" : "disabled");
+}
+
+void stepper_ctrl::set_limit(int32_t lim10)
+{
+	trace_cmd(id, TRACE_CMD_LIMIT, lim10);
+	limit_reached = false;
+	limit_us = 0;
+	max = um_to_steps(lim10 * 100);
+}
+
+bool stepper_ctrl::check_limit()
+{
+	bool ret = limit_reached.exchange(false);
+	if (ret)
+		INFO("%s LIMIT REACHED! (pos = %" PRId32 ", lim: %" PRId32
+			")", axis.name, position, max);
+	return ret;
+}
+
+void stepper_ctrl::reset()
+{
+	trace_cmd(id, TRACE_CMD_RESET);
+	clear_abs_position();
+	set_enable(false);
+	delay_ms(STP_DELAY_MS);
+	set_enable(true);
+}
+
+void stepper_ctrl::clear_fault()
+{
+	trace_cmd(id, TRACE_CMD_CLEAR_FAULT);
+	planner.clear();
+	spindle_stop(false);
+}
+
+/* Edges are ignored meanwhile */
+void stepper_ctrl::rapid_to(int32_t um)
+{
+	trace_cmd(id, TRACE_CMD_RAPID, um);
+	sync = SYNC_HOLD;
+	wait_backlash();
+	set_enable(true);
+	if (limit_us) {
+		MSTAT_RETURN(esp_timer_get_time() - limit_us);
+		limit_us = 0;
+	}
+	move(um_to_steps(um) - position);
+	INFO("%s at %" PRId32, axis.name, position);
+}
+
+void stepper_ctrl::resume()
+{
+	trace_cmd(id, TRACE_CMD_RESUME);
+	clear_abs_position();
+	sync = SYNC_FOLLOW;
+}
+
+/*
+ * Overshoots by the axis overshoot and comes back, so the backlash is
+ * taken up against the move, i.e. in the cutting direction of a return.
+ */
+void stepper_ctrl::move(int32_t steps)
+{
+	int32_t over = um_to_steps(axis.overshoot_um);
+
+	if (steps < 0)
+		over = -over;
+
+	if (steps) {
+		rapid.add(steps + over);
+		if (over)
+			rapid.add(-over);
+		position += rapid.run();
+
+		int32_t last = over ? -over : steps;
+		backlash.reset(last > 0 ? 1 : -1);
+	}
+	/* the engine moved the direction pin */
+	last_step = 0;
+}
+
+/* Unlike reset(), the driver stays powered and keeps its microstep */
+void stepper_ctrl::arm(bool keep)
+{
+	trace_cmd(id, TRACE_CMD_ARM, keep);
+	sync = SYNC_HOLD;
+	wait_backlash();
+	if (keep) {
+		gear.reset();
+		check_limit();
+	} else {
+		clear_abs_position();
+	}
+	set_enable(true);
+	sync = SYNC_ARMED;
+	INFO("%s armed at %" PRId32 ", waiting for the index", axis.name,
+		position);
+}
+
+/* Following is held, let the kept steps out before the position is used */
+void stepper_ctrl::wait_backlash()
+{
+	while (backlash.is_busy())
+		vTaskDelay(1);
+}
+
+/*
+ * The listener switches in when this interrupt returns rather than at the
+ * next tick, whichever core it runs on: the other one gets its own yield
+ * request from the notify.
+ */
+void IRAM_ATTR stepper_ctrl::notify(stepper_ctrl *s, uint32_t bits)
+{
+	TaskHandle_t task = s->listener;
+	BaseType_t woken = pdFALSE;
+
+	if (!task)
+		return;
+	xTaskNotifyFromISR(task, bits, eSetBits, &woken);
+	portYIELD_FROM_ISR(woken);
+}
+
+void IRAM_ATTR stepper_ctrl::hit_limit()
+{
+	if (!limit_reached.exchange(true)) {
+		trace(TRACE_LIMIT, id, 0, position);
+		limit_us = esp_timer_get_time();
+		notify(this, MOTION_EV_LIMIT);
+	}
+}
+
+void IRAM_ATTR stepper_ctrl::set_dir(stepper_ctrl *s, int32_t step)
+{
+	if (step != s->last_step) {
+		s->out.set_dir(step > 0 ? !s->dir_invert : s->dir_invert);
+		s->last_step = step;
+	}
+}
+
+void IRAM_ATTR stepper_ctrl::motor_step(stepper_ctrl *s, int32_t step)
+{
+	/* after a reversal the timer makes it, once the slack is taken up */
+	if (s->backlash.defer(step))
+		return;
+
+	carriage_step(s, step);
+}
+
+void IRAM_ATTR stepper_ctrl::carriage_step(stepper_ctrl *s, int32_t step)
+{
+	if (s->max && (step > 0 ? s->position >= s->max :
+				  s->position <= -s->max)) {
+		s->hit_limit();
+		return;
+	}
+
+	set_dir(s, step);
+	s->position += step;
+	s->out.pulse();
+	MSTAT_STEP();
+	trace(TRACE_STEP, s->id, step, s->position);
+}
+
+/* From the backlash timer */
+void IRAM_ATTR stepper_ctrl::on_take_up(void *arg, int32_t step, bool take_up)
+{
+	stepper_ctrl *s = static_cast<stepper_ctrl *>(arg);
+
+	if (!take_up) {
+		carriage_step(s, step);
+		return;
+	}
+
+	set_dir(s, step);
+	s->out.take_up();
+	trace(TRACE_TAKE_UP, s->id, step, s->position);
+}
+
+/*
+ * Share of the next @edges this axis can follow, Q16: all of it unless
+ * it is braking into its limit, none once it is on it. The estimate is
+ * only read near the limit.
+ */
+int32_t IRAM_ATTR stepper_ctrl::allow(int32_t edges, const spindle_est& est)
+{
+	if (!max || !edges || !follows() ||
+	    sync.load(std::memory_order_relaxed) != SYNC_FOLLOW)
+		return limit_ramp::ONE;
+
+	int32_t left = edges > 0 ? max - position : max + position;
+	if (left <= 0) {
+		hit_limit();
+		return 0;
+	}
+	if (!ramp.near(left))
+		return limit_ramp::ONE;
+
+	return ramp.scale(left, est.get().vel);
+}
+
+/* @count is the spindle count after the @edges, which may be scaled down */
+void IRAM_ATTR stepper_ctrl::follow(int32_t edges, int32_t count)
+{
+	if (is_enabled == false)
+		return;
+
+	int sync = this->sync.load(std::memory_order_acquire);
+	if (sync != SYNC_FOLLOW) {
+		if (sync != SYNC_ENGAGE)
+			return;
+
+		/* only the edges past the index pulse count */
+		int32_t max = gear.max_batch();
+		edges = count - engage_at.load(std::memory_order_relaxed);
+		if (edges > max)
+			edges = max;
+		else if (edges < -max)
+			edges = -max;
+		this->sync.store(SYNC_FOLLOW, std::memory_order_relaxed);
+	}
+
+	int32_t step = gear.advance(edges);
+	if (step)
+		motor_step(this, step);
+}
+
+/* After the steps, the estimate is from the previous event */
+void IRAM_ATTR stepper_ctrl::plan(const spindle_est_state& st)
+{
+	if (!follows() || planner.get_fault() != PLAN_OK)
+		return;
+
+	if (planner.check(st.vel, st.acc)) {
+		spindle_stop(true);
+		notify(this, MOTION_EV_FAULT);
+	}
+}
+
+void IRAM_ATTR stepper_ctrl::index(int32_t count)
+{
+	if (sync.load(std::memory_order_relaxed) != SYNC_ARMED)
+		return;
+
+	if (has_ref) {
+		int32_t d = (count - ref) % EXT_ENC_Z_SYNC_EDGES;
+		if (d < 0)
+			d += EXT_ENC_Z_SYNC_EDGES;
+
+		/* same spindle angle, give or take a few missed edges */
+		if (d > EXT_ENC_Z_EDGES / 2 &&
+		    d < EXT_ENC_Z_SYNC_EDGES - EXT_ENC_Z_EDGES / 2)
+			return;
+	} else {
+		ref = count;
+		has_ref = true;
+	}
+
+	engage_at.store(count, std::memory_order_relaxed);
+	sync.store(SYNC_ENGAGE, std::memory_order_release);
+}
@@ -0,0 +1,89 @@
+#include "stress.h"
+#include "motion.h"
+#include "motion_stats.h"
+#include "hardware.h"
+#include "log.h"
+#include <free_rtos_h.h>
+#include <stdio.h>
+#include <atomic>
+#include "lwip/sockets.h"
+
+#define STRESS_RPM			1000
+#define STRESS_PITCH_UM			1000
+#define STRESS_MS			5000
+#define STRESS_UDP_PORT			9 /* discard */
+#define STRESS_UDP_SIZE			1400
+#define STRESS_TASK_SIZE		0x1000
+
+static std::atomic<bool> flooding;
+
+/* Broadcast datagrams as fast as the stack takes them */
+static void wifi_flood(void *arg)
+{
+	static char buf[STRESS_UDP_SIZE];
+	struct sockaddr_in dst = { };
+	int on = 1;
+
+	dst.sin_family = AF_INET;
+	dst.sin_port = htons(STRESS_UDP_PORT);
+	dst.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+
+	int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock >= 0)
+		setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+
+	while (flooding) {
+		if (sock < 0 || sendto(sock, buf, sizeof(buf), 0,
+				(struct sockaddr *)&dst, sizeof(dst)) < 0)
+			vTaskDelay(1);
+	}
+
+	if (sock >= 0)
+		close(sock);
+	vTaskDelete(NULL);
+}
+
+static void stress_pass(lcd& lcd, bool load, char *summary, size_t size)
+{
+	motion_stats_clear();
+
+	if (load) {
+		flooding = true;
+		xTaskCreatePinnedToCore(wifi_flood, "flood", STRESS_TASK_SIZE,
+			NULL, 1, NULL, UI_CORE);
+	}
+
+	for (int32_t ms = 0; ms < STRESS_MS; ms += 10) {
+		/* keep the lcd ring full, every message is a new frame */
+		for (uint32_t i = 0; load && i != LCD_RING_SIZE; i++)
+			lcd.try_print_fixed<6, 0>(SECOND_ROW, 0, "LOAD:",
+				ms + i);
+		delay_ms(10);
+	}
+
+	flooding = false;
+	INFO("Stress %s, lcd dropped %lu", load ? "loaded" : "idle",
+		lcd.get_dropped());
+	motion_stats_dump();
+	snprintf(summary, size, "%s", motion_stats_summary(MSTAT_HIST_STEP));
+}
+
+const char *stress_test(lcd& lcd)
+{
+	static char buf[LCD_COLS + 1];
+	char idle[24], loaded[24];
+
+	motion_start(MOTION_SRC_SIM, STRESS_PITCH_UM,
+		ENC_PULSES_TO_SUPPORT_UM, false, STRESS_RPM);
+
+	stress_pass(lcd, false, idle, sizeof(idle));
+	stress_pass(lcd, true, loaded, sizeof(loaded));
+
+	motion_stop();
+	delay_ms(100);	/* let the flood task go */
+
+	INFO("Step latency idle %s, loaded %s", idle, loaded);
+	snprintf(buf, sizeof(buf), "%s", loaded);
+
+	return buf;
+}
@@ -0,0 +1,317 @@
+#include "telemetry.h"
+#include "motion.h"
+#include "motion_stats.h"
+#include "hardware.h"
+#include "lcd.h"
+#include "log.h"
+#include <free_rtos_h.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include "lwip/sockets.h"
+
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+
+#define TELEM_TASK_SIZE			0x1000
+#define TELEM_TEST_MS			5000
+#define TELEM_TEST_HZ			100
+#define TELEM_TEST_PORT			(TELEM_PORT + 1)
+#define TELEM_TEST_RPM			1000
+#define TELEM_TEST_PITCH_UM		1000
+#define TELEM_TEST_RX_MS		100 /* after the last frame */
+
+static_assert(TELEM_AXES == MOTION_AXES, "one telemetry column per axis");
+static_assert(TELEM_FRAME_SAMPLES <= 255, "telem_frame_hdr n is 8 bits");
+
+struct telem_frame {
+	telem_frame_hdr hdr;
+	telem_sample s[TELEM_FRAME_SAMPLES];
+};
+
+static_assert(sizeof(telem_frame) == TELEM_FRAME_SIZE(TELEM_FRAME_SAMPLES),
+	      "no padding on the wire");
+
+static TaskHandle_t task;
+static int sock = -1;
+
+/* Set by the UI task, read by the sampling one */
+static std::atomic<uint32_t> rate;
+static std::atomic<uint32_t> dst_addr;
+static std::atomic<uint16_t> dst_port;
+
+/* From the sampling task */
+static std::atomic<uint32_t> sent;
+static std::atomic<uint32_t> lost;
+static std::atomic<uint32_t> samples;
+static std::atomic<uint32_t> cycles;	/* per sample, average */
+
+/* Only the sampling task touches these */
+static telem_frame frame;
+static uint32_t seq;
+static int64_t prev_us;
+static int32_t prev_steps[MOTION_AXES];
+static uint32_t prev_busy;
+
+static void telem_sample_now(telem_sample *s)
+{
+	motion_status st;
+	int64_t now = esp_timer_get_time();
+	uint32_t busy = motion_stats_busy();
+
+	motion_get_status(&st);
+
+	int64_t dt = prev_us ? now - prev_us : 0;
+
+	*s = {
+		.t_ms = (uint32_t)(now / 1000),
+		.rpm10 = st.rpm10,
+		.rpm_s = st.rpm_s,
+	};
+	for (uint32_t i = 0; i < MOTION_AXES; i++) {
+		s->pos_10um[i] = st.pos_10um[i];
+		/* a zeroed position shows as one odd sample */
+		if (dt)
+			s->step_hz[i] = (int64_t)(st.steps[i] -
+				prev_steps[i]) * 1000000 / dt;
+		prev_steps[i] = st.steps[i];
+	}
+	if (dt) {
+		uint64_t all = dt * esp_rom_get_cpu_ticks_per_us();
+		uint64_t load = (uint64_t)(busy - prev_busy) * 10000 / all;
+
+		s->isr_load = load < UINT16_MAX ? load : UINT16_MAX;
+	}
+
+	s->flags = (st.running ? TELEM_F_RUNNING : 0) |
+		(st.armed ? TELEM_F_ARMED : 0) |
+		(st.fault != PLAN_OK ? TELEM_F_FAULT : 0) |
+		(st.at_limit[MOTION_AXIS_Z] ? TELEM_F_LIMIT_Z : 0) |
+		(st.at_limit[MOTION_AXIS_X] ? TELEM_F_LIMIT_X : 0);
+
+	prev_us = now;
+	prev_busy = busy;
+}
+
+/* Never waits: what the stack cannot take now is lost */
+static void telem_send(uint32_t n, uint32_t hz)
+{
+	struct sockaddr_in dst = { };
+
+	dst.sin_family = AF_INET;
+	dst.sin_port = htons(dst_port.load());
+	dst.sin_addr.s_addr = dst_addr.load();
+
+	frame.hdr = {
+		.magic = TELEM_MAGIC,
+		.version = TELEM_VERSION,
+		.n = (uint8_t)n,
+		.rate_hz = (uint8_t)hz,
+		.seq = seq++,
+		.lost = lost,
+	};
+	memset(frame.s + n, 0,
+	       (TELEM_FRAME_SAMPLES - n) * sizeof(telem_sample));
+
+	if (sendto(sock, &frame, sizeof(frame), MSG_DONTWAIT,
+		   (struct sockaddr *)&dst, sizeof(dst)) < 0)
+		lost++;
+	else
+		sent++;
+}
+
+static void telem_task(void *arg)
+{
+	TickType_t wake = 0;
+	uint32_t hz = 0, n = 0;
+	uint64_t total = 0;
+
+	while (1) {
+		if (!rate) {
+			/* the rest of the last frame, then wait for a start */
+			if (n)
+				telem_send(n, hz);
+			n = 0;
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+			seq = 0;
+			prev_us = 0;
+			total = 0;
+			wake = xTaskGetTickCount();
+			continue;
+		}
+
+		hz = rate;
+		TickType_t period = pdMS_TO_TICKS(1000 / hz);
+		vTaskDelayUntil(&wake, period ? period : 1);
+
+		uint32_t c0 = esp_cpu_get_cycle_count();
+
+		telem_sample_now(&frame.s[n++]);
+		if (n == TELEM_FRAME_SAMPLES) {
+			telem_send(n, hz);
+			n = 0;
+		}
+
+		total += esp_cpu_get_cycle_count() - c0;
+		samples++;
+		cycles = total / samples;
+	}
+}
+
+void telemetry_init()
+{
+	xTaskCreatePinnedToCore(telem_task, "telemetry", TELEM_TASK_SIZE,
+		NULL, TELEM_TASK_PRIO, &task, UI_CORE);
+}
+
+void telemetry_start(const char *ip, uint16_t port, uint32_t rate_hz)
+{
+	if (sock < 0)
+		sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		ERROR("Telemetry: no socket");
+		return;
+	}
+
+	dst_addr = inet_addr(ip);
+	dst_port = port;
+	sent = 0;
+	lost = 0;
+	samples = 0;
+	cycles = 0;
+	rate = rate_hz;
+	xTaskNotifyGive(task);
+	INFO("Telemetry to %s:%u at %" PRIu32 " Hz", ip, port, rate_hz);
+}
+
+void telemetry_stop()
+{
+	rate = 0;
+	xTaskNotifyGive(task);
+}
+
+uint32_t telemetry_get_rate()
+{
+	return rate;
+}
+
+uint32_t telemetry_get_sent()
+{
+	return sent;
+}
+
+uint32_t telemetry_get_lost()
+{
+	return lost;
+}
+
+uint32_t telemetry_get_cycles()
+{
+	return cycles;
+}
+
+/* Frames that arrived and their samples taken at the simulated speed */
+struct telem_rx {
+	uint32_t frames;
+	uint32_t samples;
+	uint32_t at_speed;
+};
+
+static void telem_rx_frame(telem_rx *rx, const telem_frame *f, int len)
+{
+	if (len != sizeof(*f) || f->hdr.magic != TELEM_MAGIC ||
+	    f->hdr.version != TELEM_VERSION ||
+	    f->hdr.n > TELEM_FRAME_SAMPLES) {
+		ERROR("Telemetry test: bad frame, %d bytes", len);
+		return;
+	}
+
+	rx->frames++;
+
+	for (uint32_t i = 0; i < f->hdr.n; i++) {
+		int32_t d = f->s[i].rpm10 - TELEM_TEST_RPM * 10;
+
+		rx->samples++;
+		if (d > -TELEM_TEST_RPM / 10 && d < TELEM_TEST_RPM / 10)
+			rx->at_speed++;
+	}
+}
+
+const char *telemetry_test()
+{
+	static char buf[40];
+	static telem_frame f;
+	struct sockaddr_in addr = { };
+	struct timeval tv = { 0, TELEM_TEST_RX_MS * 1000 };
+	telem_rx rx = { };
+
+	uint32_t was_rate = rate;
+	uint32_t was_addr = dst_addr;
+	uint16_t was_port = dst_port;
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(TELEM_TEST_PORT);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	int rx_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (rx_sock < 0 ||
+	    bind(rx_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		if (rx_sock >= 0)
+			close(rx_sock);
+		return "NO SOCKET";
+	}
+	setsockopt(rx_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	motion_start(MOTION_SRC_SIM, TELEM_TEST_PITCH_UM,
+		ENC_PULSES_TO_SUPPORT_UM, false, TELEM_TEST_RPM);
+
+	int64_t t0 = esp_timer_get_time();
+	telemetry_start("127.0.0.1", TELEM_TEST_PORT, TELEM_TEST_HZ);
+
+	/* then until nothing more comes, the last frame is flushed on stop */
+	bool stopped = false;
+	while (1) {
+		int len = recv(rx_sock, &f, sizeof(f), 0);
+
+		if (len > 0)
+			telem_rx_frame(&rx, &f, len);
+		if (!stopped &&
+		    esp_timer_get_time() - t0 > TELEM_TEST_MS * 1000LL) {
+			telemetry_stop();
+			stopped = true;
+		} else if (stopped && len < 0) {
+			break;
+		}
+	}
+	int64_t us = esp_timer_get_time() - t0;
+
+	motion_stop();
+	close(rx_sock);
+
+	uint32_t frames = telemetry_get_sent() + telemetry_get_lost();
+	uint64_t busy = (uint64_t)telemetry_get_cycles() * samples;
+	uint32_t cpu = busy * 10000 / (us * esp_rom_get_cpu_ticks_per_us());
+
+	INFO("Telemetry loopback: %" PRIu32 " of %" PRIu32 " frames, %" PRIu32
+		" not sent, %" PRIu32 " samples, %" PRIu32 " at %d RPM",
+		rx.frames, frames, telemetry_get_lost(), rx.samples,
+		rx.at_speed, TELEM_TEST_RPM);
+	INFO("Telemetry cost: %" PRIu32 " cycles/sample, %" PRIu32 ".%02" PRIu32
+		"%% of core %d", telemetry_get_cycles(), cpu / 100, cpu % 100,
+		UI_CORE);
+
+	snprintf(buf, sizeof(buf), "L:%" PRIu32 "/%" PRIu32 " C:%" PRIu32
+		".%02" PRIu32 "%%", frames - rx.frames, frames, cpu / 100,
+		cpu % 100);
+
+	/* back to the server, if it was streaming there */
+	if (was_rate) {
+		struct in_addr a = { .s_addr = was_addr };
+		telemetry_start(inet_ntoa(a), was_port, was_rate);
+	}
+
+	return buf;
+}
@@ -0,0 +1,139 @@
+#include "trace.h"
+#include "hardware.h"
+#include "log.h"
+#include <free_rtos_h.h>
+#include <string.h>
+
+#include "esp_attr.h"
+#include "driver/uart.h"
+
+#define TRACE_TASK_SIZE		0x800
+#define TRACE_UART_RX_BUF	256 /* unused, the driver wants one */
+#define TRACE_UART_TX_BUF	4096
+
+#if MOTION_TRACE
+DRAM_ATTR trace_ring_t trace_ring;
+DRAM_ATTR std::atomic<bool> trace_on { false };
+DRAM_ATTR std::atomic<uint32_t> trace_dropped { 0 };
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t sent;
+
+/* The interrupts write without a lock, keep them out meanwhile */
+void trace_cmd(uint8_t axis, enum trace_cmd cmd, uint32_t val)
+{
+	portENTER_CRITICAL(&lock);
+	trace(TRACE_CMD, axis, cmd, val);
+	portEXIT_CRITICAL(&lock);
+}
+
+/* Sync, header, records and CRC, back to back */
+#define TRACE_FRAME_MAX		(2 + sizeof(trace_frame_hdr) + \
+				 TRACE_FRAME_RECS * sizeof(trace_rec) + 2)
+
+/* Frames as they fill up, never more than TRACE_DRAIN_MS late */
+static void trace_task(void *arg)
+{
+	static uint8_t frame[TRACE_FRAME_MAX] = { TRACE_SYNC0, TRACE_SYNC1 };
+	uint8_t *recs = frame + 2 + sizeof(trace_frame_hdr);
+	uint8_t seq = 0;
+
+	while (1) {
+		trace_rec rec;
+		uint32_t n = 0;
+
+		while (n != TRACE_FRAME_RECS && trace_ring.pop(rec))
+			memcpy(recs + n++ * sizeof(rec), &rec, sizeof(rec));
+		if (!n) {
+			vTaskDelay(pdMS_TO_TICKS(TRACE_DRAIN_MS));
+			continue;
+		}
+
+		trace_frame_hdr hdr = {
+			.seq = seq++,
+			.n = (uint8_t)n,
+			.version = TRACE_VERSION,
+			.dropped = trace_dropped.load(std::memory_order_relaxed),
+		};
+		memcpy(frame + 2, &hdr, sizeof(hdr));
+
+		size_t len = sizeof(hdr) + n * sizeof(trace_rec);
+		uint16_t crc = trace_crc16(0xffff, frame + 2, len);
+
+		frame[2 + len] = crc;
+		frame[3 + len] = crc >> 8;
+		/* blocks on the driver buffer, the ring takes the slack */
+		uart_write_bytes(TRACE_UART, frame, 2 + len + 2);
+		sent += n;
+	}
+}
+
+void trace_init()
+{
+	uart_config_t config = {
+		.baud_rate = TRACE_BAUD,
+		.data_bits = UART_DATA_8_BITS,
+		.parity = UART_PARITY_DISABLE,
+		.stop_bits = UART_STOP_BITS_1,
+		.flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+		.source_clk = UART_SCLK_DEFAULT,
+	};
+
+	ESP_ERROR_CHECK(uart_driver_install(TRACE_UART, TRACE_UART_RX_BUF,
+		TRACE_UART_TX_BUF, 0, NULL, 0));
+	ESP_ERROR_CHECK(uart_param_config(TRACE_UART, &config));
+	ESP_ERROR_CHECK(uart_set_pin(TRACE_UART, TRACE_TX_PIN,
+		UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+
+	xTaskCreatePinnedToCore(trace_task, "trace", TRACE_TASK_SIZE, NULL,
+		TRACE_TASK_PRIO, NULL, UI_CORE);
+	INFO("Motion trace on UART%d, %d baud", TRACE_UART, TRACE_BAUD);
+}
+
+void trace_enable(bool on)
+{
+	if (on && !trace_on) {
+		trace_dropped = 0;
+		sent = 0;
+	}
+	trace_on = on;
+	INFO("Motion trace %s", on ? "on" : "off");
+}
+
+bool trace_is_enabled()
+{
+	return trace_on;
+}
+
+uint32_t trace_get_sent()
+{
+	return sent;
+}
+
+uint32_t trace_get_dropped()
+{
+	return trace_dropped;
+}
+#else
+void trace_init() { }
+
+void trace_enable(bool on)
+{
+	INFO("motion trace disabled (MOTION_TRACE = 0)");
+}
+
+bool trace_is_enabled()
+{
+	return false;
+}
+
+uint32_t trace_get_sent()
+{
+	return 0;
+}
+
+uint32_t trace_get_dropped()
+{
+	return 0;
+}
+#endif
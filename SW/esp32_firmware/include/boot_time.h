@@ -0,0 +1,94 @@
+#ifndef __BOOT_TIME_H__
+#define __BOOT_TIME_H__
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <atomic>
+#include <free_rtos_h.h>
+#include <log.h>
+#include "esp_timer.h"
+
+/*
+ * Boot timeline: when each init stage began and ended, on which core, in
+ * us since the esp_timer started (right after the bootloader). Stages run
+ * from different tasks at once, a slot is claimed with one atomic add and
+ * only its owner writes it. Marks are stages of no length: "app_main",
+ * "ready" once the menu shows, "fw confirmed".
+ *
+ * Header only, so the lcd in the api component records its stage too.
+ */
+#define BOOT_STAGES_MAX		16
+
+struct boot_stage {
+	const char *name;
+	int64_t begin_us;
+	int64_t end_us;		/* 0 while it runs */
+	int core;
+};
+
+inline boot_stage boot_stages[BOOT_STAGES_MAX];
+inline std::atomic<uint32_t> boot_count;
+inline std::atomic<int64_t> boot_ready_us;
+
+/* The slot for boot_end(), -1 once the table is full */
+static inline int boot_begin(const char *name)
+{
+	uint32_t i = boot_count.fetch_add(1);
+
+	if (i >= BOOT_STAGES_MAX)
+		return -1;
+	boot_stages[i] = { name, esp_timer_get_time(), 0, xPortGetCoreID() };
+	return i;
+}
+
+static inline void boot_end(int stage)
+{
+	if (stage >= 0)
+		boot_stages[stage].end_us = esp_timer_get_time();
+}
+
+static inline void boot_mark(const char *name)
+{
+	boot_end(boot_begin(name));
+}
+
+/* The splash is gone, the menu shows and takes buttons */
+static inline void boot_ready()
+{
+	boot_mark("ready");
+	boot_ready_us = esp_timer_get_time();
+}
+
+/* ms, 0 until boot_ready() */
+static inline uint32_t boot_get_ready_ms()
+{
+	return boot_ready_us / 1000;
+}
+
+/* The timeline to the console, stages still running without an end */
+static inline void boot_dump()
+{
+	uint32_t n = boot_count;
+
+	if (n > BOOT_STAGES_MAX)
+		n = BOOT_STAGES_MAX;
+
+	INFO("Boot timeline, ms:");
+	for (uint32_t i = 0; i < n; i++) {
+		const boot_stage& s = boot_stages[i];
+
+		if (!s.name)
+			continue;
+		int64_t begin = s.begin_us / 1000;
+
+		if (s.end_us)
+			INFO("  %-12s %5" PRId64 " .. %5" PRId64 "  %5" PRId64
+				"  core %d", s.name, begin, s.end_us / 1000,
+				(s.end_us - s.begin_us) / 1000, s.core);
+		else
+			INFO("  %-12s %5" PRId64 " .. running       core %d",
+				s.name, begin, s.core);
+	}
+}
+
+#endif /* __BOOT_TIME_H__ */
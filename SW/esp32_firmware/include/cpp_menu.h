@@ -13,7 +13,7 @@ public:
 
 	void next() {
 		i++;
-		if (i == list.size())
+		if (i == (int)list.size())
 			i = 0;
 	}
 
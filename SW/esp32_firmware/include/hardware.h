@@ -25,6 +25,10 @@
 #define EXT_ENC_A			GPIO_NUM_23
 #define EXT_ENC_B			GPIO_NUM_22
 #define EXT_ENC_Z			GPIO_NUM_21
+#define EXT_ENC_PCNT			1 /* 0: decode with GPIO interrupts */
+#define EXT_ENC_GLITCH_NS		1000
+#define EXT_ENC_Z_EDGES			3200 /* 800 x 4 per encoder turn */
+#define EXT_ENC_Z_SYNC_EDGES		128000 /* Z at the same spindle angle */
 
 /* stepper */
 #define STP_CLK_PIN			GPIO_NUM_26
@@ -35,26 +39,133 @@
 #define STP_ENA_POL			0
 #define STP_ACC				1000
 #define STP_SPEED			1000
-#define STP_BACKLASH_MM			5
 #define STP_CLK_INVERT			false
 #define STP_ENA_INVERT			true
 #define STP_DELAY_MS			1000
+#define STP_PULSE_BACKEND_TIMER		0 /* esp_timer pull-down */
+#define STP_PULSE_BACKEND_RMT		1 /* hardware timed pulse */
+#define STP_PULSE_BACKEND		STP_PULSE_BACKEND_RMT
+#define STP_RMT_CHANNEL			0
+#define STP_PULSE_US			MOTOR_CLK_PULSE_US /* as the timer one */
+#define STP_DIR_SETUP_US		5 /* DIR before the CLK edge */
+#define STP_DIR_HOLD_US			5 /* CLK idle before DIR may change */
+#define STP_MAX_STEP_HZ			10000 /* motor pull-out, 1500 RPM */
+#define STP_MAX_ACC_HZ_S		50000
+#define STP_MAX_JERK_HZ_S2		1000000
+#define RTN_OVERSHOOT_UM		500 /* return past the start by */
+#define STP_BACKLASH_UM			100 /* lead screw slack, 0 for none */
+#define STP_BACKLASH_HZ			1000 /* slack taken up at */
+#define STP_LIMIT_DEC_HZ_S		STP_MAX_ACC_HZ_S /* into the limit, 0 dead stop */
+
+/*
+ * Cross-slide stepper, the second (X) axis. Always on the RMT backend.
+ * X+ moves the tool away from the spindle axis. GP timers are scarce (4):
+ * with no backlash the axis only takes one, for its rapid engine.
+ */
+#define CROSS_CLK_PIN			GPIO_NUM_27
+#define CROSS_DIR_PIN			GPIO_NUM_32
+#define CROSS_ENA_PIN			GPIO_NUM_13
+#define CROSS_RMT_CHANNEL		1
+#define CROSS_DIR_INVERT		false
+#define CROSS_BACKLASH_UM		0
+#define CROSS_OVERSHOOT_UM		0
+
+/* Step rate planner */
+#define PLAN_MARGIN_PCT			90
+#define PLAN_LOOKAHEAD_US		50000
+
+/* Spindle stop output, asserted on a planner fault */
+#define SPINDLE_STOP_PIN		GPIO_NUM_NC
+#define SPINDLE_STOP_POL		1
+
+/* Machine position, see abs_pos.h */
+#define ABS_POS_PARTITION		"nvs" /* the default one, shared */
+#define ABS_POS_COMMIT_MS		1000 /* flash commit check period */
+#define ABS_POS_QUIET_MS		2000 /* no spindle edges for */
+
+/* Cores and priorities */
+#define MOTION_CORE			1 /* encoder + step interrupts */
+#define UI_CORE				0 /* menu, lcd, wifi, ota */
+#define MOTION_TASK_PRIO		20
+#define LCD_TASK_PRIO			1
+#define ABS_POS_TASK_PRIO		1
+
+/* Compound infeed threading cycle, 60 deg threads */
+#define CYCLE_FLANK_DEG10		295 /* infeed along the flank at */
+#define CYCLE_CLEAR_UM			500 /* X retract over the surface */
+#define CYCLE_SPRING_PASSES		1 /* at full depth */
+#define CYCLE_MAX_PASSES		16
+
+/* Diagnostics */
+#define MOTION_STATS			1 /* ISR timing histograms */
+#ifndef MOTION_TRACE
+#define MOTION_TRACE			0 /* ISR trace ring, see trace.h */
+#endif
+#ifndef MOTION_BENCH
+#define MOTION_BENCH			0 /* bench.h instead of the menu */
+#endif
+#define TRACE_RING_SIZE			2048 /* records, 8 bytes each */
+#define TRACE_UART			UART_NUM_1
+#define TRACE_TX_PIN			GPIO_NUM_4
+#define TRACE_BAUD			2000000
+#define TRACE_FRAME_RECS		64
+#define TRACE_DRAIN_MS			10
+#define TRACE_TASK_PRIO			1
+#define TELEM_SERVER_IP			"192.168.0.108" /* the OTA server */
+#define TELEM_PORT			5006
+#define TELEM_RATE_HZ			50 /* default, up to the tick rate */
+#define TELEM_FRAME_SAMPLES		16
+#define TELEM_TASK_PRIO			1
+
+/* Firmware update, see fw_update.h */
+#define FW_UPDATE_SERVER_IP		"192.168.0.108"
+#define FW_UPDATE_PORT			5008
+#define FW_UPDATE_TIMEOUT_MS		5000 /* no data for */
+#define FW_UPDATE_RETRIES		10 /* connections without progress */
+#define FW_UPDATE_RETRY_MS		2000
+#define FW_UPDATE_SAVE_BLOCKS		16 /* NVS progress, every 64 KB */
+#define FW_UPDATE_TASK_PRIO		1
+
+/* Startup, see boot_time.h */
+#define BOOT_SPLASH_MS			1500 /* version up for, or to a button */
+#define BOOT_CONFIRM_MS			10000 /* running before ota_confirm() */
+#define BOOT_TASK_PRIO			1
 
 /* Fan */
 #define FAN_ENA_PIN			GPIO_NUM_15
 
+/* Gear train, see the drawing below and kinematics.h */
+#define GEAR_SPINDLE_T			40
+#define GEAR_BLDC_T			20
+#define GEAR_ENC_DRIVE_T		60
+#define GEAR_ENC_T			27
+#define ENC_PPR				800
+#define ENC_EDGES_PER_PULSE		4
+#define STP_STEPS_PER_REV		400
+#define GEAR_STP_T			12
+#define GEAR_SCREW_T			32
+#define SCREW_PITCH_UM			1500 /* M16x1.5 */
+#define CROSS_STEPS_PER_REV		400
+#define CROSS_GEAR_STP_T		20 /* belt */
+#define CROSS_GEAR_SCREW_T		40
+#define CROSS_SCREW_PITCH_UM		1250 /* M10x1.25 */
+
 /* Timings */
 #define MOTOR_CLK_PULSE_US		50
-#define SPEED_RATIO_CALC(x)		(200 * (x) / 11500)
-#define MOTOR_PULSES_TO_SUPPORT_MM	(float)(2 * 800 * 4 * 60 / 27)
-#define ENC_PULSES_TO_SUPPORT_MM	(float)(20) /* 1r spindle == enc / 20 */
-#define MOTOR_BACKLASH_MM		5
+#define ENC_PULSES_TO_SUPPORT_UM	20000 /* 1r spindle == enc / 20 */
+#define MOTOR_STEPS_PER_MM_NUM		6400 /* 400 x 32/12 / 1.5 */
+#define MOTOR_STEPS_PER_MM_DEN		9
+#define ENC_PULSES_PER_REV_NUM		128000 /* 2 x 60/27 x 800 x 4 */
+#define ENC_PULSES_PER_REV_DEN		9
+#define CROSS_STEPS_PER_MM_NUM		640 /* 400 x 40/20 / 1.25 */
+#define CROSS_STEPS_PER_MM_DEN		1
 #define STP_ACC_TIME_MS			500
 
 int hardware_init();
 void fan_start();
 void fan_stop();
 void motor_enable(bool state);
+void spindle_stop(bool stop);
 
 /*
  * 27T o 800 PPM encoder (generates 800 x 4 = 3200 interrupts / revolution)
@@ -71,6 +182,10 @@ void motor_enable(bool state);
  *
  * 4 x 96000 x 2 x 18 / (27 x 25600) = 20
  * =======> [enc pulses] / [20] = 1mm support movement
+ *
+ * So for a pitch of P um the stepper makes exactly P / 20000 steps per
+ * encoder pulse. kinematics.h derives it from the tooth counts above, for
+ * any lead, and checks it against these figures at compile time.
  */
 
 /**
@@ -0,0 +1,87 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Log2 histogram of 32-bit samples (CPU cycles). Bin 0 holds 0 and 1,
+ * bin n holds [2^n, 2^(n+1)). add() is a single relaxed atomic increment,
+ * safe from interrupts on either core.
+ */
+class log2_histogram
+{
+public:
+	static const unsigned BINS = 32;
+
+	void add(uint32_t v) {
+		unsigned bin = v ? 31 - __builtin_clz(v) : 0;
+		bins[bin].fetch_add(1, std::memory_order_relaxed);
+		uint32_t m = max.load(std::memory_order_relaxed);
+		while (v > m && !max.compare_exchange_weak(m, v,
+				std::memory_order_relaxed))
+			;
+	}
+
+	void merge(const log2_histogram& other) {
+		for (unsigned i = 0; i != BINS; i++)
+			bins[i].fetch_add(other.get_bin(i),
+					  std::memory_order_relaxed);
+		uint32_t m = other.get_max();
+		uint32_t cur = max.load(std::memory_order_relaxed);
+		while (m > cur && !max.compare_exchange_weak(cur, m,
+				std::memory_order_relaxed))
+			;
+	}
+
+	void clear() {
+		for (unsigned i = 0; i != BINS; i++)
+			bins[i].store(0, std::memory_order_relaxed);
+		max.store(0, std::memory_order_relaxed);
+	}
+
+	uint32_t get_bin(unsigned i) const {
+		return bins[i].load(std::memory_order_relaxed);
+	}
+
+	uint32_t get_max() const {
+		return max.load(std::memory_order_relaxed);
+	}
+
+	uint32_t count() const {
+		uint32_t n = 0;
+		for (unsigned i = 0; i != BINS; i++)
+			n += get_bin(i);
+		return n;
+	}
+
+	/*
+	 * Upper bound of the bin holding the @pct percentile sample, capped
+	 * by the largest sample seen.
+	 */
+	uint32_t percentile(unsigned pct) const {
+		uint32_t n = count();
+		if (!n)
+			return 0;
+
+		uint64_t want = ((uint64_t)n * pct + 99) / 100;
+		/* the 0th is the smallest sample */
+		if (!want)
+			want = 1;
+		uint64_t seen = 0;
+		for (unsigned i = 0; i != BINS; i++) {
+			seen += get_bin(i);
+			if (seen < want)
+				continue;
+			uint32_t ub = i == 31 ? UINT32_MAX : (2u << i) - 1;
+			return ub < get_max() ? ub : get_max();
+		}
+		return get_max();
+	}
+
+private:
+	std::atomic<uint32_t> bins[BINS] = { };
+	std::atomic<uint32_t> max { 0 };
+};
+
+#endif /* __HISTOGRAM_H__ */
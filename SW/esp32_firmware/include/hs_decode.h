@@ -0,0 +1,66 @@
+#ifndef __HS_DECODE_H__
+#define __HS_DECODE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Decoder for the heatshrink LZSS bit stream, @w window and @l lookahead
+ * bits: a 1 bit is followed by a literal byte, a 0 bit by a back reference,
+ * @w bits of distance - 1 and @l bits of count - 1, all MSB first.
+ *
+ * It decodes a block compressed on its own, so the output buffer is the
+ * whole window and there is no other state: RAM is what the caller gives.
+ * Stops when @out_size bytes are out or the input ends; returns the bytes
+ * written, -1 for a reference outside the output.
+ */
+static inline int32_t hs_decode(const uint8_t *in, size_t in_len,
+				uint8_t *out, size_t out_size,
+				unsigned w, unsigned l)
+{
+	size_t bit = 0, bits = in_len * 8;
+	size_t n = 0;
+
+	auto get = [&](unsigned count) -> int32_t {
+		uint32_t v = 0;
+
+		if (bits - bit < count)
+			return -1;
+		while (count--) {
+			v = v << 1 | (in[bit >> 3] >> (7 - (bit & 7)) & 1);
+			bit++;
+		}
+		return v;
+	};
+
+	while (n < out_size) {
+		int32_t tag = get(1);
+		if (tag < 0)
+			break;
+
+		if (tag) {
+			int32_t c = get(8);
+			if (c < 0)
+				break;
+			out[n++] = c;
+			continue;
+		}
+
+		/* the padding at the end is shorter than a reference */
+		int32_t dist = get(w);
+		int32_t count = get(l);
+		if (dist < 0 || count < 0)
+			break;
+		dist++;
+		count++;
+		if ((size_t)dist > n || n + count > out_size)
+			return -1;
+		while (count--) {
+			out[n] = out[n - dist];
+			n++;
+		}
+	}
+	return n;
+}
+
+#endif /* __HS_DECODE_H__ */
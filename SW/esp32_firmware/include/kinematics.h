@@ -0,0 +1,129 @@
+#ifndef __KINEMATICS_H__
+#define __KINEMATICS_H__
+
+#include <stdint.h>
+#include "hardware.h"
+#include "rational.h"
+
+/*
+ * Machine kinematics, built at compile time from the gear train in
+ * hardware.h with exact fractions, see rational.h. Nothing here exists at
+ * run time but the kin_gear results.
+ *
+ * Spindle side: the BLDC motor drives the spindle and, through its other
+ * pulley, the encoder:
+ *	edges / spindle rev = SPINDLE/BLDC x ENC_DRIVE/ENC x ENC_PPR x 4
+ *
+ * Support side: the stepper drives the lead screw through the helical
+ * gear:
+ *	steps / mm = STP_STEPS_PER_REV x SCREW/STP / screw pitch
+ *
+ * A thread of lead L then needs L x steps/mm / (edges/rev) motor steps per
+ * encoder edge, the num / den pair gear_ratio and motion_start() take.
+ */
+constexpr rational KIN_EDGES_PER_REV =
+	rational(GEAR_SPINDLE_T, GEAR_BLDC_T) *
+	rational(GEAR_ENC_DRIVE_T, GEAR_ENC_T) *
+	rational(ENC_PPR * ENC_EDGES_PER_PULSE);
+
+constexpr rational KIN_STEPS_PER_MM =
+	rational(STP_STEPS_PER_REV) *
+	rational(GEAR_SCREW_T, GEAR_STP_T) /
+	rational(SCREW_PITCH_UM, 1000);
+
+/* Motor steps per encoder edge for a 1 mm lead */
+constexpr rational KIN_STEPS_PER_EDGE_MM = KIN_STEPS_PER_MM /
+	KIN_EDGES_PER_REV;
+
+/* The cross-slide (X) the same way, its own stepper, belt and screw */
+constexpr rational KIN_X_STEPS_PER_MM =
+	rational(CROSS_STEPS_PER_REV) *
+	rational(CROSS_GEAR_SCREW_T, CROSS_GEAR_STP_T) /
+	rational(CROSS_SCREW_PITCH_UM, 1000);
+
+constexpr rational KIN_X_STEPS_PER_EDGE_MM = KIN_X_STEPS_PER_MM /
+	KIN_EDGES_PER_REV;
+
+/* The rest of the firmware uses the reduced figures, they must agree */
+static_assert(KIN_EDGES_PER_REV == rational(ENC_PULSES_PER_REV_NUM,
+					    ENC_PULSES_PER_REV_DEN));
+static_assert(KIN_STEPS_PER_MM == rational(MOTOR_STEPS_PER_MM_NUM,
+					   MOTOR_STEPS_PER_MM_DEN));
+static_assert(KIN_STEPS_PER_EDGE_MM * rational(ENC_PULSES_TO_SUPPORT_UM,
+					       1000) == rational(1));
+static_assert(EXT_ENC_Z_EDGES == ENC_PPR * ENC_EDGES_PER_PULSE);
+static_assert(KIN_EDGES_PER_REV.num == EXT_ENC_Z_SYNC_EDGES);
+static_assert(KIN_X_STEPS_PER_MM == rational(CROSS_STEPS_PER_MM_NUM,
+					     CROSS_STEPS_PER_MM_DEN));
+
+/* 355/113, 2.7e-7 off, 8.5e-8 relative: 8.5 nm over a 100 mm module thread */
+constexpr rational KIN_PI = rational(355, 113);
+
+/* 1351/780, 3e-7 relative, for the cones; 2e-6 in 2 - sqrt(3), 15 degrees */
+constexpr rational KIN_SQRT3 = rational(1351, 780);
+
+/* Motor steps per encoder edge */
+struct kin_gear {
+	uint32_t num;
+	uint32_t den;
+};
+
+/* Gear for a lead of @lead_mm per spindle revolution, on the Z axis */
+consteval kin_gear kin_lead(rational lead_mm,
+			    rational steps_per_edge_mm = KIN_STEPS_PER_EDGE_MM)
+{
+	rational r = lead_mm * steps_per_edge_mm;
+
+	rational::check(r.num > 0, "lead must be positive");
+	/* the following interrupt makes one step per edge at most */
+	rational::check(r <= rational(1), "lead too long for the gear");
+	/* gear_ratio accumulates up to 2 x den in an int32_t */
+	rational::check(r.den <= INT32_MAX / 2, "gear denominator too big");
+
+	return { (uint32_t)r.num, (uint32_t)r.den };
+}
+
+/* Metric pitch or feed in um per revolution */
+consteval kin_gear kin_metric(int64_t pitch_um, int64_t starts = 1)
+{
+	return kin_lead(rational(pitch_um * starts, 1000));
+}
+
+/* Threads per inch, @tpi_num / @tpi_den for the fractional ones */
+consteval kin_gear kin_tpi(int64_t tpi_num, int64_t tpi_den = 1)
+{
+	return kin_lead(rational(254, 10) / rational(tpi_num, tpi_den));
+}
+
+/* Module (worm) thread, pitch = pi x module, module in um */
+consteval kin_gear kin_module(int64_t module_um, int64_t starts = 1)
+{
+	return kin_lead(KIN_PI * rational(module_um * starts, 1000));
+}
+
+/* Z and X gears that move the tool along a line, e.g. a taper */
+struct kin_gear_xz {
+	kin_gear z;
+	kin_gear x;
+};
+
+/*
+ * Z feeds @feed_um per revolution and X @x_per_z of it, radially: a taper
+ * of diameter ratio 1:n has x_per_z = 1 / 2n, a cone of half angle a has
+ * tan(a). Both come from the same edges, so the ratio is exact.
+ */
+consteval kin_gear_xz kin_taper(int64_t feed_um, rational x_per_z)
+{
+	rational feed = rational(feed_um, 1000);
+
+	return { kin_lead(feed),
+		 kin_lead(feed * x_per_z, KIN_X_STEPS_PER_EDGE_MM) };
+}
+
+/* Diameter ratio 1:@n, @n in thousandths for the Morse tapers */
+consteval rational kin_taper_ratio(int64_t n_milli)
+{
+	return rational(1000, 2 * n_milli);
+}
+
+#endif /* __KINEMATICS_H__ */
@@ -0,0 +1,100 @@
+#ifndef __RATIONAL_H__
+#define __RATIONAL_H__
+
+#include <stdint.h>
+
+/*
+ * Exact fraction for compile-time unit conversions. Every operation is
+ * consteval and keeps the result reduced, with the sign on num, so two
+ * ratios compare equal field by field. An overflow, a zero denominator or
+ * a failed check() calls rational_error(), which has no definition and is
+ * not constexpr: the build stops at the expression that caused it.
+ */
+void rational_error(const char *why);
+
+struct rational {
+	int64_t num;
+	int64_t den;
+
+	consteval rational(int64_t num = 0, int64_t den = 1) :
+		num(num), den(den) {
+		if (den == 0)
+			rational_error("zero denominator");
+		if (den < 0) {
+			this->num = neg(num);
+			this->den = neg(den);
+		}
+		int64_t g = gcd(this->num, this->den);
+		this->num /= g;
+		this->den /= g;
+	}
+
+	static consteval int64_t gcd(int64_t a, int64_t b) {
+		a = a < 0 ? -a : a;
+		while (b) {
+			int64_t t = a % b;
+			a = b;
+			b = t;
+		}
+		return a ? a : 1;
+	}
+
+	static consteval int64_t neg(int64_t a) {
+		if (a == INT64_MIN)
+			rational_error("overflow");
+		return -a;
+	}
+
+	static consteval int64_t mul(int64_t a, int64_t b) {
+		int64_t r = 0;
+		if (__builtin_mul_overflow(a, b, &r))
+			rational_error("overflow");
+		return r;
+	}
+
+	static consteval int64_t add(int64_t a, int64_t b) {
+		int64_t r = 0;
+		if (__builtin_add_overflow(a, b, &r))
+			rational_error("overflow");
+		return r;
+	}
+
+	/* Cross-reduced first, so the products stay as small as they can */
+	consteval rational operator*(const rational& b) const {
+		int64_t g1 = gcd(num, b.den), g2 = gcd(b.num, den);
+		return rational(mul(num / g1, b.num / g2),
+				mul(den / g2, b.den / g1));
+	}
+
+	consteval rational operator/(const rational& b) const {
+		if (b.num == 0)
+			rational_error("division by zero");
+		return *this * rational(b.den, b.num);
+	}
+
+	consteval rational operator+(const rational& b) const {
+		int64_t g = gcd(den, b.den);
+		return rational(add(mul(num, b.den / g), mul(b.num, den / g)),
+				mul(den / g, b.den));
+	}
+
+	consteval rational operator-(const rational& b) const {
+		return *this + rational(neg(b.num), b.den);
+	}
+
+	consteval bool operator==(const rational& b) const {
+		return num == b.num && den == b.den;
+	}
+
+	consteval bool operator<=(const rational& b) const {
+		return mul(num, b.den) <= mul(b.num, den);
+	}
+
+	/* Stops the build with @why unless @cond */
+	static consteval void check(bool cond, const char *why) {
+		if (!cond)
+			rational_error(why);
+	}
+};
+
+#endif /* __RATIONAL_H__ */
@@ -0,0 +1,77 @@
+#ifndef __SPSC_RING_H__
+#define __SPSC_RING_H__
+
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Lock-free single producer / single consumer ring with static storage.
+ * Items are written and read in place: claim() + publish() on the producer
+ * side, peek() + pop() on the consumer side. Safe between two tasks, or
+ * between an ISR and a task, as long as each side has only one user.
+ */
+template <typename T, uint32_t N> class spsc_ring
+{
+	static_assert(N && (N & (N - 1)) == 0, "N must be a power of two");
+
+	T buf[N];
+	std::atomic<uint32_t> head { 0 };	/* producer index */
+	std::atomic<uint32_t> tail { 0 };	/* consumer index */
+public:
+	/* Free slot to fill, nullptr if the ring is full */
+	T *claim() {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == N)
+			return nullptr;
+		return &buf[h & (N - 1)];
+	}
+
+	/* Make the claimed slot visible to the consumer */
+	void publish() {
+		head.store(head.load(std::memory_order_relaxed) + 1,
+			   std::memory_order_release);
+	}
+
+	bool push(const T& item) {
+		T *slot = claim();
+		if (!slot)
+			return false;
+		*slot = item;
+		publish();
+		return true;
+	}
+
+	/* Oldest item, nullptr if the ring is empty */
+	T *peek() {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire))
+			return nullptr;
+		return &buf[t & (N - 1)];
+	}
+
+	/* Release the slot returned by peek() */
+	void pop() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1,
+			   std::memory_order_release);
+	}
+
+	bool pop(T& item) {
+		T *slot = peek();
+		if (!slot)
+			return false;
+		item = *slot;
+		pop();
+		return true;
+	}
+
+	uint32_t size() {
+		return head.load(std::memory_order_acquire) -
+			tail.load(std::memory_order_acquire);
+	}
+
+	bool empty() {
+		return size() == 0;
+	}
+};
+
+#endif /* __SPSC_RING_H__ */
@@ -0,0 +1,298 @@
+#include "bench.h"
+#include "hardware.h"
+#include <free_rtos_h.h>
+#include <log.h>
+#include <stdio.h>
+#include "lcd.h"
+#include "fixed_fmt.h"
+#include "gear_ratio.h"
+#include "stepper_ctrl.h"
+#include "gearbox.h"
+#include "spindle.h"
+#include "step_out.h"
+#include "feedrate.h"
+#include "cpp_menu.h"
+#include "rapid.h"
+#include "motion.h"
+#include "motion_stats.h"
+
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+
+#define BENCH_RUNS		5
+#define BENCH_OPS		10000
+#define BENCH_RPM		1000
+#define BENCH_RETURN_MM		10
+#define BENCH_LIMIT_10		10 /* 1 mm, in 0.1 mm */
+#define BENCH_POLL_MS		200 /* thread_cut's old btns.wait() */
+
+/* keeps results alive so the compiler can't drop the loops */
+static volatile int32_t sink;
+
+/*
+ * Best of BENCH_RUNS, in cycles per op x100. The best run is the one least
+ * disturbed by interrupts and the other core, which makes numbers
+ * reproducible between builds.
+ */
+template <typename F> static uint32_t measure(const char *name,
+					      uint32_t ops, F fn,
+					      int runs = BENCH_RUNS)
+{
+	uint32_t best = UINT32_MAX;
+
+	for (int run = 0; run != runs; run++) {
+		uint32_t t0 = esp_cpu_get_cycle_count();
+		for (uint32_t i = 0; i != ops; i++)
+			fn(i);
+		uint32_t dt = esp_cpu_get_cycle_count() - t0;
+		if (dt < best)
+			best = dt;
+	}
+
+	uint32_t x100 = (uint64_t)best * 100 / ops;
+	INFO("%-28s %6lu.%02lu cycles/op", name, x100 / 100, x100 % 100);
+
+	return x100;
+}
+
+/* Interrupt load in 0.1% of one core for @events/s at @x100 cycles each */
+static uint32_t load_permille(uint64_t events, uint32_t x100)
+{
+	uint64_t hz = (uint64_t)esp_rom_get_cpu_ticks_per_us() * 1000000;
+
+	return events * x100 * 10 / hz;
+}
+
+static void bench_gear()
+{
+	gear_ratio gear(700, ENC_PULSES_TO_SUPPORT_UM);
+
+	measure("gear_ratio::advance(+1)", BENCH_OPS, [&] (uint32_t i) {
+		sink = gear.advance(1);
+	});
+	measure("gear_ratio::advance(batch)", BENCH_OPS, [&] (uint32_t i) {
+		sink = gear.advance(i & 1 ? 28 : -28);
+	});
+}
+
+static void bench_est()
+{
+	spindle_est est;
+	int32_t count = 0;
+	int64_t t = 0;
+
+	est.reset(0, 0, 28);
+	/* one tracker update per call, in-between events are cheaper */
+	measure("spindle_est::update", BENCH_OPS, [&] (uint32_t i) {
+		count += 28;
+		t += spindle_est::MIN_DT_US;
+		est.update(count, t);
+	});
+	measure("spindle_est::get_rpm10", BENCH_OPS, [&] (uint32_t i) {
+		sink = est.get_rpm10(t + i);
+	});
+}
+
+static void bench_motion()
+{
+	spindle_sim spindle;
+	step_out_sim out;
+	stepper_ctrl ctrl(out, axis_z_config, 700, ENC_PULSES_TO_SUPPORT_UM,
+		false);
+	gearbox box(spindle);
+	uint32_t batch = ENC_PULSES_TO_SUPPORT_UM / 700;
+
+	box.add(&ctrl);
+	box.start();
+
+	/* per edge, as delivered by the GPIO interrupt decoder */
+	uint32_t edge = measure("motion path, 1 edge", BENCH_OPS,
+		[&] (uint32_t i) { spindle.feed(1); });
+
+	/* per watch point event, as delivered by PCNT */
+	uint32_t event = measure("motion path, PCNT batch", BENCH_OPS,
+		[&] (uint32_t i) { spindle.feed(batch); });
+
+	uint64_t edges_s = (uint64_t)BENCH_RPM * ENC_PULSES_PER_REV_NUM /
+		(ENC_PULSES_PER_REV_DEN * 60);
+	INFO("M4x0.7 @ %d RPM: %llu edges/s, motion load isr %lu, pcnt %lu "
+		"[0.1%%, without interrupt entry]", BENCH_RPM, edges_s,
+		load_permille(edges_s, edge),
+		load_permille(edges_s / batch, event));
+	INFO("steps made: %lu", out.get_steps());
+}
+
+/* The same feed with the cross-slide on a 1:20 taper: one more axis */
+static void bench_gearbox()
+{
+	static constexpr kin_gear_xz taper = kin_taper(700,
+		kin_taper_ratio(20000));
+	spindle_sim spindle;
+	step_out_sim out_z, out_x;
+	stepper_ctrl z(out_z, axis_z_config, taper.z.num, taper.z.den, false);
+	stepper_ctrl x(out_x, axis_x_config, taper.x.num, taper.x.den, false);
+	gearbox box(spindle);
+
+	box.add(&z);
+	box.add(&x);
+	box.start();
+
+	uint32_t batch = box.get_batch();
+	measure("motion path, PCNT batch, Z+X", BENCH_OPS,
+		[&] (uint32_t i) { spindle.feed(batch); });
+	INFO("steps made: Z %lu, X %lu", out_z.get_steps(),
+		out_x.get_steps());
+}
+
+static void bench_step_out()
+{
+	{
+		step_out_sim out;
+		measure("step_out_sim::pulse", BENCH_OPS,
+			[&] (uint32_t i) { out.pulse(); });
+	}
+	{
+		/* includes re-arming the esp_timer pull-down */
+		step_out_timer out;
+		measure("step_out_timer::pulse", 1000,
+			[&] (uint32_t i) { out.pulse(); });
+	}
+	{
+		/* back to back, so each waits out the pulse before it */
+		step_out_rmt out;
+		measure("step_out_rmt::pulse, max rate", 1000,
+			[&] (uint32_t i) { out.pulse(); });
+		INFO("late pulses: %lu", out.get_late());
+	}
+}
+
+/* Wall time per mm of support return, simulated output */
+static void bench_return()
+{
+	int32_t steps = BENCH_RETURN_MM * MOTOR_STEPS_PER_MM_NUM /
+		MOTOR_STEPS_PER_MM_DEN;
+	step_out_sim out;
+	rapid_engine rapid(out, false, STP_MAX_STEP_HZ,
+		STP_MAX_ACC_HZ_S, STP_MAX_JERK_HZ_S2);
+	int64_t t0, dt;
+
+	t0 = esp_timer_get_time();
+	rapid.add(steps);
+	rapid.run();
+	dt = esp_timer_get_time() - t0;
+	INFO("rapid_engine return: %lld us/mm (planned %lu), "
+		"%lu steps made", dt / BENCH_RETURN_MM,
+		rapid.duration_us(steps) / BENCH_RETURN_MM,
+		out.get_steps());
+}
+
+/*
+ * Limit reached to autoreturn, polled the way thread_cut used to and
+ * notified from the interrupt. Simulated spindle, a dry run returns
+ * included: the driver stays off, nothing moves.
+ */
+static void bench_limit()
+{
+	for (int notified = 0; notified != 2; notified++) {
+		motion_stats_clear();
+		motion_notify(notified ? xTaskGetCurrentTaskHandle() : nullptr);
+		motion_start(MOTION_SRC_SIM, 2000, ENC_PULSES_TO_SUPPORT_UM,
+			false, BENCH_RPM);
+
+		for (int run = 0; run != BENCH_RUNS; run++) {
+			uint32_t ev = 0;
+
+			xTaskNotifyWait(0, UINT32_MAX, NULL, 0);
+			motion_set_limit(BENCH_LIMIT_10);
+			if (notified) {
+				while (!(ev & MOTION_EV_LIMIT))
+					xTaskNotifyWait(0, UINT32_MAX, &ev,
+						portMAX_DELAY);
+				motion_check_limit();
+			} else {
+				while (!motion_check_limit())
+					delay_ms(BENCH_POLL_MS);
+			}
+			motion_return(false);
+		}
+
+		motion_stop();
+		INFO("limit to return, %s: %s [us]",
+			notified ? "notified" : "polled",
+			motion_stats_summary(MSTAT_HIST_RETURN));
+	}
+	motion_notify(nullptr);
+}
+
+static void bench_format()
+{
+	char buf[LCD_MAX_MESSAGE_SIZE];
+
+	measure("snprintf %-6.2f", 1000, [&] (uint32_t i) {
+		snprintf(buf, sizeof(buf), "POS:%-6.2f", (float)i / 100);
+		sink = buf[4];
+	});
+	measure("fmt_fixed<6, 2>", 1000, [&] (uint32_t i) {
+		*fmt_fixed<6, 2>(buf, i) = 0;
+		sink = buf[0];
+	});
+}
+
+static void bench_lcd(lcd& lcd)
+{
+
+	/* one ring worth per run, then let the lcd task drain it */
+	for (int run = 0; run != 3; run++) {
+		delay_ms(100);
+		measure("lcd::try_print (varargs)", LCD_RING_SIZE,
+			[&] (uint32_t i) {
+				lcd.try_print(SECOND_ROW, 0, "POS:%-6.2f",
+					(float)i / 100);
+			}, 1);
+		delay_ms(100);
+		measure("lcd::try_print_fixed", LCD_RING_SIZE,
+			[&] (uint32_t i) {
+				lcd.try_print_fixed<6, 2>(SECOND_ROW, 0,
+					"POS:", i);
+			}, 1);
+	}
+
+	INFO("lcd dropped %lu", lcd.get_dropped());
+}
+
+static void bench_menu()
+{
+	Child<FeedRateType> child(thread_list);
+	static const std::vector<int> items { 1, 2, 3, 4 };
+	Menu<int> menu(items);
+
+	measure("Child::next", BENCH_OPS, [&] (uint32_t i) {
+		sink = child.next().title[0];
+	});
+	measure("Menu::next + get", BENCH_OPS, [&] (uint32_t i) {
+		menu.next();
+		sink = *menu.get();
+	});
+}
+
+void bench_start(lcd& screen)
+{
+	INFO("Benchmark, %lu MHz", esp_rom_get_cpu_ticks_per_us());
+
+	bench_gear();
+	bench_est();
+	bench_motion();
+	bench_gearbox();
+	bench_step_out();
+	bench_return();
+	bench_limit();
+	bench_format();
+	bench_lcd(screen);
+	bench_menu();
+
+	INFO("Benchmark done");
+
+	while (1)
+		delay_s(1);
+}
@@ -0,0 +1,14 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+class lcd;
+
+/*
+ * Hot path microbenchmarks, run by app_main() in place of menu_start()
+ * with MOTION_BENCH 1 in hardware.h. menu_init() has brought up @screen,
+ * the lcd ones print to it. Results are printed to the console in CPU
+ * cycles per operation. Does not return.
+ */
+void bench_start(lcd& screen);
+
+#endif /* __BENCH_H__ */
@@ -1,5 +1,7 @@
 #include "hardware.h"
 #include "driver/gpio.h"
+#include "esp_attr.h"
+#include "hal/gpio_ll.h"
 
 int hardware_init()
 {
@@ -11,6 +13,17 @@ int hardware_init()
 	ESP_ERROR_CHECK(gpio_set_direction(STP_ENA_PIN, GPIO_MODE_OUTPUT));
 	ESP_ERROR_CHECK(gpio_set_level(STP_ENA_PIN, 0));
 
+	ESP_ERROR_CHECK(gpio_reset_pin(CROSS_ENA_PIN));
+	ESP_ERROR_CHECK(gpio_set_direction(CROSS_ENA_PIN, GPIO_MODE_OUTPUT));
+	ESP_ERROR_CHECK(gpio_set_level(CROSS_ENA_PIN, 0));
+
+	if (SPINDLE_STOP_PIN != GPIO_NUM_NC) {
+		ESP_ERROR_CHECK(gpio_reset_pin(SPINDLE_STOP_PIN));
+		ESP_ERROR_CHECK(gpio_set_direction(SPINDLE_STOP_PIN,
+			GPIO_MODE_OUTPUT));
+		spindle_stop(false);
+	}
+
 	return 0;
 }
 
@@ -29,3 +42,14 @@ void motor_enable(bool state)
 	ESP_ERROR_CHECK(gpio_set_level(STP_ENA_PIN, state));
 	ESP_ERROR_CHECK(gpio_set_level(FAN_ENA_PIN, state));
 }
+
+/*
+ * Called from the motion interrupt on a planner fault: in IRAM, and the
+ * register write rather than gpio_set_level(), which is in flash
+ */
+void IRAM_ATTR spindle_stop(bool stop)
+{
+	if (SPINDLE_STOP_PIN != GPIO_NUM_NC)
+		gpio_ll_set_level(&GPIO, SPINDLE_STOP_PIN,
+			stop == SPINDLE_STOP_POL);
+}
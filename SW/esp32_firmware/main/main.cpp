@@ -9,17 +9,39 @@
 #include <log.h>
 #include "lcd.h"
 #include "hardware.h"
+#include "bench.h"
+#include "motion.h"
+#include "abs_pos.h"
+#include "trace.h"
+#include "telemetry.h"
+#include "boot_time.h"
 
 extern "C" {
 	void app_main();
 }
 
+#define BOOT_TASK_SIZE			0x1000
+
+static SemaphoreHandle_t nvs_done;
+
 static void ota_confirm(void *args)
 {
-	delay_s(10);
+	delay_ms(BOOT_CONFIRM_MS);
 
 	INFO("Firmware is valid, confirm image");
 	ota_confirm();
+	boot_mark("fw confirmed");
+	vTaskDelete(NULL);
+}
+
+/* NVS and the saved position, on the motion core, idle until a cut */
+static void nvs_task(void *args)
+{
+	int stage = boot_begin("nvs");
+
+	abs_pos_init();
+	boot_end(stage);
+	xSemaphoreGive(nvs_done);
 	vTaskDelete(NULL);
 }
 
@@ -48,20 +70,48 @@ void stepper_test() {
 	}
 }
 
+/*
+ * Only what depends on each other is in order: the outputs first, the GPIO
+ * interrupt service (motion_init) before the buttons, everything before the
+ * menu. NVS and the display controller come up in their own tasks
+ * meanwhile; boot_time.h has the timeline.
+ */
 void app_main(void)
 {
 	const esp_app_desc_t *app_desc = esp_app_get_description();
 
-	xTaskCreate(ota_confirm, NULL, 0x800, 0, 1, 0);
+	boot_mark("app_main");
+	xTaskCreatePinnedToCore(ota_confirm, NULL, 0x800, 0, 1, 0, UI_CORE);
 
+	int stage = boot_begin("hardware");
 	int res = hardware_init();
+	boot_end(stage);
 	if (res)
 		return;
 
+	nvs_done = xSemaphoreCreateBinary();
+	xTaskCreatePinnedToCore(nvs_task, "nvs", BOOT_TASK_SIZE, NULL,
+		BOOT_TASK_PRIO, NULL, MOTION_CORE);
+
+	stage = boot_begin("motion");
+	motion_init();
+	boot_end(stage);
+
+	menu_init(app_desc->version);
+
+	stage = boot_begin("trace+telem");
+	trace_init();
+	telemetry_init();
+	boot_end(stage);
+
 	//enc_test();
 	//stepper_test();
 
-	menu_start(app_desc->version);
+	xSemaphoreTake(nvs_done, portMAX_DELAY);
+#if MOTION_BENCH
+	bench_start(menu_lcd());
+#endif
+	menu_start();
 
 	return;
 }
@@ -0,0 +1,236 @@
+/*
+ * Host counterpart of main/bench.cpp: the hot paths timed on the host, as
+ * a baseline to compare a change against. The quadrature decoder and the
+ * gear, the whole step path from an encoder edge or a batch to the step
+ * output, fmt_fixed against snprintf, queueing on the lcd ring with its
+ * task draining it on a thread, and the menu list navigation. Best of
+ * BENCH_RUNS runs, ns per op; with -q fewer ops, to see it still runs.
+ */
+#include "lathe.h"
+#include "gearbox.h"
+#include "stepper_ctrl.h"
+#include "gear_ratio.h"
+#include "quadrature.h"
+#include "menu.h"
+#include "feedrate.h"
+#include "cpp_menu.h"
+#include "fixed_fmt.h"
+#include "lcd.h"
+#include "host.h"
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define BENCH_RUNS	5
+#define BENCH_OPS	1000000
+#define BENCH_EDGES	100000
+
+static volatile int32_t sink;
+static uint32_t ops = BENCH_OPS;
+static uint32_t edges = BENCH_EDGES;
+
+static int64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename F> static double measure(const char *name, uint32_t n,
+					    F fn)
+{
+	int64_t best = INT64_MAX;
+
+	for (int run = 0; run != BENCH_RUNS; run++) {
+		int64_t t0 = now_ns();
+		for (uint32_t i = 0; i != n; i++)
+			fn(i);
+		int64_t dt = now_ns() - t0;
+		if (dt < best)
+			best = dt;
+	}
+
+	double per_op = (double)best / n;
+	printf("%-32s %9.2f ns/op\n", name, per_op);
+	return per_op;
+}
+
+/* Counts the steps, nothing else, so the path is what is timed */
+class bench_out : public step_output
+{
+public:
+	void pulse() { steps++; }
+	void set_dir(bool level) { }
+	void set_enable(bool on) { }
+	uint32_t max_rate() { return 1000000; }
+	uint32_t steps = 0;
+};
+
+static void bench_gear()
+{
+	static const uint8_t fwd[4] = { 0b00, 0b10, 0b11, 0b01 };
+	static constexpr kin_gear m4 = kin_metric(700);
+	quad_decoder q;
+	gear_ratio gear(m4.num, m4.den);
+
+	measure("quad_decoder::update", ops, [&] (uint32_t i) {
+		sink = q.update(fwd[i & 3]);
+	});
+	measure("gear_ratio::advance(+1)", ops, [&] (uint32_t i) {
+		sink = gear.advance(1);
+	});
+	measure("gear_ratio::advance(batch)", ops, [&] (uint32_t i) {
+		sink = gear.advance(i & 1 ? 28 : -28);
+	});
+}
+
+/* Edge or batch in, steps out: the gearbox and a Z axis on M4x0.7 */
+static void bench_step_path()
+{
+	static constexpr kin_gear m4 = kin_metric(700);
+	{
+		spindle_sim spindle;
+		bench_out out;
+		stepper_ctrl z(out, axis_z_config, m4.num, m4.den, false);
+		gearbox box(spindle);
+
+		box.add(&z);
+		box.start();
+		uint32_t batch = box.get_batch();
+
+		measure("step path, 1 edge", ops, [&] (uint32_t i) {
+			spindle.feed(1);
+		});
+		measure("step path, batch", ops / batch, [&] (uint32_t i) {
+			spindle.feed(batch);
+		});
+	}
+	{
+		/* decoded from the host GPIOs, timed inside the interrupt */
+		lathe_encoder enc;
+		spindle_isr spindle(EXT_ENC_A, EXT_ENC_B, EXT_ENC_Z);
+		bench_out out;
+		stepper_ctrl z(out, axis_z_config, m4.num, m4.den, false);
+		gearbox box(spindle);
+
+		box.add(&z);
+		box.start();
+		uint64_t ns = host_isr_ns();
+		enc.move(edges);
+		ns = host_isr_ns() - ns;
+		printf("%-32s %9.2f ns/edge in the interrupt, %u steps\n",
+		       "spindle_isr step path", (double)ns / edges,
+		       out.steps);
+	}
+}
+
+static void bench_format()
+{
+	char buf[LCD_MAX_MESSAGE_SIZE];
+
+	measure("snprintf %-6.2f", ops / 10, [&] (uint32_t i) {
+		snprintf(buf, sizeof(buf), "POS:%-6.2f", (float)i / 100);
+		sink = buf[4];
+	});
+	measure("fmt_fixed<6, 2>", ops / 10, [&] (uint32_t i) {
+		*fmt_fixed<6, 2>(buf, i) = 0;
+		sink = buf[0];
+	});
+}
+
+struct task_end { };
+
+static std::atomic<bool> stopping;
+
+static void idle(void *arg)
+{
+	std::this_thread::yield();
+}
+
+static void on_delay(void *arg, int ms)
+{
+	if (ms == -1 && stopping)
+		throw task_end();
+}
+
+static void lcd_task(void (*fn)(void *), void *arg)
+{
+	try {
+		fn(arg);
+	} catch (task_end&) {
+	}
+}
+
+/* A ring worth at a time, drawn by the task before the next */
+static void bench_lcd()
+{
+	lcd screen;
+	void (*fn)(void *);
+	void *arg;
+	int64_t vargs = 0, fixed = 0;
+	uint32_t rings = ops / 100 / LCD_RING_SIZE;
+
+	host_last_task(&fn, &arg);
+	host_set_idle(idle, nullptr);
+	host_set_delay(on_delay, nullptr);
+	std::thread task(lcd_task, fn, arg);
+
+	for (uint32_t r = 0; r < rings; r++) {
+		int64_t t0 = now_ns();
+		for (uint32_t i = 0; i < LCD_RING_SIZE; i++)
+			screen.try_print(SECOND_ROW, 0, "POS:%-6.2f",
+					 (float)i / 100);
+		vargs += now_ns() - t0;
+		screen.sync();
+
+		t0 = now_ns();
+		for (uint32_t i = 0; i < LCD_RING_SIZE; i++)
+			screen.try_print_fixed<6, 2>(SECOND_ROW, 0, "POS:",
+						     i);
+		fixed += now_ns() - t0;
+		screen.sync();
+	}
+
+	stopping = true;
+	task.join();
+	host_set_delay(nullptr, nullptr);
+	host_set_idle(nullptr, nullptr);
+
+	printf("%-32s %9.2f ns/op\n", "lcd::try_print (varargs)",
+	       (double)vargs / (rings * LCD_RING_SIZE));
+	printf("%-32s %9.2f ns/op\n", "lcd::try_print_fixed",
+	       (double)fixed / (rings * LCD_RING_SIZE));
+	printf("lcd dropped %u\n", screen.get_dropped());
+}
+
+static void bench_menu()
+{
+	Child<FeedRateType> child(thread_list);
+	static const std::vector<int> items { 1, 2, 3, 4 };
+	Menu<int> menu(items);
+
+	measure("Child::next", ops, [&] (uint32_t i) {
+		sink = child.next().title[0];
+	});
+	measure("Menu::next + get", ops, [&] (uint32_t i) {
+		menu.next();
+		sink = *menu.get();
+	});
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "-q")) {
+		ops /= 100;
+		edges /= 100;
+	}
+
+	bench_gear();
+	bench_step_path();
+	bench_format();
+	bench_lcd();
+	bench_menu();
+
+	return 0;
+}
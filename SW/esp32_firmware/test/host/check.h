@@ -0,0 +1,37 @@
+#ifndef __CHECK_H__
+#define __CHECK_H__
+
+#include <stdio.h>
+
+/*
+ * Host test checks: a failed one is printed and the test goes on, main()
+ * returns check_result() for ctest.
+ */
+inline int check_failed;
+
+#define CHECK(cond)	do { \
+		if (!(cond)) { \
+			fprintf(stderr, "%s:%d: CHECK(%s) failed\n", \
+				__FILE__, __LINE__, #cond); \
+			check_failed++; \
+		} \
+	} while (0)
+
+#define CHECK_EQ(a, b)	do { \
+		long long _a = (a), _b = (b); \
+		if (_a != _b) { \
+			fprintf(stderr, "%s:%d: CHECK_EQ(%s, %s) failed: " \
+				"%lld != %lld\n", __FILE__, __LINE__, #a, #b, \
+				_a, _b); \
+			check_failed++; \
+		} \
+	} while (0)
+
+static inline int check_result()
+{
+	if (check_failed)
+		fprintf(stderr, "%d checks failed\n", check_failed);
+	return check_failed ? 1 : 0;
+}
+
+#endif /* __CHECK_H__ */
@@ -0,0 +1,119 @@
+#include "lathe.h"
+#include "host.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+/* Edges per us at 1 RPM, x this: rpm x ENC_PULSES_PER_REV / 60 s */
+#define EDGES_DIV	((int64_t)ENC_PULSES_PER_REV_DEN * 60000000)
+
+lathe_encoder::lathe_encoder(gpio_num_t a, gpio_num_t b, gpio_num_t z) :
+	a(a), b(b), z(z)
+{
+	/* AB 00 at 0, forward A leads: 00 10 11 01 */
+	host_gpio_set(a, 0);
+	host_gpio_set(b, 0);
+	host_gpio_set(z, 1);
+}
+
+/* Pin that changes between the AB states @k and @k + 1 */
+static int channel(int64_t k, gpio_num_t a, gpio_num_t b)
+{
+	return (k & 1) ? b : a;
+}
+
+static int level(int pin)
+{
+	return host_gpio_read(pin / 32) >> (pin % 32) & 1;
+}
+
+void lathe_encoder::edge(int dir)
+{
+	int pin = channel(dir > 0 ? pos : pos - 1, a, b);
+	bool irq = true;
+
+	if (glitch && ++since_glitch == glitch) {
+		int other = pin == a ? b : a;
+
+		since_glitch = 0;
+		host_gpio_set(other, !level(other));
+		host_gpio_set(other, !level(other));
+	}
+	/* its interrupt only comes with the next edge's */
+	if (miss && ++since_miss == miss) {
+		since_miss = 0;
+		irq = false;
+	}
+
+	host_gpio_set(pin, !level(pin), irq);
+	pos += dir;
+
+	/* the index is at the same angle whichever way it turns */
+	host_gpio_set(z, pos % EXT_ENC_Z_EDGES == 0);
+}
+
+void lathe_encoder::tick(int64_t t, int32_t rpm)
+{
+	host_run(t);
+
+	acc += (int64_t)rpm * ENC_PULSES_PER_REV_NUM;
+	int64_t n = acc / EDGES_DIV;
+	acc -= n * EDGES_DIV;
+
+	for (int64_t i = 0; i < (n < 0 ? -n : n); i++) {
+		int64_t due = t + (jitter ? esp_random() % (jitter + 1) : 0);
+
+		if (due < last_due)
+			due = last_due;
+		last_due = due;
+		late.push_back({ due, n < 0 ? -1 : 1 });
+	}
+
+	while (!late.empty() && late.front().first <= t) {
+		edge(late.front().second);
+		late.pop_front();
+	}
+}
+
+void lathe_encoder::flush()
+{
+	while (!late.empty())
+		tick(esp_timer_get_time() + 1, 0);
+}
+
+void lathe_encoder::run(const sim_segment *seg, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++) {
+		int64_t us = (int64_t)seg[i].duration_ms * 1000;
+		int64_t t0 = esp_timer_get_time();
+
+		for (int64_t u = 1; u <= us; u++)
+			tick(t0 + u, seg[i].rpm_from + (seg[i].rpm_to -
+				seg[i].rpm_from) * u / us);
+	}
+	flush();
+}
+
+void lathe_encoder::run(int32_t rpm, uint32_t ms)
+{
+	sim_segment seg = { ms, rpm, rpm };
+
+	run(&seg, 1);
+}
+
+void lathe_encoder::move(int32_t edges)
+{
+	int dir = edges < 0 ? -1 : 1;
+
+	for (int32_t i = 0; i != edges; i += dir) {
+		host_run(esp_timer_get_time() + 1);
+		edge(dir);
+	}
+}
+
+void lathe_driver::step(bool take_up)
+{
+	position += dir ? 1 : -1;
+	steps.push_back({ esp_timer_get_time(),
+			  spindle ? spindle->get_count() : 0, position,
+			  take_up });
+}
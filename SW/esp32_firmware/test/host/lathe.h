@@ -0,0 +1,139 @@
+#ifndef __LATHE_H__
+#define __LATHE_H__
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "hardware.h"
+#include "spindle.h"
+#include "step_out.h"
+
+/*
+ * Virtual lathe for the host tests.
+ *
+ * lathe_encoder is the spindle encoder: A, B and the index on the host
+ * GPIOs (host.h), so spindle_isr and spindle_pcnt decode it the way they
+ * do on the machine. It turns at the speed of a profile of ramps, the
+ * sim_segment of spindle_sim, negative RPM backwards. The clock moves one
+ * us at a time and the firmware timers fire as it passes them.
+ *
+ * lathe_driver is a step/dir driver that records every pulse with the
+ * time and the spindle count it was made at.
+ */
+class lathe_encoder
+{
+public:
+	lathe_encoder(gpio_num_t a = EXT_ENC_A, gpio_num_t b = EXT_ENC_B,
+		      gpio_num_t z = EXT_ENC_Z);
+
+	/* Edges turned since the start, signed */
+	int64_t get_edges() const {
+		return pos;
+	}
+
+	/* Every edge comes up to @us late, they stay in order */
+	void set_jitter(uint32_t us) {
+		jitter = us;
+	}
+
+	/* Every @edges one channel pulses there and back, 0 for none */
+	void set_glitch(uint32_t edges) {
+		glitch = edges;
+	}
+
+	/*
+	 * Every @edges two edges come so close that the interrupt of the
+	 * first sees both, 0 for none
+	 */
+	void set_miss(uint32_t edges) {
+		miss = edges;
+	}
+
+	/* Turn through @n segments, then let the late edges in */
+	void run(const sim_segment *seg, uint32_t n);
+
+	/* Turn at @rpm for @ms */
+	void run(int32_t rpm, uint32_t ms);
+
+	/* @edges now, one per us */
+	void move(int32_t edges);
+
+private:
+	gpio_num_t a, b, z;
+	int64_t pos = 0;
+	int64_t acc = 0;
+	uint32_t jitter = 0;
+	uint32_t glitch = 0;
+	uint32_t miss = 0;
+	uint32_t since_glitch = 0;
+	uint32_t since_miss = 0;
+	int64_t last_due = 0;
+	std::deque<std::pair<int64_t, int>> late;	/* time, direction */
+
+	void tick(int64_t t, int32_t rpm);
+	void edge(int dir);
+	void flush();
+};
+
+struct lathe_step {
+	int64_t t_us;
+	int32_t spindle;	/* spindle count when it was made */
+	int32_t position;	/* motor steps after it, DIR high positive */
+	bool take_up;
+};
+
+class lathe_driver : public step_output
+{
+public:
+	lathe_driver(spindle_source *spindle = nullptr,
+		     uint32_t rate = 1000000) :
+		spindle(spindle), rate(rate) { }
+
+	void pulse() {
+		step(false);
+	}
+
+	void take_up() {
+		step(true);
+	}
+
+	void set_dir(bool level) {
+		dir = level;
+	}
+
+	void set_enable(bool on) {
+		enabled = on;
+	}
+
+	uint32_t max_rate() {
+		return rate;
+	}
+
+	int32_t get_position() const {
+		return position;
+	}
+
+	bool is_enabled() const {
+		return enabled;
+	}
+
+	const std::vector<lathe_step>& get_steps() const {
+		return steps;
+	}
+
+	void clear() {
+		steps.clear();
+	}
+
+private:
+	spindle_source *spindle;
+	uint32_t rate;
+	std::vector<lathe_step> steps;
+	int32_t position = 0;
+	bool dir = false;
+	bool enabled = false;
+
+	void step(bool take_up);
+};
+
+#endif /* __LATHE_H__ */
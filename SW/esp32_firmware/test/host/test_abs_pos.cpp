@@ -0,0 +1,164 @@
+/*
+ * The machine position across resets: the RTC journal wins after a
+ * software reset or a panic, a power cut (or a torn journal) falls back
+ * to the last flash commit, a bad or missing one to 0. The commit task
+ * only writes a position that held still for a whole period with the
+ * motion core quiet, and only once. Steps move the position and the
+ * slack side, take-ups only the slack side.
+ */
+#include "check.h"
+#include "abs_pos.h"
+#include "host.h"
+#include "esp_system.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/* What happens during one commit period of the task */
+struct period {
+	int32_t steps;
+	bool quiet;
+};
+
+struct task_end { };
+
+struct script {
+	std::vector<period> periods;
+	size_t next = 0;
+};
+
+static void step(int32_t steps)
+{
+	for (int32_t i = 0; i < (steps < 0 ? -steps : steps); i++)
+		abs_pos_step(steps < 0 ? -1 : 1);
+}
+
+static void on_delay(void *arg, int ms)
+{
+	script *s = (script *)arg;
+
+	CHECK_EQ(ms, ABS_POS_COMMIT_MS);
+	if (s->next == s->periods.size())
+		throw task_end();
+
+	const period& p = s->periods[s->next++];
+
+	step(p.steps);
+	abs_pos_quiet(p.quiet);
+}
+
+/* Run the commit task through @periods, the flash writes it made */
+static uint32_t run_task(std::vector<period> periods)
+{
+	void (*fn)(void *);
+	void *arg;
+	script s = { periods };
+	uint32_t writes = host_nvs_writes();
+
+	host_last_task(&fn, &arg);
+	CHECK(fn != nullptr);
+	host_set_delay(on_delay, &s);
+	try {
+		fn(arg);
+	} catch (task_end&) {
+	}
+	host_set_delay(nullptr, nullptr);
+	abs_pos_quiet(true);
+
+	return host_nvs_writes() - writes;
+}
+
+static void boot(esp_reset_reason_t why)
+{
+	host_set_reset_reason(why);
+	abs_pos_init();
+}
+
+int main()
+{
+	/* power-on garbage in RTC memory, nothing in flash */
+	memset(&abs_pos_rtc, 0x5a, sizeof(abs_pos_rtc));
+	boot(ESP_RST_POWERON);
+	CHECK_EQ(abs_pos_get(), 0);
+	CHECK_EQ(abs_pos_get_dir(), 0);
+
+	/* the first 0 is committed too, once */
+	CHECK_EQ(run_task({ { 0, true }, { 0, true } }), 1);
+
+	/* moving, then still but busy, then still and quiet */
+	CHECK_EQ(run_task({ { 100, true }, { 0, false }, { 0, false } }), 0);
+	CHECK_EQ(run_task({ { 0, true }, { 0, true }, { 0, true } }), 1);
+	CHECK_EQ(abs_pos_get(), 100);
+	CHECK_EQ(abs_pos_get_dir(), 1);
+
+	/* every period moving: nothing is written until it stops */
+	CHECK_EQ(run_task({ { -30, true }, { 5, true }, { -75, true } }), 0);
+	CHECK_EQ(run_task({ { 0, true } }), 1);
+	CHECK_EQ(abs_pos_get(), 0);
+
+	/* back to where it was, and the same again does not rewrite */
+	CHECK_EQ(run_task({ { 1000, true }, { 0, true } }), 1);
+	CHECK_EQ(run_task({ { 0, true }, { 0, true } }), 0);
+
+	/* a take-up moves the slack side only */
+	abs_pos_take_up(-1);
+	CHECK_EQ(abs_pos_get(), 1000);
+	CHECK_EQ(abs_pos_get_dir(), -1);
+
+	/* uncommitted steps, then resets that keep RTC memory */
+	step(-250);
+	CHECK_EQ(abs_pos_get(), 750);
+	for (esp_reset_reason_t why : { ESP_RST_SW, ESP_RST_PANIC,
+					ESP_RST_TASK_WDT }) {
+		boot(why);
+		CHECK_EQ(abs_pos_get(), 750);
+		CHECK_EQ(abs_pos_get_dir(), -1);
+	}
+
+	/* a power cut loses them, back to the last commit, slack unknown */
+	boot(ESP_RST_POWERON);
+	CHECK_EQ(abs_pos_get(), 1000);
+	CHECK_EQ(abs_pos_get_dir(), 0);
+	boot(ESP_RST_BROWNOUT);
+	CHECK_EQ(abs_pos_get(), 1000);
+
+	/* torn by a step as it reset */
+	step(64000 - 1000);
+	abs_pos_rtc.check = 0;
+	boot(ESP_RST_PANIC);
+	CHECK_EQ(abs_pos_get(), 1000);
+
+	/* 64000 steps are 90 mm */
+	abs_pos_set(64000);
+	CHECK_EQ(abs_pos_get_10um(), 9000);
+	abs_pos_set(-64000);
+	CHECK_EQ(abs_pos_get_10um(), -9000);
+
+	/* and 64 bit, past what 32 bits hold */
+	abs_pos_set(INT32_MAX);
+	step(10);
+	CHECK_EQ(run_task({ { 0, true } }), 1);
+	boot(ESP_RST_POWERON);
+	CHECK_EQ(abs_pos_get(), (int64_t)INT32_MAX + 10);
+
+	/* a bad commit is not restored */
+	CHECK(host_nvs_corrupt("pos"));
+	boot(ESP_RST_POWERON);
+	CHECK_EQ(abs_pos_get(), 0);
+	CHECK_EQ(run_task({ { 0, true } }), 1);
+
+	/* a partition from another NVS version is erased and used */
+	step(42);
+	CHECK_EQ(run_task({ { 0, true } }), 1);
+	host_nvs_init_error(ESP_ERR_NVS_NEW_VERSION_FOUND);
+	boot(ESP_RST_POWERON);
+	CHECK_EQ(abs_pos_get(), 0);
+	CHECK_EQ(run_task({ { 7, true }, { 0, true } }), 1);
+	boot(ESP_RST_POWERON);
+	CHECK_EQ(abs_pos_get(), 7);
+
+	printf("%u position commits\n", host_nvs_writes());
+
+	return check_result();
+}
@@ -0,0 +1,203 @@
+/*
+ * backlash_comp on its own, the GP timer run by the host clock: a
+ * reversal, a reversal during the take-up, during the catch-up and
+ * random sequences of them. The motor never gets more than the slack
+ * away from the carriage, and once the timer is done the carriage is
+ * where the steps asked for, on the side the slack was last taken up.
+ */
+#include "check.h"
+#include "backlash.h"
+#include "host.h"
+#include "hardware.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include <stdio.h>
+
+#define SLACK		71
+#define CATCH_HZ	STP_MAX_STEP_HZ
+
+struct rig {
+	int64_t asked = 0;	/* carriage steps asked for */
+	int64_t carriage = 0;
+	int64_t motor = 0;
+	uint32_t take_up = 0;	/* steps made by the timer */
+	uint32_t caught = 0;
+	uint32_t out = 0;	/* motor more than the slack off */
+	int64_t last_us = 0;	/* of the last timer step */
+	backlash_comp b;
+
+	rig() : b(SLACK, STP_BACKLASH_HZ, CATCH_HZ, rig::cb, this) {
+		b.reset(1);
+	}
+
+	/* the motor is on the carriage on the + side, a slack below on - */
+	int64_t gap() const {
+		return motor - carriage;
+	}
+
+	void check() {
+		if (gap() > 0 || gap() < -SLACK)
+			out++;
+	}
+
+	static void cb(void *arg, int32_t step, bool take_up) {
+		rig *r = static_cast<rig *>(arg);
+
+		r->motor += step;
+		if (take_up) {
+			r->take_up++;
+		} else {
+			r->carriage += step;
+			r->caught++;
+		}
+		r->last_us = esp_timer_get_time();
+		r->check();
+	}
+
+	void step(int32_t s) {
+		asked += s;
+		if (!b.defer(s)) {
+			motor += s;
+			carriage += s;
+		}
+		check();
+	}
+
+	void wait(int64_t us) {
+		host_run(esp_timer_get_time() + us);
+	}
+
+	/* Let the timer finish, then the state must be settled */
+	void settle() {
+		wait(1000000);
+		CHECK(!b.is_busy());
+		CHECK_EQ(carriage, asked);
+		CHECK_EQ(gap(), b.get_dir() > 0 ? 0 : -SLACK);
+		CHECK_EQ(out, 0);
+	}
+};
+
+/* One reversal with steps during the take-up, timed */
+static void reversal()
+{
+	rig r;
+
+	for (int i = 0; i < 10; i++)
+		r.step(1);
+	int64_t t0 = esp_timer_get_time();
+	r.step(-1);
+	CHECK(r.b.is_busy());
+	for (int i = 0; i < 9; i++) {
+		r.wait(1000);
+		r.step(-1);
+	}
+	CHECK_EQ(r.carriage, 10);
+	r.settle();
+
+	CHECK_EQ(r.take_up, SLACK);
+	CHECK_EQ(r.caught, 10);
+	CHECK_EQ(r.b.get_reversals(), 1);
+	/*
+	 * SLACK take-up ticks, the first kept step on the tick after, the
+	 * other 9 at the catch-up rate
+	 */
+	int64_t want = (int64_t)(SLACK + 1) * 1000000 / STP_BACKLASH_HZ +
+		9 * 1000000 / CATCH_HZ;
+	CHECK(r.last_us - t0 <= want + 1 && r.last_us - t0 >= want - 1);
+}
+
+/* Back again half way through the take-up, nothing kept */
+static void during_take_up()
+{
+	rig r;
+
+	r.step(-1);
+	r.wait((SLACK / 2) * 1000000 / STP_BACKLASH_HZ + 1);
+	uint32_t half = r.take_up;
+	CHECK(half > 0 && half < SLACK);
+	r.step(1);
+	r.step(1);
+	r.settle();
+
+	/* only what was taken up is given back */
+	CHECK_EQ(r.take_up, 2 * half);
+	CHECK_EQ(r.b.get_reversals(), 2);
+	CHECK_EQ(r.carriage, 1);
+}
+
+/* Back again during the take-up with steps kept: they cancel first */
+static void during_take_up_kept()
+{
+	rig r;
+
+	r.step(-1);
+	r.step(-1);
+	r.step(-1);
+	r.wait(10 * 1000000 / STP_BACKLASH_HZ);
+	r.step(1);
+	r.step(1);
+	CHECK_EQ(r.b.get_reversals(), 1);
+	r.step(1);
+	r.step(1);
+	CHECK_EQ(r.b.get_reversals(), 2);
+	r.settle();
+	CHECK_EQ(r.carriage, 1);
+}
+
+/* Back again while the kept steps are being caught up */
+static void during_catch_up()
+{
+	rig r;
+
+	r.step(-1);
+	for (int i = 0; i < 50; i++)
+		r.step(-1);
+	/* the take-up is over, a few of the 51 kept are out */
+	r.wait((int64_t)(SLACK + 1) * 1000000 / STP_BACKLASH_HZ +
+	       5 * 1000000 / CATCH_HZ + 1);
+	CHECK(r.b.is_busy());
+	CHECK(r.caught > 0 && r.caught < 51);
+	uint32_t caught = r.caught;
+	/* as many up as are still kept, then one more reverses */
+	for (uint32_t i = 0; i < 51 - caught + 1; i++)
+		r.step(1);
+	CHECK_EQ(r.b.get_reversals(), 2);
+	r.settle();
+	CHECK_EQ(r.carriage, r.asked);
+}
+
+/* Random steps, reversals and pauses in every phase */
+static void random_runs()
+{
+	uint32_t steps = 0, reversals = 0;
+
+	for (int run = 0; run < 1000; run++) {
+		rig r;
+		int32_t dir = 1;
+
+		for (int i = 0; i < 500; i++) {
+			if (esp_random() % 20 == 0)
+				dir = -dir;
+			r.step(dir);
+			r.wait(esp_random() % 2000);
+			steps++;
+		}
+		r.settle();
+		reversals += r.b.get_reversals();
+	}
+	printf("random: %u steps, %u reversals, carriage exact\n", steps,
+		reversals);
+}
+
+int main()
+{
+	host_srand(1);
+
+	reversal();
+	during_take_up();
+	during_take_up_kept();
+	during_catch_up();
+	random_runs();
+
+	return check_result();
+}
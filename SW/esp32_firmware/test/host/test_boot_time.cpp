@@ -0,0 +1,180 @@
+/*
+ * The boot timeline: the stages app_main() and its tasks record, on the
+ * host clock, come out with their begin, end and core as the console
+ * shows them, a stage still going without an end, marks with no length.
+ * Past BOOT_STAGES_MAX stages are dropped, not written over. Stages begun
+ * from several threads at once each get a slot of their own.
+ */
+#include "check.h"
+#include "boot_time.h"
+#include "host.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define THREADS		8
+
+/* What boot_dump() prints, one line each */
+static std::vector<std::string> dump()
+{
+	std::vector<std::string> lines;
+	FILE *log = tmpfile();
+	int err = dup(2);
+	char line[128];
+
+	fflush(stderr);
+	dup2(fileno(log), 2);
+	host_verbose = true;
+	boot_dump();
+	host_verbose = false;
+	fflush(stderr);
+	dup2(err, 2);
+	close(err);
+
+	rewind(log);
+	while (fgets(line, sizeof(line), log))
+		lines.push_back(line);
+	fclose(log);
+
+	return lines;
+}
+
+static void clear()
+{
+	boot_count = 0;
+	boot_ready_us = 0;
+	memset(boot_stages, 0, sizeof(boot_stages));
+}
+
+/* The stage @name began at @begin_ms: found once, ended at @end_ms */
+static void check_stage(const char *name, int64_t begin_ms, int64_t end_ms,
+			int core)
+{
+	int found = 0;
+
+	for (const boot_stage& s : boot_stages)
+		if (s.name && !strcmp(s.name, name)) {
+			found++;
+			CHECK_EQ(s.begin_us, begin_ms * 1000);
+			CHECK_EQ(s.end_us, end_ms * 1000);
+			CHECK_EQ(s.core, core);
+		}
+	CHECK_EQ(found, 1);
+}
+
+/* app_main() as main.cpp runs it, made up times */
+static void timeline()
+{
+	host_set_time(312000);
+	CHECK_EQ(boot_get_ready_ms(), 0);
+	boot_mark("app_main");
+
+	int hw = boot_begin("hardware");
+	host_set_time(318000);
+	boot_end(hw);
+
+	/* the load, on the motion core, goes on past the rest */
+	host_set_core(1);
+	int nvs = boot_begin("nvs");
+	host_set_core(0);
+	int motion = boot_begin("motion");
+	host_set_time(321000);
+	boot_end(motion);
+	int lcd = boot_begin("lcd");
+	host_set_time(390000);
+	boot_end(nvs);
+	host_set_time(402000);
+	boot_end(lcd);
+	boot_ready();
+	boot_begin("ota confirm");
+
+	check_stage("app_main", 312, 312, 0);
+	check_stage("hardware", 312, 318, 0);
+	check_stage("nvs", 318, 390, 1);
+	check_stage("motion", 318, 321, 0);
+	check_stage("lcd", 321, 402, 0);
+	check_stage("ready", 402, 402, 0);
+	check_stage("ota confirm", 402, 0, 0);
+	CHECK_EQ(boot_get_ready_ms(), 402);
+
+	std::vector<std::string> lines = dump();
+	static const char *want[] = {
+		"Boot timeline, ms:\n",
+		"  app_main       312 ..   312      0  core 0\n",
+		"  hardware       312 ..   318      6  core 0\n",
+		"  nvs            318 ..   390     72  core 1\n",
+		"  motion         318 ..   321      3  core 0\n",
+		"  lcd            321 ..   402     81  core 0\n",
+		"  ready          402 ..   402      0  core 0\n",
+		"  ota confirm    402 .. running       core 0\n",
+	};
+
+	CHECK_EQ(lines.size(), sizeof(want) / sizeof(want[0]));
+	for (size_t i = 0; i < lines.size() && i < sizeof(want) /
+	     sizeof(want[0]); i++) {
+		CHECK(lines[i] == want[i]);
+		if (lines[i] != want[i])
+			fprintf(stderr, "got \"%s\"\n", lines[i].c_str());
+	}
+	for (const std::string& l : lines)
+		printf("%s", l.c_str());
+}
+
+/* Past the table: nothing written, the first ones kept */
+static void full()
+{
+	clear();
+	for (int i = 0; i < BOOT_STAGES_MAX; i++)
+		CHECK_EQ(boot_begin("early"), i);
+
+	host_set_time(500000);
+	int late = boot_begin("late");
+	CHECK_EQ(late, -1);
+	boot_end(late);
+	boot_mark("late mark");
+
+	for (const boot_stage& s : boot_stages) {
+		CHECK(!strcmp(s.name, "early"));
+		CHECK_EQ(s.end_us, 0);
+	}
+	CHECK_EQ(dump().size(), 1 + BOOT_STAGES_MAX);
+}
+
+/* Two stages from each of THREADS threads, at once */
+static void threads()
+{
+	static char names[THREADS][2][8];
+	std::vector<std::thread> t;
+
+	clear();
+	for (int i = 0; i < THREADS; i++)
+		t.emplace_back([i] {
+			host_set_core(i % 2);
+			for (int k = 0; k < 2; k++) {
+				snprintf(names[i][k], sizeof(names[i][k]),
+					 "t%d.%d", i, k);
+				boot_end(boot_begin(names[i][k]));
+			}
+		});
+	for (std::thread& th : t)
+		th.join();
+
+	CHECK_EQ(boot_count, 2 * THREADS);
+	for (int i = 0; i < THREADS; i++)
+		for (int k = 0; k < 2; k++)
+			check_stage(names[i][k], 500, 500, i % 2);
+	printf("%d stages from %d threads, each in its own slot\n",
+	       2 * THREADS, THREADS);
+}
+
+int main()
+{
+	timeline();
+	full();
+	threads();
+
+	return check_result();
+}
@@ -0,0 +1,98 @@
+/*
+ * fmt_fixed<W, F> prints what "%-W.Ff" prints, for the fields the cutting
+ * display uses, and how long it takes against the vsnprintf path it
+ * replaced (lcd::vprint(), float argument).
+ */
+#include "check.h"
+#include "fixed_fmt.h"
+#include "esp_random.h"
+#include "host.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#define BENCH_OPS	1000000
+
+static volatile char sink;
+
+static void vfmt(char *buf, size_t size, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(buf, size, format, args);
+	va_end(args);
+}
+
+static constexpr double pow10(unsigned f)
+{
+	return f ? 10 * pow10(f - 1) : 1;
+}
+
+/* The first W chars of the printf text, fmt_fixed clips what is longer */
+template <unsigned W, unsigned F> static bool same(int32_t v)
+{
+	char ref[32], out[W + 1];
+
+	snprintf(ref, sizeof(ref), "%-*.*f", W, F, v / pow10(F));
+	*fmt_fixed<W, F>(out, v) = 0;
+	if (!strncmp(ref, out, W))
+		return true;
+
+	fprintf(stderr, "fmt_fixed<%u, %u>(%d): \"%s\", printf \"%.*s\"\n",
+		W, F, v, out, W, ref);
+	return false;
+}
+
+template <unsigned W, unsigned F> static void check_field()
+{
+	static const int32_t edge[] = {
+		0, 1, -1, 9, 10, 99, 100, -99, -100, 999999, -999999,
+		INT32_MAX, INT32_MIN,
+	};
+	uint32_t bad = 0;
+
+	for (int32_t v = -200000; v <= 200000; v++)
+		bad += !same<W, F>(v);
+	for (int32_t v : edge)
+		bad += !same<W, F>(v);
+	for (int i = 0; i < 100000; i++)
+		bad += !same<W, F>(esp_random());
+	CHECK_EQ(bad, 0);
+}
+
+template <typename T> static double ns_per_op(T fn)
+{
+	auto t0 = std::chrono::steady_clock::now();
+
+	for (uint32_t i = 0; i < BENCH_OPS; i++)
+		fn(i);
+	return std::chrono::duration<double, std::nano>(
+		std::chrono::steady_clock::now() - t0).count() / BENCH_OPS;
+}
+
+int main()
+{
+	char buf[64];
+
+	host_srand(1);
+	check_field<4, 0>();	/* FRQ: */
+	check_field<6, 2>();	/* POS: */
+	check_field<5, 1>();	/* L: */
+	check_field<6, 0>();	/* LOAD: */
+
+	double vs = ns_per_op([&] (uint32_t i) {
+		vfmt(buf, sizeof(buf), "POS:%-6.2f", (float)i / 100);
+		sink = buf[4];
+	});
+	double fx = ns_per_op([&] (uint32_t i) {
+		memcpy(buf, "POS:", 4);
+		*fmt_fixed<6, 2>(buf + 4, i) = 0;
+		sink = buf[4];
+	});
+	printf("POS:%%-6.2f: vsnprintf %.1f ns, fmt_fixed<6, 2> %.1f ns, "
+		"%.1fx\n", vs, fx, vs / fx);
+
+	return check_result();
+}
@@ -0,0 +1,228 @@
+/*
+ * The firmware update task against the real server (SW/tools/ota, path in
+ * @argv[1]) on the loopback, into the update partition kept in memory with
+ * the flash rules. The server drops the connection every few blocks: the
+ * task goes on from the last block it has, and after a restart in between
+ * from the count it saved, unless the server now has another image. Every
+ * sector is erased and written once, the partition ends up as the image
+ * and is made the boot one. A server on the running version, or none at
+ * all, leaves the partition alone.
+ */
+#include "check.h"
+#include "fw_update.h"
+#include "hardware.h"
+#include "esp_random.h"
+#include "host.h"
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <vector>
+#include "lwip/sockets.h"
+
+#define IMAGE		"fw_update.bin"
+#define IMAGE_SIZE	(75 * FW_BLOCK_SIZE + 1234)
+#define IMAGE_BLOCKS	76
+
+struct task_end { };
+
+/* What a run of the task met */
+struct boot {
+	uint32_t cut_at;	/* power cut at this retry, 0 never */
+	uint32_t retries;
+	uint32_t erases;
+	bool restarted;
+};
+
+static const char *tool;
+static uint16_t port;
+static pid_t server;
+static std::vector<uint8_t> image;
+
+static void write_image()
+{
+	FILE *f = fopen(IMAGE, "wb");
+
+	CHECK(f && fwrite(image.data(), 1, image.size(), f) == image.size());
+	if (f)
+		fclose(f);
+}
+
+static void make_image()
+{
+	image.resize(IMAGE_SIZE);
+	for (size_t i = 0; i < image.size(); i++) {
+		/* code-like, with a block of noise in every 10 */
+		if (i / FW_BLOCK_SIZE % 10 == 9 || i < 64)
+			image[i] = esp_random();
+		else
+			image[i] = esp_random() % 8 ? image[i - 64 + i % 3] :
+				esp_random();
+	}
+	write_image();
+}
+
+static void stop_server()
+{
+	if (server > 0) {
+		kill(server, SIGTERM);
+		waitpid(server, NULL, 0);
+	}
+	server = 0;
+}
+
+/* Serve the image as @version, dropping every @drop blocks */
+static bool start_server(const char *version, uint32_t drop)
+{
+	char p[8], d[16];
+
+	stop_server();
+	snprintf(p, sizeof(p), "%u", port);
+	snprintf(d, sizeof(d), "%u", drop);
+
+	server = fork();
+	if (!server) {
+		freopen("fw_serve.log", "a", stderr);
+		execl(tool, tool, "-p", p, "-V", version, "-d", d, IMAGE,
+		      (char *)NULL);
+		_exit(127);
+	}
+
+	/* up once it takes a connection, which it then drops */
+	for (int i = 0; i < 500; i++) {
+		struct sockaddr_in addr = { };
+		int sock = socket(AF_INET, SOCK_STREAM, 0);
+
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		bool up = !connect(sock, (struct sockaddr *)&addr,
+				   sizeof(addr));
+		close(sock);
+		if (up)
+			return true;
+		if (waitpid(server, NULL, WNOHANG) == server)
+			break;
+		usleep(20000);
+	}
+	fprintf(stderr, "%s did not start, see fw_serve.log\n", tool);
+	server = 0;
+	return false;
+}
+
+static void on_delay(void *arg, int ms)
+{
+	boot *b = (boot *)arg;
+
+	if (ms != FW_UPDATE_RETRY_MS)
+		return;
+	if (++b->retries == b->cut_at)
+		throw task_end();
+}
+
+/* A boot that starts the update: until it ends, restarts or loses power */
+static boot run(uint32_t cut_at = 0)
+{
+	void (*fn)(void *);
+	void *arg;
+	boot b = { cut_at };
+	uint32_t erases = host_ota_erases();
+
+	host_last_task(&fn, &arg);
+	host_set_delay(on_delay, &b);
+	try {
+		fn(arg);
+	} catch (host_restart&) {
+		b.restarted = true;
+	} catch (task_end&) {
+	}
+	host_set_delay(nullptr, nullptr);
+	b.erases = host_ota_erases() - erases;
+
+	return b;
+}
+
+static bool has_image()
+{
+	return !memcmp(host_ota_data(), image.data(), image.size());
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2) {
+		fprintf(stderr, "usage: test_fw_update path/to/fw_serve\n");
+		return 2;
+	}
+	tool = argv[1];
+	port = 30000 + getpid() % 20000;
+	signal(SIGPIPE, SIG_IGN);
+	host_srand(3);
+	host_ota_version("v1");
+	make_image();
+
+	/* once; every run() after it is a boot that goes on with it */
+	fw_update_start("127.0.0.1", port);
+
+	/* dropped every 20 blocks: three reconnections, no sector twice */
+	if (!start_server("v2", 20))
+		return 1;
+	boot b = run();
+	CHECK(b.restarted);
+	CHECK_EQ(b.retries, 3);
+	CHECK_EQ(b.erases, IMAGE_BLOCKS);
+	CHECK(has_image());
+	CHECK_EQ(host_ota_boots(), 1);
+	CHECK(!strcmp(fw_update_status(), "RESTARTING"));
+	printf("%u blocks, %u connections, %u sectors erased\n",
+	       IMAGE_BLOCKS, b.retries + 1, b.erases);
+
+	/* the power goes after 30 blocks: the next boot has 46 to go */
+	host_ota_wipe();
+	if (!start_server("v3", 30))
+		return 1;
+	b = run(1);
+	CHECK(!b.restarted);
+	CHECK_EQ(b.erases, 30);
+	b = run();
+	CHECK(b.restarted);
+	CHECK_EQ(b.retries, 1);
+	CHECK_EQ(b.erases, IMAGE_BLOCKS - 30);
+	CHECK(has_image());
+	CHECK_EQ(host_ota_boots(), 2);
+	printf("resumed after a restart: %u sectors erased\n", b.erases);
+
+	/* same again, but the server has another image by then */
+	b = run(1);
+	CHECK_EQ(b.erases, 30);
+	image[50 * FW_BLOCK_SIZE] ^= 1;
+	write_image();
+	if (!start_server("v3", 30))
+		return 1;
+	b = run();
+	CHECK(b.restarted);
+	CHECK_EQ(b.erases, IMAGE_BLOCKS);
+	CHECK(has_image());
+	printf("another image: from the start, %u sectors erased\n",
+	       b.erases);
+
+	/* nothing to do */
+	host_ota_wipe();
+	if (!start_server("v1", 0))
+		return 1;
+	b = run();
+	CHECK(!b.restarted);
+	CHECK_EQ(b.erases, 0);
+	CHECK(!strcmp(fw_update_status(), "UP TO DATE"));
+
+	/* nobody there: gives up after its retries */
+	stop_server();
+	b = run();
+	CHECK(!b.restarted);
+	CHECK_EQ(b.retries, FW_UPDATE_RETRIES - 1);
+	CHECK_EQ(b.erases, 0);
+	CHECK(!strcmp(fw_update_status(), "NO SERVER"));
+	CHECK_EQ(host_ota_boots(), 3);
+
+	return check_result();
+}
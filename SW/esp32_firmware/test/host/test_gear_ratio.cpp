@@ -0,0 +1,89 @@
+/*
+ * gear_ratio over long runs, for every gear the menus offer: after any
+ * number of edges, in any batches and with any reversals, the steps are
+ * floor(edges x num / den), nothing accumulates.
+ */
+#include "check.h"
+#include "gear_ratio.h"
+#include "feedrate.h"
+#include "host.h"
+#include "esp_random.h"
+#include <stdio.h>
+
+#define RUN_EDGES	10000000
+
+static int64_t floor_div(int64_t a, int64_t b)
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/* Steps off at the worst point, 0 when exact everywhere */
+static int64_t run(const kin_gear& g, bool reverse)
+{
+	gear_ratio gear(g.num, g.den);
+	int32_t batch = gear.max_batch();
+	int64_t edges = 0, steps = 0, worst = 0;
+	int64_t left = RUN_EDGES;
+	int dir = 1;
+
+	while (left) {
+		int64_t seg = reverse ? 1 + esp_random() % 100000 : left;
+
+		if (seg > left)
+			seg = left;
+		left -= seg;
+
+		while (seg) {
+			int32_t n = 1 + esp_random() % batch;
+
+			if (n > seg)
+				n = seg;
+			seg -= n;
+			edges += dir * n;
+			steps += gear.advance(dir * n);
+
+			int64_t off = steps - floor_div(edges * g.num, g.den);
+			if (off < 0)
+				off = -off;
+			if (off > worst)
+				worst = off;
+		}
+		dir = -dir;
+	}
+
+	return worst;
+}
+
+static void check_list(const char *name, const std::vector<FeedRateType>& list)
+{
+	for (const FeedRateType& f : list) {
+		CHECK_EQ(run(f.gear, false), 0);
+		CHECK_EQ(run(f.gear, true), 0);
+	}
+	printf("%s: %zu gears, %d edges each way\n", name, list.size(),
+		RUN_EDGES);
+}
+
+static void check_list(const char *name, const std::vector<TaperType>& list)
+{
+	for (const TaperType& t : list) {
+		CHECK_EQ(run(t.gear.z, true), 0);
+		CHECK_EQ(run(t.gear.x, true), 0);
+	}
+	printf("%s: %zu Z/X gears, %d edges\n", name, list.size(), RUN_EDGES);
+}
+
+int main()
+{
+	host_srand(1);
+
+	check_list("metric", thread_list);
+	check_list("tpi", tpi_list);
+	check_list("module", module_list);
+	check_list("multistart", multistart_list);
+	check_list("feed", feedrate_list);
+	check_list("taper", taper_list);
+	check_list("cone", cone_list);
+
+	return check_result();
+}
@@ -0,0 +1,144 @@
+/*
+ * log2_histogram: the bins, percentiles against the exact ones of the
+ * same samples, merge against one histogram of all of them, and add()
+ * from several threads at once.
+ */
+#include "check.h"
+#include "histogram.h"
+#include "esp_random.h"
+#include "host.h"
+#include <stdio.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+static unsigned bin_of(uint32_t v)
+{
+	unsigned b = 0;
+
+	while (v > 1) {
+		v >>= 1;
+		b++;
+	}
+	return b;
+}
+
+/* Log-uniform, like cycle counts: as many in 10..20 as in 1000..2000 */
+static uint32_t sample()
+{
+	uint32_t bits = esp_random() % 33;
+
+	return bits ? esp_random() >> (32 - bits) : 0;
+}
+
+static void bins()
+{
+	log2_histogram h;
+
+	h.add(0);
+	h.add(1);
+	CHECK_EQ(h.get_bin(0), 2);
+	for (unsigned n = 1; n != log2_histogram::BINS; n++) {
+		h.add(1u << n);
+		h.add((2u << n) - 1);
+		CHECK_EQ(h.get_bin(n), 2);
+	}
+	CHECK_EQ(h.count(), 2 * log2_histogram::BINS);
+	CHECK_EQ(h.get_max(), UINT32_MAX);
+
+	h.clear();
+	CHECK_EQ(h.count(), 0);
+	CHECK_EQ(h.get_max(), 0);
+	CHECK_EQ(h.percentile(50), 0);
+}
+
+/* In the bin of the exact percentile, never below it nor above the max */
+static void percentiles()
+{
+	for (uint32_t n : { 1u, 2u, 7u, 100u, 12345u }) {
+		log2_histogram h;
+		std::vector<uint32_t> v(n);
+
+		for (uint32_t& s : v) {
+			s = sample();
+			h.add(s);
+		}
+		std::sort(v.begin(), v.end());
+
+		for (unsigned pct = 0; pct <= 100; pct++) {
+			uint64_t rank = ((uint64_t)n * pct + 99) / 100;
+			uint32_t exact = v[rank ? rank - 1 : 0];
+			uint32_t p = h.percentile(pct);
+
+			CHECK(p >= exact);
+			CHECK(p <= v.back());
+			CHECK_EQ(bin_of(p), bin_of(exact));
+		}
+		CHECK_EQ(h.percentile(100), v.back());
+	}
+
+	/* the 0th is the smallest sample's bin, not the first bin */
+	log2_histogram h;
+	h.add(1000);
+	h.add(5000);
+	CHECK_EQ(h.percentile(0), 1023);
+	CHECK_EQ(h.percentile(50), 1023);
+	CHECK_EQ(h.percentile(51), 5000);
+}
+
+static void merge()
+{
+	log2_histogram a, b, all;
+
+	for (int i = 0; i < 10000; i++) {
+		uint32_t s = sample();
+
+		(i % 3 ? a : b).add(s);
+		all.add(s);
+	}
+	a.merge(b);
+
+	for (unsigned i = 0; i != log2_histogram::BINS; i++)
+		CHECK_EQ(a.get_bin(i), all.get_bin(i));
+	CHECK_EQ(a.get_max(), all.get_max());
+	for (unsigned pct = 0; pct <= 100; pct++)
+		CHECK_EQ(a.percentile(pct), all.percentile(pct));
+
+	/* into an empty one, and an empty one in */
+	log2_histogram c, empty;
+	c.merge(all);
+	c.merge(empty);
+	CHECK_EQ(c.count(), all.count());
+	CHECK_EQ(c.get_max(), all.get_max());
+}
+
+/* No sample lost, the max is the largest of all threads */
+static void threads()
+{
+	static const uint32_t ADDS = 1000000;
+	log2_histogram h;
+	std::vector<std::thread> t;
+
+	for (uint32_t k = 0; k < 4; k++)
+		t.emplace_back([&h, k] {
+			for (uint32_t i = 0; i < ADDS; i++)
+				h.add(i * 4 + k);
+		});
+	for (std::thread& th : t)
+		th.join();
+
+	CHECK_EQ(h.count(), 4 * ADDS);
+	CHECK_EQ(h.get_max(), 4 * ADDS - 1);
+}
+
+int main()
+{
+	host_srand(1);
+
+	bins();
+	percentiles();
+	merge();
+	threads();
+
+	return check_result();
+}
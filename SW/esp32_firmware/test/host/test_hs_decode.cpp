@@ -0,0 +1,124 @@
+/*
+ * The firmware update's block decoder against the server's encoder: every
+ * kind of block comes back byte for byte at the window and lookahead
+ * sizes the server takes, a block of one byte value costs the bits worked
+ * out by hand, and a stream that is cut short, or refers outside the
+ * output, stops there instead of writing past it.
+ */
+#include "check.h"
+#include "hs_decode.h"
+#include "hs_encode.h"
+#include "fw_update.h"
+#include "esp_random.h"
+#include "host.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+typedef std::vector<uint8_t> bytes;
+
+static bytes zeros(size_t n)
+{
+	return bytes(n, 0);
+}
+
+static bytes noise(size_t n)
+{
+	bytes b(n);
+
+	for (uint8_t& c : b)
+		c = esp_random();
+	return b;
+}
+
+/* Noise repeating every @period bytes, with a byte in 64 changed */
+static bytes pattern(size_t n, size_t period)
+{
+	bytes b = noise(period);
+
+	b.resize(n);
+	for (size_t i = period; i < n; i++)
+		b[i] = esp_random() % 64 ? b[i - period] : esp_random();
+	return b;
+}
+
+/* Round trip, the compressed size */
+static size_t round_trip(const bytes& in, unsigned w, unsigned l)
+{
+	bytes comp;
+	uint8_t out[FW_BLOCK_SIZE];
+
+	hs_encode(in.data(), in.size(), comp, w, l);
+	int32_t n = hs_decode(comp.data(), comp.size(), out, in.size(), w, l);
+
+	CHECK_EQ(n, (int32_t)in.size());
+	CHECK(!memcmp(out, in.data(), in.size()));
+	if (n != (int32_t)in.size() || memcmp(out, in.data(), in.size()))
+		fprintf(stderr, "w%u l%u: %zu bytes do not come back\n", w, l,
+			in.size());
+	return comp.size();
+}
+
+int main()
+{
+	static const struct { unsigned w, l; } sizes[] = {
+		{ 4, 2 }, { 4, 3 }, { 8, 4 }, { 10, 5 }, { 12, 4 },
+		{ 15, 8 }, { 15, 14 },
+	};
+
+	host_srand(7);
+	for (auto [w, l] : sizes) {
+		size_t window = 1 << w;
+
+		round_trip({ }, w, l);
+		round_trip({ 0x5a }, w, l);
+		round_trip(zeros(FW_BLOCK_SIZE), w, l);
+		round_trip(noise(FW_BLOCK_SIZE), w, l);
+		round_trip(noise(FW_BLOCK_SIZE - 1), w, l);
+		/* repeats at the window, just past it, and well inside */
+		round_trip(pattern(FW_BLOCK_SIZE, window), w, l);
+		round_trip(pattern(FW_BLOCK_SIZE, window + 1), w, l);
+		round_trip(pattern(FW_BLOCK_SIZE, 3), w, l);
+	}
+
+	/* a literal, then references of the whole lookahead */
+	size_t bits = 9 + (FW_BLOCK_SIZE - 1 + 31) / 32 * 16;
+	CHECK_EQ(round_trip(zeros(FW_BLOCK_SIZE), 10, 5), (bits + 7) / 8);
+
+	size_t n = round_trip(pattern(FW_BLOCK_SIZE, 700), 10, 5);
+	printf("w10 l5: %u byte block of zeros in %zu, repeating noise in "
+	       "%zu\n", FW_BLOCK_SIZE, (bits + 7) / 8, n);
+
+	/* cut short: what was whole comes out, nothing more */
+	bytes in = pattern(FW_BLOCK_SIZE, 100), comp;
+	uint8_t out[FW_BLOCK_SIZE];
+
+	hs_encode(in.data(), in.size(), comp, 10, 5);
+	int32_t got = hs_decode(comp.data(), comp.size() / 2, out,
+				sizeof(out), 10, 5);
+	CHECK(got > 0 && got < FW_BLOCK_SIZE);
+	CHECK(!memcmp(out, in.data(), got));
+
+	/* a reference that would run past the output */
+	memset(out, 0xee, sizeof(out));
+	bytes z = zeros(FW_BLOCK_SIZE);
+	comp.clear();
+	hs_encode(z.data(), z.size(), comp, 10, 5);
+	CHECK_EQ(hs_decode(comp.data(), comp.size(), out, 100, 10, 5), -1);
+	CHECK_EQ(out[100], 0xee);
+
+	/* and one to before the start */
+	comp.clear();
+	bit_writer bw(comp);
+	bw.put(1, 1);
+	bw.put('A', 8);
+	bw.put(0, 1);
+	bw.put(1, 10);
+	bw.put(0, 5);
+	CHECK_EQ(hs_decode(comp.data(), comp.size(), out, sizeof(out), 10, 5),
+		 -1);
+	CHECK_EQ(hs_decode(comp.data(), 2, out, sizeof(out), 10, 5), 1);
+	CHECK_EQ(out[0], 'A');
+
+	return check_result();
+}
@@ -0,0 +1,112 @@
+/*
+ * Multi-pass threading on the index: Z is armed with the spindle stopped
+ * at a random angle, the spindle turns and Z must start following on the
+ * index, the first pass on the next one, every later pass only on one at
+ * the first pass's spindle angle (a multiple of EXT_ENC_Z_SYNC_EDGES
+ * away). At the end of a pass Z is exactly on the step of the edges past
+ * that index, so every pass cuts the same groove. Both spindle sources,
+ * the index from the Z pin of the lathe encoder.
+ */
+#include "check.h"
+#include "lathe.h"
+#include "gearbox.h"
+#include "kinematics.h"
+#include "host.h"
+#include "esp_random.h"
+#include <stdio.h>
+
+#define PASSES		6
+
+static constexpr kin_gear m6 = kin_metric(1000);
+
+static int64_t steps_for(int64_t edges, const kin_gear& g)
+{
+	int64_t n = edges * g.num;
+
+	return n >= 0 ? n / g.den : -((-n + g.den - 1) / g.den);
+}
+
+/* First index past @from, forward: on a Z pulse and, once @ref, in phase */
+static int64_t next_index(int64_t from, bool has_ref, int64_t ref)
+{
+	int64_t at = (from / EXT_ENC_Z_EDGES + 1) * EXT_ENC_Z_EDGES;
+
+	if (has_ref)
+		while ((at - ref) % EXT_ENC_Z_SYNC_EDGES)
+			at += EXT_ENC_Z_EDGES;
+
+	return at;
+}
+
+static void passes(spindle_source& src, const char *name, uint32_t jitter)
+{
+	lathe_encoder enc;
+	lathe_driver out(&src);
+	stepper_ctrl z(out, axis_z_config, m6.num, m6.den, false);
+	gearbox box(src);
+	bool has_ref = false;
+	int64_t ref = 0;
+
+	host_srand(3);
+	enc.set_jitter(jitter);
+	box.add(&z);
+	box.start();
+
+	/* off the index to begin with */
+	enc.move(1 + esp_random() % (EXT_ENC_Z_EDGES - 1));
+
+	for (int pass = 0; pass < PASSES; pass++) {
+		int64_t armed = enc.get_edges();
+		int64_t at = next_index(armed, has_ref, ref);
+
+		CHECK(at - armed <= EXT_ENC_Z_SYNC_EDGES);
+
+		z.arm();
+		CHECK(z.is_armed());
+		CHECK_EQ(z.get_position(), 0);
+
+		/* waits up to 9 turns for the index, then cuts for a while */
+		enc.run(600, 1000 + esp_random() % 1500);
+		enc.run(0, 50);
+
+		int64_t end = enc.get_edges();
+
+		if (end < at) {
+			/* not that far yet, Z must still wait */
+			CHECK(z.is_armed());
+			CHECK_EQ(z.get_position(), 0);
+			continue;
+		}
+		if (!has_ref) {
+			ref = at;
+			has_ref = true;
+		}
+
+		CHECK(!z.is_armed());
+		CHECK_EQ((at - ref) % EXT_ENC_Z_SYNC_EDGES, 0);
+		CHECK_EQ(z.get_position(), steps_for(end - at, m6));
+
+		printf("%-4s jitter %2u pass %d: armed at %lld, index %lld "
+			"(%+lld turns of the first), %d steps\n", name, jitter,
+			pass, (long long)armed, (long long)at,
+			(long long)((at - ref) / EXT_ENC_Z_SYNC_EDGES),
+			z.get_position());
+	}
+	CHECK(has_ref);
+	CHECK_EQ(src.get_count(), enc.get_edges());
+	box.stop();
+}
+
+int main()
+{
+	for (uint32_t jitter : { 0, 20 }) {
+		spindle_pcnt pcnt(EXT_ENC_A, EXT_ENC_B, EXT_ENC_GLITCH_NS,
+				  EXT_ENC_Z);
+		spindle_isr isr(EXT_ENC_A, EXT_ENC_B, EXT_ENC_Z);
+
+		passes(pcnt, "pcnt", jitter);
+		passes(isr, "isr", jitter);
+	}
+
+	return check_result();
+}
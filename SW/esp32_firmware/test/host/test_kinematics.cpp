@@ -0,0 +1,179 @@
+/*
+ * The gears kinematics.h builds at compile time, against the machine
+ * worked out by hand (hardware.h): 1 mm of lead is 1/20 step per encoder
+ * edge on Z, 9/200 on X. Every menu entry's lead is read back from its
+ * title and its gear must be that exact fraction, reduced, and agree with
+ * the tooth counts multiplied out in double. The cones use the 1351/780
+ * approximation of sqrt(3): within 3e-7 of tan(), 2e-6 at 15 degrees.
+ */
+#include "check.h"
+#include "feedrate.h"
+#include <math.h>
+#include <numeric>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Exact fraction, from a decimal title field */
+struct frac {
+	__int128 num;
+	__int128 den;
+};
+
+static frac mul(frac a, frac b)
+{
+	return { a.num * b.num, a.den * b.den };
+}
+
+static frac decimal(const char *s)
+{
+	frac f = { 0, 1 };
+	bool point = false;
+
+	for (; (*s >= '0' && *s <= '9') || *s == '.'; s++) {
+		if (*s == '.') {
+			point = true;
+			continue;
+		}
+		f.num = f.num * 10 + (*s - '0');
+		if (point)
+			f.den *= 10;
+	}
+	return f;
+}
+
+/* Lead in mm per revolution, as the title reads */
+static frac lead(const char *title)
+{
+	const char *x = strchr(title, 'x');
+
+	if (strstr(title, "TPI"))
+		return mul({ 254, 10 }, { decimal(title).den,
+					  decimal(title).num });
+	if (!strncmp(title, "MOD ", 4))
+		return mul({ 355, 113 }, decimal(title + 4));
+	if (title[0] == 'M')
+		return decimal(x + 1);
+	if (title[0] == 'P')
+		return mul(decimal(title + 1), decimal(x + 1));
+	return decimal(title);
+}
+
+static bool same(frac f, const kin_gear& g)
+{
+	return f.num * g.den == f.den * g.num;
+}
+
+/* Steps per edge from the gear train, in double */
+static double z_per_edge_mm()
+{
+	double steps_mm = STP_STEPS_PER_REV * (double)GEAR_SCREW_T /
+		GEAR_STP_T / (SCREW_PITCH_UM / 1000.0);
+	double edges_rev = (double)GEAR_SPINDLE_T / GEAR_BLDC_T *
+		GEAR_ENC_DRIVE_T / GEAR_ENC_T * ENC_PPR * ENC_EDGES_PER_PULSE;
+
+	return steps_mm / edges_rev;
+}
+
+static double x_per_edge_mm()
+{
+	double steps_mm = CROSS_STEPS_PER_REV * (double)CROSS_GEAR_SCREW_T /
+		CROSS_GEAR_STP_T / (CROSS_SCREW_PITCH_UM / 1000.0);
+
+	return steps_mm * z_per_edge_mm() /
+		(STP_STEPS_PER_REV * (double)GEAR_SCREW_T / GEAR_STP_T /
+		 (SCREW_PITCH_UM / 1000.0));
+}
+
+static void check_gear(const char *title, const kin_gear& g, frac want,
+		       double lead_mm, double per_edge)
+{
+	double ratio = (double)g.num / g.den;
+
+	CHECK(same(want, g));
+	CHECK_EQ(std::gcd(g.num, g.den), 1);
+	CHECK(g.num <= g.den);
+	CHECK(fabs(ratio - lead_mm * per_edge) <= 1e-12 * ratio);
+	if (!same(want, g))
+		fprintf(stderr, "%s: %u/%u\n", title, g.num, g.den);
+}
+
+static void check_list(const char *name, const std::vector<FeedRateType>& list)
+{
+	for (const FeedRateType& f : list) {
+		frac l = lead(f.title);
+
+		check_gear(f.title, f.gear, mul(l, { 1, 20 }),
+			   (double)l.num / (double)l.den, z_per_edge_mm());
+	}
+	printf("%-10s %2zu gears exact\n", name, list.size());
+}
+
+/* Z feeds TAPER_FEED_UM, X @x_per_z of it */
+static void check_taper(const TaperType& t, frac x_per_z, double tol)
+{
+	frac feed = { TAPER_FEED_UM, 1000 };
+	double fz = TAPER_FEED_UM / 1000.0;
+	double exact = fz * (double)x_per_z.num / (double)x_per_z.den;
+	double x = (double)t.gear.x.num / t.gear.x.den;
+
+	check_gear(t.title, t.gear.z, mul(feed, { 1, 20 }), fz,
+		   z_per_edge_mm());
+	CHECK_EQ(std::gcd(t.gear.x.num, t.gear.x.den), 1);
+	CHECK(fabs(x - exact * x_per_edge_mm()) <= tol * x);
+}
+
+int main()
+{
+	/* the hand-worked figures, and the ones from the request */
+	CHECK(fabs(z_per_edge_mm() - 1 / 20.0) < 1e-15);
+	CHECK(fabs(x_per_edge_mm() - 9 / 200.0) < 1e-15);
+	CHECK_EQ(kin_metric(1500).num, 3);
+	CHECK_EQ(kin_metric(1500).den, 40);
+	CHECK_EQ(kin_tpi(8).num, 127);
+	CHECK_EQ(kin_tpi(8).den, 800);
+	CHECK_EQ(kin_module(1000).num, 71);
+	CHECK_EQ(kin_module(1000).den, 452);
+
+	/* the accuracy kinematics.h gives for 355/113 */
+	double pi = (double)KIN_PI.num / KIN_PI.den;
+	CHECK(fabs(pi - M_PI) < 2.7e-7);
+	CHECK(fabs(pi / M_PI - 1) < 8.5e-8);
+
+	check_list("metric", thread_list);
+	check_list("tpi", tpi_list);
+	check_list("module", module_list);
+	check_list("multistart", multistart_list);
+	check_list("feed", feedrate_list);
+
+	/* diameter 1:n is n / 2 along Z per unit of radius */
+	static const int64_t taper_milli[] = {
+		20047, 20020, 19922, 19254, 10000, 20000, 50000,
+	};
+	CHECK_EQ(taper_list.size(),
+		 sizeof(taper_milli) / sizeof(taper_milli[0]));
+	for (size_t i = 0; i < taper_list.size(); i++) {
+		frac r = { 1000, 2 * taper_milli[i] };
+
+		check_taper(taper_list[i], r, 1e-12);
+		CHECK(same(mul(mul({ TAPER_FEED_UM, 1000 }, r), { 9, 200 }),
+			   taper_list[i].gear.x));
+	}
+	printf("%-10s %2zu gears exact\n", "taper", taper_list.size());
+
+	/* 2 - sqrt(3) takes sqrt(3)'s error 6.5 times over */
+	static const struct { int deg; double tol; } cones[] = {
+		{ 15, 2e-6 }, { 30, 3e-7 }, { 45, 1e-12 }, { 60, 3e-7 },
+	};
+	CHECK_EQ(cone_list.size(), sizeof(cones) / sizeof(cones[0]));
+	for (size_t i = 0; i < cone_list.size(); i++) {
+		double t = tan(cones[i].deg * M_PI / 180);
+		frac r = { llround(t * 1e15), 1000000000000000 };
+
+		check_taper(cone_list[i], r, cones[i].tol);
+	}
+	printf("%-10s %2zu gears within 2e-6 of tan()\n", "cone",
+		cone_list.size());
+
+	return check_result();
+}
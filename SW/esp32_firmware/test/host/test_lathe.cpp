@@ -0,0 +1,129 @@
+/*
+ * The virtual lathe end to end: the encoder decoded by spindle_pcnt and
+ * spindle_isr, the gearbox and a Z stepper_ctrl following it, the steps
+ * recorded by the driver. Pitch, limit and interrupts per edge.
+ */
+#include "check.h"
+#include "lathe.h"
+#include "gearbox.h"
+#include "kinematics.h"
+#include "host.h"
+#include <stdio.h>
+
+static constexpr kin_gear m6 = kin_metric(1000);
+
+static int64_t steps_for(int64_t edges, const kin_gear& g)
+{
+	int64_t n = edges * g.num;
+
+	return n >= 0 ? n / g.den : -((-n + g.den - 1) / g.den);
+}
+
+/* Forward only: every step lands on the thread, the slack side is unknown */
+static void pitch(spindle_source& src, const char *name)
+{
+	lathe_encoder enc;
+	lathe_driver out(&src);
+	stepper_ctrl z(out, axis_z_config, m6.num, m6.den, false);
+	gearbox box(src);
+	static const sim_segment profile[] = {
+		{ 200, 0, 1000 },
+		{ 500, 1000, 1000 },
+		{ 300, 1000, 50 },
+	};
+
+	box.add(&z);
+	box.start();
+	enc.run(profile, 3);
+
+	int64_t edges = enc.get_edges();
+	CHECK_EQ(src.get_count(), edges);
+	box.stop();
+
+	CHECK_EQ(z.get_position(), steps_for(edges, m6));
+	CHECK_EQ(out.get_position(), z.get_position());
+
+	/* the spindle count at the step gives the position it must be at */
+	uint32_t off = 0;
+	for (const lathe_step& s : out.get_steps())
+		if (s.position != steps_for(s.spindle, m6))
+			off++;
+	CHECK_EQ(off, 0);
+
+	printf("%s: %lld edges, %d steps, %u interrupts, batch %u\n", name,
+		(long long)edges, z.get_position(), src.get_events(),
+		box.get_batch());
+}
+
+/* Back and forth: the slack is taken up, the carriage ends exact */
+static void reversals()
+{
+	spindle_pcnt src(EXT_ENC_A, EXT_ENC_B, EXT_ENC_GLITCH_NS);
+	lathe_encoder enc;
+	lathe_driver out(&src);
+	stepper_ctrl z(out, axis_z_config, m6.num, m6.den, false);
+	gearbox box(src);
+	static const sim_segment profile[] = {
+		{ 100, 0, 600 },
+		{ 200, 600, -600 },
+		{ 300, -600, 300 },
+		{ 100, 300, 0 },
+	};
+
+	box.add(&z);
+	box.start();
+	enc.run(profile, 4);
+	/* let the last take-up finish */
+	enc.run(0, 200);
+	box.stop();
+
+	CHECK_EQ(z.get_position(), steps_for(enc.get_edges(), m6));
+	CHECK(z.get_reversals() >= 2);
+
+	uint32_t take_up = 0;
+	for (const lathe_step& s : out.get_steps())
+		take_up += s.take_up;
+	CHECK(take_up > 0);
+	/* the motor is a slack away from the carriage, or on it */
+	int32_t d = out.get_position() - z.get_position();
+	CHECK(d == 0 || d == (int32_t)((uint64_t)STP_BACKLASH_UM *
+		MOTOR_STEPS_PER_MM_NUM / (MOTOR_STEPS_PER_MM_DEN * 1000)) ||
+	      -d == (int32_t)((uint64_t)STP_BACKLASH_UM *
+		MOTOR_STEPS_PER_MM_NUM / (MOTOR_STEPS_PER_MM_DEN * 1000)));
+}
+
+/* Into the limit at speed: it stops on it, not past it */
+static void limit()
+{
+	spindle_pcnt src(EXT_ENC_A, EXT_ENC_B, EXT_ENC_GLITCH_NS);
+	lathe_encoder enc;
+	lathe_driver out(&src);
+	stepper_ctrl z(out, axis_z_config, m6.num, m6.den, false);
+	gearbox box(src);
+	int32_t max = (int64_t)50 * 100 * MOTOR_STEPS_PER_MM_NUM /
+		(MOTOR_STEPS_PER_MM_DEN * 1000);
+
+	z.set_limit(50);
+	box.add(&z);
+	box.start();
+	enc.run(600, 1000);
+	box.stop();
+
+	CHECK_EQ(z.get_position(), max);
+	CHECK(z.check_limit());
+	for (const lathe_step& s : out.get_steps())
+		CHECK(s.position <= max);
+}
+
+int main()
+{
+	spindle_pcnt pcnt(EXT_ENC_A, EXT_ENC_B, EXT_ENC_GLITCH_NS);
+	spindle_isr isr(EXT_ENC_A, EXT_ENC_B);
+
+	pitch(pcnt, "pcnt");
+	pitch(isr, "isr");
+	reversals();
+	limit();
+
+	return check_result();
+}
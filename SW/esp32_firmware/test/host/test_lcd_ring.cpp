@@ -0,0 +1,250 @@
+/*
+ * lcd.cpp on the HD44780 shim, its task on a thread of its own the way
+ * lcd.h is used. Before the task runs the ring fills, and try_print()
+ * then drops and counts; once it runs everything comes out on the glass.
+ * A clear followed by a reprint of the same text sends nothing. Under
+ * load from the UI side, with print() waiting and try_print() and
+ * try_print_fixed() dropping, every sync() comes back with the last
+ * message of each row on the glass, whole, never an older one; and none
+ * of it touches the heap, neither new nor malloc.
+ */
+#include "check.h"
+#include "lcd.h"
+#include "host.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
+
+#define MESSAGES	200000
+#define SYNC_EVERY	1000
+#define FRAME_US	20
+
+static std::atomic<bool> counting;
+static std::atomic<uint32_t> heap_calls;
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+extern "C" void __libc_free(void *p);
+
+extern "C" void *malloc(size_t size)
+{
+	if (counting)
+		heap_calls++;
+	return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+	if (counting)
+		heap_calls++;
+	return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *p, size_t size)
+{
+	if (counting)
+		heap_calls++;
+	return __libc_realloc(p, size);
+}
+
+extern "C" void free(void *p)
+{
+	if (counting && p)
+		heap_calls++;
+	__libc_free(p);
+}
+
+void *operator new(size_t size)
+{
+	if (counting)
+		heap_calls++;
+	void *p = __libc_malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	if (counting)
+		heap_calls++;
+	__libc_free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept
+{
+	operator delete(p);
+}
+
+struct task_end { };
+
+static std::atomic<bool> stopping;
+
+static int64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static thread_local bool in_task;
+
+/*
+ * Both sides wait in vTaskDelay(): the lcd task for the frame, a short
+ * one so the ring still fills, print() for a free slot
+ */
+static void idle(void *arg)
+{
+	if (in_task)
+		std::this_thread::sleep_for(std::chrono::microseconds(
+			FRAME_US));
+	else
+		std::this_thread::yield();
+}
+
+/* The lcd task found nothing given: leave it once asked to */
+static void on_delay(void *arg, int ms)
+{
+	if (ms == -1 && stopping)
+		throw task_end();
+}
+
+static void lcd_task(void (*fn)(void *), void *arg)
+{
+	in_task = true;
+	try {
+		fn(arg);
+	} catch (task_end&) {
+	}
+}
+
+/* The first strlen(@want) chars of @row are @want */
+static bool shows(enum row_e row, const char *want)
+{
+	char text[LCD_COLS + 1];
+
+	host_lcd_row(row, text);
+	if (!strncmp(text, want, strlen(want)))
+		return true;
+	fprintf(stderr, "row %d: \"%s\", want \"%s\"\n", row, text, want);
+	return false;
+}
+
+/* Before the task runs: a ring worth of messages, then drops */
+static void fill(lcd& screen)
+{
+	screen.clear();
+	screen.print(FIRST_ROW, CENTER, "VERSION");
+	screen.print(SECOND_ROW, RIGHT, "%s", "v1.2");
+	for (int32_t i = 0; i < LCD_RING_SIZE - 3; i++)
+		CHECK((screen.try_print_fixed<6, 2>(SECOND_ROW, 0, "POS:", i)));
+
+	CHECK(!screen.try_print(FIRST_ROW, 0, "lost"));
+	CHECK(!(screen.try_print_fixed<6, 2>(SECOND_ROW, 0, "POS:", -1)));
+	CHECK_EQ(screen.get_dropped(), 2);
+}
+
+/* What fill() left, then a clear and the same again */
+static void redraw(lcd& screen)
+{
+	screen.sync();
+	CHECK(shows(FIRST_ROW, "    VERSION     "));
+	CHECK(shows(SECOND_ROW, "POS:0.04    v1.2"));
+
+	uint32_t chars = host_lcd_chars();
+	lcd_stats st = screen.get_stats();
+
+	screen.clear();
+	screen.print(FIRST_ROW, CENTER, "VERSION");
+	screen.print(SECOND_ROW, RIGHT, "%s", "v1.2");
+	screen.print_fixed<6, 2>(SECOND_ROW, 0, "POS:", 4);
+	screen.sync();
+	CHECK_EQ(host_lcd_chars(), chars);
+	CHECK_EQ(screen.get_stats().frames, st.frames);
+}
+
+struct producer_stats {
+	uint32_t sent;
+	uint32_t stale;		/* a sync() that found older text */
+	int64_t max_try_ns;	/* longest try_print(), full or not */
+};
+
+static void producer(lcd& screen, producer_stats *st)
+{
+	char first[LCD_COLS + 1] = "", second[LCD_COLS + 1] = "";
+
+	for (uint32_t seq = 0; seq < MESSAGES; seq++) {
+		/* every 3rd waits like print(), the rest drop like try_ */
+		if (seq % 3 == 0) {
+			screen.print(SECOND_ROW, 0, "S:%-12u", seq);
+			snprintf(second, sizeof(second), "S:%-12u", seq);
+			st->sent++;
+		} else {
+			int64_t t0 = now_ns();
+			bool sent = seq % 3 == 1 ?
+				screen.try_print(FIRST_ROW, 0, "F:%-8u", seq) :
+				screen.try_print_fixed<8, 0>(FIRST_ROW, 0,
+					"F:", seq);
+			int64_t t = now_ns() - t0;
+
+			if (t > st->max_try_ns)
+				st->max_try_ns = t;
+			if (sent) {
+				snprintf(first, sizeof(first), "F:%-8u", seq);
+				st->sent++;
+			}
+		}
+
+		if (seq % SYNC_EVERY == SYNC_EVERY - 1) {
+			screen.sync();
+			if (!shows(FIRST_ROW, first) ||
+			    !shows(SECOND_ROW, second))
+				st->stale++;
+		}
+	}
+	screen.sync();
+}
+
+int main()
+{
+	lcd screen;
+	void (*fn)(void *);
+	void *arg;
+	producer_stats p = { };
+
+	host_last_task(&fn, &arg);
+	host_set_idle(idle, nullptr);
+	host_set_delay(on_delay, nullptr);
+
+	fill(screen);
+	std::thread task(lcd_task, fn, arg);
+	redraw(screen);
+
+	uint32_t dropped = screen.get_dropped();
+	uint32_t frames = screen.get_stats().frames;
+
+	counting = true;
+	producer(screen, &p);
+	counting = false;
+
+	stopping = true;
+	task.join();
+
+	dropped = screen.get_dropped() - dropped;
+	frames = screen.get_stats().frames - frames;
+	CHECK_EQ(heap_calls, 0);
+	CHECK_EQ(p.sent + dropped, MESSAGES);
+	CHECK_EQ(p.stale, 0);
+	CHECK(frames > 0);
+	CHECK(dropped > 0);
+
+	printf("%u messages: %u sent, %u dropped, %u frames drawn, "
+		"try_print %lld ns at most\n", MESSAGES, p.sent, dropped,
+		frames, (long long)p.max_try_ns);
+
+	return check_result();
+}
@@ -0,0 +1,108 @@
+/*
+ * Into the limit following the spindle: for every gear of the feed and
+ * thread lists, at a quarter, 60% and all of its safe speed, the Z axis
+ * stops on the limit, never past it, and brakes no harder than
+ * STP_LIMIT_DEC_HZ_S on the way.
+ */
+#include "check.h"
+#include "feedrate.h"
+#include "lathe.h"
+#include "gearbox.h"
+#include "limit_ramp.h"
+#include "host.h"
+#include <math.h>
+#include <stdio.h>
+
+#define LIMIT_10	50	/* 5 mm */
+#define SPEED_WIN	32	/* steps the speed is taken over */
+
+struct stop_result {
+	int32_t position;
+	int32_t max;
+	uint32_t past;		/* steps made past the limit */
+	double brake;		/* worst speed over the braking curve, x */
+};
+
+static stop_result run(const kin_gear& g, double pct)
+{
+	spindle_pcnt src(EXT_ENC_A, EXT_ENC_B, EXT_ENC_GLITCH_NS);
+	lathe_encoder enc;
+	lathe_driver out(&src);
+	stepper_ctrl z(out, axis_z_config, g.num, g.den, false);
+	gearbox box(src);
+	stop_result r = { 0, (int32_t)((int64_t)LIMIT_10 * 100 *
+		MOTOR_STEPS_PER_MM_NUM / (MOTOR_STEPS_PER_MM_DEN * 1000)), 0, 0 };
+	int32_t rpm = z.get_max_rpm() * pct / 100;
+	/* time to the limit at that speed, a ramp up and some to spare */
+	double hz = (double)rpm * ENC_PULSES_PER_REV_NUM /
+		ENC_PULSES_PER_REV_DEN / 60 * g.num / g.den;
+	uint32_t ms = r.max / hz * 1000 * 1.5 + 300;
+	sim_segment profile[] = {
+		{ 200, 0, rpm },
+		{ ms, rpm, rpm },
+	};
+
+	z.set_limit(LIMIT_10);
+	box.add(&z);
+	box.start();
+	enc.run(profile, 2);
+	box.stop();
+	r.position = z.get_position();
+
+	/* the speed over the last steps against sqrt(2 dec left) */
+	const std::vector<lathe_step>& s = out.get_steps();
+	for (size_t i = 0; i < s.size(); i++) {
+		if (s[i].position > r.max)
+			r.past++;
+		if (i < SPEED_WIN)
+			continue;
+
+		const lathe_step& a = s[i - SPEED_WIN];
+		double v = SPEED_WIN * 1e6 / (s[i].t_us - a.t_us);
+		double curve = sqrt(2.0 * STP_LIMIT_DEC_HZ_S *
+			(r.max - a.position + 1));
+		if (v / curve > r.brake)
+			r.brake = v / curve;
+	}
+
+	return r;
+}
+
+template <typename T> static void list(const char *name,
+				       const std::vector<T>& l)
+{
+	double brake = 0;
+	uint32_t n = 0;
+
+	for (const T& t : l) {
+		if (!t.gear.num)
+			continue;
+		for (double pct : { 25.0, 60.0, 100.0 }) {
+			stop_result r = run(t.gear, pct);
+
+			CHECK_EQ(r.position, r.max);
+			CHECK_EQ(r.past, 0);
+			/*
+			 * the steps are timed by the batch events, a period
+			 * of them is 3% of SPEED_WIN steps at the ceiling
+			 */
+			CHECK(r.brake < 1.05);
+			if (r.brake > brake)
+				brake = r.brake;
+			n++;
+		}
+	}
+	printf("%-10s %3u runs on the limit, braking speed at most %.3f x "
+		"the curve\n", name, n, brake);
+}
+
+int main()
+{
+	list("feed", feedrate_list);
+	list("metric", thread_list);
+	list("tpi", tpi_list);
+	list("module", module_list);
+	list("multistart", multistart_list);
+
+	return check_result();
+}
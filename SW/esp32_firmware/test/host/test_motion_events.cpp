@@ -0,0 +1,140 @@
+/*
+ * The events the cutting loop waits on instead of polling: running into
+ * the limit either way, the listener gets MOTION_EV_LIMIT once, from the
+ * edge interrupt after the step that reached it (within one batch of
+ * edges), and nothing more while the spindle turns on; check_limit() or
+ * set_limit() arms it again. Past the safe speed it gets MOTION_EV_FAULT once. Without a
+ * listener nothing is sent, check_limit() still sees it.
+ */
+#include "check.h"
+#include "lathe.h"
+#include "gearbox.h"
+#include "kinematics.h"
+#include "motion.h"
+#include "host.h"
+#include <stdio.h>
+
+#define LIMIT_10	100	/* 0.1 mm, 10 mm */
+
+static constexpr kin_gear m6 = kin_metric(1000);
+
+struct rig {
+	spindle_pcnt src { EXT_ENC_A, EXT_ENC_B, EXT_ENC_GLITCH_NS };
+	lathe_encoder enc;
+	lathe_driver out { &src };
+	stepper_ctrl z { out, axis_z_config, m6.num, m6.den, false };
+	gearbox box { src };
+
+	rig(bool listen) {
+		/* any handle will do, the host only records the bits */
+		if (listen)
+			z.set_listener((TaskHandle_t)this);
+		box.add(&z);
+		box.start();
+		host_take_notify();
+	}
+
+	~rig() {
+		box.stop();
+	}
+
+	/* Time of one batch of edges at @rpm */
+	double batch_us(int32_t rpm) {
+		return box.get_batch() * 60e6 * ENC_PULSES_PER_REV_DEN /
+			((double)ENC_PULSES_PER_REV_NUM * (rpm < 0 ? -rpm : rpm));
+	}
+};
+
+/* Into the limit at @rpm, and on for as long again */
+static void limit(int32_t rpm)
+{
+	rig r(true);
+	int32_t max = (int64_t)LIMIT_10 * 100 * MOTOR_STEPS_PER_MM_NUM /
+		(MOTOR_STEPS_PER_MM_DEN * 1000);
+	/* up at 500 RPM/s, within what the planner allows */
+	sim_segment start[] = {
+		{ (uint32_t)(rpm < 0 ? -rpm : rpm) * 2, 0, rpm },
+		{ 3000, rpm, rpm },
+	};
+	int64_t at;
+
+	r.z.set_limit(LIMIT_10);
+	r.enc.run(start, 2);
+
+	CHECK_EQ(r.z.get_position(), rpm > 0 ? max : -max);
+	CHECK_EQ(host_take_notify(&at), MOTION_EV_LIMIT);
+
+	/* the last carriage step, not a take-up */
+	const std::vector<lathe_step>& s = r.out.get_steps();
+	int64_t last = 0;
+	for (const lathe_step& st : s)
+		if (!st.take_up)
+			last = st.t_us;
+
+	int64_t late = at - last;
+	CHECK(late >= 0 && late <= r.batch_us(rpm) + 1);
+
+	/* held on it, the spindle turning on, until the loop takes it */
+	r.enc.run(rpm, 500);
+	CHECK_EQ(host_take_notify(), 0);
+	CHECK_EQ(r.z.get_position(), rpm > 0 ? max : -max);
+	CHECK(r.z.check_limit());
+
+	/* taken, or armed again, while still on the limit: once more */
+	r.enc.run(rpm, 100);
+	CHECK_EQ(host_take_notify(), MOTION_EV_LIMIT);
+	r.z.set_limit(LIMIT_10);
+	r.enc.run(rpm, 100);
+	CHECK_EQ(host_take_notify(), MOTION_EV_LIMIT);
+	r.enc.run(rpm, 100);
+	CHECK_EQ(host_take_notify(), 0);
+
+	printf("limit at %5d RPM: event %lld us after the last step "
+		"(one batch is %.0f us)\n", rpm, (long long)late,
+		r.batch_us(rpm));
+}
+
+static void no_listener()
+{
+	rig r(false);
+
+	sim_segment start[] = {
+		{ 600, 0, 300 },
+		{ 3000, 300, 300 },
+	};
+
+	r.z.set_limit(LIMIT_10);
+	r.enc.run(start, 2);
+	CHECK_EQ(r.z.get_fault(), PLAN_OK);
+	CHECK_EQ(host_take_notify(), 0);
+	CHECK(r.z.check_limit());
+}
+
+/* Ramp past the safe speed, no limit */
+static void fault()
+{
+	rig r(true);
+	int32_t rpm = r.z.get_max_rpm() * 6 / 5;
+	sim_segment ramp[] = {
+		{ 1000, 0, rpm },
+		{ 200, rpm, rpm },
+	};
+
+	r.enc.run(ramp, 2);
+	CHECK_EQ(r.z.get_fault(), PLAN_OVERSPEED);
+	CHECK_EQ(host_take_notify(), MOTION_EV_FAULT);
+
+	r.enc.run(rpm, 200);
+	CHECK_EQ(host_take_notify(), 0);
+}
+
+int main()
+{
+	limit(300);
+	limit(-300);
+	limit(700);
+	no_listener();
+	fault();
+
+	return check_result();
+}
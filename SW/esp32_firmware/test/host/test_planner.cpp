@@ -0,0 +1,190 @@
+/*
+ * step_planner: for every shipped gear the fault latches once the step
+ * rate, predicted PLAN_LOOKAHEAD_US ahead, passes PLAN_MARGIN_PCT of the
+ * ceiling, and never while it stays below. Then on the virtual lathe:
+ * a spindle ramping past the safe speed is caught before the steps reach
+ * the ceiling, a steady one under the margin runs on.
+ */
+#include "check.h"
+#include "planner.h"
+#include "feedrate.h"
+#include "lathe.h"
+#include "gearbox.h"
+#include "kinematics.h"
+#include "host.h"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+#define CEIL_HZ		STP_MAX_STEP_HZ
+#define ACC_HZ_S	STP_MAX_ACC_HZ_S
+
+static const double EDGES_RPM = (double)ENC_PULSES_PER_REV_NUM /
+	ENC_PULSES_PER_REV_DEN / 60;
+static const double MARGIN = PLAN_MARGIN_PCT / 100.0;
+
+/* Edges/s Q16 of @hz steps/s on @g */
+static int64_t edges_q(double hz, const kin_gear& g)
+{
+	return llround(hz * g.den / g.num * (1 << step_planner::Q));
+}
+
+static enum plan_fault fault(const kin_gear& g, double hz, double acc_hz)
+{
+	step_planner p(g.num, g.den, CEIL_HZ, ACC_HZ_S);
+
+	p.check(edges_q(hz, g), edges_q(acc_hz, g));
+	return p.get_fault();
+}
+
+/* Step rates and accelerations just either side of the margins */
+static void gear(const kin_gear& g, uint32_t& checked)
+{
+	static const double near = 0.001;
+	double ahead = ACC_HZ_S / 2 * PLAN_LOOKAHEAD_US / 1e6;
+	double margin = CEIL_HZ * MARGIN;
+
+	if (!g.num)
+		return;
+
+	for (int sign = -1; sign <= 1; sign += 2) {
+		/* steady */
+		CHECK_EQ(fault(g, sign * margin * (1 - near), 0), PLAN_OK);
+		CHECK_EQ(fault(g, sign * margin * (1 + near), 0),
+			 PLAN_OVERSPEED);
+		/* accelerating: the speed ahead counts, not the one now */
+		CHECK_EQ(fault(g, sign * (margin - ahead) * (1 - near),
+			       sign * ACC_HZ_S / 2), PLAN_OK);
+		CHECK_EQ(fault(g, sign * (margin - ahead) * (1 + near),
+			       sign * ACC_HZ_S / 2), PLAN_OVERSPEED);
+		/* braking from over the margin is fine */
+		CHECK_EQ(fault(g, sign * (margin + ahead) * (1 - near),
+			       -sign * ACC_HZ_S / 2), PLAN_OK);
+		/* too fast a change, either way, at a low speed */
+		CHECK_EQ(fault(g, sign * margin / 10, ACC_HZ_S * (1 - near)),
+			 PLAN_OK);
+		CHECK_EQ(fault(g, sign * margin / 10, ACC_HZ_S * (1 + near)),
+			 PLAN_OVERACCEL);
+		CHECK_EQ(fault(g, sign * margin / 10, -ACC_HZ_S * (1 + near)),
+			 PLAN_OVERACCEL);
+	}
+
+	/* max_rpm() is the margin, give or take its rounding */
+	step_planner p(g.num, g.den, CEIL_HZ, ACC_HZ_S);
+	double rpm = margin * g.den / g.num / EDGES_RPM;
+	CHECK(p.max_rpm() <= rpm && p.max_rpm() > rpm - 1);
+
+	/* latched until cleared */
+	p.check(edges_q(CEIL_HZ, g), 0);
+	CHECK(p.check(0, 0));
+	p.clear();
+	CHECK(!p.check(0, 0));
+
+	checked++;
+}
+
+template <typename T> static void list(const std::vector<T>& l,
+				       uint32_t& checked)
+{
+	for (const T& t : l) {
+		if constexpr (requires { t.gear.z; }) {
+			gear(t.gear.z, checked);
+			gear(t.gear.x, checked);
+		} else {
+			gear(t.gear, checked);
+		}
+	}
+}
+
+struct lathe_result {
+	enum plan_fault fault;
+	double rpm;		/* true spindle speed at the latch */
+	double hz;		/* true step rate there */
+	double max_hz;		/* highest step rate of the run */
+};
+
+/* Spindle from @rpm0 to @rpm1 over @ms, @hold ms there, up to a latch */
+static lathe_result ramp(const kin_gear& g, double rpm0, double rpm1,
+			 uint32_t ms, uint32_t hold = 0)
+{
+	spindle_pcnt src(EXT_ENC_A, EXT_ENC_B, EXT_ENC_GLITCH_NS);
+	lathe_encoder enc;
+	lathe_driver out(&src);
+	stepper_ctrl z(out, axis_z_config, g.num, g.den, false);
+	gearbox box(src);
+	lathe_result r = { PLAN_OK, 0, 0, 0 };
+	double hz_rpm = EDGES_RPM * g.num / g.den;
+
+	box.add(&z);
+	box.start();
+	for (uint32_t t = 0; t < ms + hold && r.fault == PLAN_OK; t++) {
+		int32_t a = lround(rpm0 + (rpm1 - rpm0) * std::min(t, ms) / ms);
+		int32_t b = lround(rpm0 + (rpm1 - rpm0) * std::min(t + 1, ms) /
+			ms);
+		sim_segment seg = { 1, a, b };
+
+		enc.run(&seg, 1);
+		r.fault = z.get_fault();
+		r.rpm = b;
+		r.hz = b * hz_rpm;
+		if (r.hz > r.max_hz)
+			r.max_hz = r.hz;
+	}
+	box.stop();
+	return r;
+}
+
+static void lathe()
+{
+	static constexpr kin_gear m6 = kin_metric(1000);
+	double hz_rpm = EDGES_RPM * m6.num / m6.den;
+	double max_rpm = CEIL_HZ * MARGIN / hz_rpm;
+	/* the spindle acceleration that asks ACC_HZ_S of the motor */
+	double acc_rpm_s = ACC_HZ_S / hz_rpm;
+
+	/* up to 95% of the safe speed and a second there: no fault */
+	lathe_result r = ramp(m6, 0, max_rpm * 0.95,
+		max_rpm * 0.95 / (acc_rpm_s * 0.1) * 1000, 1000);
+	CHECK_EQ(r.fault, PLAN_OK);
+
+	/* ramps past the ceiling at a tenth and half the motor's accel */
+	for (double k : { 0.1, 0.5 }) {
+		double to = max_rpm / MARGIN * 1.2;
+		uint32_t ms = to / (acc_rpm_s * k) * 1000;
+
+		r = ramp(m6, 0, to, ms);
+		CHECK_EQ(r.fault, PLAN_OVERSPEED);
+		CHECK(r.hz < CEIL_HZ);
+		/* what it would be at a lookahead later had reached it */
+		CHECK(r.rpm + acc_rpm_s * k * PLAN_LOOKAHEAD_US / 1e6 >
+		      max_rpm * 0.98);
+		printf("ramp at %4.0f RPM/s: overspeed at %.0f RPM, %.0f "
+			"steps/s of %u, safe speed %.0f RPM\n", acc_rpm_s * k,
+			r.rpm, r.hz, CEIL_HZ, max_rpm);
+	}
+
+	/* faster than the motor can follow: caught below the ceiling */
+	r = ramp(m6, 0, max_rpm, max_rpm / (acc_rpm_s * 2) * 1000);
+	CHECK_EQ(r.fault, PLAN_OVERACCEL);
+	CHECK(r.hz < CEIL_HZ);
+	printf("ramp at %4.0f RPM/s: overaccel at %.0f RPM\n", acc_rpm_s * 2,
+		r.rpm);
+}
+
+int main()
+{
+	uint32_t checked = 0;
+
+	list(thread_list, checked);
+	list(tpi_list, checked);
+	list(module_list, checked);
+	list(multistart_list, checked);
+	list(feedrate_list, checked);
+	list(taper_list, checked);
+	list(cone_list, checked);
+	printf("%u gears: latched past the margin, not below\n", checked);
+
+	lathe();
+
+	return check_result();
+}
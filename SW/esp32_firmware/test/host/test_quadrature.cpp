@@ -0,0 +1,139 @@
+/*
+ * quad_decoder on AB sequences, then spindle_isr decoding the virtual
+ * lathe's encoder with glitches and missed interrupts: the count and the
+ * direction come out right, the missed edges are counted as errors.
+ */
+#include "check.h"
+#include "quadrature.h"
+#include "lathe.h"
+#include "esp_random.h"
+#include "host.h"
+#include <stdio.h>
+
+/* AB states in forward order, A leads */
+static const uint8_t fwd[4] = { 0b00, 0b10, 0b11, 0b01 };
+
+static int32_t feed(quad_decoder& q, const uint8_t *ab, uint32_t n)
+{
+	int32_t sum = 0;
+
+	for (uint32_t i = 0; i < n; i++)
+		sum += q.update(ab[i]);
+	return sum;
+}
+
+static void sequences()
+{
+	quad_decoder q;
+
+	/* a turn each way, then no change at all */
+	static const uint8_t turn[] = { 0b10, 0b11, 0b01, 0b00 };
+	static const uint8_t back[] = { 0b01, 0b11, 0b10, 0b00 };
+	static const uint8_t same[] = { 0b00, 0b00, 0b00 };
+	CHECK_EQ(feed(q, turn, 4), 4);
+	CHECK_EQ(feed(q, back, 4), -4);
+	CHECK_EQ(feed(q, same, 3), 0);
+
+	/* a glitch on either channel, there and back, adds nothing */
+	static const uint8_t glitch_a[] = { 0b10, 0b00 };
+	static const uint8_t glitch_b[] = { 0b01, 0b00 };
+	CHECK_EQ(feed(q, glitch_a, 2), 0);
+	CHECK_EQ(feed(q, glitch_b, 2), 0);
+	CHECK_EQ(q.get_illegal(), 0);
+
+	/* a missed edge is two in the last direction: backwards now */
+	static const uint8_t skip[] = { 0b11 };
+	CHECK_EQ(feed(q, back, 2), -2);		/* 01 11 */
+	CHECK_EQ(feed(q, back + 3, 1), -2);	/* 11 -> 00 */
+	CHECK_EQ(q.get_illegal(), 1);
+
+	/* and forwards once it turns */
+	CHECK_EQ(feed(q, turn, 1), 1);		/* 00 -> 10 */
+	CHECK_EQ(feed(q, fwd, 1), -1);		/* 10 -> 00 */
+	CHECK_EQ(feed(q, turn, 1), 1);		/* forward again */
+	q.reset(0b00);
+	CHECK_EQ(feed(q, skip, 1), 2);		/* 00 -> 11 */
+	CHECK_EQ(q.get_illegal(), 2);
+
+	/* reset() takes the pins as they are, no edge */
+	q.reset(0b11);
+	CHECK_EQ(feed(q, &fwd[2], 1), 0);
+}
+
+/*
+ * A recorded run: a random walk with reversals, sampled with an edge lost
+ * now and then at speed, i.e. between two in the same direction.
+ */
+static void recorded()
+{
+	quad_decoder q;
+	int64_t pos = 0, count = 0;
+	uint32_t lost = 0;
+	int dir = 1, last = 1;
+
+	q.reset(fwd[0]);
+	for (int i = 0; i < 1000000; i++) {
+		if (esp_random() % 1000 == 0)
+			dir = -dir;
+
+		pos += dir;
+		/* lost: the next sample sees two edges at once */
+		if (dir == last && esp_random() % 50 == 0) {
+			pos += dir;
+			lost++;
+		}
+		last = dir;
+		count += q.update(fwd[pos & 3]);
+	}
+
+	CHECK_EQ(count, pos);
+	CHECK_EQ(q.get_illegal(), lost);
+	printf("recorded: %lld edges net, %u lost, all counted\n",
+		(long long)pos, lost);
+}
+
+/* spindle_isr on the lathe, @rpm for 500 ms, one more edge at the end */
+static void lathe(int32_t rpm, uint32_t glitch, uint32_t miss)
+{
+	spindle_isr src(EXT_ENC_A, EXT_ENC_B);
+	lathe_encoder enc;
+	int32_t last = 0;
+
+	src.start(1, [] (void *arg, int32_t edges) {
+		*static_cast<int32_t *>(arg) = edges;
+	}, &last);
+
+	enc.set_glitch(glitch);
+	enc.set_miss(miss);
+	enc.run(rpm, 500);
+	/* a missed interrupt on the last edge comes in with this one */
+	enc.move(rpm < 0 ? -1 : 1);
+
+	int64_t edges = enc.get_edges();
+	CHECK_EQ(src.get_count(), edges);
+	CHECK((last > 0) == (rpm > 0));
+	CHECK_EQ(src.get_errors(), miss ? (edges < 0 ? -edges : edges) / miss :
+		0);
+	src.stop();
+
+	printf("lathe %5d RPM, glitch %3u, miss %3u: %lld edges, %u errors\n",
+		rpm, glitch, miss, (long long)edges, src.get_errors());
+}
+
+int main()
+{
+	host_srand(1);
+
+	sequences();
+	recorded();
+
+	lathe(600, 0, 0);
+	lathe(-600, 0, 0);
+	lathe(600, 37, 0);
+	lathe(-600, 37, 0);
+	lathe(600, 0, 101);
+	lathe(-600, 0, 101);
+	lathe(600, 0, 7);
+
+	return check_result();
+}
@@ -0,0 +1,150 @@
+/*
+ * The S-curve rapid engine on its GP timer: every move, short of the
+ * ramp, on it or long past it, either way, makes exactly its steps in the
+ * planned time, brakes the way it sped up and stays within the step rate
+ * and acceleration limits. Then through stepper_ctrl::rapid_to(), with
+ * the overshoot: the position ends exact and the return time per mm is
+ * printed against the old engine's 1000 steps/s cruise, a lower bound of
+ * what the autoreturn used to take. A dry run, as on the simulated
+ * spindle, makes the same steps with the driver kept off throughout.
+ */
+#include "check.h"
+#include "lathe.h"
+#include "rapid.h"
+#include "stepper_ctrl.h"
+#include "kinematics.h"
+#include "host.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <math.h>
+
+/* steps averaged over, the host clock counts in us */
+#define WINDOW		50
+
+static constexpr kin_gear m6 = kin_metric(1000);
+
+static double rate(const std::vector<lathe_step>& st, size_t i)
+{
+	return WINDOW * 1e6 / (st[i + WINDOW].t_us - st[i].t_us);
+}
+
+static void move(int32_t steps)
+{
+	lathe_driver out;
+	rapid_engine rapid(out, false, STP_MAX_STEP_HZ, STP_MAX_ACC_HZ_S,
+			   STP_MAX_JERK_HZ_S2);
+	uint32_t n = steps < 0 ? -steps : steps;
+	int64_t t0 = esp_timer_get_time();
+
+	CHECK(rapid.add(steps));
+	CHECK_EQ(rapid.run(), steps);
+	CHECK_EQ(out.get_position(), steps);
+
+	const std::vector<lathe_step>& st = out.get_steps();
+	int64_t took = st.back().t_us - t0;
+	int64_t planned = rapid.duration_us(n);
+
+	CHECK_EQ(st.size(), n);
+	CHECK(took >= planned - 1 && took <= planned + 1);
+
+	/* from rest at the jerk limit, s = j t^3 / 6: one step takes this */
+	double first = cbrt(6.0 / STP_MAX_JERK_HZ_S2) * 1e6;
+	CHECK(st[0].t_us - t0 > first * 0.99 && st[0].t_us - t0 < first * 1.01);
+
+	/* braking mirrors the start, to the clock's us */
+	for (size_t i = 1; i + 2 < n; i++) {
+		int64_t up = st[i].t_us - st[i - 1].t_us;
+		int64_t down = st[n - 1 - i].t_us - st[n - 2 - i].t_us;
+
+		CHECK(up - down >= -1 && up - down <= 1);
+	}
+
+	double top = 0, acc = 0;
+	for (size_t i = 0; i + 2 * WINDOW < n; i += WINDOW) {
+		double v0 = rate(st, i), v1 = rate(st, i + WINDOW);
+		double dt = (st[i + 2 * WINDOW].t_us - st[i].t_us) / 2e6;
+		double a = (v1 > v0 ? v1 - v0 : v0 - v1) / dt;
+
+		if (v1 > top)
+			top = v1;
+		if (a > acc)
+			acc = a;
+	}
+	CHECK(top <= STP_MAX_STEP_HZ * 1.001);
+	CHECK(acc <= STP_MAX_ACC_HZ_S * 1.02);
+
+	printf("%6d steps: %7lld us (planned %7lld), up to %5.0f steps/s, "
+		"%5.0f steps/s^2\n", steps, (long long)took,
+		(long long)planned, top, acc);
+}
+
+/* A return with the overshoot and its way back, twice over */
+static void returns()
+{
+	lathe_driver out;
+	stepper_ctrl z(out, axis_z_config, m6.num, m6.den, false);
+
+	for (int32_t mm : { 1, 5, 10, 30, 100 }) {
+		int32_t steps = (int64_t)mm * axis_z_config.steps_mm_num /
+			axis_z_config.steps_mm_den;
+
+		/* out to mm and back to the start, as after a pass */
+		z.rapid_to(mm * 1000);
+		CHECK_EQ(z.get_position(), steps);
+
+		int64_t t0 = esp_timer_get_time();
+		z.rapid_to(0);
+		int64_t took = esp_timer_get_time() - t0;
+
+		CHECK_EQ(z.get_position(), 0);
+		z.resume();
+
+		/* the old one cruised at STP_SPEED, then power cycled */
+		int64_t old = (int64_t)steps * 1000000 / STP_SPEED +
+			STP_DELAY_MS * 1000;
+
+		CHECK(took < old);
+		printf("return %3d mm: %7lld us, %6lld us/mm, old > %6lld "
+			"us/mm\n", mm, (long long)took, (long long)took / mm,
+			(long long)old / mm);
+	}
+
+	CHECK_EQ(out.get_position(), 0);
+}
+
+/* Out, back and a reset behind step_out_dry: the driver never comes on */
+static void dry()
+{
+	lathe_driver *out = new lathe_driver;
+	step_out_dry dry(out);
+	stepper_ctrl z(dry, axis_z_config, m6.num, m6.den, false);
+
+	z.rapid_to(5000);
+	CHECK(!out->is_enabled());
+	CHECK_EQ(out->get_position(), z.get_position());
+	z.rapid_to(0);
+	z.reset();
+	z.arm();
+	CHECK(!out->is_enabled());
+	CHECK_EQ(out->get_position(), 0);
+	CHECK(!out->get_steps().empty());
+}
+
+int main()
+{
+	lathe_driver out;
+	rapid_engine rapid(out, false, STP_MAX_STEP_HZ, STP_MAX_ACC_HZ_S,
+			   STP_MAX_JERK_HZ_S2);
+	int32_t ramp = rapid.get_ramp_len();
+
+	for (int32_t n : { 1, 2, 3, 7, 100, ramp - 1, ramp, ramp + 1,
+			   2 * ramp - 2, 2 * ramp, 2 * ramp + 1, 20000 }) {
+		move(n);
+		move(-n);
+	}
+
+	returns();
+	dry();
+
+	return check_result();
+}
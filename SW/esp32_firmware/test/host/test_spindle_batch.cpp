@@ -0,0 +1,95 @@
+/*
+ * Batched against per-edge: spindle_pcnt wakes the gearbox every batch
+ * of edges, spindle_isr on every one. Over the same turns, late edges,
+ * glitches and missed interrupts included, the Z axis must end on the
+ * same step with both, the one the spindle position gives.
+ */
+#include "check.h"
+#include "lathe.h"
+#include "gearbox.h"
+#include "kinematics.h"
+#include "host.h"
+#include "esp_random.h"
+#include <stdio.h>
+
+static constexpr kin_gear m6 = kin_metric(1000);
+
+struct noise {
+	const char *name;
+	uint32_t jitter;	/* us */
+	uint32_t glitch;	/* edges */
+	uint32_t miss;		/* edges */
+};
+
+static int64_t steps_for(int64_t edges, const kin_gear& g)
+{
+	int64_t n = edges * g.num;
+
+	return n >= 0 ? n / g.den : -((-n + g.den - 1) / g.den);
+}
+
+/* Carriage position at the end, the edges turned in @edges */
+static int32_t run(spindle_source& src, const char *name, const noise& n,
+		   int64_t& edges)
+{
+	lathe_encoder enc;
+	lathe_driver out(&src);
+	stepper_ctrl z(out, axis_z_config, m6.num, m6.den, false);
+	gearbox box(src);
+	static const sim_segment profile[] = {
+		{ 100, 0, 700 },
+		{ 300, 700, 700 },
+		{ 200, 700, -400 },
+		{ 200, -400, -400 },
+		{ 100, -400, 250 },
+		{ 100, 250, 0 },
+	};
+
+	/* the same noise for both sources */
+	host_srand(1);
+	enc.set_jitter(n.jitter);
+	enc.set_glitch(n.glitch);
+	enc.set_miss(n.miss);
+
+	box.add(&z);
+	box.start();
+	enc.run(profile, sizeof(profile) / sizeof(profile[0]));
+	/* one more edge brings a missed last one in, then the take-up out */
+	enc.move(1);
+	enc.run(0, 200);
+
+	edges = enc.get_edges();
+	CHECK_EQ(src.get_count(), edges);
+	box.stop();
+
+	printf("%-6s %-4s %lld edges, %d steps, %u interrupts, %u errors\n",
+		n.name, name, (long long)edges, z.get_position(), src.get_events(),
+		src.get_errors());
+
+	return z.get_position();
+}
+
+int main()
+{
+	static const noise noises[] = {
+		{ "clean", 0, 0, 0 },
+		{ "jitter", 20, 0, 0 },
+		{ "glitch", 0, 37, 0 },
+		{ "missed", 0, 0, 101 },
+		{ "all", 20, 37, 101 },
+	};
+
+	for (const noise& n : noises) {
+		spindle_pcnt pcnt(EXT_ENC_A, EXT_ENC_B, EXT_ENC_GLITCH_NS);
+		spindle_isr isr(EXT_ENC_A, EXT_ENC_B);
+		int64_t e_pcnt, e_isr;
+		int32_t s_pcnt = run(pcnt, "pcnt", n, e_pcnt);
+		int32_t s_isr = run(isr, "isr", n, e_isr);
+
+		CHECK_EQ(e_pcnt, e_isr);
+		CHECK_EQ(s_pcnt, s_isr);
+		CHECK_EQ(s_pcnt, steps_for(e_pcnt, m6));
+	}
+
+	return check_result();
+}
@@ -0,0 +1,138 @@
+/*
+ * spindle_est fed the batch events of a spindle turning through steady
+ * speeds and ramps, time stamped to the us like esp_timer: it settles,
+ * then tracks the speed and the acceleration within the errors stated in
+ * spindle_est.h. The phase is exact at events and within an edge between.
+ */
+#include "check.h"
+#include "spindle_est.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Edges/s at 1 RPM */
+static const double EDGES_RPM = (double)ENC_PULSES_PER_REV_NUM /
+	ENC_PULSES_PER_REV_DEN / 60;
+
+struct est_case {
+	double rpm_from, rpm_to;
+	uint32_t ms;
+	uint32_t batch;
+	double vel_pct;		/* speed error allowed once settled */
+};
+
+struct est_result {
+	uint32_t updates;	/* of the tracker */
+	uint32_t settle;	/* updates before the speed stays within 1% */
+	double vel_pct;		/* worst once settled */
+	double acc_rpm_s;
+	double phase;		/* edges, worst between events */
+};
+
+static est_result run(const est_case& c)
+{
+	spindle_est est;
+	est_result r = { };
+	double pos = 0;
+	int32_t last = 0;
+	int64_t us = (int64_t)c.ms * 1000;
+	double acc = (c.rpm_to - c.rpm_from) * EDGES_RPM * 1000 / c.ms;
+
+	est.reset(0, 0, c.batch);
+	for (int64_t t = 1; t <= us; t++) {
+		double vel = (c.rpm_from + (c.rpm_to - c.rpm_from) * t / us) *
+			EDGES_RPM;
+		pos += vel / spindle_est::US;
+
+		/* the count moves when an edge is passed, either way */
+		int32_t count = (int32_t)pos;
+		if (abs(count - last) < (int32_t)c.batch) {
+			/* between events, once settled: the interpolated phase */
+			if (t % 97 == 0 && r.updates > 100) {
+				double d = fabs(est.get_phase(t) /
+					(double)(1 << spindle_est::Q) - pos);
+				if (d > r.phase)
+					r.phase = d;
+			}
+			continue;
+		}
+		last = count;
+
+		int64_t t_us = est.get().t_us;
+		est.update(count, t);
+		spindle_est_state st = est.get();
+		CHECK_EQ(est.get_phase(t), (int64_t)count << spindle_est::Q);
+		if (st.t_us == t_us)
+			continue;
+		r.updates++;
+
+		double ev = fabs(st.vel / (double)(1 << spindle_est::Q) - vel) /
+			fabs(vel) * 100;
+		double ea = fabs(st.acc / (double)(1 << spindle_est::Q) - acc) /
+			EDGES_RPM;
+		if (ev > 1)
+			r.settle = r.updates;
+		if (r.updates > 100) {
+			if (ev > r.vel_pct)
+				r.vel_pct = ev;
+			if (ea > r.acc_rpm_s)
+				r.acc_rpm_s = ea;
+		}
+	}
+
+	return r;
+}
+
+/* No event for a second: the speed falls to what a batch could hide */
+static void stop()
+{
+	spindle_est est;
+	int32_t batch = 20;
+	int64_t t = 0;
+
+	est.reset(0, 0, batch);
+	for (int32_t count = batch; count <= 100000; count += batch) {
+		t += 84;	/* 1000 RPM */
+		est.update(count, t);
+	}
+	CHECK(est.get_rpm10(t) > 9900 && est.get_rpm10(t) < 10100);
+
+	int64_t max = ((int64_t)batch << (spindle_est::Q + 1));
+	CHECK(est.get_vel(t + spindle_est::US) <= max);
+	CHECK_EQ(est.get_rpm10(t + 100 * spindle_est::US), 0);
+}
+
+int main()
+{
+	static const est_case cases[] = {
+		{ 10, 10, 10000, 20, 0.05 },
+		{ 50, 50, 3000, 20, 0.05 },
+		{ 300, 300, 1000, 20, 0.05 },
+		{ 2000, 2000, 1000, 20, 0.05 },
+		{ 300, 300, 1000, 1, 0.05 },
+		{ -500, -500, 1000, 20, 0.05 },
+		{ 100, 1000, 1000, 20, 0.1 },
+		{ 1000, 100, 1000, 20, 0.1 },
+		{ 300, 2000, 500, 20, 0.1 },
+		{ 2000, 300, 500, 20, 0.1 },
+		{ -100, -1000, 1000, 20, 0.1 },
+		{ 100, 1000, 1000, 1, 0.1 },
+	};
+
+	for (const est_case& c : cases) {
+		est_result r = run(c);
+
+		CHECK(r.settle <= 60);
+		CHECK(r.vel_pct <= c.vel_pct);
+		CHECK(r.acc_rpm_s <= 300);
+		CHECK(r.phase < 1);
+
+		printf("%5.0f -> %5.0f RPM, batch %2u: %4u updates, settled in "
+			"%2u, speed %.3f%%, acceleration %5.1f RPM/s, phase "
+			"%.2f edges\n", c.rpm_from, c.rpm_to, c.batch,
+			r.updates, r.settle, r.vel_pct, r.acc_rpm_s, r.phase);
+	}
+	stop();
+
+	return check_result();
+}
@@ -0,0 +1,75 @@
+/*
+ * Interrupt load of the two encoder decoders at the same spindle speeds:
+ * spindle_isr takes one per edge, spindle_pcnt one per batch. Both drive
+ * the gearbox and a Z axis on M6x1, and must make the same steps.
+ */
+#include "check.h"
+#include "lathe.h"
+#include "gearbox.h"
+#include "kinematics.h"
+#include "host.h"
+#include <stdio.h>
+
+#define RUN_MS		2000
+
+static constexpr kin_gear m6 = kin_metric(1000);
+
+struct load {
+	int64_t edges;
+	int32_t steps;
+	uint32_t events;
+	uint64_t isr_ns;
+	uint32_t batch;
+};
+
+static load run(spindle_source& src, int32_t rpm)
+{
+	lathe_encoder enc;
+	lathe_driver out(&src);
+	stepper_ctrl z(out, axis_z_config, m6.num, m6.den, false);
+	gearbox box(src);
+
+	box.add(&z);
+	box.start();
+
+	uint64_t ns = host_isr_ns();
+	enc.run(rpm, RUN_MS);
+	ns = host_isr_ns() - ns;
+
+	load l = { enc.get_edges(), 0, src.get_events(), ns, box.get_batch() };
+	CHECK_EQ(src.get_count(), l.edges);
+	box.stop();
+	l.steps = z.get_position();
+
+	return l;
+}
+
+int main()
+{
+	static const int32_t rpm[] = { 100, 300, 750 };
+
+	/* load: share of the run spent in the handlers, on this host */
+	printf("  RPM   edges  steps |  isr irq/rev   load |  pcnt irq/rev"
+		"   load  batch\n");
+	for (int32_t r : rpm) {
+		spindle_isr isr(EXT_ENC_A, EXT_ENC_B);
+		spindle_pcnt pcnt(EXT_ENC_A, EXT_ENC_B, EXT_ENC_GLITCH_NS);
+		load a = run(isr, r);
+		load b = run(pcnt, r);
+		double revs = (double)a.edges * ENC_PULSES_PER_REV_DEN /
+			ENC_PULSES_PER_REV_NUM;
+
+		CHECK_EQ(a.edges, b.edges);
+		CHECK_EQ(a.steps, b.steps);
+		CHECK_EQ(a.events, a.edges);
+		/* a batch per interrupt, the last one may be short */
+		CHECK(b.events <= a.edges / b.batch + 1);
+
+		printf("%5d %7lld %6d | %12.1f %5.2f%% | %13.1f %5.2f%%  %5u\n",
+			r, (long long)a.edges, a.steps, a.events / revs,
+			a.isr_ns / (RUN_MS * 1e4), b.events / revs,
+			b.isr_ns / (RUN_MS * 1e4), b.batch);
+	}
+
+	return check_result();
+}
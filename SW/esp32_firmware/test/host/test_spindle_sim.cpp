@@ -0,0 +1,163 @@
+/*
+ * The simulated spindle the stress test runs on: spindle_sim on its GP
+ * timer interrupt, as the motion task starts it. At a fixed speed, either
+ * way, the count after N ticks is the exact edges of N periods; batches
+ * stay within the batch, the index comes at every EXT_ENC_Z_EDGES boundary
+ * crossed, jitter only moves edges between ticks, a profile ends on its
+ * last speed and a gearbox on it ends on the step the count gives.
+ */
+#include "check.h"
+#include "lathe.h"
+#include "gearbox.h"
+#include "kinematics.h"
+#include "host.h"
+#include "esp_timer.h"
+#include <stdio.h>
+
+#define PERIOD_US	1000
+
+static constexpr kin_gear m6 = kin_metric(1000);
+
+struct sink {
+	uint32_t batch;
+	int32_t count = 0;
+	int32_t biggest = 0;
+	uint32_t index = 0;
+	bool off_boundary = false;
+
+	static void on_edges(void *arg, int32_t edges) {
+		sink *s = (sink *)arg;
+		int32_t a = edges < 0 ? -edges : edges;
+
+		s->count += edges;
+		if (a > s->biggest)
+			s->biggest = a;
+	}
+
+	static void on_index(void *arg, int32_t at) {
+		sink *s = (sink *)arg;
+
+		s->index++;
+		if (at % EXT_ENC_Z_EDGES)
+			s->off_boundary = true;
+	}
+};
+
+/* Edges of @ticks periods at @rpm, as the tick accumulator cuts them */
+static int64_t edges_at(int32_t rpm, int64_t ticks)
+{
+	return (int64_t)rpm * ENC_PULSES_PER_REV_NUM * PERIOD_US * ticks /
+		((int64_t)ENC_PULSES_PER_REV_DEN * 60000000);
+}
+
+static int64_t steps_for(int64_t edges, const kin_gear& g)
+{
+	int64_t n = edges * g.num;
+
+	return n >= 0 ? n / g.den : -((-n + g.den - 1) / g.den);
+}
+
+/* Run the timer for @ticks periods */
+static void run_ticks(int64_t ticks)
+{
+	host_run(esp_timer_get_time() + ticks * PERIOD_US);
+}
+
+static void steady(int32_t rpm, uint32_t batch, uint32_t jitter)
+{
+	spindle_sim sim(PERIOD_US);
+	sink s;
+	const int64_t ticks = 3000;
+
+	s.batch = batch;
+	sim.set_jitter(jitter);
+	sim.set_rpm(rpm);
+	sim.set_index(sink::on_index, &s);
+	sim.start(batch, sink::on_edges, &s);
+
+	/* between ticks too, jitter must not pile up */
+	for (int64_t t = 1; t <= ticks; t++) {
+		run_ticks(1);
+
+		int64_t want = edges_at(rpm, t);
+		int64_t off = sim.get_count() - want;
+
+		CHECK(off >= -(int64_t)jitter && off <= (int64_t)jitter);
+	}
+	sim.stop();
+
+	/* one more period settles the jitter shift, stopped it stays */
+	int32_t end = sim.get_count();
+	run_ticks(10);
+	CHECK_EQ(sim.get_count(), end);
+
+	/* backwards, leaving a turn crosses the boundary at its start */
+	int64_t crossed = end >= 0 ? end / EXT_ENC_Z_EDGES :
+		(-(int64_t)end + EXT_ENC_Z_EDGES - 1) / EXT_ENC_Z_EDGES;
+
+	CHECK_EQ(s.count, end);
+	CHECK(s.biggest <= (int32_t)batch);
+	CHECK(!s.off_boundary);
+	CHECK(s.index >= crossed);
+	if (!jitter)
+		CHECK_EQ(s.index, crossed);
+
+	printf("%5d RPM batch %2u jitter %2u: %d edges, %u index, %u events\n",
+		rpm, batch, jitter, end, s.index, sim.get_events());
+}
+
+/* Back and forth through zero, the profile ends on its last speed */
+static void profile(uint32_t jitter)
+{
+	static const sim_segment segs[] = {
+		{ 300, 0, 750 },
+		{ 500, 750, 750 },
+		{ 400, 750, -500 },
+		{ 300, -500, -500 },
+		{ 200, -500, 120 },
+	};
+	spindle_sim sim(PERIOD_US);
+	lathe_driver out(&sim);
+	stepper_ctrl z(out, axis_z_config, m6.num, m6.den, false);
+	gearbox box(sim);
+
+	sim.set_jitter(jitter);
+	sim.set_profile(segs, sizeof(segs) / sizeof(segs[0]));
+	box.add(&z);
+	box.start();
+
+	uint32_t ms = 0;
+	for (const sim_segment& seg : segs)
+		ms += seg.duration_ms;
+	run_ticks(ms);
+
+	CHECK(sim.profile_done());
+	CHECK_EQ(sim.get_rpm(), 120);
+
+	/* hold still, the last shifted edges and the take-up come in */
+	sim.set_rpm(0);
+	run_ticks(200);
+	box.stop();
+
+	CHECK_EQ(z.get_position(), steps_for(sim.get_count(), m6));
+
+	printf("profile jitter %2u: %d edges, %d steps, %zu step pulses\n",
+		jitter, sim.get_count(), z.get_position(), out.get_steps().size());
+}
+
+int main()
+{
+	host_srand(1);
+
+	steady(600, 20, 0);
+	steady(-600, 20, 0);
+	steady(1500, 20, 0);
+	steady(37, 1, 0);
+	steady(600, 20, 5);
+	steady(-250, 8, 3);
+
+	profile(0);
+	profile(4);
+
+	return check_result();
+}
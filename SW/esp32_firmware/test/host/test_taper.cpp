@@ -0,0 +1,89 @@
+/*
+ * Z and X following one spindle through the gearbox, on every taper and
+ * cone gear: over 200 spindle turns each axis is on floor(edges x num /
+ * den) at every step it makes, so the X/Z ratio holds all along, and both
+ * end exact after reversals.
+ */
+#include "check.h"
+#include "feedrate.h"
+#include "lathe.h"
+#include "gearbox.h"
+#include "host.h"
+#include <math.h>
+#include <stdio.h>
+
+static int64_t steps_for(int64_t edges, const kin_gear& g)
+{
+	int64_t n = edges * g.num;
+
+	return n >= 0 ? n / g.den : -((-n + g.den - 1) / g.den);
+}
+
+/* Steps not on the gear at the spindle count they were made at */
+static uint32_t off_gear(const lathe_driver& out, const kin_gear& g)
+{
+	uint32_t off = 0;
+
+	for (const lathe_step& s : out.get_steps())
+		if (s.position != steps_for(s.spindle, g))
+			off++;
+	return off;
+}
+
+static void run(const TaperType& t)
+{
+	spindle_pcnt src(EXT_ENC_A, EXT_ENC_B, EXT_ENC_GLITCH_NS);
+	lathe_encoder enc;
+	lathe_driver zout(&src), xout(&src);
+	stepper_ctrl z(zout, axis_z_config, t.gear.z.num, t.gear.z.den, false);
+	stepper_ctrl x(xout, axis_x_config, t.gear.x.num, t.gear.x.den, false);
+	gearbox box(src);
+	static const sim_segment forward[] = {
+		{ 500, 0, 1500 },
+		{ 7750, 1500, 1500 },
+		{ 500, 1500, 0 },
+	};
+	static const sim_segment back[] = {
+		{ 200, 0, -600 },
+		{ 300, -600, 400 },
+		{ 200, 400, 0 },
+	};
+
+	box.add(&z);
+	box.add(&x);
+	box.start();
+
+	/* forward only: the slack stays on one side, steps are positions */
+	enc.run(forward, 3);
+	int64_t edges = enc.get_edges();
+	CHECK_EQ(src.get_count(), edges);
+	CHECK_EQ(off_gear(zout, t.gear.z), 0);
+	CHECK_EQ(off_gear(xout, t.gear.x), 0);
+
+	double z_mm = (double)z.get_position() * MOTOR_STEPS_PER_MM_DEN /
+		MOTOR_STEPS_PER_MM_NUM;
+	double x_mm = (double)x.get_position() * CROSS_STEPS_PER_MM_DEN /
+		CROSS_STEPS_PER_MM_NUM;
+
+	/* back and forth, then both carriages exact */
+	enc.run(back, 3);
+	enc.run(0, 200);
+	CHECK_EQ(src.get_count(), enc.get_edges());
+	box.stop();
+	CHECK_EQ(z.get_position(), steps_for(enc.get_edges(), t.gear.z));
+	CHECK_EQ(x.get_position(), steps_for(enc.get_edges(), t.gear.x));
+
+	printf("%-6s %.1f turns: Z %.3f mm, X %.4f mm, X/Z %.6f\n", t.title,
+		(double)edges * ENC_PULSES_PER_REV_DEN / ENC_PULSES_PER_REV_NUM,
+		z_mm, x_mm, x_mm / z_mm);
+}
+
+int main()
+{
+	for (const TaperType& t : taper_list)
+		run(t);
+	for (const TaperType& t : cone_list)
+		run(t);
+
+	return check_result();
+}
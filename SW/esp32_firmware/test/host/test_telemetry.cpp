@@ -0,0 +1,221 @@
+/*
+ * The telemetry sampling task against a scripted motion status, sending
+ * to a UDP socket on the loopback: one fixed size frame per
+ * TELEM_FRAME_SAMPLES samples, numbered from 0, the rest of the last one
+ * flushed and zeroed on stop, every field as it was at its sample (step
+ * rates and the interrupt load over the sample period). A restart counts
+ * from 0 again; a stack that refuses the datagrams counts them lost and
+ * the sampling goes on.
+ */
+#include "check.h"
+#include "telemetry.h"
+#include "motion.h"
+#include "host.h"
+#include "esp_timer.h"
+#include <free_rtos_h.h>
+#include <stdio.h>
+#include <string.h>
+#include "lwip/sockets.h"
+
+#define CYCLES_US	240	/* esp_rom_get_cpu_ticks_per_us() */
+
+struct frame {
+	telem_frame_hdr hdr;
+	telem_sample s[TELEM_FRAME_SAMPLES];
+};
+
+struct task_end { };
+
+/* The motion side, moved on by the test between samples */
+static motion_status status;
+static uint32_t busy;
+
+void motion_get_status(motion_status *st)
+{
+	*st = status;
+}
+
+uint32_t motion_stats_busy()
+{
+	return busy;
+}
+
+/* Only telemetry_test() starts motion, it is not run here */
+void motion_start(enum motion_src src, uint32_t num, uint32_t den,
+		  bool dir_invert, int32_t rpm)
+{
+}
+
+void motion_stop()
+{
+}
+
+/* What one sample period does */
+struct script {
+	uint32_t hz;
+	uint32_t samples;		/* then stop */
+	int32_t z_steps, x_steps;	/* per period */
+	uint32_t load;			/* 0.01% of a core */
+	uint16_t port;
+	uint32_t taken;
+	bool started;
+};
+
+static void on_wait(void *arg, int ms)
+{
+	script *s = (script *)arg;
+
+	/* blocked for a start, or stopped and flushed */
+	if (ms < 0) {
+		if (s->started)
+			throw task_end();
+		s->started = true;
+		telemetry_start("127.0.0.1", s->port, s->hz);
+		return;
+	}
+
+	CHECK_EQ(ms, 1000 / s->hz);
+	if (s->taken == s->samples)
+		throw task_end();
+
+	/* what the sample about to be taken must show */
+	s->taken++;
+	status.steps[MOTION_AXIS_Z] += s->z_steps;
+	status.steps[MOTION_AXIS_X] += s->x_steps;
+	status.pos_10um[MOTION_AXIS_Z] = s->taken * 7;
+	status.pos_10um[MOTION_AXIS_X] = -(int32_t)s->taken;
+	status.rpm10 = 10000 + s->taken;
+	status.rpm_s = -(int32_t)s->taken;
+	status.running = true;
+	status.armed = s->taken % 2;
+	status.fault = s->taken % 5 ? PLAN_OK : PLAN_OVERSPEED;
+	status.at_limit[MOTION_AXIS_Z] = s->taken % 3 == 0;
+	status.at_limit[MOTION_AXIS_X] = s->taken % 7 == 0;
+	busy += (uint64_t)s->load * CYCLES_US * ms * 1000 / 10000;
+
+	if (s->taken == s->samples)
+		telemetry_stop();
+}
+
+/* Run the task through @s, from its wait for a start to its next one */
+static void run(script& s)
+{
+	void (*fn)(void *);
+	void *arg;
+
+	host_last_task(&fn, &arg);
+	host_set_delay(on_wait, &s);
+	try {
+		fn(arg);
+	} catch (task_end&) {
+	}
+	host_set_delay(nullptr, nullptr);
+}
+
+/* Check the frames on @rx against @s, sent at @t0_ms */
+static void check_frames(int rx, const script& s, uint32_t t0_ms)
+{
+	uint32_t want = (s.samples + TELEM_FRAME_SAMPLES - 1) /
+		TELEM_FRAME_SAMPLES;
+	uint32_t seq = 0, taken = 0;
+	frame f;
+	ssize_t len;
+
+	while ((len = recv(rx, &f, sizeof(f) + 1, MSG_DONTWAIT)) >= 0) {
+		CHECK_EQ(len, TELEM_FRAME_SIZE(TELEM_FRAME_SAMPLES));
+		CHECK_EQ(f.hdr.magic, TELEM_MAGIC);
+		CHECK_EQ(f.hdr.version, TELEM_VERSION);
+		CHECK_EQ(f.hdr.rate_hz, s.hz);
+		CHECK_EQ(f.hdr.seq, seq++);
+		CHECK_EQ(f.hdr.lost, 0);
+		CHECK_EQ(f.hdr.n, seq == want ?
+			 s.samples - (want - 1) * TELEM_FRAME_SAMPLES :
+			 TELEM_FRAME_SAMPLES);
+
+		for (uint32_t i = 0; i < f.hdr.n; i++) {
+			const telem_sample& x = f.s[i];
+			bool first = taken++ == 0;
+
+			CHECK_EQ(x.t_ms, t0_ms + taken * 1000 / s.hz);
+			CHECK_EQ(x.rpm10, 10000 + (int32_t)taken);
+			CHECK_EQ(x.rpm_s, -(int32_t)taken);
+			CHECK_EQ(x.pos_10um[MOTION_AXIS_Z], (int32_t)taken * 7);
+			CHECK_EQ(x.pos_10um[MOTION_AXIS_X], -(int32_t)taken);
+			CHECK_EQ(x.step_hz[MOTION_AXIS_Z],
+				 first ? 0 : s.z_steps * (int32_t)s.hz);
+			CHECK_EQ(x.step_hz[MOTION_AXIS_X],
+				 first ? 0 : s.x_steps * (int32_t)s.hz);
+			CHECK_EQ(x.isr_load, first ? 0 : s.load);
+			CHECK_EQ(x.flags, TELEM_F_RUNNING |
+				 (taken % 2 ? TELEM_F_ARMED : 0) |
+				 (taken % 5 ? 0 : TELEM_F_FAULT) |
+				 (taken % 3 ? 0 : TELEM_F_LIMIT_Z) |
+				 (taken % 7 ? 0 : TELEM_F_LIMIT_X));
+		}
+		for (uint32_t i = f.hdr.n; i < TELEM_FRAME_SAMPLES; i++) {
+			static const telem_sample zero = { };
+
+			CHECK(!memcmp(&f.s[i], &zero, sizeof(zero)));
+		}
+	}
+	CHECK_EQ(seq, want);
+	CHECK_EQ(taken, s.samples);
+	CHECK_EQ(telemetry_get_sent(), want);
+	CHECK_EQ(telemetry_get_lost(), 0);
+
+	printf("%3u Hz: %3u samples in %2u frames, Z %d Hz, X %d Hz, "
+	       "isr %u.%02u%%\n", s.hz, s.samples, seq, s.z_steps * s.hz,
+	       s.x_steps * s.hz, s.load / 100, s.load % 100);
+}
+
+static void stream(int rx, uint16_t port, uint32_t hz, uint32_t samples,
+		   int32_t z_steps, int32_t x_steps, uint32_t load)
+{
+	script s = { hz, samples, z_steps, x_steps, load, port };
+	uint32_t t0_ms = esp_timer_get_time() / 1000;
+
+	status = { };
+	run(s);
+	CHECK_EQ(s.taken, samples);
+	check_frames(rx, s, t0_ms);
+	CHECK_EQ(telemetry_get_rate(), 0);
+}
+
+int main()
+{
+	struct sockaddr_in addr = { };
+	socklen_t len = sizeof(addr);
+	int rx = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (rx < 0 || bind(rx, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(rx, (struct sockaddr *)&addr, &len)) {
+		perror("test_telemetry");
+		return 1;
+	}
+
+	uint16_t port = ntohs(addr.sin_port);
+
+	host_set_time(1000000);
+	telemetry_init();
+
+	/* whole frames, then a part one; a restart counts from 0 */
+	stream(rx, port, TELEM_RATE_HZ, 4 * TELEM_FRAME_SAMPLES, 3, -1, 1234);
+	stream(rx, port, 100, 3 * TELEM_FRAME_SAMPLES + 5, 20, 9, 4321);
+	stream(rx, port, 10, 1, 1, 1, 5);
+
+	/* nowhere to send to: every frame lost, the count goes out too */
+	script s = { TELEM_RATE_HZ, 2 * TELEM_FRAME_SAMPLES, 1, 1, 0, 0 };
+
+	status = { };
+	run(s);
+	CHECK_EQ(s.taken, s.samples);
+	CHECK_EQ(telemetry_get_sent(), 0);
+	CHECK_EQ(telemetry_get_lost(), 2);
+	printf("port 0: %u frames lost\n", telemetry_get_lost());
+
+	close(rx);
+
+	return check_result();
+}
@@ -0,0 +1,178 @@
+/*
+ * Device side of the trace round trip, built with MOTION_TRACE 1: a two
+ * axis session through the gearbox, with reversals, index re-arming,
+ * rapids, a reset and a new limit, on a clock that wraps 32 bits. The
+ * ring is drained into frames as trace_task() sends them, after some
+ * garbage, to @argv[1]. @argv[2] gets the same capture with one step
+ * position off in a frame with a good CRC, @argv[3] with a byte of that
+ * frame flipped on the way. ctest then has the trace tool replay them:
+ * the first must match step for step, the second must be reported at
+ * that record, the third must end at the lost frame.
+ */
+#include "gearbox.h"
+#include "spindle.h"
+#include "stepper_ctrl.h"
+#include "trace.h"
+#include "host.h"
+#include "esp_random.h"
+#include <stdio.h>
+#include <string.h>
+
+#if !MOTION_TRACE
+#error "the trace round trip needs MOTION_TRACE 1"
+#endif
+
+#define WRONG_FRAME	200
+
+class null_out : public step_output
+{
+public:
+	void pulse() { }
+	void set_dir(bool level) { }
+	void set_enable(bool on) { }
+	uint32_t max_rate() { return 20000; }
+};
+
+enum { CLEAN, WRONG, GAP, CAPTURES };
+
+static FILE *out[CAPTURES];
+static uint32_t frames;
+static stepper_ctrl *z, *x;
+
+static void write_frame(FILE *f, uint8_t *frame, size_t len, bool flip)
+{
+	uint16_t crc = trace_crc16(0xffff, frame + 2, len);
+
+	frame[2 + len] = crc;
+	frame[3 + len] = crc >> 8;
+	frame[len] ^= flip ? 0xff : 0;
+	fwrite(frame, 1, 2 + len + 2, f);
+	frame[len] ^= flip ? 0xff : 0;
+}
+
+/* Whole frames, or all that is left */
+static void drain(bool all)
+{
+	static uint8_t frame[2 + sizeof(trace_frame_hdr) +
+			     TRACE_FRAME_RECS * sizeof(trace_rec) + 2] = {
+		TRACE_SYNC0, TRACE_SYNC1
+	};
+	trace_rec *recs = (trace_rec *)(frame + 2 + sizeof(trace_frame_hdr));
+
+	while (trace_ring.size() >= TRACE_FRAME_RECS ||
+	       (all && trace_ring.size())) {
+		uint32_t n = 0;
+
+		while (n != TRACE_FRAME_RECS && trace_ring.pop(recs[n]))
+			n++;
+
+		trace_frame_hdr hdr = { (uint8_t)frames, (uint8_t)n,
+					TRACE_VERSION, trace_dropped.load() };
+		size_t len = sizeof(hdr) + n * sizeof(trace_rec);
+		bool wrong = frames++ == WRONG_FRAME;
+
+		memcpy(frame + 2, &hdr, sizeof(hdr));
+		write_frame(out[CLEAN], frame, len, false);
+		write_frame(out[GAP], frame, len, wrong);
+
+		if (wrong)
+			for (uint32_t i = 0; i < n; i++)
+				if (recs[i].type == TRACE_STEP) {
+					recs[i].val++;
+					break;
+				}
+		write_frame(out[WRONG], frame, len, false);
+	}
+}
+
+/* The motion task waits for a take-up, the timers run it */
+static void idle(void *arg)
+{
+	if (!host_fire_timer(z, sizeof(*z)))
+		host_fire_timer(x, sizeof(*x));
+	drain(false);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 1 + CAPTURES) {
+		fprintf(stderr, "usage: test_trace CAPTURE WRONG GAP\n");
+		return 2;
+	}
+	for (int i = 0; i < CAPTURES; i++) {
+		out[i] = fopen(argv[1 + i], "wb");
+		if (!out[i]) {
+			perror(argv[1 + i]);
+			return 2;
+		}
+		/* the receiver starts mid-stream */
+		fwrite("\x00\x12garbage\xa5", 1, 10, out[i]);
+	}
+
+	int64_t t = 0xfff00000LL;
+	null_out oz, ox;
+	spindle_replay sp;
+
+	host_set_idle(idle, nullptr);
+	host_set_time(t);
+	host_srand(1);
+	{
+		gearbox box(sp);
+		int32_t count = 0;
+
+		z = new stepper_ctrl(oz, axis_z_config, 3, 7, false);
+		x = new stepper_ctrl(ox, axis_x_config, 1, 9, true);
+		box.add(z);
+		box.add(x);
+		z->set_slack(1);
+		x->set_slack(-1);
+		z->set_limit(50);
+		x->set_limit(20);
+		z->arm();
+		x->arm();
+		box.start();
+
+		for (int pass = 0; pass < 6; pass++) {
+			int dir = pass & 1 ? -1 : 1;
+
+			for (int k = 0; k < 3000; k++) {
+				int32_t e = dir * (1 + esp_random() % 3);
+
+				t += 50 + esp_random() % 20;
+				host_set_time(t);
+				sp.edges(e);
+				count += e;
+				if (count % 4096 == 0)
+					sp.index(count);
+				if (esp_random() % 3 == 0) {
+					host_fire_timer(z, sizeof(*z));
+					host_fire_timer(x, sizeof(*x));
+				}
+				drain(false);
+			}
+			if (pass == 2) {
+				z->rapid_to(-500);
+				z->resume();
+				x->rapid_to(300);
+				x->arm(true);
+			}
+			if (pass == 4) {
+				z->disable();
+				z->enable();
+				z->reset();
+				z->clear_fault();
+				z->set_limit(-30);
+			}
+		}
+	}
+	delete z;
+	delete x;
+	drain(true);
+
+	printf("%u frames, %u records dropped\n", frames,
+		trace_dropped.load());
+	for (int i = 0; i < CAPTURES; i++)
+		fclose(out[i]);
+
+	return trace_dropped.load() ? 1 : 0;
+}
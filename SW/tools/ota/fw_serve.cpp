@@ -0,0 +1,279 @@
+/*
+ * Firmware update server, see fw_update.h in the firmware:
+ *
+ *	fw_serve [-p port] [-w bits] [-l bits] [-V version] [-d blocks] \
+ *		build/wm210e_esp32.bin
+ *
+ * Compresses the image block by block at start, checks every block
+ * decodes back with the firmware's decoder, then serves it to whoever
+ * connects, from the block they ask for. -d drops every connection after
+ * that many blocks, to try resuming. The version is the one in the image
+ * (esp_app_desc_t) unless -V gives another; a device already on it does
+ * not update.
+ */
+#include "fw_update.h"
+#include "hs_decode.h"
+#include "hs_encode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define FW_SERVE_PORT		5008 /* FW_UPDATE_PORT */
+#define FW_SERVE_W		10 /* 1 KB window */
+#define FW_SERVE_L		5 /* matches up to 32 bytes */
+
+#define APP_DESC_OFFSET		32 /* image and first segment header */
+#define APP_DESC_MAGIC		0xabcd5432
+#define APP_DESC_VERSION	16
+
+struct block {
+	fw_block_hdr hdr;
+	std::vector<uint8_t> data;
+};
+
+static uint32_t crc32(uint32_t crc, const uint8_t *p, size_t len)
+{
+	static uint32_t table[256];
+
+	if (!table[1])
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320 ^ c >> 1 : c >> 1;
+			table[i] = c;
+		}
+
+	crc = ~crc;
+	while (len--)
+		crc = table[(crc ^ *p++) & 0xff] ^ crc >> 8;
+	return ~crc;
+}
+
+static bool send_all(int sock, const void *buf, size_t len)
+{
+	const uint8_t *p = static_cast<const uint8_t *>(buf);
+
+	while (len) {
+		ssize_t n = send(sock, p, len, MSG_NOSIGNAL);
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static bool recv_all(int sock, void *buf, size_t len)
+{
+	uint8_t *p = static_cast<uint8_t *>(buf);
+
+	while (len) {
+		ssize_t n = recv(sock, p, len, 0);
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+static double now_s()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void serve(int sock, const fw_image_hdr& img,
+		  const std::vector<block>& blocks, uint32_t drop_after)
+{
+	fw_request req;
+	fw_image_hdr hdr = img;
+
+	if (!recv_all(sock, &req, sizeof(req)) ||
+	    req.magic != FW_MAGIC_REQUEST || req.proto != FW_PROTO_VERSION) {
+		fprintf(stderr, "  not an update request\n");
+		return;
+	}
+
+	hdr.start = req.image_id == img.image_id && req.from <= blocks.size() ?
+		req.from : 0;
+	if (!send_all(sock, &hdr, sizeof(hdr)))
+		return;
+
+	double t0 = now_s();
+	uint64_t bytes = sizeof(hdr);
+	uint32_t i;
+
+	for (i = hdr.start; i < blocks.size(); i++) {
+		const block& b = blocks[i];
+
+		if (drop_after && i - hdr.start == drop_after) {
+			fprintf(stderr, "  dropping the connection\n");
+			break;
+		}
+		if (!send_all(sock, &b.hdr, sizeof(b.hdr)) ||
+		    !send_all(sock, b.data.data(), b.data.size()))
+			break;
+		bytes += sizeof(b.hdr) + b.data.size();
+	}
+
+	/* the device closes once it has the last block */
+	char c;
+	if (i == blocks.size())
+		recv(sock, &c, 1, 0);
+
+	double dt = now_s() - t0;
+	fprintf(stderr, "  blocks %u..%u, %llu bytes in %.2f s, %.1f KB/s\n",
+		hdr.start, i, (unsigned long long)bytes, dt,
+		dt > 0 ? bytes / dt / 1024 : 0);
+}
+
+int main(int argc, char **argv)
+{
+	uint16_t port = FW_SERVE_PORT;
+	unsigned w = FW_SERVE_W, l = FW_SERVE_L;
+	uint32_t drop_after = 0;
+	const char *version = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:w:l:V:d:")) != -1) {
+		switch (opt) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'w':
+			w = atoi(optarg);
+			break;
+		case 'l':
+			l = atoi(optarg);
+			break;
+		case 'V':
+			version = optarg;
+			break;
+		case 'd':
+			drop_after = atoi(optarg);
+			break;
+		default:
+			optind = argc;
+			break;
+		}
+	}
+	if (optind != argc - 1 || w < 4 || w > 15 || l < 2 || l >= w) {
+		fprintf(stderr, "usage: fw_serve [-p port] [-w bits] "
+			"[-l bits] [-V version] [-d blocks] image.bin\n");
+		return 2;
+	}
+
+	FILE *f = fopen(argv[optind], "rb");
+	if (!f) {
+		perror(argv[optind]);
+		return 1;
+	}
+	std::vector<uint8_t> image;
+	uint8_t chunk[4096];
+	size_t len;
+	while ((len = fread(chunk, 1, sizeof(chunk), f)))
+		image.insert(image.end(), chunk, chunk + len);
+	fclose(f);
+	if (image.empty()) {
+		fprintf(stderr, "%s: empty\n", argv[optind]);
+		return 1;
+	}
+
+	fw_image_hdr img = {
+		.magic = FW_MAGIC_IMAGE,
+		.proto = FW_PROTO_VERSION,
+		.window_bits = (uint8_t)w,
+		.lookahead_bits = (uint8_t)l,
+		.image_id = crc32(0, image.data(), image.size()),
+		.size = (uint32_t)image.size(),
+		.block_size = FW_BLOCK_SIZE,
+	};
+
+	uint32_t magic = 0;
+	if (image.size() >= APP_DESC_OFFSET + APP_DESC_VERSION +
+	    FW_VERSION_LEN)
+		memcpy(&magic, &image[APP_DESC_OFFSET], sizeof(magic));
+	if (version)
+		snprintf(img.version, sizeof(img.version), "%s", version);
+	else if (magic == APP_DESC_MAGIC)
+		memcpy(img.version, &image[APP_DESC_OFFSET + APP_DESC_VERSION],
+		       FW_VERSION_LEN - 1);
+	else
+		fprintf(stderr, "no app description in the image, -V?\n");
+
+	/* compress, and check with the decoder the device runs */
+	std::vector<block> blocks;
+	uint64_t wire = 0;
+	double t0 = now_s();
+
+	for (size_t at = 0; at < image.size(); at += FW_BLOCK_SIZE) {
+		size_t n = image.size() - at;
+		block b;
+		uint8_t back[FW_BLOCK_SIZE];
+
+		if (n > FW_BLOCK_SIZE)
+			n = FW_BLOCK_SIZE;
+		hs_encode(&image[at], n, b.data, w, l);
+
+		int32_t got = hs_decode(b.data.data(), b.data.size(), back, n,
+					w, l);
+		if (got != (int32_t)n || memcmp(back, &image[at], n)) {
+			fprintf(stderr, "block %zu does not decode back\n",
+				blocks.size());
+			return 1;
+		}
+		if (b.data.size() >= n)
+			b.data.assign(&image[at], &image[at] + n);
+
+		b.hdr = {
+			.index = (uint32_t)blocks.size(),
+			.raw_len = (uint16_t)n,
+			.comp_len = (uint16_t)b.data.size(),
+			.crc = crc32(0, &image[at], n),
+		};
+		wire += sizeof(b.hdr) + b.data.size();
+		blocks.push_back(b);
+	}
+
+	fprintf(stderr, "%s: %s, %u bytes, %zu blocks, %llu on the wire "
+		"(%.1f%%), w%u l%u, compressed in %.2f s\n", argv[optind],
+		img.version, img.size, blocks.size(),
+		(unsigned long long)wire, 100.0 * wire / img.size, w, l,
+		now_s() - t0);
+
+	int srv = socket(AF_INET, SOCK_STREAM, 0);
+	int on = 1;
+	struct sockaddr_in addr = { };
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (srv < 0 || bind(srv, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(srv, 1)) {
+		perror("fw_serve");
+		return 1;
+	}
+	fprintf(stderr, "listening on TCP %u\n", port);
+
+	while (1) {
+		struct sockaddr_in peer;
+		socklen_t plen = sizeof(peer);
+		int sock = accept(srv, (struct sockaddr *)&peer, &plen);
+
+		if (sock < 0)
+			continue;
+		fprintf(stderr, "%s connected\n", inet_ntoa(peer.sin_addr));
+		serve(sock, img, blocks, drop_after);
+		close(sock);
+	}
+}
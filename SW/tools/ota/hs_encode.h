@@ -0,0 +1,84 @@
+#ifndef __HS_ENCODE_H__
+#define __HS_ENCODE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/* Host side only, the device has hs_decode.h */
+class bit_writer
+{
+public:
+	bit_writer(std::vector<uint8_t>& out) : out(out) { }
+
+	void put(uint32_t v, unsigned bits) {
+		while (bits--) {
+			if (!n)
+				out.push_back(0);
+			if (v >> bits & 1)
+				out.back() |= 0x80 >> n;
+			n = (n + 1) & 7;
+		}
+	}
+
+private:
+	std::vector<uint8_t>& out;
+	unsigned n = 0;
+};
+
+/*
+ * Greedy LZSS in the heatshrink format hs_decode.h reads, @w window and @l
+ * lookahead bits, hash chains on two bytes. Appends to @out, the last byte
+ * padded with 0 bits: decode with the size of @in.
+ */
+static inline void hs_encode(const uint8_t *in, size_t len,
+			     std::vector<uint8_t>& out, unsigned w, unsigned l)
+{
+	const size_t window = 1 << w, max_count = 1 << l;
+	std::vector<int32_t> head(1 << 16, -1), prev(len, -1);
+	bit_writer bw(out);
+	size_t i = 0;
+
+	auto insert = [&](size_t at) {
+		if (at + 1 < len) {
+			uint32_t key = in[at] << 8 | in[at + 1];
+			prev[at] = head[key];
+			head[key] = at;
+		}
+	};
+
+	while (i < len) {
+		size_t best = 0, dist = 0;
+
+		if (i + 1 < len) {
+			int32_t j = head[in[i] << 8 | in[i + 1]];
+			for (; j >= 0 && i - j <= window; j = prev[j]) {
+				size_t n = 0;
+				while (n < max_count && i + n < len &&
+				       in[j + n] == in[i + n])
+					n++;
+				if (n > best) {
+					best = n;
+					dist = i - j;
+					if (n == max_count)
+						break;
+				}
+			}
+		}
+
+		/* a reference costs 1 + w + l bits, a literal 9 */
+		if (best * 9 > 1 + w + l) {
+			bw.put(0, 1);
+			bw.put(dist - 1, w);
+			bw.put(best - 1, l);
+		} else {
+			best = 1;
+			bw.put(1, 1);
+			bw.put(in[i], 8);
+		}
+		while (best--)
+			insert(i++);
+	}
+}
+
+#endif /* __HS_ENCODE_H__ */
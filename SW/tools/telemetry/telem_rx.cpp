@@ -0,0 +1,168 @@
+/*
+ * Telemetry receiver, see telemetry.h in the firmware. Listens on the UDP
+ * port the lathe streams to and prints what came, once a second:
+ *
+ *	telem_rx [-p port] [-c] [-n frames]
+ *
+ * -c prints every sample as a CSV line instead, -n stops after that many
+ * frames. Frames that did not arrive are counted from the sequence
+ * numbers; "not sent" are the ones the lathe's stack had no room for.
+ */
+#include "telemetry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define TELEM_RX_PORT		5006 /* TELEM_PORT */
+#define TELEM_RX_MAX_SAMPLES	255
+
+struct telem_rx_frame {
+	telem_frame_hdr hdr;
+	telem_sample s[TELEM_RX_MAX_SAMPLES];
+};
+
+struct telem_rx_stats {
+	uint64_t frames;
+	uint64_t missing;
+	uint64_t samples;
+	uint32_t not_sent;
+	uint32_t next;
+	bool started;
+};
+
+static void print_csv(const telem_sample& s)
+{
+	printf("%u,%d,%d,%d,%d,%d,%d,%u,%s%s%s%s%s\n", s.t_ms,
+	       s.rpm10, s.rpm_s, s.pos_10um[0], s.pos_10um[1],
+	       s.step_hz[0], s.step_hz[1], s.isr_load,
+	       s.flags & TELEM_F_RUNNING ? "R" : "",
+	       s.flags & TELEM_F_ARMED ? "A" : "",
+	       s.flags & TELEM_F_FAULT ? "F" : "",
+	       s.flags & TELEM_F_LIMIT_Z ? "Z" : "",
+	       s.flags & TELEM_F_LIMIT_X ? "X" : "");
+}
+
+static void print_summary(const telem_rx_stats& st, const telem_sample& s)
+{
+	printf("frames %llu, missing %llu, not sent %u | %d.%d RPM, "
+	       "Z %.2f mm %d Hz, X %.2f mm %d Hz, isr %u.%02u%%%s%s%s\n",
+	       (unsigned long long)st.frames,
+	       (unsigned long long)st.missing, st.not_sent,
+	       s.rpm10 / 10, abs(s.rpm10 % 10),
+	       s.pos_10um[0] / 100.0, s.step_hz[0],
+	       s.pos_10um[1] / 100.0, s.step_hz[1],
+	       s.isr_load / 100, s.isr_load % 100,
+	       s.flags & TELEM_F_ARMED ? " ARMED" : "",
+	       s.flags & TELEM_F_FAULT ? " FAULT" : "",
+	       s.flags & (TELEM_F_LIMIT_Z | TELEM_F_LIMIT_X) ? " LIMIT" : "");
+	fflush(stdout);
+}
+
+/* False for anything that is not a telemetry frame */
+static bool check(const telem_rx_frame& f, ssize_t len)
+{
+	if (len < (ssize_t)sizeof(telem_frame_hdr))
+		return false;
+	if (f.hdr.magic != TELEM_MAGIC || f.hdr.version != TELEM_VERSION)
+		return false;
+	return len >= (ssize_t)TELEM_FRAME_SIZE(f.hdr.n);
+}
+
+int main(int argc, char **argv)
+{
+	static telem_rx_frame f;
+	telem_rx_stats st = { };
+	telem_sample last = { };
+	uint16_t port = TELEM_RX_PORT;
+	uint64_t max_frames = 0;
+	bool csv = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "p:cn:")) != -1) {
+		switch (opt) {
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'c':
+			csv = true;
+			break;
+		case 'n':
+			max_frames = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr, "usage: telem_rx [-p port] [-c] "
+				"[-n frames]\n");
+			return 2;
+		}
+	}
+
+	int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	struct sockaddr_in addr = { };
+
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		perror("telem_rx");
+		return 1;
+	}
+	fprintf(stderr, "listening on UDP %u\n", port);
+	if (csv)
+		printf("t_ms,rpm10,rpm_s,z_10um,x_10um,z_hz,x_hz,isr_load,"
+		       "flags\n");
+
+	time_t shown = time(NULL);
+
+	while (!max_frames || st.frames < max_frames) {
+		ssize_t len = recv(sock, &f, sizeof(f), 0);
+
+		if (len < 0) {
+			perror("recv");
+			return 1;
+		}
+		if (!check(f, len)) {
+			fprintf(stderr, "not a telemetry frame, %zd bytes\n",
+				len);
+			continue;
+		}
+
+		/* a restarted stream counts from 0 */
+		if (!st.started || f.hdr.seq == 0) {
+			if (st.started)
+				fprintf(stderr, "stream restarted\n");
+			st.next = f.hdr.seq;
+			st.started = true;
+		}
+		if (f.hdr.seq > st.next)
+			st.missing += f.hdr.seq - st.next;
+		if (f.hdr.seq >= st.next)
+			st.next = f.hdr.seq + 1;
+		st.not_sent = f.hdr.lost;
+		st.frames++;
+		st.samples += f.hdr.n;
+
+		for (uint32_t i = 0; i < f.hdr.n; i++)
+			if (csv)
+				print_csv(f.s[i]);
+		if (f.hdr.n)
+			last = f.s[f.hdr.n - 1];
+
+		if (!csv && time(NULL) != shown) {
+			shown = time(NULL);
+			print_summary(st, last);
+		}
+	}
+
+	if (!csv)
+		print_summary(st, last);
+	fprintf(stderr, "%llu frames, %llu samples, %llu missing\n",
+		(unsigned long long)st.frames,
+		(unsigned long long)st.samples,
+		(unsigned long long)st.missing);
+	return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef __HOST_HD44780_H__
+#define __HOST_HD44780_H__
+
+#include <stdint.h>
+
+/* What lcd.cpp uses of the driver, the glass is in hd44780.cpp */
+enum {
+	HD44780_TYPE_LCD,
+	HD44780_ENGLISH_RUSSIAN_FONT,
+};
+
+struct hd44780_conn { };
+
+struct hd44780_lcd {
+	void (*write)(uint8_t data);
+	void (*write16)(uint16_t data);
+	void (*delay_us)(uint16_t us);
+	int is_backlight_enabled;
+	int type;
+	int font;
+	struct hd44780_conn *conn;
+	int ext_con;
+};
+
+int hd44780_pcf8574_con_init(struct hd44780_lcd *lcd);
+int hd44780_init(struct hd44780_lcd *lcd);
+void hd44780_send_cmd(uint8_t cmd);
+void hd44780_set_pos(uint8_t row, uint8_t col);
+void hd44780_print(const char *text);
+
+#endif /* __HOST_HD44780_H__ */
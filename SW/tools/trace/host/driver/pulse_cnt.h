@@ -0,0 +1,77 @@
+#ifndef __HOST_PULSE_CNT_H__
+#define __HOST_PULSE_CNT_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * The PCNT driver calls spindle_pcnt makes. The counter follows the host
+ * GPIO levels, see host.h; there is no glitch filter.
+ */
+typedef struct pcnt_unit_t *pcnt_unit_handle_t;
+typedef struct pcnt_chan_t *pcnt_channel_handle_t;
+
+typedef enum {
+	PCNT_CHANNEL_EDGE_ACTION_HOLD,
+	PCNT_CHANNEL_EDGE_ACTION_INCREASE,
+	PCNT_CHANNEL_EDGE_ACTION_DECREASE,
+} pcnt_channel_edge_action_t;
+
+typedef enum {
+	PCNT_CHANNEL_LEVEL_ACTION_KEEP,
+	PCNT_CHANNEL_LEVEL_ACTION_INVERSE,
+	PCNT_CHANNEL_LEVEL_ACTION_HOLD,
+} pcnt_channel_level_action_t;
+
+typedef struct {
+	int low_limit;
+	int high_limit;
+} pcnt_unit_config_t;
+
+typedef struct {
+	uint32_t max_glitch_ns;
+} pcnt_glitch_filter_config_t;
+
+typedef struct {
+	int edge_gpio_num;
+	int level_gpio_num;
+} pcnt_chan_config_t;
+
+typedef struct {
+	int watch_point_value;
+} pcnt_watch_event_data_t;
+
+typedef bool (*pcnt_watch_cb_t)(pcnt_unit_handle_t unit,
+				const pcnt_watch_event_data_t *edata,
+				void *user_ctx);
+
+typedef struct {
+	pcnt_watch_cb_t on_reach;
+} pcnt_event_callbacks_t;
+
+esp_err_t pcnt_new_unit(const pcnt_unit_config_t *config,
+			pcnt_unit_handle_t *ret);
+esp_err_t pcnt_del_unit(pcnt_unit_handle_t unit);
+esp_err_t pcnt_unit_set_glitch_filter(pcnt_unit_handle_t unit,
+	const pcnt_glitch_filter_config_t *config);
+esp_err_t pcnt_new_channel(pcnt_unit_handle_t unit,
+			   const pcnt_chan_config_t *config,
+			   pcnt_channel_handle_t *ret);
+esp_err_t pcnt_del_channel(pcnt_channel_handle_t chan);
+esp_err_t pcnt_channel_set_edge_action(pcnt_channel_handle_t chan,
+				       pcnt_channel_edge_action_t pos,
+				       pcnt_channel_edge_action_t neg);
+esp_err_t pcnt_channel_set_level_action(pcnt_channel_handle_t chan,
+					pcnt_channel_level_action_t high,
+					pcnt_channel_level_action_t low);
+esp_err_t pcnt_unit_add_watch_point(pcnt_unit_handle_t unit, int value);
+esp_err_t pcnt_unit_register_event_callbacks(pcnt_unit_handle_t unit,
+	const pcnt_event_callbacks_t *cbs, void *user_ctx);
+esp_err_t pcnt_unit_enable(pcnt_unit_handle_t unit);
+esp_err_t pcnt_unit_disable(pcnt_unit_handle_t unit);
+esp_err_t pcnt_unit_start(pcnt_unit_handle_t unit);
+esp_err_t pcnt_unit_stop(pcnt_unit_handle_t unit);
+esp_err_t pcnt_unit_clear_count(pcnt_unit_handle_t unit);
+esp_err_t pcnt_unit_get_count(pcnt_unit_handle_t unit, int *value);
+
+#endif /* __HOST_PULSE_CNT_H__ */
@@ -0,0 +1,7 @@
+#ifndef __HOST_ESP_BUTTONS_H__
+#define __HOST_ESP_BUTTONS_H__
+
+/* The menus take it by reference, the host never makes one */
+class Buttons;
+
+#endif /* __HOST_ESP_BUTTONS_H__ */
@@ -0,0 +1,16 @@
+#ifndef __HOST_ESP_ERR_H__
+#define __HOST_ESP_ERR_H__
+
+/* Host stand-ins for the ESP-IDF calls the motion code makes */
+typedef int esp_err_t;
+
+#define ESP_OK			0
+#define ESP_FAIL		-1
+#define ESP_ERROR_CHECK(x)	(void)(x)
+
+static inline const char *esp_err_to_name(esp_err_t err)
+{
+	return err == ESP_OK ? "ESP_OK" : "ESP_FAIL";
+}
+
+#endif /* __HOST_ESP_ERR_H__ */
@@ -0,0 +1,11 @@
+#ifndef __HOST_ESP_HEAP_CAPS_H__
+#define __HOST_ESP_HEAP_CAPS_H__
+
+#include <stdint.h>
+
+#define MALLOC_CAP_DEFAULT	(1 << 12)
+
+/* A fixed figure, the host has no heap to watch */
+uint32_t heap_caps_get_minimum_free_size(uint32_t caps);
+
+#endif /* __HOST_ESP_HEAP_CAPS_H__ */
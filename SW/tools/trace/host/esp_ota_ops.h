@@ -0,0 +1,17 @@
+#ifndef __HOST_ESP_OTA_OPS_H__
+#define __HOST_ESP_OTA_OPS_H__
+
+#include "esp_partition.h"
+
+typedef struct {
+	char version[32];
+} esp_app_desc_t;
+
+/* The version from host_ota_version() */
+const esp_app_desc_t *esp_app_get_description();
+const esp_partition_t *esp_ota_get_next_update_partition(
+	const esp_partition_t *start_from);
+/* Counted, see host_ota_boots() */
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *part);
+
+#endif /* __HOST_ESP_OTA_OPS_H__ */
@@ -0,0 +1,23 @@
+#ifndef __HOST_ESP_PARTITION_H__
+#define __HOST_ESP_PARTITION_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/* Only the update partition, in memory, see host_ota_data() */
+typedef struct {
+	uint32_t address;
+	uint32_t size;
+	const char *label;
+} esp_partition_t;
+
+/* Flash rules: erase whole sectors to 0xff, a write only clears bits */
+esp_err_t esp_partition_erase_range(const esp_partition_t *part,
+				    size_t offset, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset,
+			      const void *src, size_t size);
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset,
+			     void *dst, size_t size);
+
+#endif /* __HOST_ESP_PARTITION_H__ */
@@ -0,0 +1,9 @@
+#ifndef __HOST_ESP_RANDOM_H__
+#define __HOST_ESP_RANDOM_H__
+
+#include <stdint.h>
+
+/* The same sequence on every run, see host_srand() */
+uint32_t esp_random();
+
+#endif /* __HOST_ESP_RANDOM_H__ */
@@ -0,0 +1,19 @@
+#ifndef __HOST_ESP_ROM_CRC_H__
+#define __HOST_ESP_ROM_CRC_H__
+
+#include <stdint.h>
+
+/* The ROM one: CRC-32 (IEEE, reflected), inverted in and out */
+static inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf,
+					uint32_t len)
+{
+	crc = ~crc;
+	while (len--) {
+		crc ^= *buf++;
+		for (int i = 0; i < 8; i++)
+			crc = crc >> 1 ^ (0xedb88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+#endif /* __HOST_ESP_ROM_CRC_H__ */
@@ -0,0 +1,9 @@
+#ifndef __HOST_ESP_ROM_SYS_H__
+#define __HOST_ESP_ROM_SYS_H__
+
+#include <stdint.h>
+
+/* The ESP32 at 240 MHz, for what converts cycles to time */
+uint32_t esp_rom_get_cpu_ticks_per_us();
+
+#endif /* __HOST_ESP_ROM_SYS_H__ */
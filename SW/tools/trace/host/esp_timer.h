@@ -0,0 +1,10 @@
+#ifndef __HOST_ESP_TIMER_H__
+#define __HOST_ESP_TIMER_H__
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/* The replay clock, see host.h */
+int64_t esp_timer_get_time();
+
+#endif /* __HOST_ESP_TIMER_H__ */
@@ -0,0 +1,60 @@
+#ifndef __HOST_FREE_RTOS_H__
+#define __HOST_FREE_RTOS_H__
+
+#include <stdint.h>
+
+/*
+ * Single threaded: the motion task calls run in the replay loop, the
+ * interrupts are called from it, blocking waits drive it, see host.h.
+ * The task notification count is atomic, a test may run one task, e.g.
+ * the lcd one, on a thread of its own.
+ */
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define portMAX_DELAY		0xffffffff
+#define pdTRUE			1
+#define pdFALSE			0
+#define pdMS_TO_TICKS(x)	(x)
+
+enum { eNoAction, eSetBits };
+
+typedef struct { uint32_t owner; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED	{ 0 }
+#define portENTER_CRITICAL(m)		(void)(m)
+#define portEXIT_CRITICAL(m)		(void)(m)
+#define portENTER_CRITICAL_ISR(m)	(void)(m)
+#define portEXIT_CRITICAL_ISR(m)	(void)(m)
+#define portYIELD_FROM_ISR(x)		(void)(x)
+
+/* host_set_core(), 0 unless set */
+BaseType_t xPortGetCoreID();
+
+/* Not run, see host_last_task() */
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name,
+				   uint32_t stack, void *arg,
+				   UBaseType_t prio, TaskHandle_t *task,
+				   BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+void delay_ms(int ms);
+/* Only ever the calling task, which then returns */
+void vTaskDelete(TaskHandle_t task);
+void taskYIELD();
+
+/* 1 ms ticks of the host clock; both waits go through host_set_delay() */
+TickType_t xTaskGetTickCount();
+void vTaskDelayUntil(TickType_t *wake, TickType_t ticks);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t bits, int action,
+			      BaseType_t *woken);
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+void vSemaphoreDelete(SemaphoreHandle_t sem);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken);
+
+#endif /* __HOST_FREE_RTOS_H__ */
@@ -0,0 +1,270 @@
+#include "host.h"
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include "driver/gpio.h"
+#include "driver/pulse_cnt.h"
+
+/*
+ * GPIO inputs and the PCNT units counting them, for the encoder the host
+ * tests generate. Interrupts run right where the level changes.
+ */
+struct host_pin {
+	gpio_int_type_t intr;
+	gpio_isr_t isr;
+	void *arg;
+};
+
+struct pcnt_chan_t {
+	pcnt_unit_t *unit;
+	int edge_pin;
+	int level_pin;
+	pcnt_channel_edge_action_t pos, neg;
+	pcnt_channel_level_action_t high, low;
+};
+
+struct pcnt_unit_t {
+	int low_limit;
+	int high_limit;
+	int count;
+	bool running;
+	std::vector<int> watch;
+	std::vector<pcnt_chan_t *> chans;
+	pcnt_watch_cb_t on_reach;
+	void *ctx;
+};
+
+static uint64_t levels;
+static host_pin pins[GPIO_NUM_MAX];
+static std::vector<pcnt_unit_t *> units;
+static uint64_t isr_ns;
+
+/* Runs @fn as an interrupt, timed */
+template <typename F> static void interrupt(F fn)
+{
+	auto t0 = std::chrono::steady_clock::now();
+
+	fn();
+	isr_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - t0).count();
+}
+
+static int level(int pin)
+{
+	return levels >> pin & 1;
+}
+
+/* What one edge on its pin does to the count: -1, 0 or 1 */
+static int count_edge(const pcnt_chan_t *c, bool rising)
+{
+	pcnt_channel_edge_action_t a = rising ? c->pos : c->neg;
+	pcnt_channel_level_action_t l = level(c->level_pin) ? c->high :
+		c->low;
+	int d = a == PCNT_CHANNEL_EDGE_ACTION_INCREASE ? 1 :
+		a == PCNT_CHANNEL_EDGE_ACTION_DECREASE ? -1 : 0;
+
+	if (l == PCNT_CHANNEL_LEVEL_ACTION_HOLD)
+		return 0;
+	return l == PCNT_CHANNEL_LEVEL_ACTION_INVERSE ? -d : d;
+}
+
+/* The counter goes back to 0 at either limit, like the hardware */
+static void count(pcnt_unit_t *u, int d)
+{
+	if (!d)
+		return;
+
+	int at = u->count += d;
+	if (at == u->high_limit || at == u->low_limit)
+		u->count = 0;
+
+	if (u->on_reach && std::find(u->watch.begin(), u->watch.end(), at) !=
+	    u->watch.end()) {
+		pcnt_watch_event_data_t data = { at };
+
+		interrupt([&] { u->on_reach(u, &data, u->ctx); });
+	}
+}
+
+void host_gpio_set(int pin, int level, bool irq)
+{
+	uint64_t bit = 1ull << pin;
+	bool rising = level;
+
+	if (!!(levels & bit) == !!level)
+		return;
+	levels = level ? levels | bit : levels & ~bit;
+
+	for (pcnt_unit_t *u : units)
+		for (pcnt_chan_t *c : u->chans)
+			if (u->running && c->edge_pin == pin)
+				count(u, count_edge(c, rising));
+
+	const host_pin& p = pins[pin];
+	if (!irq || !p.isr)
+		return;
+	if (p.intr == GPIO_INTR_ANYEDGE ||
+	    (p.intr == GPIO_INTR_POSEDGE && rising) ||
+	    (p.intr == GPIO_INTR_NEGEDGE && !rising))
+		interrupt([&] { p.isr(p.arg); });
+}
+
+uint64_t host_isr_ns()
+{
+	return isr_ns;
+}
+
+uint32_t host_gpio_read(int reg)
+{
+	return levels >> (32 * reg);
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t pin)
+{
+	pins[pin] = { };
+	return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode)
+{
+	return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+	host_gpio_set(pin, level, false);
+	return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type)
+{
+	pins[pin].intr = type;
+	return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+	return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t isr, void *arg)
+{
+	pins[pin].isr = isr;
+	pins[pin].arg = arg;
+	return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin)
+{
+	pins[pin].isr = nullptr;
+	return ESP_OK;
+}
+
+esp_err_t pcnt_new_unit(const pcnt_unit_config_t *config,
+			pcnt_unit_handle_t *ret)
+{
+	*ret = new pcnt_unit_t { };
+	(*ret)->low_limit = config->low_limit;
+	(*ret)->high_limit = config->high_limit;
+	units.push_back(*ret);
+	return ESP_OK;
+}
+
+esp_err_t pcnt_del_unit(pcnt_unit_handle_t unit)
+{
+	std::erase(units, unit);
+	delete unit;
+	return ESP_OK;
+}
+
+esp_err_t pcnt_unit_set_glitch_filter(pcnt_unit_handle_t unit,
+	const pcnt_glitch_filter_config_t *config)
+{
+	return ESP_OK;
+}
+
+esp_err_t pcnt_new_channel(pcnt_unit_handle_t unit,
+			   const pcnt_chan_config_t *config,
+			   pcnt_channel_handle_t *ret)
+{
+	*ret = new pcnt_chan_t { };
+	(*ret)->unit = unit;
+	(*ret)->edge_pin = config->edge_gpio_num;
+	(*ret)->level_pin = config->level_gpio_num;
+	unit->chans.push_back(*ret);
+	return ESP_OK;
+}
+
+esp_err_t pcnt_del_channel(pcnt_channel_handle_t chan)
+{
+	std::erase(chan->unit->chans, chan);
+	delete chan;
+	return ESP_OK;
+}
+
+esp_err_t pcnt_channel_set_edge_action(pcnt_channel_handle_t chan,
+				       pcnt_channel_edge_action_t pos,
+				       pcnt_channel_edge_action_t neg)
+{
+	chan->pos = pos;
+	chan->neg = neg;
+	return ESP_OK;
+}
+
+esp_err_t pcnt_channel_set_level_action(pcnt_channel_handle_t chan,
+					pcnt_channel_level_action_t high,
+					pcnt_channel_level_action_t low)
+{
+	chan->high = high;
+	chan->low = low;
+	return ESP_OK;
+}
+
+esp_err_t pcnt_unit_add_watch_point(pcnt_unit_handle_t unit, int value)
+{
+	unit->watch.push_back(value);
+	return ESP_OK;
+}
+
+esp_err_t pcnt_unit_register_event_callbacks(pcnt_unit_handle_t unit,
+	const pcnt_event_callbacks_t *cbs, void *user_ctx)
+{
+	unit->on_reach = cbs->on_reach;
+	unit->ctx = user_ctx;
+	return ESP_OK;
+}
+
+esp_err_t pcnt_unit_enable(pcnt_unit_handle_t unit)
+{
+	return ESP_OK;
+}
+
+esp_err_t pcnt_unit_disable(pcnt_unit_handle_t unit)
+{
+	return ESP_OK;
+}
+
+esp_err_t pcnt_unit_start(pcnt_unit_handle_t unit)
+{
+	unit->running = true;
+	return ESP_OK;
+}
+
+esp_err_t pcnt_unit_stop(pcnt_unit_handle_t unit)
+{
+	unit->running = false;
+	return ESP_OK;
+}
+
+esp_err_t pcnt_unit_clear_count(pcnt_unit_handle_t unit)
+{
+	unit->count = 0;
+	return ESP_OK;
+}
+
+esp_err_t pcnt_unit_get_count(pcnt_unit_handle_t unit, int *value)
+{
+	*value = unit->count;
+	return ESP_OK;
+}
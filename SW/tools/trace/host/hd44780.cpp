@@ -0,0 +1,55 @@
+#include "host.h"
+#include "lcd.h"
+#include <HD44780.h>
+#include <string.h>
+
+#define HD44780_CMD_CLEAR	0x01
+
+/* DDRAM as lcd.cpp sees it: LCD_ROWS x LCD_COLS, the cursor moves on */
+static char glass[LCD_ROWS][LCD_COLS];
+static uint8_t cur_row, cur_col;
+static uint32_t chars;
+
+int hd44780_pcf8574_con_init(struct hd44780_lcd *lcd)
+{
+	return 0;
+}
+
+int hd44780_init(struct hd44780_lcd *lcd)
+{
+	hd44780_send_cmd(HD44780_CMD_CLEAR);
+	return 0;
+}
+
+void hd44780_send_cmd(uint8_t cmd)
+{
+	if (cmd == HD44780_CMD_CLEAR) {
+		memset(glass, ' ', sizeof(glass));
+		cur_row = cur_col = 0;
+	}
+}
+
+void hd44780_set_pos(uint8_t row, uint8_t col)
+{
+	cur_row = row;
+	cur_col = col;
+}
+
+/* Past the end of a row goes nowhere that is shown */
+void hd44780_print(const char *text)
+{
+	for (; *text; text++, cur_col++, chars++)
+		if (cur_row < LCD_ROWS && cur_col < LCD_COLS)
+			glass[cur_row][cur_col] = *text;
+}
+
+void host_lcd_row(int row, char *text)
+{
+	memcpy(text, glass[row], LCD_COLS);
+	text[LCD_COLS] = 0;
+}
+
+uint32_t host_lcd_chars()
+{
+	return chars;
+}
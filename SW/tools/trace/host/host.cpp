@@ -0,0 +1,406 @@
+#include "host.h"
+#include "hardware.h"
+#include "motion_stats.h"
+#include "trace.h"
+#include "log.h"
+#include <free_rtos_h.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "driver/gptimer.h"
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+#include "esp_system.h"
+
+bool host_verbose;
+
+static int64_t now;
+static void (*idle_fn)(void *arg);
+static void *idle_arg;
+static void (*delay_fn)(void *arg, int ms);
+static void *delay_arg;
+static void (*task_fn)(void *arg);
+static void *task_arg;
+/* the one count lcd.cpp's task takes on a thread of its own */
+static std::atomic<uint32_t> task_given;
+static thread_local int core;
+static esp_reset_reason_t reset_reason = ESP_RST_POWERON;
+
+/* The counter is the time since the last reload, in resolution ticks */
+struct gptimer_t {
+	gptimer_alarm_cb_t cb;
+	void *ctx;
+	uint32_t resolution_hz;
+	uint64_t alarm;
+	int64_t reload_ns;
+	bool running;
+};
+
+static std::vector<gptimer_t *> timers;
+static gptimer_t *last_started;
+static uint32_t notified;
+static int64_t notified_us;
+static uint32_t rand_state = 1;
+
+struct host_sem {
+	bool given;
+};
+
+/* The firmware globals the motion code links against */
+#if MOTION_STATS
+motion_stats_t motion_stats;
+#endif
+
+#if MOTION_TRACE
+trace_ring_t trace_ring;
+std::atomic<bool> trace_on { true };
+std::atomic<uint32_t> trace_dropped { 0 };
+
+void trace_cmd(uint8_t axis, enum trace_cmd cmd, uint32_t val)
+{
+	trace(TRACE_CMD, axis, cmd, val);
+}
+#endif
+
+void spindle_stop(bool stop) { }
+
+void host_set_time(int64_t t_us)
+{
+	now = t_us;
+}
+
+void host_set_idle(void (*idle)(void *arg), void *arg)
+{
+	idle_fn = idle;
+	idle_arg = arg;
+}
+
+static int64_t due_ns(const gptimer_t *t)
+{
+	return t->reload_ns + (int64_t)(t->alarm * 1000000000 /
+					t->resolution_hz);
+}
+
+/* Auto reload at the alarm, a new alarm from the callback counts from it */
+static void fire(gptimer_t *t, int64_t at_ns)
+{
+	gptimer_alarm_event_data_t data = { t->alarm, t->alarm };
+
+	t->reload_ns = at_ns;
+	t->cb(t, &data, t->ctx);
+}
+
+/* On time: the clock moves to the alarm, never back */
+static void fire_due(gptimer_t *t)
+{
+	int64_t at = due_ns(t);
+
+	if (at / 1000 > now)
+		now = at / 1000;
+	fire(t, at);
+}
+
+bool host_fire_timer(const void *obj, size_t size)
+{
+	const char *lo = static_cast<const char *>(obj);
+
+	for (gptimer_t *t : timers) {
+		const char *ctx = static_cast<const char *>(t->ctx);
+
+		if (t->running && ctx >= lo && ctx < lo + size) {
+			fire(t, now * 1000);
+			return true;
+		}
+	}
+	return false;
+}
+
+void host_run(int64_t t_us)
+{
+	for (;;) {
+		gptimer_t *next = nullptr;
+
+		for (gptimer_t *t : timers)
+			if (t->running && due_ns(t) <= t_us * 1000 &&
+			    (!next || due_ns(t) < due_ns(next)))
+				next = t;
+		if (!next)
+			break;
+		fire_due(next);
+	}
+	if (t_us > now)
+		now = t_us;
+}
+
+uint32_t host_take_notify(int64_t *at_us)
+{
+	uint32_t bits = notified;
+
+	if (at_us)
+		*at_us = notified_us;
+	notified = 0;
+	return bits;
+}
+
+void host_srand(uint32_t seed)
+{
+	rand_state = seed ? seed : 1;
+}
+
+/* xorshift32 */
+uint32_t esp_random()
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+int64_t esp_timer_get_time()
+{
+	return now;
+}
+
+uint32_t esp_cpu_get_cycle_count()
+{
+	return 0;
+}
+
+uint32_t esp_rom_get_cpu_ticks_per_us()
+{
+	return 240;
+}
+
+esp_err_t gptimer_new_timer(const gptimer_config_t *config,
+			    gptimer_handle_t *ret)
+{
+	*ret = new gptimer_t { };
+	(*ret)->resolution_hz = config->resolution_hz;
+	(*ret)->reload_ns = now * 1000;
+	timers.push_back(*ret);
+	return ESP_OK;
+}
+
+esp_err_t gptimer_del_timer(gptimer_handle_t timer)
+{
+	std::erase(timers, timer);
+	if (last_started == timer)
+		last_started = nullptr;
+	delete timer;
+	return ESP_OK;
+}
+
+esp_err_t gptimer_register_event_callbacks(gptimer_handle_t timer,
+	const gptimer_event_callbacks_t *cbs, void *user_ctx)
+{
+	timer->cb = cbs->on_alarm;
+	timer->ctx = user_ctx;
+	return ESP_OK;
+}
+
+esp_err_t gptimer_enable(gptimer_handle_t timer)
+{
+	return ESP_OK;
+}
+
+esp_err_t gptimer_disable(gptimer_handle_t timer)
+{
+	return ESP_OK;
+}
+
+esp_err_t gptimer_start(gptimer_handle_t timer)
+{
+	timer->running = true;
+	last_started = timer;
+	return ESP_OK;
+}
+
+esp_err_t gptimer_stop(gptimer_handle_t timer)
+{
+	timer->running = false;
+	return ESP_OK;
+}
+
+esp_err_t gptimer_set_alarm_action(gptimer_handle_t timer,
+				   const gptimer_alarm_config_t *config)
+{
+	timer->alarm = config->alarm_count;
+	return ESP_OK;
+}
+
+esp_err_t gptimer_set_raw_count(gptimer_handle_t timer, uint64_t value)
+{
+	timer->reload_ns = now * 1000 - (int64_t)(value * 1000000000 /
+						  timer->resolution_hz);
+	return ESP_OK;
+}
+
+/* Only the backlash take-up waits here, the replay runs it; 1 ms ticks */
+void vTaskDelay(TickType_t ticks)
+{
+	if (idle_fn)
+		idle_fn(idle_arg);
+	else
+		host_run(now + ticks * 1000);
+}
+
+void host_set_delay(void (*delay)(void *arg, int ms), void *arg)
+{
+	delay_fn = delay;
+	delay_arg = arg;
+}
+
+void delay_ms(int ms)
+{
+	if (delay_fn)
+		delay_fn(delay_arg, ms);
+}
+
+TickType_t xTaskGetTickCount()
+{
+	return now / 1000;
+}
+
+/* The clock moves on to the wake time, then the test has its say */
+void vTaskDelayUntil(TickType_t *wake, TickType_t ticks)
+{
+	*wake += ticks;
+	if (now < (int64_t)*wake * 1000)
+		now = (int64_t)*wake * 1000;
+	if (delay_fn)
+		delay_fn(delay_arg, ticks);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+	if (!task_given && delay_fn)
+		delay_fn(delay_arg, -1);
+
+	if (clear)
+		return task_given.exchange(0);
+
+	uint32_t given = task_given;
+
+	while (given && !task_given.compare_exchange_weak(given, given - 1))
+		;
+	return given;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+	task_given++;
+	return pdTRUE;
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*fn)(void *), const char *name,
+				   uint32_t stack, void *arg,
+				   UBaseType_t prio, TaskHandle_t *task,
+				   BaseType_t core)
+{
+	task_fn = fn;
+	task_arg = arg;
+	if (task)
+		*task = nullptr;
+	return pdTRUE;
+}
+
+void host_last_task(void (**fn)(void *), void **arg)
+{
+	*fn = task_fn;
+	*arg = task_arg;
+}
+
+void host_set_core(int c)
+{
+	core = c;
+}
+
+BaseType_t xPortGetCoreID()
+{
+	return core;
+}
+
+void host_set_reset_reason(int why)
+{
+	reset_reason = (esp_reset_reason_t)why;
+}
+
+esp_reset_reason_t esp_reset_reason()
+{
+	return reset_reason;
+}
+
+void esp_restart()
+{
+	throw host_restart();
+}
+
+/* Typical of the firmware after boot, WiFi up */
+uint32_t esp_get_free_heap_size()
+{
+	return 180000;
+}
+
+uint32_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+	return 170000;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+}
+
+void taskYIELD()
+{
+	std::this_thread::yield();
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t bits, int action,
+			      BaseType_t *woken)
+{
+	if (!notified)
+		notified_us = now;
+	notified |= bits;
+	return pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+	return new host_sem { };
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+	delete static_cast<host_sem *>(sem);
+}
+
+/*
+ * A rapid move: its timer was started last, run it to the end on time.
+ * Nothing else steps that axis meanwhile, and the traced ones go on after
+ * it.
+ */
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+	host_sem *s = static_cast<host_sem *>(sem);
+
+	while (!s->given && ticks) {
+		if (!last_started || !last_started->running) {
+			fprintf(stderr, "motion task waits, no timer runs\n");
+			exit(2);
+		}
+		fire_due(last_started);
+	}
+
+	bool taken = s->given;
+	s->given = false;
+	return taken;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken)
+{
+	static_cast<host_sem *>(sem)->given = true;
+	return pdTRUE;
+}
@@ -0,0 +1,102 @@
+#ifndef __HOST_H__
+#define __HOST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * What the host drives the firmware code with: the clock esp_timer reads,
+ * the GP timer interrupts, the GPIO inputs and the waits of the motion
+ * task. The trace replay sets the clock and fires the timers itself, the
+ * host tests let the clock run them.
+ */
+void host_set_time(int64_t t_us);
+
+/*
+ * Fire the running timer whose callback context lies in @obj, @size bytes,
+ * e.g. the backlash timer of one stepper_ctrl. False if there is none.
+ */
+bool host_fire_timer(const void *obj, size_t size);
+
+/*
+ * Move the clock on to @t_us, firing every running timer that comes due
+ * on the way at its own time, in order.
+ */
+void host_run(int64_t t_us);
+
+/*
+ * Called while the motion task waits in vTaskDelay(), e.g. for a backlash
+ * take-up to finish; it must move the replay on or the wait never ends.
+ * Without one the clock runs on by the ticks, see host_run().
+ */
+void host_set_idle(void (*idle)(void *arg), void *arg);
+
+/*
+ * Notification bits sent to any task since the last call, and at @at_us
+ * the time the first of them was sent
+ */
+uint32_t host_take_notify(int64_t *at_us = nullptr);
+
+/*
+ * Input level of @pin. A change counts on the PCNT channels that watch
+ * it and, unless !@irq, runs its GPIO interrupt handler; !@irq stands for
+ * an interrupt that came too late to see the level.
+ */
+void host_gpio_set(int pin, int level, bool irq = true);
+uint32_t host_gpio_read(int reg);
+
+/* Time spent in the GPIO and PCNT interrupt handlers so far, ns */
+uint64_t host_isr_ns();
+
+/*
+ * Called from delay_ms() and vTaskDelayUntil(), e.g. in the loop of a
+ * task under test, which it can leave by throwing; -1 ms from
+ * ulTaskNotifyTake() with nothing given, it may give. Without one the
+ * waits return at once.
+ */
+void host_set_delay(void (*delay)(void *arg, int ms), void *arg);
+
+/* Entry and argument of the last task created; nothing runs it */
+void host_last_task(void (**fn)(void *), void **arg);
+
+/* The core xPortGetCoreID() says the calling thread runs on */
+void host_set_core(int core);
+
+/* What esp_reset_reason() returns, an esp_reset_reason_t */
+void host_set_reset_reason(int why);
+
+/*
+ * The NVS partitions: wipe them all; make the next init of one fail
+ * with @err (until erased); flip a byte of the blob @key; count the
+ * blob writes so far.
+ */
+void host_nvs_wipe();
+void host_nvs_init_error(int err);
+bool host_nvs_corrupt(const char *key);
+uint32_t host_nvs_writes();
+
+/*
+ * The update partition: the version the running app reports; what was
+ * written into it, the sectors erased and the times it was made the boot
+ * partition so far; all of it back to 0xff.
+ */
+void host_ota_version(const char *version);
+const uint8_t *host_ota_data();
+uint32_t host_ota_erases();
+uint32_t host_ota_boots();
+void host_ota_wipe();
+
+/*
+ * The HD44780 behind lcd.cpp: @row as it is on the glass, LCD_COLS chars
+ * and a nul into @text; the chars written to it so far.
+ */
+void host_lcd_row(int row, char *text);
+uint32_t host_lcd_chars();
+
+/* What esp_restart() throws, it does not return */
+struct host_restart { };
+
+/* Restart esp_random() */
+void host_srand(uint32_t seed);
+
+#endif /* __HOST_H__ */
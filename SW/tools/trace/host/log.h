@@ -0,0 +1,21 @@
+#ifndef __HOST_LOG_H__
+#define __HOST_LOG_H__
+
+#include <stdio.h>
+
+/* Firmware log lines, on stderr with -v */
+extern bool host_verbose;
+
+#define HOST_LOG(...)	do { \
+		if (host_verbose) { \
+			fprintf(stderr, __VA_ARGS__); \
+			fputc('\n', stderr); \
+		} \
+	} while (0)
+
+#define INFO(...)	HOST_LOG(__VA_ARGS__)
+#define DEBUG(...)	HOST_LOG(__VA_ARGS__)
+#define WARNING(...)	HOST_LOG(__VA_ARGS__)
+#define ERROR(...)	HOST_LOG(__VA_ARGS__)
+
+#endif /* __HOST_LOG_H__ */
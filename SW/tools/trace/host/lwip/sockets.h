@@ -0,0 +1,11 @@
+#ifndef __HOST_LWIP_SOCKETS_H__
+#define __HOST_LWIP_SOCKETS_H__
+
+/* lwIP takes the BSD names, the host's own sockets stand in */
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#endif /* __HOST_LWIP_SOCKETS_H__ */
@@ -0,0 +1,91 @@
+#include "host.h"
+#include "nvs_flash.h"
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * One store for all partitions and namespaces, the firmware only keeps
+ * one blob per key. Commits are immediate.
+ */
+static std::map<std::string, std::vector<uint8_t>> blobs;
+static esp_err_t init_error = ESP_OK;
+static uint32_t writes;
+
+void host_nvs_wipe()
+{
+	blobs.clear();
+}
+
+void host_nvs_init_error(int err)
+{
+	init_error = err;
+}
+
+bool host_nvs_corrupt(const char *key)
+{
+	auto it = blobs.find(key);
+
+	if (it == blobs.end() || it->second.empty())
+		return false;
+	it->second[0] ^= 0xff;
+	return true;
+}
+
+uint32_t host_nvs_writes()
+{
+	return writes;
+}
+
+esp_err_t nvs_flash_init_partition(const char *part)
+{
+	return init_error;
+}
+
+esp_err_t nvs_flash_erase_partition(const char *part)
+{
+	blobs.clear();
+	init_error = ESP_OK;
+	return ESP_OK;
+}
+
+esp_err_t nvs_open_from_partition(const char *part, const char *ns,
+				  nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+	*handle = 1;
+	return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value,
+		       size_t *len)
+{
+	auto it = blobs.find(key);
+
+	if (it == blobs.end())
+		return ESP_ERR_NVS_NOT_FOUND;
+	if (it->second.size() > *len)
+		return ESP_ERR_NVS_INVALID_LENGTH;
+
+	std::copy(it->second.begin(), it->second.end(), (uint8_t *)value);
+	*len = it->second.size();
+	return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key,
+		       const void *value, size_t len)
+{
+	const uint8_t *p = static_cast<const uint8_t *>(value);
+
+	blobs[key].assign(p, p + len);
+	writes++;
+	return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+	return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
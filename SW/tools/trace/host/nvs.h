@@ -0,0 +1,27 @@
+#ifndef __HOST_NVS_H__
+#define __HOST_NVS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/* Blobs in memory, lost on exit; see host.h for the test hooks */
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+
+#define ESP_ERR_NVS_BASE		0x1100
+#define ESP_ERR_NVS_NOT_FOUND		(ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_INVALID_LENGTH	(ESP_ERR_NVS_BASE + 0x0c)
+#define ESP_ERR_NVS_NO_FREE_PAGES	(ESP_ERR_NVS_BASE + 0x0d)
+#define ESP_ERR_NVS_NEW_VERSION_FOUND	(ESP_ERR_NVS_BASE + 0x10)
+
+esp_err_t nvs_open_from_partition(const char *part, const char *ns,
+				  nvs_open_mode_t mode, nvs_handle_t *handle);
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value,
+		       size_t *len);
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key,
+		       const void *value, size_t len);
+esp_err_t nvs_commit(nvs_handle_t handle);
+void nvs_close(nvs_handle_t handle);
+
+#endif /* __HOST_NVS_H__ */
@@ -0,0 +1,9 @@
+#ifndef __HOST_NVS_FLASH_H__
+#define __HOST_NVS_FLASH_H__
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init_partition(const char *part);
+esp_err_t nvs_flash_erase_partition(const char *part);
+
+#endif /* __HOST_NVS_FLASH_H__ */
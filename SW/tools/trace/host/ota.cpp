@@ -0,0 +1,101 @@
+#include "host.h"
+#include "esp_ota_ops.h"
+#include <string.h>
+#include <vector>
+
+#define HOST_OTA_ADDRESS	0x160000
+#define HOST_OTA_SIZE		0x14e000
+#define HOST_OTA_SECTOR		4096
+
+static const esp_partition_t ota_1 = { HOST_OTA_ADDRESS, HOST_OTA_SIZE,
+				       "ota_1" };
+static std::vector<uint8_t> flash(HOST_OTA_SIZE, 0xff);
+static esp_app_desc_t app;
+static uint32_t erases;
+static uint32_t boots;
+
+void host_ota_version(const char *version)
+{
+	strncpy(app.version, version, sizeof(app.version) - 1);
+}
+
+const uint8_t *host_ota_data()
+{
+	return flash.data();
+}
+
+uint32_t host_ota_erases()
+{
+	return erases;
+}
+
+uint32_t host_ota_boots()
+{
+	return boots;
+}
+
+void host_ota_wipe()
+{
+	flash.assign(HOST_OTA_SIZE, 0xff);
+}
+
+static bool in_part(const esp_partition_t *part, size_t offset, size_t size)
+{
+	return part == &ota_1 && offset <= HOST_OTA_SIZE &&
+		size <= HOST_OTA_SIZE - offset;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part,
+				    size_t offset, size_t size)
+{
+	if (!in_part(part, offset, size) || offset % HOST_OTA_SECTOR ||
+	    size % HOST_OTA_SECTOR)
+		return ESP_FAIL;
+
+	memset(&flash[offset], 0xff, size);
+	erases += size / HOST_OTA_SECTOR;
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset,
+			      const void *src, size_t size)
+{
+	const uint8_t *p = static_cast<const uint8_t *>(src);
+
+	if (!in_part(part, offset, size))
+		return ESP_FAIL;
+
+	while (size--)
+		flash[offset++] &= *p++;
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset,
+			     void *dst, size_t size)
+{
+	if (!in_part(part, offset, size))
+		return ESP_FAIL;
+
+	memcpy(dst, &flash[offset], size);
+	return ESP_OK;
+}
+
+const esp_app_desc_t *esp_app_get_description()
+{
+	return &app;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(
+	const esp_partition_t *start_from)
+{
+	return &ota_1;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *part)
+{
+	if (part != &ota_1)
+		return ESP_FAIL;
+
+	boots++;
+	return ESP_OK;
+}
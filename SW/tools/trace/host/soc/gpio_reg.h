@@ -0,0 +1,8 @@
+#ifndef __HOST_GPIO_REG_H__
+#define __HOST_GPIO_REG_H__
+
+/* Pins 0-31 and 32-39, for host_gpio_read() */
+#define GPIO_IN_REG		0
+#define GPIO_IN1_REG		1
+
+#endif /* __HOST_GPIO_REG_H__ */
@@ -0,0 +1,9 @@
+#ifndef __HOST_SOC_H__
+#define __HOST_SOC_H__
+
+#include "host.h"
+
+/* Only the GPIO input registers, see soc/gpio_reg.h */
+#define REG_READ(reg)		host_gpio_read(reg)
+
+#endif /* __HOST_SOC_H__ */
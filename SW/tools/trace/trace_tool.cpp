@@ -0,0 +1,500 @@
+/*
+ * Motion trace decoder and replay, see trace.h in the firmware.
+ *
+ * Capture: a firmware built with MOTION_TRACE 1 (hardware.h), MOTION TRACE
+ * on in the diagnostics menu, TRACE_TX_PIN on a USB serial adapter, then
+ *
+ *	stty -F /dev/ttyUSB1 2000000 raw && cat /dev/ttyUSB1 > cut.trace
+ *
+ * and start the cut. Then
+ *
+ *	trace_tool decode cut.trace	one line per record
+ *	trace_tool replay cut.trace	feed the recorded inputs through the
+ *					firmware gearbox and stepper_ctrl, check
+ *					they make the recorded steps
+ *
+ * The replay starts at the first motion start in the capture and stops at
+ * the first record lost on the way (ring overflow or bad frame).
+ */
+#include "gearbox.h"
+#include "spindle.h"
+#include "stepper_ctrl.h"
+#include "trace.h"
+#include "host.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+/* A record and whether records were lost right before it */
+struct capture_rec {
+	trace_rec rec;
+	bool gap;
+};
+
+static const char *type_names[TRACE_TYPES] = {
+	"EDGES", "INDEX", "STEP", "TAKE_UP", "TICK", "LIMIT", "CMD",
+};
+
+static const char *cmd_names[] = {
+	"NUM", "DEN", "RATE", "AXIS", "BIND", "SLACK", "ENABLE", "LIMIT",
+	"RESET", "ARM", "RESUME", "RAPID", "CLEAR_FAULT",
+};
+
+/* Frames out of the byte stream; resyncs on anything that does not check */
+static bool decode(const char *path, std::vector<capture_rec>& out)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return false;
+	}
+
+	std::vector<uint8_t> buf;
+	uint8_t chunk[4096];
+	size_t len;
+
+	while ((len = fread(chunk, 1, sizeof(chunk), f)))
+		buf.insert(buf.end(), chunk, chunk + len);
+	fclose(f);
+
+	const size_t hdr_len = sizeof(trace_frame_hdr);
+	uint32_t frames = 0, bad = 0, lost = 0;
+	uint32_t dropped = 0;
+	int seq = -1;
+	bool gap = false;
+	size_t i = 0;
+
+	while (i + 2 + hdr_len + 2 <= buf.size()) {
+		if (buf[i] != TRACE_SYNC0 || buf[i + 1] != TRACE_SYNC1) {
+			i++;
+			continue;
+		}
+
+		trace_frame_hdr hdr;
+		memcpy(&hdr, &buf[i + 2], hdr_len);
+
+		size_t body = hdr_len + hdr.n * sizeof(trace_rec);
+		if (hdr.version != TRACE_VERSION || !hdr.n ||
+		    hdr.n > TRACE_FRAME_RECS || i + 2 + body + 2 > buf.size()) {
+			i++;
+			continue;
+		}
+
+		uint16_t crc = buf[i + 2 + body] | buf[i + 3 + body] << 8;
+		if (trace_crc16(0xffff, &buf[i + 2], body) != crc) {
+			bad++;
+			gap = true;
+			i++;
+			continue;
+		}
+
+		/* a frame went missing, or the ring overflowed meanwhile */
+		if (seq >= 0 && hdr.seq != (uint8_t)(seq + 1)) {
+			lost++;
+			gap = true;
+		}
+		if (hdr.dropped != dropped) {
+			if (hdr.dropped > dropped)
+				gap = true;
+			dropped = hdr.dropped;
+		}
+		seq = hdr.seq;
+
+		for (uint32_t n = 0; n < hdr.n; n++) {
+			capture_rec r;
+
+			memcpy(&r.rec, &buf[i + 2 + hdr_len + n * sizeof(trace_rec)],
+			       sizeof(trace_rec));
+			r.gap = gap;
+			gap = false;
+			out.push_back(r);
+		}
+		frames++;
+		i += 2 + body + 2;
+	}
+
+	fprintf(stderr, "%s: %u frames, %zu records, %u bad, %u missing, "
+		"%u dropped on the device\n", path, frames, out.size(), bad,
+		lost, dropped);
+	return true;
+}
+
+static void print_rec(size_t i, const trace_rec& r)
+{
+	printf("%8zu ", i);
+	if (r.type >= TRACE_TYPES) {
+		printf("? type %u\n", r.type);
+		return;
+	}
+	printf("%-8s %u ", type_names[r.type], r.axis);
+
+	switch (r.type) {
+	case TRACE_EDGES:
+		printf("%+d at %u us\n", r.arg, r.val);
+		break;
+	case TRACE_INDEX:
+		printf("count %d\n", (int32_t)r.val);
+		break;
+	case TRACE_STEP:
+	case TRACE_TAKE_UP:
+		printf("%+d pos %d\n", r.arg, (int32_t)r.val);
+		break;
+	case TRACE_LIMIT:
+		printf("pos %d\n", (int32_t)r.val);
+		break;
+	case TRACE_CMD:
+		if ((size_t)r.arg < sizeof(cmd_names) / sizeof(cmd_names[0]))
+			printf("%s %d\n", cmd_names[r.arg], (int32_t)r.val);
+		else
+			printf("? cmd %d\n", r.arg);
+		break;
+	default:
+		printf("\n");
+		break;
+	}
+}
+
+/* Step output of the replayed axes, the rate is what the device had */
+class host_out : public step_output
+{
+public:
+	host_out(uint32_t rate) : rate(rate) { }
+
+	void pulse() { }
+	void set_dir(bool level) { }
+	void set_enable(bool on) { }
+	uint32_t max_rate() {
+		return rate;
+	}
+
+private:
+	uint32_t rate;
+};
+
+/*
+ * The motion code as the device ran it: the recorded inputs go in, the
+ * records it makes are held against the recorded ones. Records from the
+ * device that the replay makes itself are outputs, the rest inputs.
+ */
+class replay
+{
+public:
+	replay(const std::vector<capture_rec>& cap) : cap(cap) { }
+	~replay() {
+		end_session();
+	}
+
+	int run();
+
+private:
+	const std::vector<capture_rec>& cap;
+	size_t in = 0;		/* next record to feed */
+	size_t cmp = 0;		/* next record to compare */
+	int64_t now = 0;
+	bool started = false;
+	bool waiting = false;	/* in a motion task wait */
+
+	spindle_replay *spindle = nullptr;
+	gearbox *box = nullptr;
+	host_out *outs[gearbox::MAX_AXES] = { };
+	stepper_ctrl *ctrl[gearbox::MAX_AXES] = { };
+	uint32_t num[gearbox::MAX_AXES], den[gearbox::MAX_AXES];
+	uint32_t rate[gearbox::MAX_AXES];
+
+	uint32_t steps = 0, limits = 0, fed = 0;
+	bool failed = false;
+
+	static bool is_input(const trace_rec& r) {
+		return r.type == TRACE_EDGES || r.type == TRACE_INDEX ||
+			r.type == TRACE_TICK || r.type == TRACE_CMD;
+	}
+
+	/* 32 bit device time stamps onto the 64 bit clock */
+	void set_time(uint32_t t) {
+		int64_t next = (now & ~(int64_t)0xffffffff) | t;
+
+		if (next < now - 0x80000000LL)
+			next += 0x100000000LL;
+		now = next;
+		host_set_time(now);
+	}
+
+	void end_session();
+	void start_session();
+	bool feed();
+	bool command(const trace_rec& r, size_t at);
+	bool check();
+	void fail(const char *what, size_t i) {
+		fprintf(stderr, "record %zu: %s\n", i, what);
+		failed = true;
+	}
+
+	static void on_idle(void *arg);
+};
+
+void replay::end_session()
+{
+	delete box;
+	box = nullptr;
+	for (uint32_t i = 0; i < gearbox::MAX_AXES; i++) {
+		delete ctrl[i];
+		delete outs[i];
+		ctrl[i] = nullptr;
+		outs[i] = nullptr;
+	}
+	delete spindle;
+	spindle = nullptr;
+}
+
+void replay::start_session()
+{
+	end_session();
+	spindle = new spindle_replay();
+	box = new gearbox(*spindle);
+}
+
+/*
+ * What the records made here mean: the limit flag is cleared by the UI
+ * core, so whether a limit is recorded again does not follow from the
+ * inputs. Those are counted, not compared.
+ */
+bool replay::check()
+{
+	trace_rec r;
+
+	while (trace_ring.pop(r)) {
+		if (r.type == TRACE_LIMIT) {
+			limits++;
+			continue;
+		}
+		while (cmp < cap.size() && cap[cmp].rec.type == TRACE_LIMIT)
+			cmp++;
+		if (cmp == cap.size()) {
+			fail("replay made more records than the capture has",
+			     cmp);
+			return false;
+		}
+
+		const trace_rec& want = cap[cmp].rec;
+		if (memcmp(&r, &want, sizeof(r))) {
+			fail("replay differs", cmp);
+			printf("device:\n");
+			print_rec(cmp, want);
+			printf("replay:\n");
+			print_rec(cmp, r);
+			return false;
+		}
+		if (r.type == TRACE_STEP)
+			steps++;
+		cmp++;
+	}
+	return true;
+}
+
+bool replay::command(const trace_rec& r, size_t at)
+{
+	uint32_t a = r.axis;
+	int32_t val = r.val;
+
+	if (a >= gearbox::MAX_AXES) {
+		fail("no such axis", at);
+		return false;
+	}
+
+	switch (r.arg) {
+	case TRACE_CMD_NUM:
+		/* the first axis starts a new motion session */
+		if (!a) {
+			start_session();
+			started = true;
+			cmp = at;
+		}
+		num[a] = r.val;
+		return true;
+	case TRACE_CMD_DEN:
+		den[a] = r.val;
+		return true;
+	case TRACE_CMD_RATE:
+		rate[a] = r.val;
+		return true;
+	default:
+		break;
+	}
+
+	/* a capture started mid-session, wait for the next one */
+	if (!started)
+		return true;
+	if (r.arg != TRACE_CMD_AXIS && !ctrl[a]) {
+		fail("command for an axis not set up", at);
+		return false;
+	}
+
+	switch (r.arg) {
+	case TRACE_CMD_AXIS:
+		outs[a] = new host_out(rate[a]);
+		ctrl[a] = new stepper_ctrl(*outs[a], (r.val & 0xff) == 'X' ?
+			axis_x_config : axis_z_config, num[a], den[a],
+			r.val >> 8 & 1);
+		box->add(ctrl[a]);
+		break;
+	case TRACE_CMD_BIND:
+		set_time(r.val);
+		box->start();
+		break;
+	case TRACE_CMD_SLACK:
+		ctrl[a]->set_slack(val);
+		break;
+	case TRACE_CMD_ENABLE:
+		if (val)
+			ctrl[a]->enable();
+		else
+			ctrl[a]->disable();
+		break;
+	case TRACE_CMD_LIMIT:
+		ctrl[a]->set_limit(val);
+		break;
+	case TRACE_CMD_RESET:
+		ctrl[a]->reset();
+		break;
+	case TRACE_CMD_ARM:
+		ctrl[a]->arm(val);
+		break;
+	case TRACE_CMD_RESUME:
+		ctrl[a]->resume();
+		break;
+	case TRACE_CMD_RAPID:
+		ctrl[a]->rapid_to(val);
+		break;
+	case TRACE_CMD_CLEAR_FAULT:
+		ctrl[a]->clear_fault();
+		break;
+	default:
+		fail("unknown command", at);
+		return false;
+	}
+	return true;
+}
+
+/* One input record through the motion code, false at the end */
+bool replay::feed()
+{
+	while (in < cap.size() && !failed) {
+		const capture_rec& c = cap[in];
+		const trace_rec& r = c.rec;
+
+		if (c.gap && started) {
+			fprintf(stderr, "record %zu: records lost on the way, "
+				"replay ends here\n", in);
+			return false;
+		}
+		if (!is_input(r)) {
+			in++;
+			continue;
+		}
+
+		bool ok = true;
+		if (r.type == TRACE_CMD) {
+			/* the motion task is busy in the call that waits */
+			if (waiting) {
+				fail("motion task call while one waits", in);
+				return false;
+			}
+			/* a wait in the call feeds on from the next one */
+			ok = command(r, in++);
+		} else if (started) {
+			in++;
+			fed++;
+			if (r.type == TRACE_EDGES) {
+				set_time(r.val);
+				spindle->edges(r.arg);
+			} else if (r.type == TRACE_INDEX) {
+				spindle->index(r.val);
+			} else if (r.axis >= gearbox::MAX_AXES || !ctrl[r.axis] ||
+				   !host_fire_timer(ctrl[r.axis],
+						    sizeof(stepper_ctrl))) {
+				fail("backlash timer not running", in - 1);
+				ok = false;
+			}
+		} else {
+			in++;
+		}
+		return ok && check();
+	}
+	return false;
+}
+
+/* The motion task waits for the backlash timer, the inputs go on */
+void replay::on_idle(void *arg)
+{
+	replay *r = static_cast<replay *>(arg);
+
+	r->waiting = true;
+	bool more = r->feed();
+	r->waiting = false;
+	if (!more) {
+		fprintf(stderr, "capture ends while the motion task waits\n");
+		exit(r->failed ? 1 : 0);
+	}
+}
+
+int replay::run()
+{
+	host_set_idle(replay::on_idle, this);
+
+	while (feed())
+		;
+	if (!failed)
+		check();
+
+	if (!started) {
+		fprintf(stderr, "no motion start in the capture\n");
+		return 1;
+	}
+	printf("%u inputs, %u steps %s, %u limits, up to record %zu\n",
+	       fed, steps, failed ? "matched before the difference" :
+	       "match", limits, cmp);
+	return failed ? 1 : 0;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: trace_tool [-v] decode|replay CAPTURE\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		if (opt == 'v')
+			host_verbose = true;
+		else
+			usage();
+	}
+	if (argc - optind != 2)
+		usage();
+
+	const char *mode = argv[optind];
+	std::vector<capture_rec> cap;
+
+	if (!decode(argv[optind + 1], cap))
+		return 1;
+
+	if (!strcmp(mode, "decode")) {
+		for (size_t i = 0; i < cap.size(); i++) {
+			if (cap[i].gap)
+				printf("-------- records lost\n");
+			print_rec(i, cap[i].rec);
+		}
+		return 0;
+	}
+	if (!strcmp(mode, "replay")) {
+		replay r(cap);
+		return r.run();
+	}
+	usage();
+}